@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../source/base.hpp"
+
+// Shared by the benchmark suites, main and the helpers live in math_bench.cpp
+
+constexpr uint32_t RUNS = 5;    // Best of, timings are noisy on shared machines
+
+struct check_stats
+{
+    uint32_t failures;
+};
+
+// Deterministic xorshift, every run sees the same inputs
+float RandomFloat(float low, float high);
+
+void Check(check_stats &stats, const char *name, bool passed, double error = 0.0);
+
+// TransformStore::computeWorldMatrices against composing mat4x4 per object
+namespace transformBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
+
+// Frustum culling of sphere and box batches, throughput and how many draws survive
+namespace cullBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
+
+// meshOptimize on a grid, a shuffled grid and the viewer's sphere, triangles kept and ACMR/ATVR
+namespace meshBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
+
+// vertexQuantize packing, error bounds of each attribute and throughput
+namespace quantizeBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
+
+// pixelConvert to half, from half and to B10G11R11 on every path, bits against the references
+namespace pixelBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
+
+// freeList merges, first fit and packing after compact, then random churn against a bitmap
+namespace freeListBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
+
+// stagingRing alignment, skipping the end and full size reserves, then in order churn
+namespace stagingRingBench
+{
+    void RunChecks(check_stats &stats);
+    void RunTimings(bool quick);
+}
@@ -0,0 +1,177 @@
+// Frustum culling of a scattered field of objects around a camera. Every path has to return
+// the scalar path's indices, no object with a point inside the clip volume may be culled,
+// then spheres and boxes are timed for 100k objects along with how many draws remain.
+
+#include "bench.hpp"
+#include "../source/backend/culling.hpp"
+#include "../source/mv_utils/cpu_features.hpp"
+#include <stdio.h>
+#include <string.h>
+
+constexpr uint32_t OBJECT_COUNT = 100000;
+constexpr float FIELD_SIZE = 200.0f;         // Objects spread over a cube this wide around the camera
+
+// One array per component, the layout the batch functions take
+struct BoundsArrays
+{
+    float*      data;
+    SphereBatch spheres;
+    BoxBatch    boxes;
+};
+
+static BoundsArrays MakeBounds(uint32_t count)
+{
+    BoundsArrays arrays;
+    arrays.data = new float[size_t(count) * 7];
+    float *x = arrays.data, *y = x + count, *z = y + count, *radius = z + count;
+    float *extentX = radius + count, *extentY = extentX + count, *extentZ = extentY + count;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        x[i] = RandomFloat(-0.5f * FIELD_SIZE, 0.5f * FIELD_SIZE);
+        y[i] = RandomFloat(-0.5f * FIELD_SIZE, 0.5f * FIELD_SIZE);
+        z[i] = RandomFloat(-0.5f * FIELD_SIZE, 0.5f * FIELD_SIZE);
+        extentX[i] = RandomFloat(0.1f, 2.0f);
+        extentY[i] = RandomFloat(0.1f, 2.0f);
+        extentZ[i] = RandomFloat(0.1f, 2.0f);
+        radius[i] = length(vec3(extentX[i], extentY[i], extentZ[i]));
+    }
+
+    arrays.spheres = {x, y, z, radius, count};
+    arrays.boxes = {x, y, z, extentX, extentY, extentZ, count};
+    return arrays;
+}
+
+// The viewer's camera setup, 60 degrees and 0.1 to 100
+static mat4x4 ViewProjection(vec3<float> eye, vec3<float> target)
+{
+    const auto view = mat4x4::lookAt(eye, target, vec3(0.0f, 1.0f, 0.0f));
+    return view * mat4x4::perspective(GetRadians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+}
+
+// Any corner strictly inside the clip volume means part of the box is on screen
+static bool CornerInside(const BoxBatch &boxes, uint32_t i, mat4x4 viewProjection)
+{
+    for (uint32_t corner = 0; corner < 8; corner++)
+    {
+        const auto p = vec4(boxes.centreX[i] + ((corner & 1) ? boxes.extentX[i] : -boxes.extentX[i]),
+                            boxes.centreY[i] + ((corner & 2) ? boxes.extentY[i] : -boxes.extentY[i]),
+                            boxes.centreZ[i] + ((corner & 4) ? boxes.extentZ[i] : -boxes.extentZ[i]), 1.0f);
+        const auto clip = p * viewProjection;
+        const float w = clip.w * 0.999f;
+        if(std::fabs(clip.x) < w && std::fabs(clip.y) < w && std::fabs(clip.z) < w)
+            return true;
+    }
+    return false;
+}
+
+void cullBench::RunChecks(check_stats &stats)
+{
+    printf("culling checks\n");
+    constexpr uint32_t COUNT = 20003;
+
+    auto bounds = MakeBounds(COUNT);
+    const auto viewProjection = ViewProjection(vec3(3.0f, 2.0f, -5.0f), vec3(-10.0f, 0.0f, 40.0f));
+    const auto frustum = culling::ExtractFrustum(viewProjection);
+
+    auto reference = new uint32_t[COUNT];
+    auto visible = new uint32_t[COUNT];
+
+    // Boxes, scalar against the clip volume and the single box test
+    const uint32_t boxCount = culling::CullBoxes(frustum, bounds.boxes, reference, simd_path::scalar);
+    bool noFalseCulls = true, singleMatches = true;
+    for (uint32_t i = 0, next = 0; i < COUNT; i++)
+    {
+        const bool kept = next < boxCount && reference[next] == i;
+        next += kept ? 1 : 0;
+        noFalseCulls &= kept || !CornerInside(bounds.boxes, i, viewProjection);
+
+        const auto centre = vec3(bounds.boxes.centreX[i], bounds.boxes.centreY[i], bounds.boxes.centreZ[i]);
+        const auto extent = vec3(bounds.boxes.extentX[i], bounds.boxes.extentY[i], bounds.boxes.extentZ[i]);
+        singleMatches &= culling::BoxVisible(frustum, {centre - extent, centre + extent}) == kept;
+    }
+    Check(stats, "boxes with a corner on screen are kept", noFalseCulls && boxCount > 0 && boxCount < COUNT);
+    Check(stats, "batch matches single box tests", singleMatches);
+
+    const simd_path paths[] = {simd_path::sse, simd_path::avx};
+    const char *const boxNames[] = {"sse boxes match scalar", "avx boxes match scalar"};
+    const char *const sphereNames[] = {"sse spheres match scalar", "avx spheres match scalar"};
+    for (uint32_t p = 0; p < arraysize(paths); p++)
+    {
+        if(paths[p] == simd_path::avx && !cpu::Features().avx)
+            continue;
+
+        const uint32_t count = culling::CullBoxes(frustum, bounds.boxes, visible, paths[p]);
+        Check(stats, boxNames[p], count == boxCount && memcmp(visible, reference, sizeof(uint32_t) * count) == 0);
+    }
+
+    // Spheres enclose the boxes, they may keep more but never less
+    const uint32_t sphereCount = culling::CullSpheres(frustum, bounds.spheres, reference, simd_path::scalar);
+    Check(stats, "spheres keep every box kept", sphereCount >= boxCount);
+    for (uint32_t p = 0; p < arraysize(paths); p++)
+    {
+        if(paths[p] == simd_path::avx && !cpu::Features().avx)
+            continue;
+
+        const uint32_t count = culling::CullSpheres(frustum, bounds.spheres, visible, paths[p]);
+        Check(stats, sphereNames[p], count == sphereCount && memcmp(visible, reference, sizeof(uint32_t) * count) == 0);
+    }
+
+    // A unit box moved and turned keeps its corners inside the transformed box
+    const auto m = mat4x4::rotateY(0.7f) * mat4x4::rotateX(-0.4f) * mat4x4::translate(vec3(5.0f, -2.0f, 1.0f));
+    const auto box = culling::TransformBox({vec3(-1.0f), vec3(1.0f)}, m);
+    bool enclosed = true;
+    for (uint32_t corner = 0; corner < 8; corner++)
+    {
+        const auto p = transformPoint(vec3((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f,
+                                           (corner & 4) ? 1.0f : -1.0f), m);
+        enclosed &= p.x >= box.min.x - 1e-5f && p.x <= box.max.x + 1e-5f && p.y >= box.min.y - 1e-5f &&
+                    p.y <= box.max.y + 1e-5f && p.z >= box.min.z - 1e-5f && p.z <= box.max.z + 1e-5f;
+    }
+    Check(stats, "transformed box encloses the corners", enclosed);
+
+    delete[] reference;
+    delete[] visible;
+    delete[] bounds.data;
+}
+
+void cullBench::RunTimings(bool quick)
+{
+    auto bounds = MakeBounds(OBJECT_COUNT);
+    const auto frustum = culling::ExtractFrustum(ViewProjection(vec3(0.0f), vec3(0.0f, 0.0f, 1.0f)));
+    auto visible = new uint32_t[OBJECT_COUNT];
+
+    const simd_path paths[] = {simd_path::scalar, simd_path::sse, simd_path::avx};
+    const char *const names[] = {"scalar", "SSE", "AVX"};
+    const uint32_t rounds = quick ? 4 : 32;
+
+    printf("\n%u objects culled, ms     spheres    boxes  Mobjects/s\n", OBJECT_COUNT);
+    uint32_t sphereCount = 0, boxCount = 0;
+    for (uint32_t p = 0; p < arraysize(paths); p++)
+    {
+        if(paths[p] == simd_path::avx && !cpu::Features().avx)
+            continue;
+
+        double sphereTime = 1e30, boxTime = 1e30;
+        for (uint32_t run = 0; run < (quick ? 1 : RUNS); run++)
+        {
+            double begin = pltf::GetTime();
+            for (uint32_t round = 0; round < rounds; round++)
+                sphereCount = culling::CullSpheres(frustum, bounds.spheres, visible, paths[p]);
+            sphereTime = min(sphereTime, (pltf::GetTime() - begin) / rounds);
+
+            begin = pltf::GetTime();
+            for (uint32_t round = 0; round < rounds; round++)
+                boxCount = culling::CullBoxes(frustum, bounds.boxes, visible, paths[p]);
+            boxTime = min(boxTime, (pltf::GetTime() - begin) / rounds);
+        }
+        printf("  %-24s %9.3f %8.3f %11.0f\n", names[p], sphereTime * 1000.0, boxTime * 1000.0,
+               OBJECT_COUNT / boxTime / 1e6);
+    }
+
+    printf("  draws left: %u of %u with spheres (%.1f%%), %u with boxes (%.1f%%)\n", sphereCount, OBJECT_COUNT,
+           sphereCount * 100.0 / OBJECT_COUNT, boxCount, boxCount * 100.0 / OBJECT_COUNT);
+
+    delete[] visible;
+    delete[] bounds.data;
+}
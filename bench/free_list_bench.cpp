@@ -0,0 +1,204 @@
+// The free lists MeshRegistry sub-allocates its buffers with. Releases have to merge with the
+// free range before, after or both, takes have to be first fit, and a registry compacted down
+// to its live meshes has to read as packed. A random sequence of takes and releases is then
+// replayed against a bitmap of the same capacity, the list has to stay sorted, fully merged
+// and agree with it after every step. Timed as meshes churning through a registry.
+
+#include "bench.hpp"
+#include "../source/backend/free_list.hpp"
+#include <stdio.h>
+#include <string.h>
+
+constexpr uint32_t BITMAP_CAPACITY = 4096;
+constexpr uint32_t LIVE_MAX = 256;
+
+struct LiveRange
+{
+    uint32_t    offset;
+    uint32_t    count;
+};
+
+static bool Holds(const FreeList &list, const FreeRange *expected, uint32_t count)
+{
+    return list.count == count && memcmp(list.ranges, expected, sizeof(FreeRange) * count) == 0;
+}
+
+// Sorted, no two ranges touching and exactly the free elements of the bitmap
+static bool Matches(const FreeList &list, const bool *used, uint32_t capacity)
+{
+    uint32_t i = 0, range = 0;
+    while (i < capacity)
+    {
+        if(used[i])
+        {
+            i++;
+            continue;
+        }
+
+        uint32_t end = i;
+        while (end < capacity && !used[end])
+            end++;
+        if(range >= list.count || list.ranges[range].offset != i || list.ranges[range].count != end - i)
+            return false;
+        range++;
+        i = end;
+    }
+    return range == list.count;
+}
+
+// Start of the lowest run of count free elements, capacity when there is none
+static uint32_t FirstFit(const bool *used, uint32_t capacity, uint32_t count)
+{
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        run = used[i] ? 0 : run + 1;
+        if(run == count)
+            return i + 1 - count;
+    }
+    return capacity;
+}
+
+static uint32_t RandomCount(uint32_t largest)
+{
+    return min(1 + uint32_t(RandomFloat(0.0f, float(largest))), largest);
+}
+
+void freeListBench::RunChecks(check_stats &stats)
+{
+    printf("free list checks\n");
+
+    // Five ranges of 10 taken from 100, each release below touches a different neighbour
+    FreeList list;
+    freeList::Create(list, 0, 100);
+    uint32_t offsets[5];
+    bool taken = true;
+    for (uint32_t i = 0; i < 5; i++)
+        taken &= freeList::Take(list, 10, offsets[i]) && offsets[i] == i * 10;
+    Check(stats, "takes are contiguous from 0", taken);
+
+    freeList::Release(list, 10, 10);
+    freeList::Release(list, 30, 10);
+    const FreeRange holes[] = {{10, 10}, {30, 10}, {50, 50}};
+    Check(stats, "separate releases stay separate", Holds(list, holes, 3));
+
+    freeList::Release(list, 0, 10);
+    const FreeRange mergedNext[] = {{0, 20}, {30, 10}, {50, 50}};
+    Check(stats, "release merges with the next range", Holds(list, mergedNext, 3));
+
+    freeList::Release(list, 40, 10);
+    const FreeRange mergedBoth[] = {{0, 20}, {30, 70}};
+    Check(stats, "release merges with both sides", Holds(list, mergedBoth, 2));
+
+    uint32_t offset = 0;
+    const bool fits = freeList::Take(list, 15, offset);
+    const FreeRange afterFit[] = {{15, 5}, {30, 70}};
+    Check(stats, "take is first fit", fits && offset == 0 && Holds(list, afterFit, 2));
+
+    const bool skips = freeList::Take(list, 6, offset);
+    Check(stats, "take skips ranges too small", skips && offset == 30);
+    Check(stats, "take fails when nothing fits", !freeList::Take(list, 65, offset));
+
+    freeList::Release(list, 20, 10);
+    const FreeRange mergedPrevious[] = {{15, 15}, {36, 64}};
+    Check(stats, "release merges with the previous range", Holds(list, mergedPrevious, 2));
+
+    // What compact leaves, the 21 live elements moved to the front
+    Check(stats, "list with holes is not packed", !freeList::Packed(list, 100));
+    freeList::Reset(list, 21, 100);
+    const FreeRange compacted[] = {{21, 79}};
+    Check(stats, "packed after compact", freeList::Packed(list, 100) && Holds(list, compacted, 1));
+    freeList::Reset(list, 100, 100);
+    Check(stats, "full list is packed", freeList::Packed(list, 100) && list.count == 0);
+    freeList::Destroy(list);
+
+    // Random churn against a bitmap, more ranges than the list starts with room for
+    auto used = new bool[BITMAP_CAPACITY]();
+    LiveRange live[LIVE_MAX];
+    uint32_t liveCount = 0;
+    freeList::Create(list, 0, BITMAP_CAPACITY);
+
+    bool consistent = true, firstFit = true;
+    for (uint32_t step = 0; step < 20000 && consistent && firstFit; step++)
+    {
+        if(liveCount < LIVE_MAX && (liveCount == 0 || RandomFloat(0.0f, 1.0f) < 0.55f))
+        {
+            const uint32_t count = RandomCount(64);
+            const uint32_t expected = FirstFit(used, BITMAP_CAPACITY, count);
+            const bool found = freeList::Take(list, count, offset);
+            firstFit = found == (expected < BITMAP_CAPACITY) && (!found || offset == expected);
+            if(found)
+            {
+                memset(used + offset, 1, count);
+                live[liveCount++] = {offset, count};
+            }
+        }
+        else
+        {
+            const uint32_t index = min(uint32_t(RandomFloat(0.0f, float(liveCount))), liveCount - 1);
+            const auto range = live[index];
+            live[index] = live[--liveCount];
+            freeList::Release(list, range.offset, range.count);
+            memset(used + range.offset, 0, range.count);
+        }
+        consistent = Matches(list, used, BITMAP_CAPACITY);
+    }
+    Check(stats, "random takes are first fit", firstFit);
+    Check(stats, "random churn matches a bitmap", consistent);
+
+    while (liveCount > 0)
+    {
+        const auto range = live[--liveCount];
+        freeList::Release(list, range.offset, range.count);
+    }
+    const FreeRange empty[] = {{0, BITMAP_CAPACITY}};
+    Check(stats, "releasing everything leaves one range", Holds(list, empty, 1));
+
+    freeList::Destroy(list);
+    delete[] used;
+}
+
+void freeListBench::RunTimings(bool quick)
+{
+    const uint32_t steps = quick ? 100000 : 1000000;
+    constexpr uint32_t CAPACITY = 1u << 24;     // Vertices of a large registry
+
+    LiveRange live[LIVE_MAX];
+    uint32_t liveCount = 0, failed = 0, peakRanges = 0;
+
+    double best = 1e9;
+    for (uint32_t run = 0; run < RUNS; run++)
+    {
+        FreeList list;
+        freeList::Create(list, 0, CAPACITY);
+        liveCount = 0;
+        failed = 0;
+        peakRanges = 0;
+
+        const double begin = pltf::GetTime();
+        for (uint32_t step = 0; step < steps; step++)
+        {
+            if(liveCount < LIVE_MAX && (liveCount == 0 || (step * 2654435761u) >> 31))
+            {
+                const uint32_t count = 1 + (step * 40503u) % 65536;
+                uint32_t offset;
+                if(freeList::Take(list, count, offset))
+                    live[liveCount++] = {offset, count};
+                else
+                    failed++;
+            }
+            else
+            {
+                const uint32_t index = (step * 2246822519u) % liveCount;
+                freeList::Release(list, live[index].offset, live[index].count);
+                live[index] = live[--liveCount];
+            }
+            peakRanges = max(peakRanges, list.count);
+        }
+        best = min(best, pltf::GetTime() - begin);
+        freeList::Destroy(list);
+    }
+
+    printf("\n%u takes and releases, up to %u live ranges: %.2f ms, %.0f ns each, %u free ranges at most, "
+           "%u takes did not fit\n", steps, LIVE_MAX, best * 1000.0, best * 1e9 / steps, peakRanges, failed);
+}
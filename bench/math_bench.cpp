@@ -0,0 +1,384 @@
+// Benchmarks for the math kernels the viewer runs per object and per vertex, for building the
+// world matrices of many objects at once (transform_bench.cpp) and for culling them against
+// the view frustum (cull_bench.cpp). Every kernel is first checked against a reference, the
+// SIMD versions also against the scalar ones they have to match bit for bit, then timed per
+// call and per batch.
+//
+//     bench [-quick]
+//
+// Returns 1 when a check fails. -quick runs the checks and a single short timing pass.
+
+#include "bench.hpp"
+#include "../source/mv_utils/cpu_features.hpp"
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+constexpr uint32_t CALL_MATRICES = 4096;        // Working set of the per call loops, fits in L1/L2
+constexpr uint32_t BATCH_POINTS = 1u << 20;
+
+struct dmat4
+{
+    double m[4][4];
+};
+
+static uint64_t randomState = 0x9E3779B97F4A7C15ull;
+
+float RandomFloat(float low, float high)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return low + (high - low) * float(randomState >> 40) / float(1u << 24);
+}
+
+// Random entries around a scaled identity keep the matrices well conditioned for the inverse
+static mat4x4 RandomMatrix()
+{
+    mat4x4 result;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t j = 0; j < 4; j++)
+            result(i, j) = RandomFloat(-1.0f, 1.0f) + (i == j ? 3.0f : 0.0f);
+    }
+    return result;
+}
+
+static mat4x4 RandomTransform()
+{
+    const auto axis = vec3(RandomFloat(-4.0f, 4.0f), RandomFloat(-4.0f, 4.0f), RandomFloat(-4.0f, 4.0f));
+    return mat4x4::scale(vec3(RandomFloat(0.5f, 2.0f))) * mat4x4::rotateY(RandomFloat(0.0f, 2.0f * PI32)) *
+           mat4x4::rotateX(RandomFloat(0.0f, 2.0f * PI32)) * mat4x4::translate(axis);
+}
+
+static dmat4 ToDouble(const mat4x4 &m)
+{
+    dmat4 result;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t j = 0; j < 4; j++)
+            result.m[i][j] = m(i, j);
+    }
+    return result;
+}
+
+static dmat4 Multiply(const dmat4 &a, const dmat4 &b)
+{
+    dmat4 result = {};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            for (uint32_t k = 0; k < 4; k++)
+                result.m[i][j] += a.m[i][k] * b.m[k][j];
+        }
+    }
+    return result;
+}
+
+// Gauss-Jordan with partial pivoting
+static dmat4 Inverse(dmat4 a)
+{
+    dmat4 result = {};
+    for (uint32_t i = 0; i < 4; i++)
+        result.m[i][i] = 1.0;
+
+    for (uint32_t column = 0; column < 4; column++)
+    {
+        uint32_t pivot = column;
+        for (uint32_t row = column + 1; row < 4; row++)
+        {
+            if(std::fabs(a.m[row][column]) > std::fabs(a.m[pivot][column]))
+                pivot = row;
+        }
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            const double t = a.m[column][j]; a.m[column][j] = a.m[pivot][j]; a.m[pivot][j] = t;
+            const double u = result.m[column][j]; result.m[column][j] = result.m[pivot][j]; result.m[pivot][j] = u;
+        }
+
+        const double scale = 1.0 / a.m[column][column];
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            a.m[column][j] *= scale;
+            result.m[column][j] *= scale;
+        }
+        for (uint32_t row = 0; row < 4; row++)
+        {
+            if(row == column)
+                continue;
+            const double factor = a.m[row][column];
+            for (uint32_t j = 0; j < 4; j++)
+            {
+                a.m[row][j] -= factor * a.m[column][j];
+                result.m[row][j] -= factor * result.m[column][j];
+            }
+        }
+    }
+    return result;
+}
+
+// Largest difference relative to the largest element of the reference
+static double MatrixError(const mat4x4 &m, const dmat4 &reference)
+{
+    double error = 0.0, magnitude = 0.0;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            error = std::fmax(error, std::fabs(double(m(i, j)) - reference.m[i][j]));
+            magnitude = std::fmax(magnitude, std::fabs(reference.m[i][j]));
+        }
+    }
+    return error / std::fmax(magnitude, 1e-30);
+}
+
+static bool SameBits(const void *a, const void *b, size_t size)
+{
+    return memcmp(a, b, size) == 0;
+}
+
+void Check(check_stats &stats, const char *name, bool passed, double error)
+{
+    printf("  %-44s %s", name, passed ? "ok" : "FAILED");
+    if(error > 0.0)
+        printf("  (max relative error %.2e)", error);
+    printf("\n");
+    if(!passed)
+        stats.failures++;
+}
+
+static void RunChecks(check_stats &stats)
+{
+    printf("checks\n");
+    constexpr uint32_t MATRICES = 10000;
+
+    double multiplyError = 0.0, inverseError = 0.0, identityError = 0.0, transformError = 0.0;
+    bool multiplyBits = true, transposeExact = true, transformBits = true;
+    for (uint32_t n = 0; n < MATRICES; n++)
+    {
+        const auto a = RandomMatrix();
+        const auto b = n % 2 ? RandomMatrix() : RandomTransform();
+
+        const auto simd = mat4Simd::multiply(a, b);
+        const auto scalar = mat4Scalar::multiply(a, b);
+        multiplyBits = multiplyBits && SameBits(&simd, &scalar, sizeof(mat4x4));
+        multiplyError = std::fmax(multiplyError, MatrixError(simd, Multiply(ToDouble(a), ToDouble(b))));
+
+        const auto transposed = mat4Simd::transpose(a);
+        const auto transposedScalar = mat4Scalar::transpose(a);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            for (uint32_t j = 0; j < 4; j++)
+                transposeExact = transposeExact && transposed(i, j) == a(j, i) && transposedScalar(i, j) == a(j, i);
+        }
+
+        const dmat4 reference = Inverse(ToDouble(b));
+        const mat4x4 inverses[] = {mat4Simd::inverse(b), mat4Scalar::inverse(b)};
+        for (const auto &inverted : inverses)
+        {
+            inverseError = std::fmax(inverseError, MatrixError(inverted, reference));
+            dmat4 identity = {};
+            for (uint32_t i = 0; i < 4; i++)
+                identity.m[i][i] = 1.0;
+            identityError = std::fmax(identityError, MatrixError(inverted * b, identity));
+        }
+
+        const auto p = vec3(RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f));
+        const auto v = vec4(p, RandomFloat(-1.0f, 1.0f));
+        const auto point = mat4Simd::transformPoint(p, b);
+        const auto direction = mat4Simd::transformDirection(p, b);
+        const auto full = mat4Simd::transform(v, b);
+        const auto pointScalar = mat4Scalar::transformPoint(p, b);
+        const auto directionScalar = mat4Scalar::transformDirection(p, b);
+        const auto fullScalar = mat4Scalar::transform(v, b);
+        transformBits = transformBits && SameBits(&point, &pointScalar, sizeof(point)) &&
+                        SameBits(&direction, &directionScalar, sizeof(direction)) &&
+                        SameBits(&full, &fullScalar, sizeof(full));
+
+        const dmat4 bd = ToDouble(b);
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            const double x = p.x * bd.m[0][j] + double(p.y) * bd.m[1][j] + double(p.z) * bd.m[2][j];
+            const double scale = std::fabs(p.x * bd.m[0][j]) + std::fabs(p.y * bd.m[1][j]) +
+                                 std::fabs(p.z * bd.m[2][j]) + std::fabs(bd.m[3][j]) + 1e-30;
+            const float gotPoint = j == 0 ? point.x : j == 1 ? point.y : point.z;
+            const float gotDirection = j == 0 ? direction.x : j == 1 ? direction.y : direction.z;
+            transformError = std::fmax(transformError, std::fabs(gotPoint - (x + bd.m[3][j])) / scale);
+            transformError = std::fmax(transformError, std::fabs(gotDirection - x) / scale);
+        }
+    }
+
+    Check(stats, "multiply against double", multiplyError < 1e-6, multiplyError);
+    Check(stats, "multiply SSE matches scalar bits", multiplyBits);
+    Check(stats, "transpose exact", transposeExact);
+    Check(stats, "inverse against double", inverseError < 1e-5, inverseError);
+    Check(stats, "inverse times matrix is identity", identityError < 1e-5, identityError);
+    Check(stats, "point and direction against double", transformError < 1e-6, transformError);
+    Check(stats, "transforms SSE match scalar bits", transformBits);
+
+    // Regressions, the third row of products used a(3, 3) and vec3 * mat4x4 read the
+    // components it had already written and took the translation from the wrong elements
+    const auto a = RandomMatrix(), b = RandomMatrix();
+    const auto product = a * b;
+    const double thirdRow = double(a(2, 0)) * b(0, 1) + double(a(2, 1)) * b(1, 1) +
+                            double(a(2, 2)) * b(2, 1) + double(a(2, 3)) * b(3, 1);
+    Check(stats, "third row of the product", std::fabs(product(2, 1) - thirdRow) < 1e-5 * std::fabs(thirdRow) + 1e-6);
+
+    const auto moved = vec3(1.0f, 2.0f, 3.0f) * mat4x4::translate(vec3(10.0f, 20.0f, 30.0f));
+    const auto turned = vec3(1.0f, 2.0f, 3.0f) * mat4x4::scale(vec3(2.0f, 3.0f, 4.0f));
+    Check(stats, "vec3 * mat4x4 translates and scales", moved == vec3(11.0f, 22.0f, 33.0f) &&
+                                                       turned == vec3(2.0f, 6.0f, 12.0f));
+
+    // Batches against single calls, every tail length and in place
+    bool batchBits = true;
+    vec3<float> points[37], single[37], batch[37];
+    for (auto &p : points)
+        p = vec3(RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f));
+    const auto matrix = RandomTransform();
+    const simd_path paths[] = {simd_path::scalar, simd_path::sse, simd_path::avx};
+    for (const auto path : paths)
+    {
+        for (uint32_t count = 0; count <= 37; count++)
+        {
+            for (uint32_t i = 0; i < count; i++)
+                single[i] = transformPoint(points[i], matrix);
+            memcpy(batch, points, sizeof(points));
+            transformPoints(matrix, batch, count, batch, path);
+            batchBits = batchBits && SameBits(batch, single, count * sizeof(vec3<float>)) &&
+                        SameBits(batch + count, points + count, (37 - count) * sizeof(vec3<float>));
+
+            for (uint32_t i = 0; i < count; i++)
+                single[i] = transformDirection(points[i], matrix);
+            transformDirections(matrix, points, count, batch, path);
+            batchBits = batchBits && SameBits(batch, single, count * sizeof(vec3<float>));
+        }
+    }
+    Check(stats, "batches match single calls", batchBits);
+}
+
+// The kernel is inlined into the loop like it is at its call sites, inputs change every
+// iteration and every result is stored so none of the work can be hoisted or dropped
+template<typename Kernel>
+static double TimeCalls(Kernel kernel, const mat4x4 *a, const mat4x4 *b, mat4x4 *out, uint32_t rounds)
+{
+    double best = 1e30;
+    for (uint32_t run = 0; run < RUNS; run++)
+    {
+        const double begin = pltf::GetTime();
+        for (uint32_t round = 0; round < rounds; round++)
+        {
+            for (uint32_t i = 0; i < CALL_MATRICES; i++)
+                out[i] = kernel(a[i], b[i]);
+        }
+        best = min(best, pltf::GetTime() - begin);
+    }
+    return best * 1e9 / (double(rounds) * CALL_MATRICES);
+}
+
+static void PrintCalls(const char *name, double scalar, double simd)
+{
+    printf("  %-18s %9.2f %8.2f %8.2fx\n", name, scalar, simd, scalar / simd);
+}
+
+static void RunTimings(bool quick)
+{
+    const uint32_t rounds = quick ? 4 : 64;
+
+    auto a = new mat4x4[CALL_MATRICES];
+    auto b = new mat4x4[CALL_MATRICES];
+    auto out = new mat4x4[CALL_MATRICES];
+    for (uint32_t i = 0; i < CALL_MATRICES; i++)
+    {
+        a[i] = RandomMatrix();
+        b[i] = RandomTransform();
+    }
+
+    printf("\nper call, ns           scalar      SSE   speedup\n");
+    PrintCalls("multiply",
+               TimeCalls([](mat4x4 x, mat4x4 y) {return mat4Scalar::multiply(x, y);}, a, b, out, rounds),
+               TimeCalls([](mat4x4 x, mat4x4 y) {return mat4Simd::multiply(x, y);}, a, b, out, rounds));
+    PrintCalls("inverse",
+               TimeCalls([](mat4x4 x, mat4x4) {return mat4Scalar::inverse(x);}, a, b, out, rounds),
+               TimeCalls([](mat4x4 x, mat4x4) {return mat4Simd::inverse(x);}, a, b, out, rounds));
+    PrintCalls("transpose",
+               TimeCalls([](mat4x4 x, mat4x4) {return mat4Scalar::transpose(x);}, a, b, out, rounds),
+               TimeCalls([](mat4x4 x, mat4x4) {return mat4Simd::transpose(x);}, a, b, out, rounds));
+
+    delete[] a;
+    delete[] b;
+    delete[] out;
+
+    auto points = new vec3<float>[BATCH_POINTS];
+    auto transformed = new vec3<float>[BATCH_POINTS];
+    for (uint32_t i = 0; i < BATCH_POINTS; i++)
+        points[i] = vec3(RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f), RandomFloat(-10.0f, 10.0f));
+    const auto matrix = RandomTransform();
+
+    const struct
+    {
+        const char*     name;
+        simd_path       path;
+    } paths[] = {
+        {"scalar", simd_path::scalar},
+        {"SSE", simd_path::sse},
+        {"AVX", simd_path::avx},
+    };
+
+    printf("\n%u points, ms         points  directions  Mpoints/s\n", BATCH_POINTS);
+    for (const auto &path : paths)
+    {
+        if(path.path == simd_path::avx && !cpu::Features().avx)
+        {
+            printf("  %-18s not supported\n", path.name);
+            continue;
+        }
+
+        double pointTime = 1e30, directionTime = 1e30;
+        for (uint32_t run = 0; run < (quick ? 1 : RUNS); run++)
+        {
+            double begin = pltf::GetTime();
+            transformPoints(matrix, points, BATCH_POINTS, transformed, path.path);
+            pointTime = min(pointTime, pltf::GetTime() - begin);
+
+            begin = pltf::GetTime();
+            transformDirections(matrix, points, BATCH_POINTS, transformed, path.path);
+            directionTime = min(directionTime, pltf::GetTime() - begin);
+        }
+        printf("  %-18s %8.2f %11.2f %10.0f\n", path.name, pointTime * 1000.0, directionTime * 1000.0,
+               BATCH_POINTS / pointTime / 1e6);
+    }
+
+    delete[] points;
+    delete[] transformed;
+}
+
+int main(int argc, char **argv)
+{
+    const bool quick = argc > 1 && strcmp(argv[1], "-quick") == 0;
+
+    check_stats stats = {};
+    RunChecks(stats);
+    transformBench::RunChecks(stats);
+    cullBench::RunChecks(stats);
+    meshBench::RunChecks(stats);
+    quantizeBench::RunChecks(stats);
+    pixelBench::RunChecks(stats);
+    freeListBench::RunChecks(stats);
+    stagingRingBench::RunChecks(stats);
+    if(stats.failures > 0)
+    {
+        fprintf(stderr, "%u checks failed\n", stats.failures);
+        return 1;
+    }
+
+    RunTimings(quick);
+    transformBench::RunTimings(quick);
+    cullBench::RunTimings(quick);
+    meshBench::RunTimings(quick);
+    quantizeBench::RunTimings(quick);
+    pixelBench::RunTimings(quick);
+    freeListBench::RunTimings(quick);
+    stagingRingBench::RunTimings(quick);
+    return 0;
+}
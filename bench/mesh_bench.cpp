@@ -0,0 +1,291 @@
+// Index and vertex reordering of meshOptimize on the meshes the viewer draws: a regular grid in
+// row order, the same grid with its triangles shuffled like an arbitrary import, and the
+// stack and slice sphere of Model3D::loadSpherePrimitive. The passes have to keep every
+// triangle with its winding, then ACMR and ATVR are reported before and after with the time.
+
+#include "bench.hpp"
+#include "../source/backend/mesh_optimize.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The original index rides along so triangles can be compared after the vertices moved
+struct BenchVertex
+{
+    vec3<float> position;
+    uint32_t    id;
+};
+
+struct BenchMesh
+{
+    BenchVertex*    vertices;
+    uint32_t*       indices;
+    uint32_t        vertexCount;
+    uint32_t        indexCount;
+};
+
+static BenchMesh MakeGrid(uint32_t size)
+{
+    BenchMesh mesh;
+    mesh.vertexCount = (size + 1) * (size + 1);
+    mesh.indexCount = size * size * 6;
+    mesh.vertices = new BenchVertex[mesh.vertexCount];
+    mesh.indices = new uint32_t[mesh.indexCount];
+
+    for (uint32_t y = 0; y <= size; y++)
+    {
+        for (uint32_t x = 0; x <= size; x++)
+        {
+            const uint32_t v = y * (size + 1) + x;
+            mesh.vertices[v] = {vec3(float(x), 0.0f, float(y)), v};
+        }
+    }
+
+    auto index = mesh.indices;
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            const uint32_t v0 = y * (size + 1) + x, v1 = v0 + 1;
+            const uint32_t v2 = v0 + size + 1, v3 = v2 + 1;
+            *(index++) = v0; *(index++) = v2; *(index++) = v1;
+            *(index++) = v1; *(index++) = v2; *(index++) = v3;
+        }
+    }
+    return mesh;
+}
+
+// Model3D::loadSpherePrimitive's layout
+static BenchMesh MakeSphere(uint32_t stacks, uint32_t slices)
+{
+    BenchMesh mesh;
+    mesh.vertexCount = (stacks - 1) * slices + 2;
+    mesh.indexCount = 6 * slices * (stacks - 1);
+    mesh.vertices = new BenchVertex[mesh.vertexCount];
+    mesh.indices = new uint32_t[mesh.indexCount];
+
+    uint32_t v = 0;
+    mesh.vertices[v] = {vec3(0.0f, 1.0f, 0.0f), v};
+    v++;
+    for (uint32_t i = 0; i < stacks - 1; i++)
+    {
+        for (uint32_t j = 0; j < slices; j++)
+        {
+            const float theta = 2 * PI32 * float(j) / float(slices);
+            const float phi = PI32 * float(i + 1) / float(stacks);
+            mesh.vertices[v] = {vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)), v};
+            v++;
+        }
+    }
+    mesh.vertices[v] = {vec3(0.0f, -1.0f, 0.0f), v};
+
+    auto index = mesh.indices;
+    for (uint32_t i = 0; i < slices; i++)
+    {
+        uint32_t i0 = i + 1, i1 = i0 % slices + 1;
+        *(index++) = 0; *(index++) = i1; *(index++) = i0;
+
+        i0 += slices * (stacks - 2);
+        i1 += slices * (stacks - 2);
+        *(index++) = mesh.vertexCount - 1; *(index++) = i0; *(index++) = i1;
+    }
+    for (uint32_t i = 0; i < stacks - 2; i++)
+    {
+        const uint32_t i0 = i * slices + 1, i1 = (i + 1) * slices + 1;
+        for (uint32_t j = 0; j < slices; j++)
+        {
+            const uint32_t j0 = i0 + j, j1 = i0 + (j + 1) % slices;
+            const uint32_t j2 = i1 + (j + 1) % slices, j3 = i1 + j;
+            *(index++) = j0; *(index++) = j1; *(index++) = j2;
+            *(index++) = j0; *(index++) = j2; *(index++) = j3;
+        }
+    }
+    return mesh;
+}
+
+static BenchMesh Copy(const BenchMesh &source)
+{
+    BenchMesh mesh = source;
+    mesh.vertices = new BenchVertex[mesh.vertexCount];
+    mesh.indices = new uint32_t[mesh.indexCount];
+    memcpy(mesh.vertices, source.vertices, sizeof(BenchVertex) * mesh.vertexCount);
+    memcpy(mesh.indices, source.indices, sizeof(uint32_t) * mesh.indexCount);
+    return mesh;
+}
+
+static void Destroy(BenchMesh &mesh)
+{
+    delete[] mesh.vertices;
+    delete[] mesh.indices;
+    mesh = {};
+}
+
+static void ShuffleTriangles(BenchMesh &mesh)
+{
+    const uint32_t triangleCount = mesh.indexCount / 3;
+    for (uint32_t i = triangleCount - 1; i > 0; i--)
+    {
+        const uint32_t j = min(uint32_t(RandomFloat(0.0f, float(i + 1))), i);
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t swap = mesh.indices[3 * i + k];
+            mesh.indices[3 * i + k] = mesh.indices[3 * j + k];
+            mesh.indices[3 * j + k] = swap;
+        }
+    }
+}
+
+struct Triangle
+{
+    uint32_t    ids[3];
+};
+
+static int CompareTriangles(const void *a, const void *b)
+{
+    return memcmp(a, b, sizeof(Triangle));
+}
+
+// Original vertex ids, rotated to start at the smallest so the winding is kept, then sorted
+static Triangle *CanonicalTriangles(const BenchMesh &mesh)
+{
+    const uint32_t triangleCount = mesh.indexCount / 3;
+    auto triangles = new Triangle[triangleCount];
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        uint32_t ids[3];
+        for (uint32_t k = 0; k < 3; k++)
+            ids[k] = mesh.vertices[mesh.indices[3 * t + k]].id;
+
+        const uint32_t first = ids[0] <= ids[1] && ids[0] <= ids[2] ? 0 : (ids[1] <= ids[2] ? 1 : 2);
+        for (uint32_t k = 0; k < 3; k++)
+            triangles[t].ids[k] = ids[(first + k) % 3];
+    }
+    qsort(triangles, triangleCount, sizeof(Triangle), CompareTriangles);
+    return triangles;
+}
+
+static bool SameTriangles(const BenchMesh &a, const BenchMesh &b)
+{
+    if(a.indexCount != b.indexCount)
+        return false;
+
+    auto left = CanonicalTriangles(a);
+    auto right = CanonicalTriangles(b);
+    const bool same = memcmp(left, right, sizeof(Triangle) * (a.indexCount / 3)) == 0;
+    delete[] left;
+    delete[] right;
+    return same;
+}
+
+static void OptimizeMesh(BenchMesh &mesh, VertexCacheStats &before, VertexCacheStats &after)
+{
+    meshOptimize::Optimize(mesh.vertices, mesh.indices, mesh.indexCount, mesh.vertexCount,
+                           sizeof(BenchVertex), before, after);
+}
+
+void meshBench::RunChecks(check_stats &stats)
+{
+    printf("mesh optimization checks\n");
+
+    // Every vertex of a lone triangle misses once
+    const uint32_t triangle[] = {0, 1, 2};
+    const auto single = meshOptimize::AnalyzeVertexCache(triangle, 3, 3);
+    Check(stats, "lone triangle transforms 3 vertices", single.transformed == 3 && single.acmr() == 3.0f &&
+                                                         single.atvr() == 1.0f);
+
+    auto grid = MakeGrid(64);
+    auto shuffled = Copy(grid);
+    ShuffleTriangles(shuffled);
+    auto sphere = MakeSphere(64, 64);
+
+    const BenchMesh *sources[] = {&grid, &shuffled, &sphere};
+    const char *const keepNames[] = {"grid keeps its triangles", "shuffled grid keeps its triangles",
+                                     "sphere keeps its triangles"};
+    const char *const cacheNames[] = {"grid ACMR does not grow", "shuffled grid ACMR does not grow",
+                                      "sphere ACMR does not grow"};
+    const char *const fetchNames[] = {"grid vertices in first use order", "shuffled grid vertices in first use order",
+                                      "sphere vertices in first use order"};
+    for (uint32_t i = 0; i < arraysize(sources); i++)
+    {
+        auto mesh = Copy(*sources[i]);
+        VertexCacheStats before, after;
+        OptimizeMesh(mesh, before, after);
+
+        Check(stats, keepNames[i], SameTriangles(mesh, *sources[i]));
+        Check(stats, cacheNames[i], after.transformed <= before.transformed && after.triangles == before.triangles &&
+                                    after.vertices == before.vertices);
+
+        // First use order, each index is at most one past the largest before it
+        bool firstUse = true;
+        uint32_t next = 0;
+        for (uint32_t j = 0; j < mesh.indexCount; j++)
+        {
+            firstUse &= mesh.indices[j] <= next;
+            next = max(next, mesh.indices[j] + 1);
+        }
+        Check(stats, fetchNames[i], firstUse && next == mesh.vertexCount);
+        Destroy(mesh);
+    }
+
+    // A shuffled grid has next to no reuse left, the optimizer has to find it again
+    auto mesh = Copy(shuffled);
+    VertexCacheStats before, after;
+    OptimizeMesh(mesh, before, after);
+    Check(stats, "shuffled grid ACMR below 1", before.acmr() > 2.0f && after.acmr() < 1.0f);
+    Destroy(mesh);
+
+    // Unreferenced vertices go to the back, the count returned excludes them
+    auto sparse = Copy(grid);
+    for (uint32_t j = 0; j < sparse.indexCount; j++)
+        sparse.indices[j] = sparse.indices[j] < sparse.vertexCount / 2 ? sparse.indices[j] : 0;
+    uint32_t referenced = 0;
+    {
+        auto used = new bool[sparse.vertexCount]();
+        for (uint32_t j = 0; j < sparse.indexCount; j++)
+            used[sparse.indices[j]] = true;
+        for (uint32_t j = 0; j < sparse.vertexCount; j++)
+            referenced += used[j] ? 1 : 0;
+        delete[] used;
+    }
+    const uint32_t returned = meshOptimize::OptimizeVertexFetch(sparse.vertices, sparse.indices, sparse.indexCount,
+                                                                sparse.vertexCount, sizeof(BenchVertex));
+    Check(stats, "fetch returns the referenced count", returned == referenced && returned < sparse.vertexCount);
+    Destroy(sparse);
+
+    Destroy(grid);
+    Destroy(shuffled);
+    Destroy(sphere);
+}
+
+void meshBench::RunTimings(bool quick)
+{
+    const uint32_t gridSize = quick ? 128 : 256;
+    auto grid = MakeGrid(gridSize);
+    auto shuffled = Copy(grid);
+    ShuffleTriangles(shuffled);
+    auto sphere = MakeSphere(64, 64);
+
+    const BenchMesh *sources[] = {&grid, &shuffled, &sphere};
+    const char *const names[] = {"grid", "shuffled grid", "sphere"};
+
+    printf("\nmesh optimization  triangles      ms  ACMR before  after  ATVR before  after\n");
+    for (uint32_t i = 0; i < arraysize(sources); i++)
+    {
+        VertexCacheStats before = {}, after = {};
+        double best = 1e9;
+        for (uint32_t run = 0; run < RUNS; run++)
+        {
+            auto mesh = Copy(*sources[i]);
+            const double begin = pltf::GetTime();
+            OptimizeMesh(mesh, before, after);
+            best = min(best, pltf::GetTime() - begin);
+            Destroy(mesh);
+        }
+        printf("  %-14s %11u %7.2f %12.3f %6.3f %12.3f %6.3f\n", names[i], before.triangles, best * 1000.0,
+               before.acmr(), after.acmr(), before.atvr(), after.atvr());
+    }
+
+    Destroy(grid);
+    Destroy(shuffled);
+    Destroy(sphere);
+}
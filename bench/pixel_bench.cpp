@@ -0,0 +1,223 @@
+// Float to half and B10G11R11 conversions of pixelConvert. Every path has to match FloatToHalf
+// and HalfToFloat bit for bit, across a sweep of float bit patterns and all 65536 halves, and
+// B10G11R11 has to match a double precision rounding of each channel. Then an equirectangular
+// 2048x1024 RGB source, what HDRImage::load stages, is converted on every path and timed
+// against copying it as RGBA32F.
+
+#include "bench.hpp"
+#include "../source/backend/pixel_convert.hpp"
+#include "../source/mv_utils/cpu_features.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+
+constexpr uint32_t SOURCE_WIDTH = 2048;
+constexpr uint32_t SOURCE_HEIGHT = 1024;
+constexpr uint32_t BIT_PATTERN_STEP = 251;  // Prime, touches every exponent and mantissa pattern
+
+static const simd_path PATHS[] = {simd_path::scalar, simd_path::sse, simd_path::avx};
+
+static bool PathAvailable(simd_path path)
+{
+    return path != simd_path::avx || cpu::Features().f16c;
+}
+
+static bool SameFloat(float a, float b)
+{
+    if(std::isnan(a) || std::isnan(b))
+        return std::isnan(a) && std::isnan(b);
+    return std::bit_cast<uint32_t>(a) == std::bit_cast<uint32_t>(b);
+}
+
+// Unsigned float with a 5 bit exponent and mantissaBits, rounded to nearest even in double.
+// Mirrors what the format holds rather than how pixelConvert gets there
+static uint32_t SmallFloatReference(float value, int mantissaBits)
+{
+    const double largest = std::ldexp(2.0 - std::ldexp(1.0, -mantissaBits), 15);
+    const double v = std::isnan(value) ? 0.0 : clamp(double(value), 0.0, largest);
+    if(v == 0.0)
+        return 0;
+
+    int exponent;
+    std::frexp(v, &exponent);
+    exponent = max(exponent - 1, -14);
+
+    // v / step is exact, nearbyint rounds ties to even
+    const double steps = std::nearbyint(std::ldexp(v, mantissaBits - exponent));
+    if(steps < std::ldexp(1.0, mantissaBits))
+        return uint32_t(steps);     // Denormal
+    return (uint32_t(exponent + 15) << mantissaBits) + uint32_t(steps) - (1u << mantissaBits);
+}
+
+static uint32_t B10G11R11Reference(const float *rgb)
+{
+    return SmallFloatReference(rgb[0], 6) | (SmallFloatReference(rgb[1], 6) << 11) |
+           (SmallFloatReference(rgb[2], 5) << 22);
+}
+
+// Normal and denormal values of both formats, exact ties between two codes, and the specials
+static float RandomSmallFloat(int mantissaBits)
+{
+    const float choice = RandomFloat(0.0f, 1.0f);
+    const int exponent = int(RandomFloat(-24.0f, 17.0f));
+    if(choice < 0.4f)
+        return std::ldexp(RandomFloat(1.0f, 2.0f), exponent);
+    if(choice < 0.8f)
+    {
+        const float code = std::floor(RandomFloat(0.0f, float(1 << mantissaBits)));
+        return std::ldexp(1.0f + (code + 0.5f) / float(1 << mantissaBits), exponent);
+    }
+
+    const float specials[] = {0.0f, -0.0f, -1.0f, 65024.0f, 65500.0f, 1e6f, INFINITY, -INFINITY, NAN,
+                              0x1p-20f, 0x1p-15f, 0x1.fffffep-15f};
+    return specials[min(uint32_t(RandomFloat(0.0f, float(arraysize(specials)))), uint32_t(arraysize(specials) - 1))];
+}
+
+static float *MakeSource(uint32_t texelCount)
+{
+    // Radiance's range, most texels around 1 and a few bright ones. Room for four channels,
+    // the conversions read the first texelCount * 3 floats as RGB
+    auto source = new float[size_t(texelCount) * 4];
+    for (size_t i = 0; i < size_t(texelCount) * 4; i++)
+        source[i] = std::exp2(RandomFloat(-8.0f, 4.0f)) * (RandomFloat(0.0f, 1.0f) < 0.01f ? 1000.0f : 1.0f);
+    return source;
+}
+
+void pixelBench::RunChecks(check_stats &stats)
+{
+    printf("pixel conversion checks\n");
+
+    // Float bit patterns as RGBA texels, NaNs other than the default one keep F16C's payload
+    constexpr uint32_t SWEEP_COUNT = uint32_t(0x100000000ull / BIT_PATTERN_STEP) & ~3u;
+    auto floats = new float[SWEEP_COUNT];
+    for (uint32_t i = 0; i < SWEEP_COUNT; i++)
+    {
+        const float value = std::bit_cast<float>(uint32_t(uint64_t(i) * BIT_PATTERN_STEP));
+        floats[i] = std::isnan(value) ? NAN : value;
+    }
+
+    auto halves = new uint16_t[SWEEP_COUNT];
+    const char *const toHalfNames[] = {"scalar to half matches FloatToHalf", "sse2 to half matches FloatToHalf",
+                                       "f16c to half matches FloatToHalf"};
+    for (uint32_t p = 0; p < arraysize(PATHS); p++)
+    {
+        if(!PathAvailable(PATHS[p]))
+            continue;
+
+        pixelConvert::ToHalf(floats, 4, SWEEP_COUNT / 4, halves, PATHS[p]);
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < SWEEP_COUNT; i++)
+            mismatches += halves[i] != FloatToHalf(floats[i]) ? 1 : 0;
+        Check(stats, toHalfNames[p], mismatches == 0, mismatches);
+    }
+
+    // RGB sources get alpha 1 and read the last texel without overrunning
+    const char *const rgbNames[] = {"scalar rgb to half", "sse2 rgb to half", "f16c rgb to half"};
+    for (uint32_t p = 0; p < arraysize(PATHS); p++)
+    {
+        if(!PathAvailable(PATHS[p]))
+            continue;
+
+        constexpr uint32_t TEXELS = 7;
+        uint16_t rgba[TEXELS * 4];
+        pixelConvert::ToHalf(floats, 3, TEXELS, rgba, PATHS[p]);
+        bool same = true;
+        for (uint32_t i = 0; i < TEXELS; i++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+                same &= rgba[i * 4 + c] == FloatToHalf(floats[i * 3 + c]);
+            same &= rgba[i * 4 + 3] == 0x3C00;
+        }
+        Check(stats, rgbNames[p], same);
+    }
+
+    uint16_t allHalves[65536];
+    float decoded[65536];
+    for (uint32_t i = 0; i < 65536; i++)
+        allHalves[i] = uint16_t(i);
+    const char *const fromHalfNames[] = {"scalar from half matches HalfToFloat", "sse2 from half matches HalfToFloat",
+                                         "f16c from half matches HalfToFloat"};
+    for (uint32_t p = 0; p < arraysize(PATHS); p++)
+    {
+        if(!PathAvailable(PATHS[p]))
+            continue;
+
+        pixelConvert::FromHalf(allHalves, 65536, decoded, PATHS[p]);
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < 65536; i++)
+            mismatches += SameFloat(decoded[i], HalfToFloat(uint16_t(i))) ? 0 : 1;
+        Check(stats, fromHalfNames[p], mismatches == 0, mismatches);
+    }
+
+    // Odd count, the last texel takes the scalar tail
+    constexpr uint32_t PACKED_TEXELS = 100001;
+    auto rgb = new float[PACKED_TEXELS * 3];
+    auto packed = new uint32_t[PACKED_TEXELS];
+    for (uint32_t i = 0; i < PACKED_TEXELS; i++)
+    {
+        rgb[i * 3 + 0] = RandomSmallFloat(6);
+        rgb[i * 3 + 1] = RandomSmallFloat(6);
+        rgb[i * 3 + 2] = RandomSmallFloat(5);
+    }
+    pixelConvert::ToB10G11R11(rgb, 3, PACKED_TEXELS, packed);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < PACKED_TEXELS; i++)
+        mismatches += packed[i] != B10G11R11Reference(rgb + i * 3) ? 1 : 0;
+    Check(stats, "B10G11R11 matches double rounding", mismatches == 0, mismatches);
+
+    delete[] floats;
+    delete[] halves;
+    delete[] rgb;
+    delete[] packed;
+}
+
+void pixelBench::RunTimings(bool quick)
+{
+    const uint32_t texelCount = quick ? SOURCE_WIDTH * SOURCE_HEIGHT / 8 : SOURCE_WIDTH * SOURCE_HEIGHT;
+    auto source = MakeSource(texelCount);
+    auto target = new uint32_t[size_t(texelCount) * 4];
+
+    printf("\n%u texels of float source         ms  Mtexels/s\n", texelCount);
+    const auto report = [&](const char *name, double seconds)
+    {
+        printf("  %-30s %7.2f %10.0f\n", name, seconds * 1000.0, texelCount / seconds / 1e6);
+    };
+
+    // NOTE(arle): RGBA32F is staged as stbi decodes it, with alpha, one copy of 16 bytes a texel
+    double best = 1e9;
+    for (uint32_t run = 0; run < RUNS; run++)
+    {
+        const double begin = pltf::GetTime();
+        memcpy(target, source, sizeof(float) * 4 * texelCount);
+        best = min(best, pltf::GetTime() - begin);
+    }
+    report("RGBA32F memcpy", best);
+
+    const char *const names[] = {"RGBA16F scalar", "RGBA16F sse2", "RGBA16F f16c"};
+    for (uint32_t p = 0; p < arraysize(PATHS); p++)
+    {
+        if(!PathAvailable(PATHS[p]))
+            continue;
+
+        best = 1e9;
+        for (uint32_t run = 0; run < RUNS; run++)
+        {
+            const double begin = pltf::GetTime();
+            pixelConvert::ToHalf(source, 3, texelCount, reinterpret_cast<uint16_t*>(target), PATHS[p]);
+            best = min(best, pltf::GetTime() - begin);
+        }
+        report(names[p], best);
+    }
+
+    best = 1e9;
+    for (uint32_t run = 0; run < RUNS; run++)
+    {
+        const double begin = pltf::GetTime();
+        pixelConvert::ToB10G11R11(source, 3, texelCount, target);
+        best = min(best, pltf::GetTime() - begin);
+    }
+    report("B10G11R11", best);
+
+    delete[] source;
+    delete[] target;
+}
@@ -0,0 +1,162 @@
+// Vertex packing of vertexQuantize. Every position code has to decode, in double, within half
+// a 16 bit step of its axis of the box, every normal within a degree and every uv within half
+// a half float step, then packing a million Model3D::Vertex sized vertices is timed with the
+// errors it reports.
+
+#include "bench.hpp"
+#include "../source/backend/vertex_quantize.hpp"
+#include <stdio.h>
+#include <cmath>
+
+constexpr uint32_t VERTEX_COUNT = 1 << 20;
+
+// Model3D::Vertex's layout, the bench does not pull in Vulkan
+struct FullVertex
+{
+    vec3<float> position;
+    vec3<float> normal;
+    vec2<float> uv;
+};
+
+static vec3<float> RandomDirection()
+{
+    for (;;)
+    {
+        const auto v = vec3(RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f));
+        const float l = length(v);
+        if(l > 0.01f && l <= 1.0f)
+            return v * (1.0f / l);
+    }
+}
+
+static FullVertex *MakeVertices(uint32_t count, BoundingBox &box)
+{
+    auto vertices = new FullVertex[count];
+    box = {vec3(1e30f), vec3(-1e30f)};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto &v = vertices[i];
+        v.position = vec3(RandomFloat(-3.0f, 5.0f), RandomFloat(0.0f, 0.25f), RandomFloat(-40.0f, 40.0f));
+        v.normal = RandomDirection();
+        v.uv = vec2(RandomFloat(0.0f, 1.0f), RandomFloat(0.0f, 1.0f));
+
+        box.min = vec3(min(box.min.x, v.position.x), min(box.min.y, v.position.y), min(box.min.z, v.position.z));
+        box.max = vec3(max(box.max.x, v.position.x), max(box.max.y, v.position.y), max(box.max.z, v.position.z));
+    }
+    return vertices;
+}
+
+static QuantizationError Pack(const FullVertex *vertices, uint32_t count, const PositionDequantization &dequantization,
+                              PackedVertex *packed)
+{
+    return vertexQuantize::Pack(&vertices[0].position, &vertices[0].normal, &vertices[0].uv, sizeof(FullVertex),
+                                count, dequantization, packed);
+}
+
+// The error of rounding each octahedral coordinate on its own, what the encoder improves on
+static float RoundedNormalError(vec3<float> normal)
+{
+    const float l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    float x = normal.x / l1, y = normal.y / l1;
+    if(normal.z < 0.0f)
+    {
+        const float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+    }
+    const int8_t code[2] = {int8_t(std::round(x * 127.0f)), int8_t(std::round(y * 127.0f))};
+    return GetAngle(std::acos(clamp(dot(vertexQuantize::DecodeNormal(code), normal), -1.0f, 1.0f)));
+}
+
+void quantizeBench::RunChecks(check_stats &stats)
+{
+    printf("vertex quantization checks\n");
+    constexpr uint32_t COUNT = 50000;
+
+    BoundingBox box;
+    auto vertices = MakeVertices(COUNT, box);
+    auto packed = new PackedVertex[COUNT];
+    const auto dequantization = vertexQuantize::Dequantization(box);
+    const auto error = Pack(vertices, COUNT, dequantization, packed);
+
+    // The codes against the exact decode, in double per axis. The reported error also carries
+    // the float rounding of DecodePosition and is only checked against it below
+    const double offsets[] = {dequantization.offset.x, dequantization.offset.y, dequantization.offset.z};
+    const double scales[] = {dequantization.scale.x, dequantization.scale.y, dequantization.scale.z};
+    double worstSteps = 0.0;
+    for (uint32_t i = 0; i < COUNT; i++)
+    {
+        const float source[] = {vertices[i].position.x, vertices[i].position.y, vertices[i].position.z};
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            const double decoded = offsets[axis] + double(packed[i].position[axis]) / 65535.0 * scales[axis];
+            worstSteps = max(worstSteps, std::fabs(decoded - double(source[axis])) / (scales[axis] / 65535.0));
+        }
+    }
+    Check(stats, "positions within half a step", worstSteps <= 0.5, worstSteps);
+    Check(stats, "normals within a degree", error.normal < 1.0f, error.normal);
+    Check(stats, "uvs within half a half step", error.uv <= 0x1p-12f, error.uv / 0x1p-12f);
+
+    // The reported errors have to be the ones the decoders see
+    float positionError = 0.0f, normalError = 0.0f;
+    bool neverWorse = true;
+    for (uint32_t i = 0; i < COUNT; i++)
+    {
+        const auto position = vertexQuantize::DecodePosition(packed[i].position, dequantization);
+        const auto d = position - vertices[i].position;
+        positionError = max(positionError, max(std::fabs(d.x), max(std::fabs(d.y), std::fabs(d.z))));
+
+        const auto normal = vertexQuantize::DecodeNormal(packed[i].normal);
+        const float angle = GetAngle(std::acos(clamp(dot(normal, vertices[i].normal), -1.0f, 1.0f)));
+        normalError = max(normalError, angle);
+        // Near ties come down to float rounding of the cosines, a hundredth of a degree either way
+        neverWorse &= angle <= RoundedNormalError(vertices[i].normal) + 0.01f;
+    }
+    Check(stats, "reported errors match the decoders", positionError == error.position &&
+                                                       std::fabs(normalError - error.normal) < 1e-3f);
+    Check(stats, "normal codes no worse than rounding", neverWorse);
+
+    // The axes sit on codes exactly, including the folded lower pole
+    const vec3<float> axes[] = {vec3(1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f),
+                                vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 0.0f, -1.0f)};
+    bool exact = true;
+    for (const auto &axis : axes)
+    {
+        int8_t code[2];
+        vertexQuantize::EncodeNormal(axis, code);
+        exact &= dot(vertexQuantize::DecodeNormal(code), axis) > 0.99999f;
+    }
+    Check(stats, "axis normals round trip", exact);
+
+    delete[] vertices;
+    delete[] packed;
+}
+
+void quantizeBench::RunTimings(bool quick)
+{
+    const uint32_t count = quick ? VERTEX_COUNT / 8 : VERTEX_COUNT;
+
+    BoundingBox box;
+    auto vertices = MakeVertices(count, box);
+    auto packed = new PackedVertex[count];
+    const auto dequantization = vertexQuantize::Dequantization(box);
+
+    QuantizationError error{};
+    double best = 1e9;
+    for (uint32_t run = 0; run < RUNS; run++)
+    {
+        const double begin = pltf::GetTime();
+        error = Pack(vertices, count, dequantization, packed);
+        best = min(best, pltf::GetTime() - begin);
+    }
+
+    const auto size = box.max - box.min;
+    printf("\n%u vertices packed, %u -> %u bytes (%.2fx), %.2f ms, %.0f Mvertices/s\n", count,
+           uint32_t(sizeof(FullVertex)), uint32_t(sizeof(PackedVertex)),
+           double(sizeof(FullVertex)) / double(sizeof(PackedVertex)), best * 1000.0, count / best / 1e6);
+    printf("  max error: position %.3g (box %.1f x %.2f x %.1f), normal %.3f deg, uv %.3g\n",
+           error.position, size.x, size.y, size.z, error.normal, error.uv);
+
+    delete[] vertices;
+    delete[] packed;
+}
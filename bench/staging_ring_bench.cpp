@@ -0,0 +1,141 @@
+// The staging ring AssetLoader uploads textures through. Allocations have to be aligned, skip
+// the end of the ring rather than wrap, and wait only while allocations in use are in the way:
+// an empty ring has to take a full size allocation wherever its head stopped. A random
+// sequence of reserves and in order releases is then replayed against a byte map of the ring,
+// live allocations may never overlap. Timed as textures streaming through the ring.
+
+#include "bench.hpp"
+#include "../source/backend/staging_ring.hpp"
+#include <stdio.h>
+#include <string.h>
+
+constexpr uint64_t MAP_CAPACITY = 4096;
+constexpr uint32_t LIVE_MAX = 64;
+
+struct LiveAllocation
+{
+    uint64_t    start;
+    uint64_t    end;
+};
+
+void stagingRingBench::RunChecks(check_stats &stats)
+{
+    printf("staging ring checks\n");
+
+    constexpr uint64_t CAPACITY = MegaBytes(64);
+    StagingRing ring = {0, 0, CAPACITY};
+    uint64_t start = 0;
+
+    // A small texture, then one the size of the ring once the first is done
+    bool reserved = stagingRing::Reserve(ring, KiloBytes(64), 16, start);
+    Check(stats, "first allocation is at 0", reserved && start == 0);
+    stagingRing::Release(ring, start + KiloBytes(64));
+    reserved = stagingRing::Reserve(ring, CAPACITY, 16, start);
+    Check(stats, "empty ring takes a full size allocation", reserved && start % CAPACITY == 0);
+    Check(stats, "full ring refuses more", !stagingRing::Reserve(ring, 16, 16, start));
+    stagingRing::Release(ring, start + CAPACITY);
+
+    // Offsets round up to the alignment, 12 byte texels copy at multiples of 12
+    const uint64_t base = ring.head;
+    reserved = stagingRing::Reserve(ring, 16, 16, start);
+    reserved &= stagingRing::Reserve(ring, 48, 12, start);
+    Check(stats, "allocation is aligned", reserved && start % CAPACITY % 12 == 0 && start - base == 24);
+
+    // One that does not fit before the end starts the next lap, behind the ones in use
+    ring = {0, 0, MAP_CAPACITY};
+    uint64_t first = 0, second = 0;
+    stagingRing::Reserve(ring, 1024, 16, first);
+    stagingRing::Reserve(ring, 2048, 16, second);
+    Check(stats, "allocation past the end waits", !stagingRing::Reserve(ring, 2048, 16, start));
+    stagingRing::Release(ring, first + 1024);
+    Check(stats, "allocation past the end still waits", !stagingRing::Reserve(ring, 2048, 16, start));
+    reserved = stagingRing::Reserve(ring, 1024, 16, start);
+    Check(stats, "allocation fits up to the end", reserved && start == 3072);
+    stagingRing::Release(ring, second + 2048);
+    reserved = stagingRing::Reserve(ring, 2048, 16, start);
+    Check(stats, "allocation skips the end of the ring", reserved && start == MAP_CAPACITY);
+
+    // Random churn against a byte map, released in allocation order like AssetLoader does
+    auto owner = new uint32_t[MAP_CAPACITY]();
+    LiveAllocation live[LIVE_MAX];
+    uint32_t liveFirst = 0, liveCount = 0;
+    ring = {0, 0, MAP_CAPACITY};
+
+    bool disjoint = true, progress = true;
+    for (uint32_t step = 1; step < 50000 && disjoint && progress; step++)
+    {
+        if(liveCount < LIVE_MAX && (liveCount == 0 || RandomFloat(0.0f, 1.0f) < 0.5f))
+        {
+            const uint64_t size = min(1 + uint64_t(RandomFloat(0.0f, float(MAP_CAPACITY))), MAP_CAPACITY);
+            const uint64_t alignment = RandomFloat(0.0f, 1.0f) < 0.5f ? 16 : 12;
+            if(!stagingRing::Reserve(ring, size, alignment, start))
+            {
+                // Nothing in use may refuse, AssetLoader would wait for a release forever
+                progress = liveCount > 0;
+                continue;
+            }
+
+            const uint64_t offset = start % MAP_CAPACITY;
+            disjoint = offset % alignment == 0 && offset + size <= MAP_CAPACITY;
+            for (uint64_t i = offset; i < offset + size && disjoint; i++)
+            {
+                disjoint = owner[i] == 0;
+                owner[i] = step;
+            }
+            live[(liveFirst + liveCount++) % LIVE_MAX] = {start, start + size};
+        }
+        else
+        {
+            const auto allocation = live[liveFirst];
+            liveFirst = (liveFirst + 1) % LIVE_MAX;
+            liveCount--;
+            stagingRing::Release(ring, allocation.end);
+            const uint64_t offset = allocation.start % MAP_CAPACITY;
+            memset(owner + offset, 0, sizeof(uint32_t) * (allocation.end - allocation.start));
+        }
+    }
+    Check(stats, "random allocations never overlap", disjoint);
+    Check(stats, "empty ring never refuses", progress);
+
+    delete[] owner;
+}
+
+void stagingRingBench::RunTimings(bool quick)
+{
+    const uint32_t steps = quick ? 1000000 : 10000000;
+    constexpr uint32_t IN_FLIGHT = 8;           // MAX_ASSET_LOADS
+    constexpr uint64_t CAPACITY = MegaBytes(64);
+
+    uint64_t ends[IN_FLIGHT];
+    double best = 1e9;
+    for (uint32_t run = 0; run < RUNS; run++)
+    {
+        StagingRing ring = {0, 0, CAPACITY};
+        uint32_t first = 0, count = 0;
+
+        const double begin = pltf::GetTime();
+        for (uint32_t step = 0; step < steps; step++)
+        {
+            // Mip chains from 4 KiB to 16 MiB, the oldest finishes when nothing else fits
+            const uint64_t size = KiloBytes(4) << ((step * 2654435761u) >> 29) % 13;
+            uint64_t start;
+            while (!stagingRing::Reserve(ring, size, 16, start))
+            {
+                stagingRing::Release(ring, ends[first]);
+                first = (first + 1) % IN_FLIGHT;
+                count--;
+            }
+            if(count == IN_FLIGHT)
+            {
+                stagingRing::Release(ring, ends[first]);
+                first = (first + 1) % IN_FLIGHT;
+                count--;
+            }
+            ends[(first + count++) % IN_FLIGHT] = start + size;
+        }
+        best = min(best, pltf::GetTime() - begin);
+    }
+
+    printf("\n%u staging reserves, up to %u in flight: %.2f ms, %.1f ns each\n",
+           steps, IN_FLIGHT, best * 1000.0, best * 1e9 / steps);
+}
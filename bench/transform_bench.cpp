@@ -0,0 +1,239 @@
+// World and world-view-projection matrices for many objects. The baseline composes each
+// object's matrices one by one the way a per-draw push constant would, against the structure
+// of arrays store on every path, serial and across the thread pool.
+
+#include "bench.hpp"
+#include "../source/backend/transform_store.hpp"
+#include "../source/mv_utils/cpu_features.hpp"
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+static vec4<float> RandomRotation()
+{
+    const auto axis = vec3(RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) + 1.5f);
+    return TransformStore::AxisAngle(axis, RandomFloat(0.0f, 2.0f * PI32));
+}
+
+static void FillStore(TransformStore &store, uint32_t count)
+{
+    store.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto position = vec3(RandomFloat(-100.0f, 100.0f), RandomFloat(-100.0f, 100.0f), RandomFloat(-100.0f, 100.0f));
+        const auto scale = vec3(RandomFloat(0.5f, 2.0f), RandomFloat(0.5f, 2.0f), RandomFloat(0.5f, 2.0f));
+        store.add(position, RandomRotation(), scale);
+    }
+}
+
+static mat4x4 RotationMatrix(vec4<float> q)
+{
+    auto m = mat4x4::identity();
+    m(0, 0) = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+    m(0, 1) = 2.0f * (q.x * q.y + q.z * q.w);
+    m(0, 2) = 2.0f * (q.x * q.z - q.y * q.w);
+    m(1, 0) = 2.0f * (q.x * q.y - q.z * q.w);
+    m(1, 1) = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+    m(1, 2) = 2.0f * (q.y * q.z + q.x * q.w);
+    m(2, 0) = 2.0f * (q.x * q.z + q.y * q.w);
+    m(2, 1) = 2.0f * (q.y * q.z - q.x * q.w);
+    m(2, 2) = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+    return m;
+}
+
+// One object at a time through the mat4x4 operators
+static void ComposeEach(const TransformStore &store, mat4x4 viewProjection, mat4x4 *world, mat4x4 *wvp)
+{
+    for (uint32_t i = 0; i < store.count(); i++)
+    {
+        world[i] = mat4x4::scale(store.scale(i)) * RotationMatrix(store.rotation(i)) *
+                   mat4x4::translate(store.position(i));
+        wvp[i] = world[i] * viewProjection;
+    }
+}
+
+// Point p through the double precision T * R * S of transform i, compared with the matrix
+static double PointError(const TransformStore &store, uint32_t i, const mat4x4 &m, vec3<float> p)
+{
+    const auto t = store.position(i);
+    const auto q = store.rotation(i);
+    const auto s = store.scale(i);
+
+    // v' = v + 2w(u x v) + 2u x (u x v) for unit q = (u, w)
+    const double vx = double(p.x) * s.x, vy = double(p.y) * s.y, vz = double(p.z) * s.z;
+    const double ux = q.x, uy = q.y, uz = q.z, w = q.w;
+    const double cx = uy * vz - uz * vy, cy = uz * vx - ux * vz, cz = ux * vy - uy * vx;
+    const double ccx = uy * cz - uz * cy, ccy = uz * cx - ux * cz, ccz = ux * cy - uy * cx;
+    const double expected[3] = {vx + 2.0 * (w * cx + ccx) + t.x, vy + 2.0 * (w * cy + ccy) + t.y,
+                                vz + 2.0 * (w * cz + ccz) + t.z};
+
+    const auto actual = mat4Scalar::transformPoint(p, m);
+    const double got[3] = {actual.x, actual.y, actual.z};
+    double error = 0.0, magnitude = 1.0;
+    for (uint32_t k = 0; k < 3; k++)
+    {
+        error = std::fmax(error, std::fabs(got[k] - expected[k]));
+        magnitude = std::fmax(magnitude, std::fabs(expected[k]));
+    }
+    return error / magnitude;
+}
+
+static mat4x4 ViewProjection()
+{
+    const auto view = mat4x4::lookAt(vec3(0.0f, 20.0f, -150.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+    return view * mat4x4::perspective(1.2f, 16.0f / 9.0f, 0.1f, 1000.0f);
+}
+
+void transformBench::RunChecks(check_stats &stats)
+{
+    printf("transform store checks\n");
+    constexpr uint32_t COUNT = 3 * 4096 + 13;     // Several blocks and a scalar tail
+
+    ThreadPool pool, serialPool;
+    pool.init();
+    serialPool.init(1);
+
+    TransformStore store;
+    store.init(16);
+    FillStore(store, COUNT);
+    const auto viewProjection = ViewProjection();
+
+    auto world = new mat4x4[COUNT];
+    auto wvp = new mat4x4[COUNT];
+    auto scalarWorld = new mat4x4[COUNT];
+    auto scalarWvp = new mat4x4[COUNT];
+
+    store.computeWorldMatrices(serialPool, viewProjection, scalarWorld, scalarWvp, simd_path::scalar);
+
+    double error = 0.0;
+    bool productMatches = true;
+    for (uint32_t i = 0; i < COUNT; i++)
+    {
+        error = std::fmax(error, PointError(store, i, scalarWorld[i], vec3(1.0f, -2.0f, 3.0f)));
+        const auto product = mat4Scalar::multiply(scalarWorld[i], viewProjection);
+        productMatches &= memcmp(&product, scalarWvp + i, sizeof(mat4x4)) == 0;
+    }
+    Check(stats, "world matrix vs double T * R * S", error < 1e-5, error);
+    Check(stats, "world view projection is world * vp", productMatches);
+
+    struct
+    {
+        const char* name;
+        simd_path   path;
+        ThreadPool* pool;
+    } const variants[] = {
+        {"sse matches scalar bits", simd_path::sse, &serialPool},
+        {"avx matches scalar bits", simd_path::avx, &serialPool},
+        {"pooled best path matches scalar bits", simd_path::best, &pool},
+    };
+    for (const auto &variant : variants)
+    {
+        if(variant.path == simd_path::avx && !cpu::Features().avx)
+            continue;
+
+        memset(world, 0, sizeof(mat4x4) * COUNT);
+        memset(wvp, 0, sizeof(mat4x4) * COUNT);
+        store.computeWorldMatrices(*variant.pool, viewProjection, world, wvp, variant.path);
+        Check(stats, variant.name, memcmp(world, scalarWorld, sizeof(mat4x4) * COUNT) == 0 &&
+                                   memcmp(wvp, scalarWvp, sizeof(mat4x4) * COUNT) == 0);
+    }
+
+    // World only must not touch a missing projection output, and short stores stay inline
+    store.computeWorldMatrices(pool, world, simd_path::best);
+    Check(stats, "world only output", memcmp(world, scalarWorld, sizeof(mat4x4) * COUNT) == 0);
+
+    const auto last = store.position(COUNT - 1);
+    store.remove(0);
+    const auto moved = store.position(0);
+    Check(stats, "remove moves the last transform in", store.count() == COUNT - 1 &&
+                                                       moved.x == last.x && moved.y == last.y && moved.z == last.z);
+
+    delete[] world;
+    delete[] wvp;
+    delete[] scalarWorld;
+    delete[] scalarWvp;
+    store.destroy();
+    pool.destroy();
+    serialPool.destroy();
+}
+
+void transformBench::RunTimings(bool quick)
+{
+    constexpr uint32_t COUNTS[] = {1000, 10000, 100000, 1000000};
+    const uint32_t countTotal = quick ? 2 : 4;
+
+    ThreadPool pool, serialPool;
+    pool.init();
+    serialPool.init(1);
+
+    TransformStore store;
+    store.init(COUNTS[countTotal - 1]);
+    const auto viewProjection = ViewProjection();
+    auto world = new mat4x4[COUNTS[countTotal - 1]];
+    auto wvp = new mat4x4[COUNTS[countTotal - 1]];
+
+    struct
+    {
+        const char* name;
+        simd_path   path;
+        ThreadPool* pool;
+    } const variants[] = {
+        {"soa scalar", simd_path::scalar, &serialPool},
+        {"soa sse", simd_path::sse, &serialPool},
+        {"soa avx", simd_path::avx, &serialPool},
+        {"soa best, pooled", simd_path::best, &pool},
+    };
+
+    printf("\nworld + world view projection, ms (%u threads)\n", pool.threadCount());
+    printf("  %-18s", "objects");
+    for (uint32_t c = 0; c < countTotal; c++)
+        printf(" %10u", COUNTS[c]);
+    printf("\n");
+
+    auto timeRuns = [&](auto compute)
+    {
+        double best = 1e30;
+        for (uint32_t run = 0; run < (quick ? 1 : RUNS); run++)
+        {
+            const double begin = pltf::GetTime();
+            compute();
+            best = min(best, pltf::GetTime() - begin);
+        }
+        return best * 1000.0;
+    };
+
+    double each[4] = {}, times[4][4] = {};
+    for (uint32_t c = 0; c < countTotal; c++)
+    {
+        FillStore(store, COUNTS[c]);
+        each[c] = timeRuns([&]() {ComposeEach(store, viewProjection, world, wvp);});
+        for (uint32_t v = 0; v < 4; v++)
+        {
+            times[v][c] = timeRuns([&]()
+            {
+                store.computeWorldMatrices(*variants[v].pool, viewProjection, world, wvp, variants[v].path);
+            });
+        }
+    }
+
+    printf("  %-18s", "one by one");
+    for (uint32_t c = 0; c < countTotal; c++)
+        printf(" %10.3f", each[c]);
+    printf("\n");
+    for (uint32_t v = 0; v < 4; v++)
+    {
+        if(variants[v].path == simd_path::avx && !cpu::Features().avx)
+            continue;
+
+        printf("  %-18s", variants[v].name);
+        for (uint32_t c = 0; c < countTotal; c++)
+            printf(" %10.3f", times[v][c]);
+        printf("  %5.1fx\n", each[countTotal - 1] / times[v][countTotal - 1]);
+    }
+
+    delete[] world;
+    delete[] wvp;
+    store.destroy();
+    pool.destroy();
+    serialPool.destroy();
+}
@@ -1,38 +1,54 @@
 workspace "model_viewer"
     configurations {"Debug", "Release"}
-    platforms {"Win64"}
+    platforms {"Win64", "Linux64"}
 
 filter {"platforms:Win64"}
     system "Windows"
     architecture "x86_64"
 
+filter {"platforms:Linux64"}
+    system "Linux"
+    architecture "x86_64"
+
 project "model_viewer"
     kind "WindowedApp"
     language "C++"
     cppdialect "c++20"
     targetdir "bin/%{cfg.buildcfg}"
 
-    includedirs{
-        "C:/VulkanSDK/1.3.204.0/Include"
-    }
-
-    libdirs{
-        "C:/VulkanSDK/1.3.204.0/Lib"
-    }
-
-    links{
-        "kernel32.lib",
-        "winmm.lib",
-        "user32.lib",
-        "vulkan-1.lib"
-    }
-
     files {
         "source/**.hpp",
         "source/**.cpp",
         "source/**.ixx"
     }
 
+    filter "system:Windows"
+        removefiles {"source/platform/platform_linux.cpp"}
+
+        includedirs{
+            "C:/VulkanSDK/1.3.204.0/Include"
+        }
+
+        libdirs{
+            "C:/VulkanSDK/1.3.204.0/Lib"
+        }
+
+        links{
+            "kernel32.lib",
+            "winmm.lib",
+            "user32.lib",
+            "vulkan-1.lib"
+        }
+
+    filter "system:Linux"
+        kind "ConsoleApp"
+        removefiles {"source/platform/platform_win32.cpp"}
+
+        links{
+            "vulkan",
+            "pthread"
+        }
+
     filter "configurations:Debug"
         defines {"DEBUG"}
         symbols "On"
@@ -46,4 +62,112 @@ project "model_viewer"
         intrinsics "On"
         flags {
             "LinkTimeOptimization"
-        }
\ No newline at end of file
+        }
+
+-- Offline BCn/KTX2 compressor for material textures, see tools/texture_compress
+filter {}
+project "texture_compress"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "c++20"
+    targetdir "bin/%{cfg.buildcfg}"
+
+    files {
+        "tools/texture_compress/**.hpp",
+        "tools/texture_compress/**.cpp",
+        "source/backend/thread_pool.cpp",
+        "source/platform/platform_linux.cpp",
+        "source/platform/platform_win32.cpp"
+    }
+
+    filter "system:Windows"
+        removefiles {"source/platform/platform_linux.cpp"}
+
+        includedirs{
+            "C:/VulkanSDK/1.3.204.0/Include"
+        }
+
+        libdirs{
+            "C:/VulkanSDK/1.3.204.0/Lib"
+        }
+
+        links{
+            "kernel32.lib",
+            "winmm.lib",
+            "user32.lib",
+            "vulkan-1.lib"
+        }
+
+    filter "system:Linux"
+        removefiles {"source/platform/platform_win32.cpp"}
+
+        links{
+            "pthread"
+        }
+
+    filter "configurations:Debug"
+        defines {"DEBUG"}
+        symbols "On"
+        optimize "Off"
+
+    filter "configurations:Release"
+        symbols "Off"
+        optimize "On"
+
+-- Math kernel benchmarks, checked against double precision before they are timed, see bench/
+filter {}
+project "bench"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "c++20"
+    targetdir "bin/%{cfg.buildcfg}"
+
+    files {
+        "bench/**.hpp",
+        "bench/**.cpp",
+        "source/mv_utils/mat4.cpp",
+        "source/backend/culling.cpp",
+        "source/backend/free_list.cpp",
+        "source/backend/mesh_optimize.cpp",
+        "source/backend/pixel_convert.cpp",
+        "source/backend/staging_ring.cpp",
+        "source/backend/thread_pool.cpp",
+        "source/backend/transform_store.cpp",
+        "source/backend/vertex_quantize.cpp",
+        "source/platform/platform_linux.cpp",
+        "source/platform/platform_win32.cpp"
+    }
+
+    filter "system:Windows"
+        removefiles {"source/platform/platform_linux.cpp"}
+
+        includedirs{
+            "C:/VulkanSDK/1.3.204.0/Include"
+        }
+
+        libdirs{
+            "C:/VulkanSDK/1.3.204.0/Lib"
+        }
+
+        links{
+            "kernel32.lib",
+            "winmm.lib",
+            "user32.lib",
+            "vulkan-1.lib"
+        }
+
+    filter "system:Linux"
+        removefiles {"source/platform/platform_win32.cpp"}
+
+        links{
+            "pthread"
+        }
+
+    filter "configurations:Debug"
+        defines {"DEBUG"}
+        symbols "On"
+        optimize "Off"
+
+    filter "configurations:Release"
+        symbols "Off"
+        optimize "On"
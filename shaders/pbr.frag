@@ -4,6 +4,7 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUV;
+layout(location = 3) flat in uint inMaterial;
 
 layout(location = 0) out vec4 outColour;
 
@@ -20,17 +21,34 @@ layout(binding = 1) uniform light_data
     vec4 colours[4];
     float exposure;
     float gamma;
+    vec2 reserved;
+    vec4 irradianceSH[9];
 } lights;
 
 layout(binding = 2) uniform sampler2D brdfLUT;
+#if !defined(IRRADIANCE_SH)
 layout(binding = 3) uniform samplerCube irradianceMap;
+#endif
 layout(binding = 4) uniform samplerCube prefilteredMap;
 
 layout(binding = 5) uniform sampler2D albedoMap;
 layout(binding = 6) uniform sampler2D normalMap;
-layout(binding = 7) uniform sampler2D roughnessMap;
-layout(binding = 8) uniform sampler2D metallicMap;
-layout(binding = 9) uniform sampler2D ambientMap;
+// Occlusion, roughness and metallic in red, green and blue, the glTF layout
+layout(binding = 7) uniform sampler2D ormMap;
+
+// Texture multipliers, the instance picks one. Size matches MAX_MATERIALS
+struct material_factors
+{
+    vec4 albedo;
+    float roughness;
+    float metallic;
+    vec2 reserved;
+};
+
+layout(binding = 8) uniform material_data
+{
+    material_factors factors[256];
+} materials;
 
 const float PI = 3.14159265359;
 
@@ -99,6 +117,25 @@ vec3 PrefilteredReflection(vec3 R, float roughness)
     return texture(prefilteredMap, R, lod).rgb;
 }
 
+// Diffuse irradiance over PI, either from the baked cubemap or from L2 spherical harmonics
+// with the cosine convolution and basis constants already folded into the coefficients
+vec3 Irradiance(vec3 N)
+{
+#if defined(IRRADIANCE_SH)
+    return max(lights.irradianceSH[0].rgb
+             + lights.irradianceSH[1].rgb * N.y
+             + lights.irradianceSH[2].rgb * N.z
+             + lights.irradianceSH[3].rgb * N.x
+             + lights.irradianceSH[4].rgb * (N.x * N.y)
+             + lights.irradianceSH[5].rgb * (N.y * N.z)
+             + lights.irradianceSH[6].rgb * (3.0 * N.z * N.z - 1.0)
+             + lights.irradianceSH[7].rgb * (N.x * N.z)
+             + lights.irradianceSH[8].rgb * (N.x * N.x - N.y * N.y), vec3(0.0));
+#else
+    return texture(irradianceMap, N).rgb;
+#endif
+}
+
 vec3 SrgbToLinear(vec3 source)
 {
     return pow(source, vec3(2.2));
@@ -106,7 +143,10 @@ vec3 SrgbToLinear(vec3 source)
 
 vec3 CalculateNormal()
 {
-    const vec3 tangentNormal = SrgbToLinear(texture(normalMap, inUV).rgb);
+    // Only x and y are stored, two channel BC5 maps have no z to read
+    vec3 tangentNormal;
+    tangentNormal.xy = texture(normalMap, inUV).rg * 2.0 - 1.0;
+    tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
 
     const vec3 Q1 = dFdx(inPosition);
     const vec3 Q2 = dFdy(inPosition);
@@ -136,9 +176,11 @@ vec3 Uncharted2Tonemap(vec3 colour)
 
 void main()
 {
-    const vec3 albedo = SrgbToLinear(texture(albedoMap, inUV).rgb);
-    const float roughness = texture(roughnessMap, inUV).r;
-    const float metallic = texture(metallicMap, inUV).r;
+    const material_factors material = materials.factors[inMaterial];
+    const vec3 albedo = SrgbToLinear(texture(albedoMap, inUV).rgb) * material.albedo.rgb;
+    const vec3 orm = texture(ormMap, inUV).rgb;
+    const float roughness = orm.g * material.roughness;
+    const float metallic = orm.b * material.metallic;
 
     const vec3 N = CalculateNormal();
 	const vec3 V = normalize(camera.position.xyz - inPosition);
@@ -156,7 +198,7 @@ void main()
     }
 
 	const vec2 brdf = texture(brdfLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
-    const vec3 irradiance = texture(irradianceMap, N).rgb;
+    const vec3 irradiance = Irradiance(N);
     const vec3 reflection = PrefilteredReflection(R, roughness).rgb;
 
     const vec3 diffuse = irradiance * albedo;
@@ -165,7 +207,7 @@ void main()
     const vec3 specular = reflection * (F * brdf.x + brdf.y);
 
     const vec3 kD = (1.0 - F) * (1.0 - metallic);
-    const vec3 ambient = (kD * diffuse + specular) * texture(ambientMap, inUV).rrr;
+    const vec3 ambient = (kD * diffuse + specular) * orm.r;
 
     vec3 colour = ambient + Lo;
 
@@ -1,13 +1,24 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// PackedVertex when compiled with -DPACKED_VERTICES (pbr_packed_vert.spv), the fixed
+// function conversion leaves positions in the unit box and the octahedral normal code
 layout(location = 0) in vec3 inPosition;
+#if defined(PACKED_VERTICES)
+layout(location = 1) in vec2 inNormal;
+#else
 layout(location = 1) in vec3 inNormal;
+#endif
 layout(location = 2) in vec2 inUV;
 
+// Per instance, see Model3D::InstanceAttributes
+layout(location = 3) in mat4 inModel;
+layout(location = 7) in uint inMaterial;
+
 layout(location = 0) out vec3 outPosition;
 layout(location = 1) out vec3 outNormal;
 layout(location = 2) out vec2 outUV;
+layout(location = 3) flat out uint outMaterial;
 
 layout(binding = 0) uniform camera_data
 {
@@ -16,15 +27,38 @@ layout(binding = 0) uniform camera_data
     vec4 position;
 } camera;
 
-layout(push_constant) uniform object_data
+#if defined(PACKED_VERTICES)
+// PositionDequantization in vertex_quantize.hpp, from Model3D::pushDequantization
+layout(push_constant) uniform dequantization_data
+{
+    vec4 offset;
+    vec4 scale;
+} dequantization;
+
+// Matches vertexQuantize::DecodeNormal
+vec3 DecodeNormal(vec2 code)
 {
-    layout(offset = 0) mat4 model;
-} object;
+    vec3 n = vec3(code, 1.0 - abs(code.x) - abs(code.y));
+    const float fold = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+#endif
 
 void main()
 {
-    outPosition = vec3(object.model * vec4(inPosition, 1.0));
-    outNormal = mat3(object.model) * inNormal;
+#if defined(PACKED_VERTICES)
+    const vec3 position = dequantization.offset.xyz + inPosition * dequantization.scale.xyz;
+    const vec3 normal = DecodeNormal(inNormal);
+#else
+    const vec3 position = inPosition;
+    const vec3 normal = inNormal;
+#endif
+
+    outPosition = vec3(inModel * vec4(position, 1.0));
+    outNormal = mat3(inModel) * normal;
     outUV = inUV;
+    outMaterial = inMaterial;
     gl_Position = camera.proj * camera.view * vec4(outPosition, 1.0);
-}
\ No newline at end of file
+}
@@ -92,7 +92,7 @@ vec3 prefilter(vec3 R, float roughness)
 			const float solidAngleTexel = 4.0 * PI / (6.0 * mapDimension * mapDimension);
 			const float solidAngleSample = 1.0 / (float(NUM_SAMPLES) * pdf);
             const float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(solidAngleSample / solidAngleTexel);
-            colour += texture(environmentMap, inUVW, mipLevel).rgb * NdotL;
+            colour += textureLod(environmentMap, L, mipLevel).rgb * NdotL;
             weight += NdotL;
         }
     }
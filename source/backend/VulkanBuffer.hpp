@@ -1,13 +1,14 @@
 #pragma once
 
 #include "vulkan_initialisers.hpp"
+#include "VulkanMemory.hpp"
 
 class VulkanBuffer
 {
 public:
     VkResult bind(VkDevice device)
     {
-        return vkBindBufferMemory(device, data, memory, 0);
+        return vkBindBufferMemory(device, data, memory.memory, memory.offset);
     }
 
     void updateDescriptor()
@@ -20,22 +21,26 @@ public:
     void destroy(VkDevice device)
     {
         vkDestroyBuffer(device, data, nullptr);
-        vkFreeMemory(device, memory, nullptr);
+        memory.release();
     }
 
+    // NOTE(arle): Host visible blocks are persistently mapped by the allocator,
+    // map/unmap only hand out and drop the pointer into the block
+
     VkResult map(VkDevice device)
     {
-        return vkMapMemory(device, memory, 0, size, 0, &mapped);
+        mapped = memory.mapped;
+        return mapped ? VK_SUCCESS : VK_ERROR_MEMORY_MAP_FAILED;
     }
 
     VkResult map(VkDevice device, VkDeviceSize offset, VkDeviceSize range)
     {
-        return vkMapMemory(device, memory, offset, range, 0, &mapped);
+        mapped = memory.mapped ? static_cast<uint8_t*>(memory.mapped) + offset : nullptr;
+        return mapped ? VK_SUCCESS : VK_ERROR_MEMORY_MAP_FAILED;
     }
 
     void unmap(VkDevice device)
     {
-        vkUnmapMemory(device, memory);
         mapped = nullptr;
     }
 
@@ -47,7 +52,7 @@ public:
 
     VkDeviceSize            size;
     VkBuffer                data;
-    VkDeviceMemory          memory;
+    MemoryAllocation        memory;
     VkDescriptorBufferInfo  descriptor;
     void*                   mapped;
 };
\ No newline at end of file
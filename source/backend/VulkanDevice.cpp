@@ -1,33 +1,80 @@
 #include "VulkanDevice.hpp"
 #include <string.h>
 
-void VulkanDevice::create(bool validation)
+void VulkanDevice::create(bool validation, bool headless, uint32_t apiVersion)
 {
-    const uint32_t queueFamilies[] = {queueBits.graphics, queueBits.present};
-    const uint32_t queueCount = (queueBits.graphics != queueBits.present) ? 2 : 1;
+    // One queue from each distinct family
+    const uint32_t families[] = {queueBits.graphics, queueBits.present, queueBits.transfer};
+    uint32_t uniqueFamilies[arraysize(families)];
+    uint32_t queueCount = 0;
+    for(size_t i = 0; i < arraysize(families); i++)
+    {
+        bool unique = true;
+        for(uint32_t j = 0; j < queueCount; j++)
+            unique = unique && uniqueFamilies[j] != families[i];
+        if(unique)
+            uniqueFamilies[queueCount++] = families[i];
+    }
 
     float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfos[2];
+    VkDeviceQueueCreateInfo queueCreateInfos[arraysize(families)];
     for(size_t i = 0; i < queueCount; i++)
     {
         queueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfos[i].queueFamilyIndex = queueFamilies[i];
-        queueCreateInfos[i].queueCount = queueCount;
+        queueCreateInfos[i].queueFamilyIndex = uniqueFamilies[i];
+        queueCreateInfos[i].queueCount = 1;
         queueCreateInfos[i].pQueuePriorities = &queuePriority;
         queueCreateInfos[i].flags = 0;
         queueCreateInfos[i].pNext = nullptr;
     }
 
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    vkGetPhysicalDeviceFeatures(gpu, &supportedFeatures);
+
+    // BC formats are all or nothing, KTX2 textures are only picked when they can be sampled
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.sampleRateShading = VK_TRUE;
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+
+    // NOTE(arle): Timeline semaphores and indirect draw counts are core in 1.2, both the
+    // instance and the device have to be at least that for the feature struct to be valid
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    timelineSemaphores = false;
+    drawIndirectCount = false;
+    if(apiVersion >= VK_API_VERSION_1_2 && gpuProperties.apiVersion >= VK_API_VERSION_1_2)
+    {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(gpu, &features2);
+
+        timelineSemaphores = features12.timelineSemaphore == VK_TRUE;
+        drawIndirectCount = features12.drawIndirectCount == VK_TRUE;
+        features12 = {};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.timelineSemaphore = timelineSemaphores ? VK_TRUE : VK_FALSE;
+        features12.drawIndirectCount = drawIndirectCount ? VK_TRUE : VK_FALSE;
+    }
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount = queueCount;
     createInfo.pQueueCreateInfos = queueCreateInfos;
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(arraysize(DeviceExtensions));
-    createInfo.ppEnabledExtensionNames = DeviceExtensions;
+    createInfo.pNext = (timelineSemaphores || drawIndirectCount) ? &features12 : nullptr;
+
+    // Headless devices render offscreen and never create a swapchain
+    if(!headless)
+    {
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(arraysize(DeviceExtensions));
+        createInfo.ppEnabledExtensionNames = DeviceExtensions;
+    }
 
     if(validation)
     {
@@ -41,11 +88,13 @@ void VulkanDevice::create(bool validation)
     poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
 
-    vkGetPhysicalDeviceProperties(gpu, &gpuProperties);
+    allocator.create(gpu, device);
+    pipelineStats = {};
 }
 
 void VulkanDevice::destroy()
 {
+    allocator.destroy();
     vkDestroyCommandPool(device, commandPool, nullptr);
     vkDestroyDevice(device, nullptr);
 }
@@ -63,7 +112,7 @@ VkMemoryAllocateInfo VulkanDevice::getMemoryAllocInfo(VkMemoryRequirements memRe
 
     for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
     {
-        if((memReqs.memoryTypeBits & BIT(i)) && (memProps.memoryTypes[i].propertyFlags & flags))
+        if((memReqs.memoryTypeBits & BIT(i)) && (memProps.memoryTypes[i].propertyFlags & flags) == flags)
         {
             allocInfo.memoryTypeIndex = i;
             break;
@@ -72,7 +121,33 @@ VkMemoryAllocateInfo VulkanDevice::getMemoryAllocInfo(VkMemoryRequirements memRe
     return allocInfo;
 }
 
+MemoryAllocation VulkanDevice::allocateMemory(VkMemoryRequirements memReqs,
+                                              VkMemoryPropertyFlags flags,
+                                              MemoryPool pool) const
+{
+    const auto allocInfo = getMemoryAllocInfo(memReqs, flags);
+    return allocator.allocate(allocInfo.memoryTypeIndex, memReqs, pool);
+}
+
+MemoryAllocation VulkanDevice::allocateImageMemory(VkImage image,
+                                                   VkMemoryPropertyFlags flags,
+                                                   VkImageTiling tiling) const
+{
+    VkMemoryRequirements memReqs{};
+    vkGetImageMemoryRequirements(device, image, &memReqs);
+
+    const auto pool = (tiling == VK_IMAGE_TILING_OPTIMAL) ? MemoryPool::Optimal : MemoryPool::Linear;
+    auto allocation = allocateMemory(memReqs, flags, pool);
+    vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+    return allocation;
+}
+
 bool VulkanDevice::linearFilterSupport(VkFormat format, VkImageTiling tiling) const
+{
+    return formatSupport(format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT, tiling);
+}
+
+bool VulkanDevice::formatSupport(VkFormat format, VkFormatFeatureFlags features, VkImageTiling tiling) const
 {
     VkFormatProperties props;
     vkGetPhysicalDeviceFormatProperties(gpu, format, &props);
@@ -80,9 +155,9 @@ bool VulkanDevice::linearFilterSupport(VkFormat format, VkImageTiling tiling) co
     switch (tiling)
     {
         case VK_IMAGE_TILING_LINEAR:
-            return props.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+            return (props.linearTilingFeatures & features) == features;
         case VK_IMAGE_TILING_OPTIMAL:
-            return props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+            return (props.optimalTilingFeatures & features) == features;
         default: return false;
     }
 }
@@ -120,6 +195,30 @@ void VulkanDevice::flushCommandBuffer(VkCommandBuffer command, VkQueue queue, bo
         vkFreeCommandBuffers(device, commandPool, 1, &command);
 }
 
+VkResult VulkanDevice::createGraphicsPipeline(VkPipelineCache cache,
+                                              const VkGraphicsPipelineCreateInfo &info,
+                                              VkPipeline *pPipeline) const
+{
+    const auto begin = pltf::GetTime();
+    const auto result = vkCreateGraphicsPipelines(device, cache, 1, &info, nullptr, pPipeline);
+
+    pipelineStats.count++;
+    pipelineStats.seconds += pltf::GetTime() - begin;
+    return result;
+}
+
+VkResult VulkanDevice::createComputePipeline(VkPipelineCache cache,
+                                             const VkComputePipelineCreateInfo &info,
+                                             VkPipeline *pPipeline) const
+{
+    const auto begin = pltf::GetTime();
+    const auto result = vkCreateComputePipelines(device, cache, 1, &info, nullptr, pPipeline);
+
+    pipelineStats.count++;
+    pipelineStats.seconds += pltf::GetTime() - begin;
+    return result;
+}
+
 void VulkanDevice::createBuffer(VkBufferUsageFlags usage,
                                 VkMemoryPropertyFlags memFlags,
                                 VkDeviceSize size,
@@ -132,8 +231,7 @@ void VulkanDevice::createBuffer(VkBufferUsageFlags usage,
     VkMemoryRequirements memReqs;
     vkGetBufferMemoryRequirements(device, buffer.data, &memReqs);
 
-    auto allocInfo = getMemoryAllocInfo(memReqs, memFlags);
-    vkAllocateMemory(device, &allocInfo, nullptr, &buffer.memory);
+    buffer.memory = allocateMemory(memReqs, memFlags, MemoryPool::Linear);
 
     buffer.size = size;
     buffer.bind(device);
@@ -162,12 +260,7 @@ void VulkanDevice::createOffscreenBuffer(VkFormat format,
     imageInfo.mipLevels = 1;
     vkCreateImage(device, &imageInfo, nullptr, &buffer.image);
 
-    VkMemoryRequirements memReqs{};
-    vkGetImageMemoryRequirements(device, buffer.image, &memReqs);
-
-    auto allocInfo = getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-    vkAllocateMemory(device, &allocInfo, nullptr, &buffer.memory);
-    vkBindImageMemory(device, buffer.image, buffer.memory, 0);
+    buffer.memory = allocateImageMemory(buffer.image, MEM_FLAG_GPU_LOCAL);
 
     auto viewInfo = vkInits::imageViewCreateInfo();
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -5,11 +5,11 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTools.hpp"
 
-constexpr size_t MAX_IMAGES_IN_FLIGHT = 2;
+// Capacity of per-frame resources, the active count is VulkanInstanceSettings::framesInFlight
+constexpr size_t MAX_IMAGES_IN_FLIGHT = 3;
 
 constexpr const char *ValidationLayers[] = {"VK_LAYER_KHRONOS_validation"};
 constexpr const char *DeviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-constexpr const char *RequiredExtensions[] = {"VK_KHR_surface", "VK_KHR_win32_surface"};
 
 enum MEMORY_FLAGS : VkMemoryPropertyFlags
 {
@@ -30,24 +30,33 @@ enum USAGE_FLAGS : VkBufferUsageFlags
                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 };
 
+struct PipelineStats
+{
+    uint32_t    count;
+    double      seconds;
+};
+
 struct QueueBits
 {
     uint32_t graphics;
     uint32_t present;
+    uint32_t transfer;  // Copy engine family when the GPU has one, graphics otherwise
 };
 
 struct OffscreenBuffer
 {
     VkImage         image;
     VkImageView     view;
-    VkDeviceMemory  memory;
+    MemoryAllocation memory;
     VkFramebuffer   framebuffer;
 };
 
 class VulkanDevice
 {
 public:
-    void create(bool validation);
+    // apiVersion is the instance version, 1.2 devices get timeline semaphores and indirect
+    // draw counts when supported
+    void create(bool validation, bool headless = false, uint32_t apiVersion = VK_API_VERSION_1_0);
     void destroy();
 
     constexpr operator VkDevice()
@@ -58,10 +67,24 @@ public:
     // Tools
 
     VkMemoryAllocateInfo getMemoryAllocInfo(VkMemoryRequirements memReqs, VkMemoryPropertyFlags flags) const;
+    MemoryAllocation allocateMemory(VkMemoryRequirements memReqs, VkMemoryPropertyFlags flags, MemoryPool pool) const;
+    MemoryAllocation allocateImageMemory(VkImage image, VkMemoryPropertyFlags flags,
+                                         VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL) const;
     bool linearFilterSupport(VkFormat format, VkImageTiling tiling) const;
+    // Every feature bit has to be present for the tiling
+    bool formatSupport(VkFormat format, VkFormatFeatureFlags features,
+                       VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL) const;
     VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin = true) const;
     void flushCommandBuffer(VkCommandBuffer command, VkQueue queue, bool free = true) const;
 
+    // Creation time is accumulated into pipelineStats
+    VkResult createGraphicsPipeline(VkPipelineCache cache,
+                                    const VkGraphicsPipelineCreateInfo &info,
+                                    VkPipeline *pPipeline) const;
+    VkResult createComputePipeline(VkPipelineCache cache,
+                                   const VkComputePipelineCreateInfo &info,
+                                   VkPipeline *pPipeline) const;
+
     void createBuffer(VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags memFlags,
                       VkDeviceSize size,
@@ -81,4 +104,10 @@ public:
     VkDevice                    device;
     VkCommandPool               commandPool;
     VkPhysicalDeviceProperties  gpuProperties;
+    bool                        timelineSemaphores;
+    bool                        textureCompressionBC;
+    bool                        multiDrawIndirect;  // More than one draw per vkCmdDrawIndexedIndirect
+    bool                        drawIndirectCount;  // vkCmdDrawIndexedIndirectCount, 1.2 devices
+    mutable VulkanMemory        allocator;
+    mutable PipelineStats       pipelineStats;
 };
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "VulkanImageCache.hpp"
+#include <stdio.h>
+#include <string.h>
+
+constexpr uint32_t IMAGE_CACHE_MAGIC = 0x4943564D; // "MVCI"
+
+struct ImageCacheHeader
+{
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    key;
+    uint32_t    format;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    mipLevels;
+    uint32_t    layers;
+    uint32_t    reserved;
+    uint64_t    dataSize;
+};
+
+static void CacheFilename(uint64_t key, char (&filename)[64], bool temp = false)
+{
+    snprintf(filename, sizeof(filename), "image_cache_%016llx.bin%s",
+             static_cast<unsigned long long>(key), temp ? ".tmp" : "");
+}
+
+// Fills one copy region per mip level and returns the packed size of the whole image
+static VkDeviceSize PackedRegions(const ImageCacheDesc &desc, VkBufferImageCopy (&regions)[IMAGE_CACHE_MAX_MIPS])
+{
+    const auto texelSize = vkTools::FormatSize(desc.format);
+    if(texelSize == 0 || desc.mipLevels == 0 || desc.mipLevels > IMAGE_CACHE_MAX_MIPS)
+        return 0;
+
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < desc.mipLevels; level++)
+    {
+        const VkExtent2D extent = {max(desc.extent.width >> level, 1u), max(desc.extent.height >> level, 1u)};
+
+        regions[level] = vkInits::bufferImageCopy(extent);
+        regions[level].bufferOffset = offset;
+        regions[level].imageSubresource.mipLevel = level;
+        regions[level].imageSubresource.layerCount = desc.layers;
+
+        offset += VkDeviceSize(extent.width) * extent.height * texelSize * desc.layers;
+    }
+    return offset;
+}
+
+uint64_t imageCache::HashFile(const char *filename)
+{
+    uint64_t hash = 0;
+
+    auto file = io::Open<io::cmd::read>(filename);
+    if(io::IsValid(file))
+    {
+        auto map = io::Map(file, io::access::sequential, true);
+        if(map.data != nullptr)
+        {
+            hash = Fnv1a(map.data, map.size);
+            io::Unmap(map);
+        }
+    }
+    io::Close(file);
+
+    return hash;
+}
+
+uint64_t imageCache::Key(const char *name, const ImageCacheDesc &desc, uint64_t source)
+{
+    if(source == 0)
+        return 0;
+
+    const uint32_t params[] = {
+        IMAGE_CACHE_VERSION, uint32_t(desc.format), desc.extent.width, desc.extent.height,
+        desc.mipLevels, desc.layers
+    };
+
+    auto hash = Fnv1a(name, strlen(name), source);
+    return Fnv1a(params, sizeof(params), hash);
+}
+
+VkDeviceSize imageCache::PackedSize(const ImageCacheDesc &desc)
+{
+    VkBufferImageCopy regions[IMAGE_CACHE_MAX_MIPS];
+    return PackedRegions(desc, regions);
+}
+
+bool imageCache::Upload(const VulkanDevice *device, VkQueue queue,
+                        const ImageCacheDesc &desc, VkImage image, const void *data)
+{
+    VkBufferImageCopy regions[IMAGE_CACHE_MAX_MIPS];
+    const auto dataSize = PackedRegions(desc, regions);
+    if(dataSize == 0)
+        return false;
+
+    VulkanBuffer transfer;
+    device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEM_FLAG_HOST_VISIBLE, dataSize, transfer, data);
+
+    VkImageSubresourceRange subresourceRange{};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.levelCount = desc.mipLevels;
+    subresourceRange.layerCount = desc.layers;
+
+    auto cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    vkTools::SetImageLayout(cmd,
+                            VK_IMAGE_LAYOUT_UNDEFINED,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            image, subresourceRange);
+
+    vkCmdCopyBufferToImage(cmd, transfer.data, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           desc.mipLevels, regions);
+
+    vkTools::SetImageLayout(cmd,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            image, subresourceRange);
+
+    device->flushCommandBuffer(cmd, queue);
+
+    transfer.destroy(device->device);
+
+    return true;
+}
+
+bool imageCache::Load(const VulkanDevice *device, VkQueue queue, uint64_t key,
+                      const ImageCacheDesc &desc, VkImage image)
+{
+    const auto dataSize = PackedSize(desc);
+    if(key == 0 || dataSize == 0)
+        return false;
+
+    char filename[64];
+    CacheFilename(key, filename);
+
+    auto file = io::Open<io::cmd::read>(filename);
+    if(!io::IsValid(file))
+    {
+        io::Close(file);
+        return false;
+    }
+
+    auto map = io::Map(file, io::access::sequential, true);
+    io::Close(file);
+
+    ImageCacheHeader header{};
+    bool valid = map.size >= sizeof(header) + dataSize;
+    if(valid)
+    {
+        memcpy(&header, map.data, sizeof(header));
+        valid = header.magic == IMAGE_CACHE_MAGIC &&
+                header.version == IMAGE_CACHE_VERSION &&
+                header.key == key &&
+                header.format == uint32_t(desc.format) &&
+                header.width == desc.extent.width &&
+                header.height == desc.extent.height &&
+                header.mipLevels == desc.mipLevels &&
+                header.layers == desc.layers &&
+                header.dataSize == dataSize;
+    }
+
+    if(valid)
+        valid = Upload(device, queue, desc, image, static_cast<const uint8_t*>(map.data) + sizeof(header));
+
+    if(map.data != nullptr)
+        io::Unmap(map);
+
+    return valid;
+}
+
+bool imageCache::Readback(const VulkanDevice *device, VkQueue queue,
+                          const ImageCacheDesc &desc, VkImage image, VulkanBuffer &buffer)
+{
+    VkBufferImageCopy regions[IMAGE_CACHE_MAX_MIPS];
+    const auto dataSize = PackedRegions(desc, regions);
+    if(dataSize == 0)
+        return false;
+
+    device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEM_FLAG_HOST_VISIBLE, dataSize, buffer);
+
+    VkImageSubresourceRange subresourceRange{};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.levelCount = desc.mipLevels;
+    subresourceRange.layerCount = desc.layers;
+
+    auto cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    vkTools::SetImageLayout(cmd,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            image, subresourceRange);
+
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           buffer.data, desc.mipLevels, regions);
+
+    // Copy results have to be made visible to the host before the fence wait returns
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = buffer.data;
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+    vkTools::SetImageLayout(cmd,
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            image, subresourceRange);
+
+    device->flushCommandBuffer(cmd, queue);
+
+    return true;
+}
+
+bool imageCache::Store(const VulkanDevice *device, VkQueue queue, uint64_t key,
+                       const ImageCacheDesc &desc, VkImage image)
+{
+    VulkanBuffer readback;
+    if(key == 0 || !Readback(device, queue, desc, image, readback))
+        return false;
+
+    ImageCacheHeader header{};
+    header.magic = IMAGE_CACHE_MAGIC;
+    header.version = IMAGE_CACHE_VERSION;
+    header.key = key;
+    header.format = uint32_t(desc.format);
+    header.width = desc.extent.width;
+    header.height = desc.extent.height;
+    header.mipLevels = desc.mipLevels;
+    header.layers = desc.layers;
+    header.dataSize = readback.size;
+
+    char filename[64], tempFilename[64];
+    CacheFilename(key, filename);
+    CacheFilename(key, tempFilename, true);
+
+    // Same as the pipeline cache, written aside, synced and swapped in so a torn entry is never
+    // picked up
+    auto file = io::Open<io::cmd::write>(tempFilename);
+    const bool written = io::IsValid(file) &&
+                         io::Write(file, sizeof(header), &header) &&
+                         io::Write(file, size_t(header.dataSize), readback.memory.mapped) &&
+                         io::Sync(file);
+    io::Close(file);
+
+    readback.destroy(device->device);
+
+    return written && io::Rename(tempFilename, filename);
+}
\ No newline at end of file
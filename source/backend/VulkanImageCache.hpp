@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../base.hpp"
+#include "VulkanDevice.hpp"
+
+// Baked images (IBL maps, lookup tables) are kept on disk between runs, keyed by a
+// hash of their source data and everything that went into generating them. An entry
+// is a header followed by every mip level tightly packed, all layers of a level together.
+
+constexpr uint32_t IMAGE_CACHE_VERSION = 2;
+constexpr uint32_t IMAGE_CACHE_MAX_MIPS = 16;
+
+struct ImageCacheDesc
+{
+    VkFormat    format;
+    VkExtent2D  extent;
+    uint32_t    mipLevels;
+    uint32_t    layers;
+};
+
+namespace imageCache
+{
+    // Hash of the whole file content, 0 if it can not be read
+    uint64_t HashFile(const char *filename);
+
+    // Bump IMAGE_CACHE_VERSION when a generator changes its output for the same inputs.
+    // A source hash of 0 (missing file) yields key 0, which is never loaded or stored
+    uint64_t Key(const char *name, const ImageCacheDesc &desc, uint64_t source = FNV1A_OFFSET);
+
+    // Bytes of every level and layer tightly packed, 0 for unsupported formats
+    VkDeviceSize PackedSize(const ImageCacheDesc &desc);
+
+    // Fills the image from data in the packed layout above. Image needs TRANSFER_DST
+    // usage, it is left in SHADER_READ_ONLY_OPTIMAL on success
+    bool Upload(const VulkanDevice *device, VkQueue queue,
+                const ImageCacheDesc &desc, VkImage image, const void *data);
+
+    // Image needs TRANSFER_DST usage, it is left in SHADER_READ_ONLY_OPTIMAL on success
+    bool Load(const VulkanDevice *device, VkQueue queue, uint64_t key,
+              const ImageCacheDesc &desc, VkImage image);
+
+    // Copies every level into a new host visible buffer in the cache's packed layout.
+    // Image needs TRANSFER_SRC usage and has to be in SHADER_READ_ONLY_OPTIMAL
+    bool Readback(const VulkanDevice *device, VkQueue queue,
+                  const ImageCacheDesc &desc, VkImage image, VulkanBuffer &buffer);
+
+    // Image needs TRANSFER_SRC usage and has to be in SHADER_READ_ONLY_OPTIMAL
+    bool Store(const VulkanDevice *device, VkQueue queue, uint64_t key,
+               const ImageCacheDesc &desc, VkImage image);
+}
\ No newline at end of file
@@ -32,6 +32,7 @@ void VulkanImgui::init(const CreateInfo &info, VkQueue queue)
 {
     quadCount = 0;
     zOrder = Z_ORDER_GUI_DEFAULT;
+    pipelineCache = info.pipelineCache;
 
     auto sb = StringBuilder();
 
@@ -55,12 +56,12 @@ void VulkanImgui::init(const CreateInfo &info, VkQueue queue)
 
         fontPixels[0][0] = 255;// White pixel for gui elements
 
-        ImageFile file{};
-        file.pixels = fontPixels[0];
-        file.extent = {STB_SOMEFONT_BITMAP_WIDTH, STB_SOMEFONT_BITMAP_HEIGHT};
-        file.format = VK_FORMAT_R8_UNORM;
-        file.bytesPerPixel = 1;
-        glyphAtlas.create(device, queue, file, false);
+        const auto file = Texture2D::wrapPixels(fontPixels[0], {STB_SOMEFONT_BITMAP_WIDTH, STB_SOMEFONT_BITMAP_HEIGHT},
+                                                VK_FORMAT_R8_UNORM, 1);
+        UploadBatch upload;
+        upload.begin(device, queue);
+        glyphAtlas.create(device, upload, file, false);
+        upload.end();
 
         delete[] fontPixels;
     }
@@ -112,7 +113,7 @@ void VulkanImgui::init(const CreateInfo &info, VkQueue queue)
         depthAttachment.samples = info.sampleCount;
 
         auto colourResolve = vkInits::attachmentDescription(info.surfaceFormat.format);
-        colourResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colourResolve.finalLayout = info.finalLayout;
         colourResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colourResolve.samples = VK_SAMPLE_COUNT_1_BIT;
 
@@ -165,16 +166,8 @@ void VulkanImgui::init(const CreateInfo &info, VkQueue queue)
 
     preparePipeline(info.sampleCount);
 
-    // Render buffers
-    device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                         MEM_FLAG_HOST_VISIBLE,
-                         GUI_MAX_QUADS * QUAD_VERTEX_COUNT * sizeof(Vertex),
-                         vertexBuffer);
-
-    device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                         MEM_FLAG_HOST_VISIBLE,
-                         GUI_MAX_QUADS * QUAD_INDEX_COUNT * sizeof(uint32_t),
-                         indexBuffer);
+    vertices = {};
+    indices = {};
 }
 
 void VulkanImgui::destroy()
@@ -182,8 +175,6 @@ void VulkanImgui::destroy()
     vkDestroyDescriptorPool(device->device, descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(device->device, setLayout, nullptr);
 
-    vertexBuffer.destroy(device->device);
-    indexBuffer.destroy(device->device);
     glyphAtlas.destroy(device->device);
 
     vkDestroyRenderPass(device->device, renderPass, nullptr);
@@ -204,10 +195,12 @@ void VulkanImgui::onWindowResize(VkSampleCountFlagBits sampleCount)
 
 void VulkanImgui::begin()
 {
-    vertexBuffer.map(device->device);
-    mappedVertices = static_cast<Vertex*>(vertexBuffer.mapped);
-    indexBuffer.map(device->device);
-    mappedIndices = static_cast<uint32_t*>(indexBuffer.mapped);
+    // Geometry goes into the frame ring buffer, room for the worst case is
+    // reserved up front and the vertex tail is handed back in end()
+    indices = frameData->allocate(GUI_MAX_QUADS * QUAD_INDEX_COUNT * sizeof(uint32_t), sizeof(uint32_t));
+    vertices = frameData->allocate(GUI_MAX_QUADS * QUAD_VERTEX_COUNT * sizeof(Vertex), 16);
+    mappedVertices = static_cast<Vertex*>(vertices.mapped);
+    mappedIndices = static_cast<uint32_t*>(indices.mapped);
 
     quadCount = 0;
     zOrder = Z_ORDER_GUI_DEFAULT;
@@ -217,8 +210,7 @@ void VulkanImgui::begin()
 
 void VulkanImgui::end()
 {
-    vertexBuffer.unmap(device->device);
-    indexBuffer.unmap(device->device);
+    frameData->trim(vertices, quadCount * QUAD_VERTEX_COUNT * sizeof(Vertex));
     mappedVertices = nullptr;
     mappedIndices = nullptr;
 }
@@ -360,14 +352,14 @@ void VulkanImgui::text(const char *cstring, vec2<float> position)
 void VulkanImgui::textInt(int32_t value, vec2<float> position)
 {
     static char buffer[256];
-    sprintf_s(buffer, "%d", value);
+    snprintf(buffer, sizeof(buffer), "%d", value);
     text(buffer, position);
 }
 
 void VulkanImgui::textFloat(float value, vec2<float> position)
 {
     static char buffer[256];
-    sprintf_s(buffer, "%f", value);
+    snprintf(buffer, sizeof(buffer), "%f", value);
     text(buffer, position);
 }
 
@@ -483,11 +475,9 @@ void VulkanImgui::recordFrame(size_t currentFrame, VkFramebuffer framebuffer)
     vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
                             0, 1, &descriptorSets[currentFrame], 0, nullptr);
 
-    const VkDeviceSize vertexOffset = 0;
-    vkCmdBindVertexBuffers(command, 0, 1, &vertexBuffer.data, &vertexOffset);
-
-    const VkDeviceSize indexOffset = 0;
-    vkCmdBindIndexBuffer(command, indexBuffer.data, indexOffset, VK_INDEX_TYPE_UINT32);
+    const auto buffer = frameData->buffer.data;
+    vkCmdBindVertexBuffers(command, 0, 1, &buffer, &vertices.offset);
+    vkCmdBindIndexBuffer(command, buffer, indices.offset, VK_INDEX_TYPE_UINT32);
 
     vkCmdDrawIndexed(command, quadCount * QUAD_INDEX_COUNT, 1, 0, 0, 0);
 
@@ -551,8 +541,7 @@ void VulkanImgui::preparePipeline(VkSampleCountFlagBits sampleCount)
     pipelineInfo.pColorBlendState = &colourBlend;
     pipelineInfo.layout = pipelineLayout;
     pipelineInfo.renderPass = renderPass;
-    vkCreateGraphicsPipelines(device->device, VK_NULL_HANDLE, 1,
-                              &pipelineInfo, nullptr, &pipeline);
+    device->createGraphicsPipeline(pipelineCache, pipelineInfo, &pipeline);
 }
 
 bool VulkanImgui::hitCheck(vec2<float> topLeft, vec2<float> bottomRight)
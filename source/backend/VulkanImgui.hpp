@@ -1,6 +1,7 @@
 #pragma once
 
 #include "VulkanDevice.hpp"
+#include "VulkanRingBuffer.hpp"
 #include "shader.hpp"
 #include "VulkanTexture.hpp"
 
@@ -19,6 +20,8 @@ public:
         VkFormat                depthFormat;
         VkSurfaceFormatKHR      surfaceFormat;
         VkSampleCountFlagBits   sampleCount;
+        VkImageLayout           finalLayout;
+        VkPipelineCache         pipelineCache;
     };
 
     struct alignas(4) Vertex
@@ -58,6 +61,7 @@ public:
     void recordFrame(size_t currentFrame, VkFramebuffer framebuffer);
 
     const VulkanDevice*     device;
+    RingBuffer*             frameData;
     VkCommandBuffer         commandBuffers[MAX_IMAGES_IN_FLIGHT];
     VkExtent2D              extent;
     bool                    buttonPressed;
@@ -86,10 +90,11 @@ private:
     VkDescriptorSet         descriptorSets[MAX_IMAGES_IN_FLIGHT];
     VkPipeline              pipeline;
     VkPipelineLayout        pipelineLayout;
+    VkPipelineCache         pipelineCache;
     VertexShader            vertexShader;
     FragmentShader          fragmentShader;
-    VulkanBuffer            vertexBuffer;
-    VulkanBuffer            indexBuffer;
+    RingAllocation          vertices;
+    RingAllocation          indices;
     Texture2D               glyphAtlas;
     Vertex*                 mappedVertices;
     uint32_t*               mappedIndices;
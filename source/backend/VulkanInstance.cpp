@@ -1,16 +1,35 @@
 #include "VulkanInstance.hpp"
+#include <stdio.h>
 
 void VulkanInstance::prepare()
 {
     platformDevice = pltf::DeviceCreate();
 
+    settings.framesInFlight = clamp(settings.framesInFlight, 1u, uint32_t(MAX_IMAGES_IN_FLIGHT));
+
     pltf::WindowCreate(platformDevice, settings.title);
 
-    auto appInfo = vkInits::applicationInfo(settings.title);
+    uint32_t surfaceExtensionCount = 0;
+    const auto surfaceExtensions = pltf::SurfaceExtensions(&surfaceExtensionCount);
+    settings.headless = settings.headless || (surfaceExtensionCount == 0);
+
+    // NOTE(arle): A 1.0 loader has no vkEnumerateInstanceVersion, 1.2 is only requested
+    // when the loader offers it so older drivers keep working without timeline semaphores
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    const auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+    if(enumerateInstanceVersion != nullptr)
+        enumerateInstanceVersion(&apiVersion);
+    apiVersion = apiVersion >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : VK_API_VERSION_1_0;
+
+    auto appInfo = vkInits::applicationInfo(settings.title, apiVersion);
     auto instanceInfo = vkInits::instanceCreateInfo();
     instanceInfo.pApplicationInfo = &appInfo;
-    instanceInfo.enabledExtensionCount = uint32_t(arraysize(RequiredExtensions));
-    instanceInfo.ppEnabledExtensionNames = RequiredExtensions;
+    if(!settings.headless)
+    {
+        instanceInfo.enabledExtensionCount = surfaceExtensionCount;
+        instanceInfo.ppEnabledExtensionNames = surfaceExtensions;
+    }
     if(settings.enValidation)
     {
         instanceInfo.enabledLayerCount = uint32_t(arraysize(ValidationLayers));
@@ -18,7 +37,9 @@ void VulkanInstance::prepare()
     }
     vkCreateInstance(&instanceInfo, 0, &m_instance);
 
-    pltf::SurfaceCreate(platformDevice, m_instance, &m_surface);
+    m_surface = VK_NULL_HANDLE;
+    if(!settings.headless)
+        pltf::SurfaceCreate(platformDevice, m_instance, &m_surface);
 
     const auto pickGpu = [this]()
     {
@@ -40,19 +61,25 @@ void VulkanInstance::prepare()
             return false;
         };
 
+        device.gpu = VK_NULL_HANDLE;
         for(size_t i = 0; i < physDeviceCount; i++)
         {
-            uint32_t extensionCount = 0;
-            vkEnumerateDeviceExtensionProperties(physDevices[i], nullptr, &extensionCount, nullptr);
-            auto availableExtensions = new VkExtensionProperties[extensionCount];
-            vkEnumerateDeviceExtensionProperties(physDevices[i], nullptr, &extensionCount, availableExtensions);
-            const bool extensionsSupported = findExtensionProperty(view(availableExtensions, extensionCount));
-            delete availableExtensions;
-
-            uint32_t formatCount = 0, presentModeCount = 0;
-            vkGetPhysicalDeviceSurfaceFormatsKHR(physDevices[i], m_surface, &formatCount, nullptr);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(physDevices[i], m_surface, &presentModeCount, nullptr);
-            const bool adequateCapabilities = (formatCount > 0) && (presentModeCount > 0);
+            // NOTE(arle): Headless devices only need a graphics queue, presentation is never used
+            bool extensionsSupported = true, adequateCapabilities = true;
+            if(!settings.headless)
+            {
+                uint32_t extensionCount = 0;
+                vkEnumerateDeviceExtensionProperties(physDevices[i], nullptr, &extensionCount, nullptr);
+                auto availableExtensions = new VkExtensionProperties[extensionCount];
+                vkEnumerateDeviceExtensionProperties(physDevices[i], nullptr, &extensionCount, availableExtensions);
+                extensionsSupported = findExtensionProperty(view(availableExtensions, extensionCount));
+                delete[] availableExtensions;
+
+                uint32_t formatCount = 0, presentModeCount = 0;
+                vkGetPhysicalDeviceSurfaceFormatsKHR(physDevices[i], m_surface, &formatCount, nullptr);
+                vkGetPhysicalDeviceSurfacePresentModesKHR(physDevices[i], m_surface, &presentModeCount, nullptr);
+                adequateCapabilities = (formatCount > 0) && (presentModeCount > 0);
+            }
 
             uint32_t propCount = 0;
             vkGetPhysicalDeviceQueueFamilyProperties(physDevices[i], &propCount, nullptr);
@@ -64,15 +91,19 @@ void VulkanInstance::prepare()
             bool hasGraphicsFamily = false, hasPresentFamily = false;
             for(uint32_t queueIndex = 0; queueIndex < propCount; queueIndex++)
             {
-                if(queueFamilyProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+                // IBL maps are baked with compute on the graphics queue
+                const VkQueueFlags graphicsFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+                if(!hasGraphicsFamily && (queueFamilyProps[queueIndex].queueFlags & graphicsFlags) == graphicsFlags)
                 {
                     hasGraphicsFamily = true;
                     device.queueBits.graphics = queueIndex;
                 }
 
                 VkBool32 presentSupport = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(physDevices[i], queueIndex, m_surface, &presentSupport);
-                if(presentSupport)
+                if(!settings.headless)
+                    vkGetPhysicalDeviceSurfaceSupportKHR(physDevices[i], queueIndex, m_surface, &presentSupport);
+
+                if(!hasPresentFamily && presentSupport)
                 {
                     hasPresentFamily = true;
                     device.queueBits.present = queueIndex;
@@ -80,7 +111,31 @@ void VulkanInstance::prepare()
                 if(hasGraphicsFamily && hasPresentFamily)
                     break;
             }
-            delete queueFamilyProps;
+
+            // Uploads go to a transfer only family (the DMA engine) when there is one, then any
+            // family that copies but does not render, the graphics queue as the last resort
+            device.queueBits.transfer = device.queueBits.graphics;
+            uint32_t transferScore = 0;
+            for(uint32_t queueIndex = 0; queueIndex < propCount; queueIndex++)
+            {
+                const auto flags = queueFamilyProps[queueIndex].queueFlags;
+                if(!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+                    continue;
+
+                const uint32_t score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+                if(score > transferScore)
+                {
+                    transferScore = score;
+                    device.queueBits.transfer = queueIndex;
+                }
+            }
+            delete[] queueFamilyProps;
+
+            if(settings.headless)
+            {
+                hasPresentFamily = hasGraphicsFamily;
+                device.queueBits.present = device.queueBits.graphics;
+            }
 
             const bool isValid = extensionsSupported && adequateCapabilities &&
                                     hasGraphicsFamily && hasPresentFamily;
@@ -90,7 +145,7 @@ void VulkanInstance::prepare()
                 break;
             }
         }
-        delete physDevices;
+        delete[] physDevices;
 
         if(device.gpu == VK_NULL_HANDLE)
             coreMessage(log_level::error, "No suitable GPU found");
@@ -99,15 +154,22 @@ void VulkanInstance::prepare()
 
     refreshCapabilities();
 
-    device.create(settings.enValidation);
+    device.create(settings.enValidation, settings.headless, apiVersion);
 
     // Queues
 
     vkGetDeviceQueue(device, device.queueBits.graphics, 0, &graphicsQueue);
     vkGetDeviceQueue(device, device.queueBits.present, 0, &m_presentQueue);
+    vkGetDeviceQueue(device, device.queueBits.transfer, 0, &transferQueue);
 
     const auto prepareSurfaceFormat = [this]()
     {
+        if(settings.headless)
+        {
+            surfaceFormat = {VK_FORMAT_R8G8B8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+            return;
+        }
+
         uint32_t count = 0;
         vkGetPhysicalDeviceSurfaceFormatsKHR(device.gpu, m_surface, &count, nullptr);
         auto surfaceFormats = new VkSurfaceFormatKHR[count];
@@ -129,43 +191,64 @@ void VulkanInstance::prepare()
     };
     prepareSurfaceFormat();
 
-    const auto preparePresentMode = [this](VkPresentModeKHR mode)
-    {
-        uint32_t count = 0;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device.gpu, m_surface, &count, nullptr);
-        auto presentModes = new VkPresentModeKHR[count];
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device.gpu, m_surface, &count, presentModes);
+    // Offscreen targets are left ready to be copied out once the frame is done
+    presentLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
-        m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
-        for(size_t i = 0; i < count; i++)
+    if(settings.headless)
+    {
+        imageCount = MAX_IMAGES_IN_FLIGHT;
+        m_swapchain = VK_NULL_HANDLE;
+        m_swapchainImages = allocate<VkImage>(imageCount);
+        m_offscreenMemory = allocate<MemoryAllocation>(imageCount);
+        prepareOffscreenTargets();
+    }
+    else
+    {
+        const auto preparePresentMode = [this](VkPresentModeKHR mode)
         {
-            if(presentModes[i] == mode)
+            uint32_t count = 0;
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device.gpu, m_surface, &count, nullptr);
+            auto presentModes = new VkPresentModeKHR[count];
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device.gpu, m_surface, &count, presentModes);
+
+            m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            for(size_t i = 0; i < count; i++)
             {
-                m_presentMode = mode;
-                break;
+                if(presentModes[i] == mode)
+                {
+                    m_presentMode = mode;
+                    break;
+                }
             }
-        }
 
-        delete presentModes;
-    };
-    preparePresentMode(static_cast<VkPresentModeKHR>(settings.syncMode));
+            delete presentModes;
+        };
+        preparePresentMode(static_cast<VkPresentModeKHR>(settings.syncMode));
 
-    prepareSwapchain(VK_NULL_HANDLE);
+        prepareSwapchain(VK_NULL_HANDLE);
 
-    // Get image count
+        // Get image count
 
-    uint32_t imageCountLocal = 0;
-    vkGetSwapchainImagesKHR(device, m_swapchain, &imageCountLocal, nullptr);
-    imageCount = imageCountLocal;
+        uint32_t imageCountLocal = 0;
+        vkGetSwapchainImagesKHR(device, m_swapchain, &imageCountLocal, nullptr);
+        imageCount = imageCountLocal;
 
-    // Allocate and aquire images
+        // Allocate and aquire images
 
-    m_swapchainImages = allocate<VkImage>(imageCount);
-    vkGetSwapchainImagesKHR(device, m_swapchain, &imageCountLocal, m_swapchainImages);
+        m_swapchainImages = allocate<VkImage>(imageCount);
+        m_offscreenMemory = nullptr;
+        vkGetSwapchainImagesKHR(device, m_swapchain, &imageCountLocal, m_swapchainImages);
+    }
 
     m_swapchainViews = allocate<VkImageView>(imageCount);
     prepareSwapchainViews();
 
+    // Fence of the frame slot last rendering into each image, the acquire order
+    // is up to the presentation engine so it does not follow currentFrame
+    m_imagesInFlight = allocate<VkFence>(imageCount);
+    for (size_t i = 0; i < imageCount; i++)
+        m_imagesInFlight[i] = VK_NULL_HANDLE;
+
     const auto prepareSampleCount = [this]()
     {
         VkPhysicalDeviceProperties props{};
@@ -223,7 +306,7 @@ void VulkanInstance::prepare()
         depthAttachment.samples = sampleCount;
 
         auto colourResolve = vkInits::attachmentDescription(surfaceFormat.format);
-        colourResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colourResolve.finalLayout = presentLayout;
         colourResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colourResolve.samples = VK_SAMPLE_COUNT_1_BIT;
 
@@ -298,13 +381,82 @@ void VulkanInstance::prepare()
     };
     prepareCommandBuffers();
 
+    // Storage and transfer source for the inputs and draw templates of GPU culling
+    constexpr auto frameDataUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    frameData.create(&device, frameDataUsage, FRAME_DATA_SIZE);
+
+    const auto prepareTimestampQueries = [this]()
+    {
+        // NOTE(arle): Without timestamp support gpuTime stays 0 and the overlap is not measured
+        m_timestampPool = VK_NULL_HANDLE;
+        if(!device.gpuProperties.limits.timestampComputeAndGraphics)
+            return;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2 * MAX_IMAGES_IN_FLIGHT;
+        vkCreateQueryPool(device, &queryPoolInfo, nullptr, &m_timestampPool);
+
+        arrayfill(m_timestampsWritten, false);
+    };
+    prepareTimestampQueries();
+
+    m_frameBegin = pltf::GetTime();
+    m_recordBegin = m_frameBegin;
+
     const auto preparePipelineCache = [this]()
     {
+        // NOTE(arle): Drivers are supposed to reject foreign data themselves, but
+        // not all of them do, so anything from another GPU or driver build is dropped here
+        const auto validateCacheData = [this](const void *data, size_t size)
+        {
+            VkPipelineCacheHeaderVersionOne header{};
+            if(size < sizeof(header))
+                return false;
+
+            memcpy(&header, data, sizeof(header));
+            return header.headerSize >= sizeof(header) && header.headerSize <= size &&
+                   header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                   header.vendorID == device.gpuProperties.vendorID &&
+                   header.deviceID == device.gpuProperties.deviceID &&
+                   memcmp(header.pipelineCacheUUID, device.gpuProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        };
+
         VkPipelineCacheCreateInfo pipelineCacheInfo{};
         pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
         pipelineCacheInfo.pInitialData = VK_NULL_HANDLE;
         pipelineCacheInfo.initialDataSize = 0;
-        vkCreatePipelineCache(device, &pipelineCacheInfo, nullptr, &pipelineCache);
+
+        io::file_map cacheData = {};
+        auto file = io::Open<io::cmd::read>(PIPELINE_CACHE_FILE);
+        if(io::IsValid(file))
+        {
+            cacheData = io::Map(file, io::access::sequential, true);
+            if(validateCacheData(cacheData.data, cacheData.size))
+            {
+                pipelineCacheInfo.pInitialData = cacheData.data;
+                pipelineCacheInfo.initialDataSize = cacheData.size;
+            }
+            else
+            {
+                coreMessage(log_level::warning, "Pipeline cache was written by a different device or driver, ignoring it");
+            }
+        }
+        io::Close(file);
+
+        if(vkCreatePipelineCache(device, &pipelineCacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+        {
+            pipelineCacheInfo.pInitialData = VK_NULL_HANDLE;
+            pipelineCacheInfo.initialDataSize = 0;
+            vkCreatePipelineCache(device, &pipelineCacheInfo, nullptr, &pipelineCache);
+        }
+        m_pipelineCacheLoaded = pipelineCacheInfo.initialDataSize;
+
+        if(cacheData.data != nullptr)
+            io::Unmap(cacheData);
     };
     preparePipelineCache();
 
@@ -331,8 +483,14 @@ void VulkanInstance::prepare()
 
 void VulkanInstance::destroy()
 {
+    savePipelineCache();
     vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
+    if(m_timestampPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(device, m_timestampPool, nullptr);
+
+    frameData.destroy(device);
+
     for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
     {
         vkDestroyFence(device, m_sync.inFlightFences[i], nullptr);
@@ -347,19 +505,31 @@ void VulkanInstance::destroy()
 
     vkDestroyImage(device, m_depth.image, nullptr);
     vkDestroyImageView(device, m_depth.view, nullptr);
-    vkFreeMemory(device, m_depth.memory, nullptr);
+    m_depth.memory.release();
 
     vkDestroyImage(device, m_msaa.image, nullptr);
     vkDestroyImageView(device, m_msaa.view, nullptr);
-    vkFreeMemory(device, m_msaa.memory, nullptr);
+    m_msaa.memory.release();
 
     for (size_t i = 0; i < imageCount; i++)
         vkDestroyImageView(device, m_swapchainViews[i], nullptr);
 
-    vkDestroySwapchainKHR(device, m_swapchain, nullptr);
+    if(settings.headless)
+    {
+        for (size_t i = 0; i < imageCount; i++)
+        {
+            vkDestroyImage(device, m_swapchainImages[i], nullptr);
+            m_offscreenMemory[i].release();
+        }
+    }
+    else
+    {
+        vkDestroySwapchainKHR(device, m_swapchain, nullptr);
+    }
 
     device.destroy();
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    if(m_surface != VK_NULL_HANDLE)
+        vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
     vkDestroyInstance(m_instance, nullptr);
 
     pltf::DeviceDestroy(platformDevice);
@@ -376,25 +546,39 @@ void VulkanInstance::onResize()
 
     vkDestroyImage(device, m_depth.image, nullptr);
     vkDestroyImageView(device, m_depth.view, nullptr);
-    vkFreeMemory(device, m_depth.memory, nullptr);
+    m_depth.memory.release();
 
     vkDestroyImage(device, m_msaa.image, nullptr);
     vkDestroyImageView(device, m_msaa.view, nullptr);
-    vkFreeMemory(device, m_msaa.memory, nullptr);
+    m_msaa.memory.release();
 
     for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
         vkResetCommandBuffer(commandBuffers[i], VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 
-    auto oldSwapchain = m_swapchain;
-    prepareSwapchain(oldSwapchain);
+    for (size_t i = 0; i < imageCount; i++)
+        m_imagesInFlight[i] = VK_NULL_HANDLE;
 
     for (size_t i = 0; i < imageCount; i++)
         vkDestroyImageView(device, m_swapchainViews[i], nullptr);
 
-    vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+    if(settings.headless)
+    {
+        for (size_t i = 0; i < imageCount; i++)
+        {
+            vkDestroyImage(device, m_swapchainImages[i], nullptr);
+            m_offscreenMemory[i].release();
+        }
+        prepareOffscreenTargets();
+    }
+    else
+    {
+        auto oldSwapchain = m_swapchain;
+        prepareSwapchain(oldSwapchain);
+        vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
 
-    auto imageCountLocal = uint32_t(imageCount);
-    vkGetSwapchainImagesKHR(device, m_swapchain, &imageCountLocal, m_swapchainImages);
+        auto imageCountLocal = uint32_t(imageCount);
+        vkGetSwapchainImagesKHR(device, m_swapchain, &imageCountLocal, m_swapchainImages);
+    }
 
     prepareSwapchainViews();
     prepareDepth();
@@ -404,27 +588,69 @@ void VulkanInstance::onResize()
 
 void VulkanInstance::prepareFrame()
 {
-    currentFrame = (currentFrame + 1) % MAX_IMAGES_IN_FLIGHT;
-    vkQueueWaitIdle(graphicsQueue);
+    const auto frameBegin = pltf::GetTime();
+    frameStats.frameTime = frameBegin - m_frameBegin;
+    m_frameBegin = frameBegin;
 
+    // NOTE(arle): Only the fence of the slot about to be reused is waited on, the
+    // other frames in flight keep the GPU busy while this one is being recorded
+    currentFrame = (currentFrame + 1) % settings.framesInFlight;
     vkWaitForFences(device, 1, &m_sync.inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+
+    if(settings.headless)
+    {
+        // Offscreen targets are owned by the frame slot, nothing to acquire
+        imageIndex = uint32_t(currentFrame);
+        resizeRequired = false;
+    }
+    else
+    {
+        auto result = vkAcquireNextImageKHR(device,
+                                            m_swapchain,
+                                            UINT64_MAX,
+                                            m_sync.imageAvailableSPs[currentFrame],
+                                            VK_NULL_HANDLE,
+                                            &imageIndex);
+
+        resizeRequired = (result == VK_ERROR_OUT_OF_DATE_KHR);
+
+        // The image may still be in use by a different slot when there are more
+        // images than frames in flight
+        const auto imageFence = m_imagesInFlight[imageIndex];
+        if(imageFence != VK_NULL_HANDLE && imageFence != m_sync.inFlightFences[currentFrame])
+            vkWaitForFences(device, 1, &imageFence, VK_TRUE, UINT64_MAX);
+
+        m_imagesInFlight[imageIndex] = m_sync.inFlightFences[currentFrame];
+    }
+
     vkResetFences(device, 1, &m_sync.inFlightFences[currentFrame]);
-    auto result = vkAcquireNextImageKHR(device,
-                                        m_swapchain,
-                                        UINT64_MAX,
-                                        m_sync.imageAvailableSPs[currentFrame],
-                                        VK_NULL_HANDLE,
-                                        &imageIndex);
-
-    resizeRequired = (result == VK_ERROR_OUT_OF_DATE_KHR);
+    frameData.beginFrame(currentFrame);
+
+    m_recordBegin = pltf::GetTime();
+    frameStats.waitTime = m_recordBegin - frameBegin;
+
+    updateFrameStats();
 }
 
 void VulkanInstance::submitFrame()
 {
+    frameStats.cpuTime = pltf::GetTime() - m_recordBegin;
+
     const VkSemaphore imageAvailableSPs[] = {m_sync.imageAvailableSPs[currentFrame]};
     const VkSemaphore renderFinishedSPs[] = {m_sync.renderFinishedSPs[currentFrame]};
     const VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
+    if(settings.headless)
+    {
+        submitInfo.waitSemaphoreCount = 0;
+        submitInfo.pWaitSemaphores = nullptr;
+        submitInfo.signalSemaphoreCount = 0;
+        submitInfo.pSignalSemaphores = nullptr;
+        submitInfo.pWaitDstStageMask = nullptr;
+        vkQueueSubmit(graphicsQueue, 1, &submitInfo, m_sync.inFlightFences[currentFrame]);
+        return;
+    }
+
     submitInfo.waitSemaphoreCount = uint32_t(arraysize(imageAvailableSPs));
     submitInfo.pWaitSemaphores = imageAvailableSPs;
     submitInfo.signalSemaphoreCount = uint32_t(arraysize(renderFinishedSPs));
@@ -446,6 +672,51 @@ void VulkanInstance::submitFrame()
     }
 }
 
+void VulkanInstance::beginGpuTimer(VkCommandBuffer cmdBuffer)
+{
+    if(m_timestampPool == VK_NULL_HANDLE)
+        return;
+
+    const auto query = uint32_t(2 * currentFrame);
+    vkCmdResetQueryPool(cmdBuffer, m_timestampPool, query, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, query);
+}
+
+void VulkanInstance::endGpuTimer(VkCommandBuffer cmdBuffer)
+{
+    if(m_timestampPool == VK_NULL_HANDLE)
+        return;
+
+    const auto query = uint32_t(2 * currentFrame + 1);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, query);
+    m_timestampsWritten[currentFrame] = true;
+}
+
+void VulkanInstance::updateFrameStats()
+{
+    // Timestamps of this slot belong to the frame its fence just released
+    if(m_timestampPool != VK_NULL_HANDLE && m_timestampsWritten[currentFrame])
+    {
+        uint64_t timestamps[2] = {};
+        const auto result = vkGetQueryPoolResults(device, m_timestampPool, uint32_t(2 * currentFrame), 2,
+                                                  sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                                  VK_QUERY_RESULT_64_BIT);
+        if(result == VK_SUCCESS)
+        {
+            const auto period = double(device.gpuProperties.limits.timestampPeriod);
+            frameStats.gpuTime = double(timestamps[1] - timestamps[0]) * period * 1e-9;
+        }
+    }
+
+    // Serial execution makes the frame cost cpu + gpu, perfect pipelining max(cpu, gpu)
+    const auto shorter = frameStats.cpuTime < frameStats.gpuTime ? frameStats.cpuTime : frameStats.gpuTime;
+    if(shorter > 0.0)
+    {
+        const auto hidden = frameStats.cpuTime + frameStats.gpuTime - frameStats.frameTime;
+        frameStats.overlap = clamp(hidden / shorter, 0.0, 1.0);
+    }
+}
+
 VkResult VulkanInstance::prepareSwapchain(VkSwapchainKHR oldSwapchain)
 {
     auto info = vkInits::swapchainCreateInfo(oldSwapchain);
@@ -479,6 +750,51 @@ VkResult VulkanInstance::prepareSwapchain(VkSwapchainKHR oldSwapchain)
     return vkCreateSwapchainKHR(device, &info, nullptr, &m_swapchain);
 }
 
+void VulkanInstance::prepareOffscreenTargets()
+{
+    for (size_t i = 0; i < imageCount; i++)
+    {
+        auto imageInfo = vkInits::imageCreateInfo();
+        imageInfo.extent = {extent.width, extent.height, 1};
+        imageInfo.format = surfaceFormat.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        vkCreateImage(device, &imageInfo, nullptr, &m_swapchainImages[i]);
+
+        m_offscreenMemory[i] = device.allocateImageMemory(m_swapchainImages[i], MEM_FLAG_GPU_LOCAL);
+    }
+}
+
+void VulkanInstance::reportPipelineStats()
+{
+    char line[256];
+    snprintf(line, sizeof(line), "Pipelines: %u created in %.2f ms with a %s cache (%zu bytes loaded)",
+             device.pipelineStats.count, device.pipelineStats.seconds * 1000.0,
+             m_pipelineCacheLoaded > 0 ? "warm" : "cold", m_pipelineCacheLoaded);
+    coreMessage(log_level::info, line);
+}
+
+void VulkanInstance::savePipelineCache()
+{
+    size_t size = 0;
+    if(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+        return;
+
+    auto data = new uint8_t[size];
+    if(vkGetPipelineCacheData(device, pipelineCache, &size, data) == VK_SUCCESS)
+    {
+        // Written next to the old cache, synced and swapped in, a crash mid-write never leaves
+        // a torn file under the final name
+        auto file = io::Open<io::cmd::write>(PIPELINE_CACHE_TEMP_FILE);
+        const bool written = io::IsValid(file) && io::Write(file, size, data) && io::Sync(file);
+        io::Close(file);
+
+        if(!written || !io::Rename(PIPELINE_CACHE_TEMP_FILE, PIPELINE_CACHE_FILE))
+            coreMessage(log_level::warning, "Failed to write the pipeline cache");
+    }
+    delete[] data;
+}
+
 void VulkanInstance::prepareSwapchainViews()
 {
     for (size_t i = 0; i < imageCount; i++)
@@ -502,12 +818,7 @@ void VulkanInstance::prepareMsaa()
     msaaInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     vkCreateImage(device, &msaaInfo, nullptr, &m_msaa.image);
 
-    VkMemoryRequirements memReqs{};
-    vkGetImageMemoryRequirements(device, m_msaa.image, &memReqs);
-
-    auto allocInfo = device.getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-    vkAllocateMemory(device, &allocInfo, nullptr, &m_msaa.memory);
-    vkBindImageMemory(device, m_msaa.image, m_msaa.memory, 0);
+    m_msaa.memory = device.allocateImageMemory(m_msaa.image, MEM_FLAG_GPU_LOCAL);
 
     auto viewInfo = vkInits::imageViewCreateInfo();
     viewInfo.image = m_msaa.image;
@@ -526,12 +837,7 @@ void VulkanInstance::prepareDepth()
     depthInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     vkCreateImage(device, &depthInfo, nullptr, &m_depth.image);
 
-    VkMemoryRequirements memReqs{};
-    vkGetImageMemoryRequirements(device, m_depth.image, &memReqs);
-
-    auto allocInfo = device.getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-    vkAllocateMemory(device, &allocInfo, nullptr, &m_depth.memory);
-    vkBindImageMemory(device, m_depth.image, m_depth.memory, 0);
+    m_depth.memory = device.allocateImageMemory(m_depth.image, MEM_FLAG_GPU_LOCAL);
 
     auto viewInfo = vkInits::imageViewCreateInfo();
     viewInfo.image = m_depth.image;
@@ -563,6 +869,13 @@ void VulkanInstance::prepareFramebuffers()
 
 void VulkanInstance::refreshCapabilities()
 {
+    if(settings.headless)
+    {
+        extent = {uint32_t(VIEWPORT_SIZE_X), uint32_t(VIEWPORT_SIZE_Y)};
+        aspectRatio = float(extent.width) / float(extent.height);
+        return;
+    }
+
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device.gpu, m_surface, &m_capabilities);
 
     // Ask for one more image and clamp to max
@@ -2,8 +2,16 @@
 
 #include "vulkan_initialisers.hpp"
 #include "VulkanDevice.hpp"
+#include "VulkanRingBuffer.hpp"
 #include "storage.hpp"
 
+constexpr auto PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+constexpr auto PIPELINE_CACHE_TEMP_FILE = "pipeline_cache.bin.tmp";
+
+// Per frame budget for uniforms, dynamic geometry and instance streams in the frame ring
+// buffer. A 100 x 100 instance grid takes about 0.7 MB when all of it is in view
+constexpr VkDeviceSize FRAME_DATA_SIZE = MegaBytes(2);
+
 enum class VSyncMode
 {
     Off             = VK_PRESENT_MODE_IMMEDIATE_KHR,
@@ -16,6 +24,17 @@ struct VulkanInstanceSettings
     const char*         title;
     bool                enValidation;
     VSyncMode           syncMode;
+    bool                headless;       // Render into offscreen targets, no surface or swapchain
+    uint32_t            framesInFlight; // Frames the CPU may record ahead of the GPU, 1..MAX_IMAGES_IN_FLIGHT
+};
+
+struct FrameStats
+{
+    double              cpuTime;        // Recording, from fence release to submit
+    double              gpuTime;        // Timestamped command buffer execution
+    double              waitTime;       // Blocked on the frame fence and image acquire
+    double              frameTime;      // Between consecutive prepareFrame calls
+    double              overlap;        // Share of the shorter of cpu/gpu hidden behind the other, 0..1
 };
 
 struct SyncData
@@ -29,7 +48,7 @@ struct ImageResource
 {
     VkImage             image;
     VkImageView         view;
-    VkDeviceMemory      memory;
+    MemoryAllocation    memory;
 };
 
 class VulkanInstance : public linear_storage
@@ -41,6 +60,7 @@ public:
         imageCount = 0;
         imageIndex = 0;
         currentFrame = 1;
+        frameStats = {};
     }
 
 protected:
@@ -49,6 +69,9 @@ protected:
     void onResize();
     void prepareFrame();
     void submitFrame();
+    void beginGpuTimer(VkCommandBuffer cmdBuffer);
+    void endGpuTimer(VkCommandBuffer cmdBuffer);
+    void reportPipelineStats();
 
     // Settings
 
@@ -62,6 +85,7 @@ protected:
     VkFormat                    depthFormat;
     VkSampleCountFlagBits       sampleCount;
     VkSurfaceFormatKHR          surfaceFormat;
+    VkImageLayout               presentLayout;
     VkExtent2D                  extent;
     float                       aspectRatio;
     bool                        resizeRequired;
@@ -72,19 +96,25 @@ protected:
     VkSubmitInfo                submitInfo;
     VkPresentInfoKHR            presentInfo;
     VkQueue                     graphicsQueue;
+    VkQueue                     transferQueue;  // Same as graphicsQueue without a separate family
     VkFramebuffer*              framebuffers;
     VkRenderPass                renderPass;
     VkPipelineCache             pipelineCache;
+    FrameStats                  frameStats;
+    RingBuffer                  frameData;
 
 private:
     void pickPhysicalDevice();
     void getSwapchainImages();
     VkResult prepareSwapchain(VkSwapchainKHR oldSwapchain);
     void prepareSwapchainViews();
+    void prepareOffscreenTargets();
     void prepareMsaa();
     void prepareDepth();
     void prepareFramebuffers();
     void refreshCapabilities();
+    void updateFrameStats();
+    void savePipelineCache();
 
     VkInstance                  m_instance;
     VkSurfaceKHR                m_surface;
@@ -94,7 +124,14 @@ private:
     VkSwapchainKHR              m_swapchain;
     VkImage*                    m_swapchainImages;
     VkImageView*                m_swapchainViews;
+    MemoryAllocation*           m_offscreenMemory;
     SyncData                    m_sync;
+    VkFence*                    m_imagesInFlight;
+    VkQueryPool                 m_timestampPool;
+    bool                        m_timestampsWritten[MAX_IMAGES_IN_FLIGHT];
+    double                      m_frameBegin;
+    double                      m_recordBegin;
+    size_t                      m_pipelineCacheLoaded;
     ImageResource               m_msaa;
     ImageResource               m_depth;
     VkDescriptorPool            m_descriptorPool;
@@ -0,0 +1,347 @@
+#include "VulkanMemory.hpp"
+#include <stdio.h>
+
+// Orders are counted in leaves, order 0 is MEMORY_LEAF_SIZE and the root of a
+// block is MEMORY_BLOCK_SIZE. Every tree node stores the largest free order in
+// its subtree plus one, 0 meaning nothing is free below it.
+
+constexpr uint32_t LogTwo(VkDeviceSize value)
+{
+    uint32_t result = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        result++;
+    }
+    return result;
+}
+
+constexpr uint32_t MAX_ORDER = LogTwo(MEMORY_BLOCK_SIZE / MEMORY_LEAF_SIZE);
+constexpr size_t TREE_NODE_COUNT = (size_t(2) << MAX_ORDER) - 1;
+
+struct MemoryBlock
+{
+    VulkanMemory*   owner;
+    MemoryBlock*    next;
+    VkDeviceMemory  memory;
+    VkDeviceSize    size;
+    void*           mapped;
+    uint8_t*        longest;        // Buddy tree, null for dedicated allocations
+    uint32_t        memoryTypeIndex;
+    MemoryPool      pool;
+    uint32_t        allocationCount;
+    VkDeviceSize    requestedBytes;
+    VkDeviceSize    reservedBytes;  // Requested sizes rounded up to their buddy range
+};
+
+static uint32_t NodeOrder(size_t index)
+{
+    return MAX_ORDER - LogTwo(VkDeviceSize(index + 1));
+}
+
+static uint32_t OrderOf(VkDeviceSize size)
+{
+    const auto leaves = (size + MEMORY_LEAF_SIZE - 1) / MEMORY_LEAF_SIZE;
+    auto order = LogTwo(leaves);
+    if((VkDeviceSize(1) << order) < leaves)
+        order++;
+    return order;
+}
+
+static void UpdateParents(uint8_t *longest, size_t index)
+{
+    while (index > 0)
+    {
+        index = (index - 1) / 2;
+        const auto left = longest[2 * index + 1];
+        const auto right = longest[2 * index + 2];
+        const auto childFree = uint8_t(NodeOrder(2 * index + 1) + 1);
+
+        // Two free buddies merge back into their parent
+        longest[index] = (left == childFree && right == childFree) ? uint8_t(childFree + 1) :
+                                                                       max(left, right);
+    }
+}
+
+static bool BuddyAllocate(uint8_t *longest, uint32_t order, VkDeviceSize *pOffset)
+{
+    if(longest[0] < order + 1)
+        return false;
+
+    size_t index = 0;
+    for (auto nodeOrder = MAX_ORDER; nodeOrder != order; nodeOrder--)
+    {
+        const auto left = 2 * index + 1;
+        index = (longest[left] >= order + 1) ? left : left + 1;
+    }
+
+    longest[index] = 0;
+    UpdateParents(longest, index);
+
+    const auto firstAtDepth = (size_t(1) << (MAX_ORDER - order)) - 1;
+    *pOffset = VkDeviceSize(index - firstAtDepth) * (MEMORY_LEAF_SIZE << order);
+    return true;
+}
+
+static void BuddyFree(uint8_t *longest, uint32_t order, VkDeviceSize offset)
+{
+    const auto firstAtDepth = (size_t(1) << (MAX_ORDER - order)) - 1;
+    const auto index = firstAtDepth + size_t(offset / (MEMORY_LEAF_SIZE << order));
+
+    longest[index] = uint8_t(order + 1);
+    UpdateParents(longest, index);
+}
+
+void MemoryAllocation::release()
+{
+    if(block != nullptr)
+        block->owner->free(*this);
+}
+
+void VulkanMemory::create(VkPhysicalDevice gpu, VkDevice device)
+{
+    m_device = device;
+    m_deviceAllocations = 0;
+    vkGetPhysicalDeviceMemoryProperties(gpu, &m_memProps);
+
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(gpu, &props);
+    m_maxAllocations = props.limits.maxMemoryAllocationCount;
+
+    for (size_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        for (size_t pool = 0; pool < size_t(MemoryPool::Count); pool++)
+            m_blocks[i][pool] = nullptr;
+    }
+}
+
+void VulkanMemory::destroy()
+{
+    for (size_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        for (size_t pool = 0; pool < size_t(MemoryPool::Count); pool++)
+        {
+            auto block = m_blocks[i][pool];
+            while (block != nullptr)
+            {
+                auto next = block->next;
+                destroyBlock(block);
+                block = next;
+            }
+            m_blocks[i][pool] = nullptr;
+        }
+    }
+}
+
+MemoryAllocation VulkanMemory::allocate(uint32_t memoryTypeIndex, VkMemoryRequirements memReqs, MemoryPool pool)
+{
+    MemoryAllocation allocation{};
+    auto &head = m_blocks[memoryTypeIndex][size_t(pool)];
+
+    // Buddy ranges are aligned to their own size, so a large enough order covers the alignment
+    const auto alignedSize = max(memReqs.size, memReqs.alignment);
+    const auto order = OrderOf(alignedSize);
+
+    VkDeviceSize offset = 0;
+    MemoryBlock *block = nullptr;
+
+    // NOTE(arle): Resources this large would waste most of a block to rounding, give them their own memory
+    if(alignedSize <= MEMORY_BLOCK_SIZE / 2)
+    {
+        for (block = head; block != nullptr; block = block->next)
+        {
+            if(block->longest != nullptr && BuddyAllocate(block->longest, order, &offset))
+                break;
+        }
+
+        if(block == nullptr)
+        {
+            block = createBlock(memoryTypeIndex, MEMORY_BLOCK_SIZE, false);
+            if(block != nullptr)
+            {
+                block->pool = pool;
+                block->next = head;
+                head = block;
+                BuddyAllocate(block->longest, order, &offset);
+            }
+        }
+    }
+
+    // Dedicated, either by size or because the heap could not fit a whole block
+    if(block == nullptr)
+    {
+        block = createBlock(memoryTypeIndex, memReqs.size, true);
+        if(block == nullptr)
+            return allocation;
+
+        block->pool = pool;
+        block->next = head;
+        head = block;
+
+        block->allocationCount = 1;
+        block->requestedBytes = memReqs.size;
+        block->reservedBytes = memReqs.size;
+
+        allocation.memory = block->memory;
+        allocation.offset = 0;
+        allocation.size = memReqs.size;
+        allocation.mapped = block->mapped;
+        allocation.block = block;
+        allocation.order = 0;
+        return allocation;
+    }
+
+    block->allocationCount++;
+    block->requestedBytes += memReqs.size;
+    block->reservedBytes += MEMORY_LEAF_SIZE << order;
+
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.size = memReqs.size;
+    allocation.mapped = block->mapped ? static_cast<uint8_t*>(block->mapped) + offset : nullptr;
+    allocation.block = block;
+    allocation.order = order;
+    return allocation;
+}
+
+void VulkanMemory::free(MemoryAllocation &allocation)
+{
+    auto block = allocation.block;
+    if(block == nullptr)
+        return;
+
+    if(block->longest != nullptr)
+    {
+        BuddyFree(block->longest, allocation.order, allocation.offset);
+        block->reservedBytes -= MEMORY_LEAF_SIZE << allocation.order;
+    }
+    else
+    {
+        block->reservedBytes -= allocation.size;
+    }
+    block->requestedBytes -= allocation.size;
+    block->allocationCount--;
+
+    allocation = {};
+
+    if(block->allocationCount > 0)
+        return;
+
+    // Keep the last empty block of a pool around, staging buffers come and go constantly
+    auto link = &m_blocks[block->memoryTypeIndex][size_t(block->pool)];
+    const bool onlyBlock = (*link == block) && (block->next == nullptr);
+    if(block->longest != nullptr && onlyBlock)
+        return;
+
+    while (*link != block)
+        link = &(*link)->next;
+
+    *link = block->next;
+    destroyBlock(block);
+}
+
+void VulkanMemory::dumpStats(log_message_callback message) const
+{
+    char line[256];
+    VkDeviceSize totalRequested = 0, totalSize = 0;
+
+    for (uint32_t i = 0; i < m_memProps.memoryTypeCount; i++)
+    {
+        for (size_t pool = 0; pool < size_t(MemoryPool::Count); pool++)
+        {
+            uint32_t blockCount = 0, dedicatedCount = 0, allocationCount = 0;
+            VkDeviceSize size = 0, requested = 0, reserved = 0, largestFree = 0;
+
+            for (auto block = m_blocks[i][pool]; block != nullptr; block = block->next)
+            {
+                blockCount++;
+                dedicatedCount += (block->longest == nullptr) ? 1 : 0;
+                allocationCount += block->allocationCount;
+                size += block->size;
+                requested += block->requestedBytes;
+                reserved += block->reservedBytes;
+
+                if(block->longest != nullptr && block->longest[0] > 0)
+                    largestFree = max(largestFree, MEMORY_LEAF_SIZE << (block->longest[0] - 1));
+            }
+
+            if(blockCount == 0)
+                continue;
+
+            // Fragmentation: share of the free bytes not reachable by the largest single allocation
+            const auto freeBytes = size - reserved;
+            const auto fragmentation = freeBytes > 0 ? 1.0 - double(largestFree) / double(freeBytes) : 0.0;
+
+            snprintf(line, sizeof(line),
+                     "Memory type %u (%s, flags 0x%x): %u blocks (%u dedicated), %u allocations, "
+                     "%.2f/%.2f MiB used, %.2f MiB lost to rounding, %.1f%% fragmented",
+                     i, pool == size_t(MemoryPool::Linear) ? "linear" : "optimal",
+                     m_memProps.memoryTypes[i].propertyFlags, blockCount, dedicatedCount, allocationCount,
+                     double(requested) / double(MegaBytes(1)), double(size) / double(MegaBytes(1)),
+                     double(reserved - requested) / double(MegaBytes(1)), fragmentation * 100.0);
+            message(log_level::info, line);
+
+            totalRequested += requested;
+            totalSize += size;
+        }
+    }
+
+    snprintf(line, sizeof(line),
+             "Device memory: %u/%u vkAllocateMemory calls, %.2f MiB in blocks, %.2f MiB requested, %.2f MiB unused",
+             m_deviceAllocations, m_maxAllocations, double(totalSize) / double(MegaBytes(1)),
+             double(totalRequested) / double(MegaBytes(1)),
+             double(totalSize - totalRequested) / double(MegaBytes(1)));
+    message(log_level::info, line);
+}
+
+MemoryBlock *VulkanMemory::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated)
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+        return nullptr;
+
+    m_deviceAllocations++;
+
+    auto block = new MemoryBlock;
+    block->owner = this;
+    block->next = nullptr;
+    block->memory = memory;
+    block->size = size;
+    block->mapped = nullptr;
+    block->longest = nullptr;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->pool = MemoryPool::Linear;
+    block->allocationCount = 0;
+    block->requestedBytes = 0;
+    block->reservedBytes = 0;
+
+    // Host visible memory stays mapped for the lifetime of the block
+    if(m_memProps.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+
+    if(!dedicated)
+    {
+        block->longest = new uint8_t[TREE_NODE_COUNT];
+        for (size_t i = 0; i < TREE_NODE_COUNT; i++)
+            block->longest[i] = uint8_t(NodeOrder(i) + 1);
+    }
+
+    return block;
+}
+
+void VulkanMemory::destroyBlock(MemoryBlock *block)
+{
+    if(block->mapped != nullptr)
+        vkUnmapMemory(m_device, block->memory);
+
+    vkFreeMemory(m_device, block->memory, nullptr);
+    m_deviceAllocations--;
+
+    delete[] block->longest;
+    delete block;
+}
\ No newline at end of file
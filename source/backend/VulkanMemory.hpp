@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../base.hpp"
+#include "vulkan_initialisers.hpp"
+
+// Device memory is carved out of large blocks with a buddy allocator, one set of
+// blocks per memory type. Buffers/linear images and optimal images never share a
+// block, which keeps every allocation clear of bufferImageGranularity conflicts.
+
+constexpr VkDeviceSize MEMORY_BLOCK_SIZE = MegaBytes(64);
+constexpr VkDeviceSize MEMORY_LEAF_SIZE = 256;
+
+enum class MemoryPool : uint32_t
+{
+    Linear,     // Buffers and linear tiled images
+    Optimal,    // Optimal tiled images
+    Count
+};
+
+struct MemoryBlock;
+
+struct MemoryAllocation
+{
+    void release();
+
+    VkDeviceMemory  memory;
+    VkDeviceSize    offset;
+    VkDeviceSize    size;       // Requested size, the buddy range is 2^order leaves
+    void*           mapped;     // Persistent mapping at offset, null if the memory is not host visible
+    MemoryBlock*    block;
+    uint32_t        order;
+};
+
+class VulkanMemory
+{
+public:
+    void create(VkPhysicalDevice gpu, VkDevice device);
+    void destroy();
+
+    MemoryAllocation allocate(uint32_t memoryTypeIndex, VkMemoryRequirements memReqs, MemoryPool pool);
+    void free(MemoryAllocation &allocation);
+
+    // Blocks, fragmentation and wasted bytes per memory type
+    void dumpStats(log_message_callback message) const;
+
+private:
+    MemoryBlock *createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated);
+    void destroyBlock(MemoryBlock *block);
+
+    VkDevice                            m_device;
+    VkPhysicalDeviceMemoryProperties    m_memProps;
+    uint32_t                            m_maxAllocations;
+    uint32_t                            m_deviceAllocations;
+    MemoryBlock*                        m_blocks[VK_MAX_MEMORY_TYPES][size_t(MemoryPool::Count)];
+};
\ No newline at end of file
@@ -1,51 +1,188 @@
 #include "VulkanModels.hpp"
+#include "mesh_import.hpp"
+#include <string.h>
 
-void ModelBase::draw(VkCommandBuffer cmd)
+void ModelBase::draw(VkCommandBuffer cmd, material_bind bindMaterial, void *userData, uint32_t instanceCount)
 {
-    const VkDeviceSize vertexOffset = 0;
-    vkCmdBindVertexBuffers(cmd, 0, 1, &m_vertices.data, &vertexOffset);
+    const auto &mesh = m_registry->range(m_mesh);
+    if(m_primitiveCount == 0)
+    {
+        vkCmdDrawIndexed(cmd, m_indexCount, instanceCount, mesh.firstIndex, mesh.vertexOffset, 0);
+        return;
+    }
+
+    int32_t boundMaterial = INT32_MIN;
+    for (uint32_t i = 0; i < m_primitiveCount; i++)
+    {
+        const auto &primitive = m_primitives[i];
+        if(bindMaterial && primitive.material != boundMaterial)
+        {
+            bindMaterial(cmd, primitive.material, userData);
+            boundMaterial = primitive.material;
+        }
+        vkCmdDrawIndexed(cmd, primitive.indexCount, instanceCount, mesh.firstIndex + primitive.firstIndex,
+                         mesh.vertexOffset + primitive.vertexOffset, 0);
+    }
+}
+
+void ModelBase::writeDrawCommands(VkDrawIndexedIndirectCommand *commands, uint32_t instanceCount) const
+{
+    const auto &mesh = m_registry->range(m_mesh);
+    if(m_primitiveCount == 0)
+    {
+        commands[0] = {m_indexCount, instanceCount, mesh.firstIndex, mesh.vertexOffset, 0};
+        return;
+    }
+
+    for (uint32_t i = 0; i < m_primitiveCount; i++)
+    {
+        const auto &primitive = m_primitives[i];
+        commands[i] = {primitive.indexCount, instanceCount, mesh.firstIndex + primitive.firstIndex,
+                       mesh.vertexOffset + primitive.vertexOffset, 0};
+    }
+}
+
+void ModelBase::drawIndirect(VkCommandBuffer cmd, VkBuffer commands, VkDeviceSize offset,
+                             VkBuffer countBuffer, VkDeviceSize countOffset, bool multiDraw)
+{
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const uint32_t commandCount = drawCommandCount();
+    if(countBuffer != VK_NULL_HANDLE)
+    {
+        vkCmdDrawIndexedIndirectCount(cmd, commands, offset, countBuffer, countOffset, commandCount, stride);
+        return;
+    }
+
+    if(multiDraw)
+    {
+        vkCmdDrawIndexedIndirect(cmd, commands, offset, commandCount, stride);
+        return;
+    }
+
+    for (uint32_t i = 0; i < commandCount; i++)
+        vkCmdDrawIndexedIndirect(cmd, commands, offset + i * stride, 1, stride);
+}
+
+void ModelBase::destroy()
+{
+    if(m_registry != nullptr)
+        m_registry->free(m_mesh);
+    m_registry = nullptr;
+    m_mesh = INVALID_MESH;
+
+    delete[] m_primitives;
+    m_primitives = nullptr;
+    m_primitiveCount = 0;
+}
+
+void ModelBase::stageMesh(MeshRegistry &registry, UploadBatch &upload, uint32_t vertexCount,
+                          uint32_t indexCount, void *&vertices, Index *&indices)
+{
+    m_registry = &registry;
+    m_mesh = registry.allocate(upload, vertexCount, indexCount, vertices, indices);
+    m_indexCount = indexCount;
+}
+
+void Model3D::drawInstances(VkCommandBuffer cmd, const InstanceStreams &instances,
+                            material_bind bindMaterial, void *userData)
+{
+    if(instances.count == 0)
+        return;
+
+    bindInstances(cmd, instances);
+    draw(cmd, bindMaterial, userData, instances.count);
+}
+
+void Model3D::bindInstances(VkCommandBuffer cmd, const InstanceStreams &instances)
+{
+    const VkBuffer buffers[] = {instances.buffer, instances.buffer};
+    const VkDeviceSize offsets[] = {instances.transforms, instances.materials};
+    vkCmdBindVertexBuffers(cmd, 1, uint32_t(arraysize(buffers)), buffers, offsets);
+}
 
-    const VkDeviceSize indexOffset = 0;
-    vkCmdBindIndexBuffer(cmd, m_indices.data, indexOffset, VK_INDEX_TYPE_UINT32);
+void Model3D::pushDequantization(VkCommandBuffer cmd, VkPipelineLayout layout) const
+{
+    if(format != vertex_format::packed)
+        return;
 
-    vkCmdDrawIndexed(cmd, m_indexCount, 1, 0, 0, 0);
+    vkCmdPushConstants(cmd, layout, PackedPushConstant.stageFlags, PackedPushConstant.offset,
+                       PackedPushConstant.size, &dequantization);
 }
 
-void ModelBase::destroy(VkDevice device)
+// Each primitive's vertices run up to the next primitive's, without primitives the whole
+// mesh is one list
+static void OptimizeMesh(Model3D::Vertex *vertices, ModelBase::Index *indices, uint32_t vertexCount,
+                         uint32_t indexCount, view<const ModelBase::Primitive> primitives, ModelLoadStats &stats)
 {
-    m_vertices.destroy(device);
-    m_indices.destroy(device);
+    const auto begin = pltf::GetTime();
+
+    const ModelBase::Primitive whole = {0, indexCount, 0, -1};
+    if(primitives.count == 0)
+        primitives = view<const ModelBase::Primitive>(&whole, 1);
+
+    for (size_t i = 0; i < primitives.count; i++)
+    {
+        const auto &primitive = primitives[i];
+        const uint32_t vertexEnd = i + 1 < primitives.count ? uint32_t(primitives[i + 1].vertexOffset) : vertexCount;
+
+        VertexCacheStats before, after;
+        meshOptimize::Optimize(vertices + primitive.vertexOffset, indices + primitive.firstIndex,
+                               primitive.indexCount, vertexEnd - uint32_t(primitive.vertexOffset),
+                               sizeof(Model3D::Vertex), before, after);
+
+        stats.cacheBefore.transformed += before.transformed;
+        stats.cacheBefore.triangles += before.triangles;
+        stats.cacheBefore.vertices += before.vertices;
+        stats.cacheAfter.transformed += after.transformed;
+        stats.cacheAfter.triangles += after.triangles;
+        stats.cacheAfter.vertices += after.vertices;
+    }
+
+    stats.optimizeSeconds = pltf::GetTime() - begin;
 }
 
-VkPushConstantRange Model3D::pushConstant()
+void Model3D::copyToStaging(const MeshLoadOptions &options, Vertex *vertices, Index *indices,
+                            uint32_t vertexCount, uint32_t indexCount, view<const Primitive> primitives,
+                            void *vertexData, Index *indexData, ModelLoadStats &stats)
 {
-    VkPushConstantRange range{};
-    range.offset = 0;
-    range.size = sizeof(transform);
-    range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    return range;
+    if(options.optimize)
+        OptimizeMesh(vertices, indices, vertexCount, indexCount, primitives, stats);
+
+    if(options.format == vertex_format::packed)
+    {
+        dequantization = vertexQuantize::Dequantization(bounds.box);
+        stats.quantization = vertexQuantize::Pack(&vertices[0].position, &vertices[0].normal, &vertices[0].uv,
+                                                  sizeof(Vertex), vertexCount, dequantization,
+                                                  static_cast<PackedVertex*>(vertexData));
+    }
+    else
+    {
+        memcpy(vertexData, vertices, sizeof(Vertex) * vertexCount);
+    }
+    memcpy(indexData, indices, sizeof(Index) * indexCount);
 }
 
-void Model3D::loadSpherePrimitive(const VulkanDevice *device, VkQueue queue)
+void Model3D::loadSpherePrimitive(MeshRegistry &registry, UploadBatch &upload, const MeshLoadOptions &options,
+                                  ModelLoadStats &stats)
 {
     constexpr auto N_STACKS = 64;
     constexpr auto N_SLICES = 64;
 
     const uint32_t vertexCount = (N_STACKS - 1) * N_SLICES + 2;
-    m_indexCount = 6 * N_SLICES * (N_STACKS - 1);
-
-    VulkanBuffer vertexTransfer, indexTransfer;
-    device->createBuffer(USAGE_VERTEX_TRANSFER_SRC,
-                         MEM_FLAG_HOST_VISIBLE,
-                         vertexCount * sizeof(Vertex)   ,
-                         vertexTransfer);
-    device->createBuffer(USAGE_INDEX_TRANSFER_SRC,
-                         MEM_FLAG_HOST_VISIBLE,
-                         m_indexCount * sizeof(Index),
-                         indexTransfer);
-
-    vertexTransfer.map(device->device);
-    auto vertices = static_cast<Vertex*>(vertexTransfer.mapped);
+    const uint32_t indexCount = 6 * N_SLICES * (N_STACKS - 1);
+
+    stats = {};
+    const auto generateBegin = pltf::GetTime();
+
+    void *vertexData = nullptr;
+    Index *indexData = nullptr;
+    stageMesh(registry, upload, vertexCount, indexCount, vertexData, indexData);
+
+    // NOTE(arle): Staging memory is write combined and slow to read back, the optimizer
+    // and the packing work on a copy in system memory
+    const bool direct = !options.optimize && options.format == vertex_format::full;
+    auto vertices = direct ? static_cast<Vertex*>(vertexData) : new Vertex[vertexCount];
+    auto indices = direct ? indexData : new Index[indexCount];
     auto vertex = vertices;
 
     // Top vertex
@@ -75,10 +212,7 @@ void Model3D::loadSpherePrimitive(const VulkanDevice *device, VkQueue queue)
     // Bottom vertex
     vertex->position = vec3(0.0f, -1.0f, 0.0f);
     vertex->normal = vertex->position;
-    vertexTransfer.unmap(device->device);
 
-    indexTransfer.map(device->device);
-    auto indices = static_cast<Index*>(indexTransfer.mapped);
     auto index = indices;
 
     // Top and bottom triangles
@@ -118,29 +252,24 @@ void Model3D::loadSpherePrimitive(const VulkanDevice *device, VkQueue queue)
         }
     }
 
-    indexTransfer.unmap(device->device);
-
-    device->createBuffer(USAGE_VERTEX_TRANSFER_DST,
-                         MEM_FLAG_GPU_LOCAL,
-                         vertexTransfer.size,
-                         m_vertices);
-    device->createBuffer(USAGE_INDEX_TRANSFER_DST,
-                         MEM_FLAG_GPU_LOCAL,
-                         indexTransfer.size,
-                         m_indices);
+    bounds.box = {vec3(-1.0f), vec3(1.0f)};
+    bounds.sphere = {vec3(0.0f), 1.0f};
 
-    auto cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    stats.parseSeconds = pltf::GetTime() - generateBegin;
+    stats.bytes = VkDeviceSize(vertexCount) * vertexSize(options.format) + VkDeviceSize(indexCount) * sizeof(Index);
+    stats.vertexCount = vertexCount;
+    stats.indexCount = indexCount;
 
-    vertexTransfer.transfer(cmd, m_vertices);
-    indexTransfer.transfer(cmd, m_indices);
-
-    device->flushCommandBuffer(cmd, queue);
-
-    vertexTransfer.destroy(device->device);
-    indexTransfer.destroy(device->device);
+    format = options.format;
+    if(!direct)
+    {
+        copyToStaging(options, vertices, indices, vertexCount, indexCount, primitives(), vertexData, indexData, stats);
+        delete[] vertices;
+        delete[] indices;
+    }
 }
 
-void Model3D::loadCubePrimitive(const VulkanDevice *device, VkQueue queue)
+void Model3D::loadCubePrimitive(MeshRegistry &registry, UploadBatch &upload, vertex_format format)
 {
     constexpr auto normalPosZ = vec3(0.0f, 0.0f, 1.0f);
     constexpr auto normalNegZ = vec3(0.0f, 0.0f, -1.0f);
@@ -168,21 +297,11 @@ void Model3D::loadCubePrimitive(const VulkanDevice *device, VkQueue queue)
         vec2(0.0f, 1.0f)
     };
 
-    constexpr size_t VERTEX_COUNT = 24;
-    m_indexCount = 36;
+    constexpr uint32_t VERTEX_COUNT = 24;
+    constexpr uint32_t INDEX_COUNT = 36;
 
-    VulkanBuffer vertexTransfer, indexTransfer;
-    device->createBuffer(USAGE_VERTEX_TRANSFER_SRC,
-                         MEM_FLAG_HOST_VISIBLE,
-                         VERTEX_COUNT * sizeof(Vertex)   ,
-                         vertexTransfer);
-    device->createBuffer(USAGE_INDEX_TRANSFER_SRC,
-                         MEM_FLAG_HOST_VISIBLE,
-                         m_indexCount * sizeof(Index),
-                         indexTransfer);
-
-    vertexTransfer.map(device->device);
-    auto vertices = static_cast<Vertex*>(vertexTransfer.mapped);
+    Vertex vertices[VERTEX_COUNT];
+    Index indices[INDEX_COUNT];
 
     vertices[0] = {points[0], normalNegZ, uvs[3]};
     vertices[1] = {points[3], normalNegZ, uvs[0]};
@@ -214,10 +333,6 @@ void Model3D::loadCubePrimitive(const VulkanDevice *device, VkQueue queue)
     vertices[22] = {points[6], normalPosX, uvs[2]};
     vertices[23] = {points[5], normalPosX, uvs[3]};
 
-    vertexTransfer.unmap(device->device);
-
-    indexTransfer.map(device->device);
-    auto indices = static_cast<Index*>(indexTransfer.mapped);
 
     for (uint32_t i = 0; i < 6; i++)
     {
@@ -231,45 +346,85 @@ void Model3D::loadCubePrimitive(const VulkanDevice *device, VkQueue queue)
         indices[index + 5] = offset;
     }
 
-    indexTransfer.unmap(device->device);
+    bounds = culling::ComputeBounds(points, arraysize(points));
+
+    void *vertexData = nullptr;
+    Index *indexData = nullptr;
+    stageMesh(registry, upload, VERTEX_COUNT, INDEX_COUNT, vertexData, indexData);
+
+    this->format = format;
+    ModelLoadStats stats = {};
+    copyToStaging({format, false}, vertices, indices, VERTEX_COUNT, INDEX_COUNT, primitives(),
+                  vertexData, indexData, stats);
+}
 
-    device->createBuffer(USAGE_VERTEX_TRANSFER_DST,
-                         MEM_FLAG_GPU_LOCAL,
-                         vertexTransfer.size,
-                         m_vertices);
-    device->createBuffer(USAGE_INDEX_TRANSFER_DST,
-                         MEM_FLAG_GPU_LOCAL,
-                         indexTransfer.size,
-                         m_indices);
+bool Model3D::loadFile(MeshRegistry &registry, UploadBatch &upload, const char *filename,
+                       const MeshLoadOptions &options, ModelLoadStats &stats, const char *&error)
+{
+    stats = {};
 
-    auto cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+    // Earlier copies go out on their own so the flush below times only this model
+    upload.flush();
+    const auto parseBegin = pltf::GetTime();
 
-    vertexTransfer.transfer(cmd, m_vertices);
-    indexTransfer.transfer(cmd, m_indices);
+    MeshImport mesh;
+    if(!meshImport::Open(filename, mesh))
+    {
+        error = mesh.error;
+        return false;
+    }
 
-    device->flushCommandBuffer(cmd, queue);
+    // NOTE(arle): Every mesh in the registry shares its 32 bit index buffer, meshes that
+    // would fit 16 bit indices are widened while they are decoded
+    mesh.indexType = MeshRegistry::INDEX_TYPE;
+    const auto vertexBytes = VkDeviceSize(mesh.vertexCount) * vertexSize(options.format);
+    const auto indexBytes = VkDeviceSize(mesh.indexCount) * sizeof(Index);
+
+    // Decoded straight into the upload arena, glTF attributes come from the mapped file. The
+    // optimizer and the packing work on a copy in system memory first
+    void *vertexData = nullptr;
+    Index *indexData = nullptr;
+    stageMesh(registry, upload, mesh.vertexCount, mesh.indexCount, vertexData, indexData);
+    const bool direct = !options.optimize && options.format == vertex_format::full;
+    auto vertices = direct ? static_cast<Vertex*>(vertexData) : new Vertex[mesh.vertexCount];
+    auto indices = direct ? indexData : new Index[mesh.indexCount];
+    bounds = culling::FromBox(meshImport::Fill(mesh, vertices, indices));
+
+    stats.parseSeconds = pltf::GetTime() - parseBegin;
+    stats.bytes = vertexBytes + indexBytes;
+    stats.vertexCount = mesh.vertexCount;
+    stats.indexCount = mesh.indexCount;
+    stats.materialCount = mesh.materialCount;
+
+    format = options.format;
+    if(!direct)
+    {
+        copyToStaging(options, vertices, indices, mesh.vertexCount, mesh.indexCount,
+                      view<const Primitive>(mesh.primitives, mesh.primitiveCount), vertexData, indexData, stats);
+        delete[] vertices;
+        delete[] indices;
+    }
 
-    vertexTransfer.destroy(device->device);
-    indexTransfer.destroy(device->device);
+    // The primitive table moves over to the model
+    m_primitives = mesh.primitives;
+    m_primitiveCount = mesh.primitiveCount;
+    mesh.primitives = nullptr;
+    meshImport::Close(mesh);
+
+    // NOTE(arle): One more submit per file, it keeps the parse and upload times apart
+    stats.uploadSeconds = upload.flush();
+    return true;
 }
 
-void CubemapModel::load(const VulkanDevice *device, VkQueue queue)
+void CubemapModel::load(MeshRegistry &registry, UploadBatch &upload)
 {
-    constexpr size_t VERTEX_COUNT = 8;
-    m_indexCount = 36;
-
-    VulkanBuffer vertexTransfer, indexTransfer;
-    device->createBuffer(USAGE_VERTEX_TRANSFER_SRC,
-                         MEM_FLAG_HOST_VISIBLE,
-                         VERTEX_COUNT * sizeof(Vertex)   ,
-                         vertexTransfer);
-    device->createBuffer(USAGE_INDEX_TRANSFER_SRC,
-                         MEM_FLAG_HOST_VISIBLE,
-                         m_indexCount * sizeof(Index),
-                         indexTransfer);
-
-    vertexTransfer.map(device->device);
-    auto vertices = static_cast<Vertex*>(vertexTransfer.mapped);
+    constexpr uint32_t VERTEX_COUNT = 8;
+
+    void *vertexData = nullptr;
+    Index *indices = nullptr;
+    stageMesh(registry, upload, VERTEX_COUNT, 36, vertexData, indices);
+
+    auto vertices = static_cast<Vertex*>(vertexData);
 
     constexpr float SIZE = 10.0f;
     vertices[0] = {vec3(-SIZE, -SIZE, -SIZE)};
@@ -281,10 +436,6 @@ void CubemapModel::load(const VulkanDevice *device, VkQueue queue)
     vertices[6] = {vec3(SIZE, SIZE, SIZE)};
     vertices[7] = {vec3(-SIZE, SIZE, SIZE)};
 
-    vertexTransfer.unmap(device->device);
-
-    indexTransfer.map(device->device);
-    auto indices = static_cast<Index*>(indexTransfer.mapped);
 
     indices[0] = 0;
     indices[1] = 3;
@@ -328,24 +479,4 @@ void CubemapModel::load(const VulkanDevice *device, VkQueue queue)
     indices[34] = 5;
     indices[35] = 1;
 
-    indexTransfer.unmap(device->device);
-
-    device->createBuffer(USAGE_VERTEX_TRANSFER_DST,
-                         MEM_FLAG_GPU_LOCAL,
-                         vertexTransfer.size,
-                         m_vertices);
-    device->createBuffer(USAGE_INDEX_TRANSFER_DST,
-                         MEM_FLAG_GPU_LOCAL,
-                         indexTransfer.size,
-                         m_indices);
-
-    auto cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-    vertexTransfer.transfer(cmd, m_vertices);
-    indexTransfer.transfer(cmd, m_indices);
-
-    device->flushCommandBuffer(cmd, queue);
-
-    vertexTransfer.destroy(device->device);
-    indexTransfer.destroy(device->device);
 }
\ No newline at end of file
@@ -1,19 +1,86 @@
 #pragma once
 
 #include "VulkanDevice.hpp"
+#include "upload_batch.hpp"
+#include "mesh_registry.hpp"
+#include "culling.hpp"
+#include "mesh_optimize.hpp"
+#include "vertex_quantize.hpp"
 
 class ModelBase
 {
 public:
-    using Index = uint32_t;
+    using Index = MeshRegistry::Index;
 
-    void draw(VkCommandBuffer cmd);
-    void destroy(VkDevice device);
+    // A draw range of the model's mesh, indices are relative to vertexOffset
+    struct Primitive
+    {
+        uint32_t    firstIndex;
+        uint32_t    indexCount;
+        int32_t     vertexOffset;
+        int32_t     material;   // -1 without a material
+    };
+
+    // Called before a primitive whose material differs from the previous one
+    using material_bind = void(*)(VkCommandBuffer cmd, int32_t material, void *userData);
+
+    // Every primitive instanceCount times, with whatever instance streams the caller bound.
+    // Draws from the registry the model was loaded into, MeshRegistry::bind binds it once
+    // for every model in it
+    void draw(VkCommandBuffer cmd, material_bind bindMaterial = nullptr, void *userData = nullptr,
+              uint32_t instanceCount = 1);
+
+    // One indexed draw command per primitive, the same draws draw() records
+    uint32_t drawCommandCount() const { return m_primitiveCount > 0 ? m_primitiveCount : 1; }
+    void writeDrawCommands(VkDrawIndexedIndirectCommand *commands, uint32_t instanceCount) const;
+
+    // drawCommandCount() commands from the buffer. With a count buffer the GPU decides how
+    // many of them run (Vulkan 1.2 drawIndirectCount), otherwise all of them do. Without
+    // multiDrawIndirect every command is its own call. Materials are not rebound per primitive
+    void drawIndirect(VkCommandBuffer cmd, VkBuffer commands, VkDeviceSize offset,
+                      VkBuffer countBuffer = VK_NULL_HANDLE, VkDeviceSize countOffset = 0,
+                      bool multiDraw = true);
+    void destroy();    // Frees the mesh in the registry
+
+    view<const Primitive> primitives() const { return view<const Primitive>(m_primitives, m_primitiveCount); }
 
 protected:
-    VulkanBuffer    m_vertices;
-    VulkanBuffer    m_indices;
+    // Allocates the mesh in the registry and returns its staging memory in the batch
+    void stageMesh(MeshRegistry &registry, UploadBatch &upload, uint32_t vertexCount,
+                   uint32_t indexCount, void *&vertices, Index *&indices);
+
+    MeshRegistry    *m_registry = nullptr;
+    mesh_handle     m_mesh = INVALID_MESH;
     uint32_t        m_indexCount;
+    Primitive       *m_primitives = nullptr; // Without primitives every index is drawn at once
+    uint32_t        m_primitiveCount = 0;
+};
+
+// Vertex layouts of binding 0, a registry holds one of them
+enum class vertex_format
+{
+    full,       // Model3D::Vertex
+    packed      // PackedVertex, see vertex_quantize.hpp
+};
+
+struct MeshLoadOptions
+{
+    vertex_format   format;
+    bool            optimize;   // meshOptimize::Optimize on each primitive before staging
+};
+
+struct ModelLoadStats
+{
+    double          parseSeconds;   // Parsing and decoding into the upload batch
+    double          uploadSeconds;  // Submit to fence of the batch flush after loadFile
+    VkDeviceSize    bytes;
+    uint32_t        vertexCount;
+    uint32_t        indexCount;
+    uint32_t        materialCount;
+    double          optimizeSeconds;
+    VertexCacheStats cacheBefore;   // Summed over the primitives, zero without optimize
+    VertexCacheStats cacheAfter;
+    QuantizationError quantization; // Zero unless packed
 };
 
 class Model3D : public ModelBase
@@ -32,11 +99,103 @@ public:
         {2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)}
     };
 
-    static VkPushConstantRange pushConstant();
-    void loadSpherePrimitive(const VulkanDevice* device, VkQueue queue);
-    void loadCubePrimitive(const VulkanDevice* device, VkQueue queue);
+    // The same locations for PackedVertex, the position reads four lanes to get a format
+    // every device supports and the shader drops the fourth
+    static constexpr VkVertexInputAttributeDescription PackedAttributes[] = {
+        {0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position)},
+        {1, 0, VK_FORMAT_R8G8_SNORM, offsetof(PackedVertex, normal)},
+        {2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)}
+    };
+
+    // A packed model's PositionDequantization, for pbr.vert compiled with PACKED_VERTICES
+    static constexpr VkPushConstantRange PackedPushConstant = {
+        VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PositionDequantization)
+    };
+
+    // Per instance streams, world matrices in binding 1 with a location per row (a GLSL mat4
+    // input) and indices into the MaterialTable in binding 2. Separate bindings let the
+    // matrices come straight from TransformStore::computeWorldMatrices
+    static constexpr VkVertexInputAttributeDescription InstanceAttributes[] = {
+        {3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0},
+        {4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 16},
+        {5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 32},
+        {6, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 48},
+        {7, 2, VK_FORMAT_R32_UINT, 0}
+    };
+
+    static constexpr VkVertexInputBindingDescription Bindings[] = {
+        {0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX},
+        {1, sizeof(mat4x4), VK_VERTEX_INPUT_RATE_INSTANCE},
+        {2, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_INSTANCE}
+    };
+
+    static constexpr VkVertexInputBindingDescription PackedBindings[] = {
+        {0, sizeof(PackedVertex), VK_VERTEX_INPUT_RATE_VERTEX},
+        {1, sizeof(mat4x4), VK_VERTEX_INPUT_RATE_INSTANCE},
+        {2, sizeof(uint32_t), VK_VERTEX_INPUT_RATE_INSTANCE}
+    };
+
+    static constexpr uint32_t vertexSize(vertex_format format)
+    {
+        return format == vertex_format::packed ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+
+    struct InstanceStreams
+    {
+        VkBuffer        buffer;
+        VkDeviceSize    transforms;     // Offsets of count world matrices and count material indices
+        VkDeviceSize    materials;
+        uint32_t        count;
+    };
+
+    // Binds the instance streams, count is not used
+    void bindInstances(VkCommandBuffer cmd, const InstanceStreams &instances);
+
+    // Packed models push their own box before their draws, so any number of them can share
+    // a registry. Nothing to do for full vertices
+    void pushDequantization(VkCommandBuffer cmd, VkPipelineLayout layout) const;
 
-    mat4x4 transform;
+    // All instances of every primitive in one draw call per primitive
+    void drawInstances(VkCommandBuffer cmd, const InstanceStreams &instances,
+                       material_bind bindMaterial = nullptr, void *userData = nullptr);
+
+    // The registry has to hold options.format. Optimized or packed vertices are built in
+    // system memory and copied to staging afterwards
+    void loadSpherePrimitive(MeshRegistry &registry, UploadBatch &upload, const MeshLoadOptions &options,
+                             ModelLoadStats &stats);
+    void loadCubePrimitive(MeshRegistry &registry, UploadBatch &upload, vertex_format format);
+
+    // glTF 2.0 (.gltf, .glb) or OBJ into an empty model, see mesh_import.hpp. Returns false
+    // with the reason in error, the model is left untouched then
+    bool loadFile(MeshRegistry &registry, UploadBatch &upload, const char *filename,
+                  const MeshLoadOptions &options, ModelLoadStats &stats, const char *&error);
+
+    ModelBounds bounds;     // Model space, set by the loads
+    vertex_format format = vertex_format::full;
+    PositionDequantization dequantization = {}; // Set for packed vertices, from bounds.box
+
+private:
+    // Optimizes and packs the vertices and indices per options into the staging memory,
+    // bounds has to be set
+    void copyToStaging(const MeshLoadOptions &options, Vertex *vertices, Index *indices,
+                       uint32_t vertexCount, uint32_t indexCount, view<const Primitive> primitives,
+                       void *vertexData, Index *indexData, ModelLoadStats &stats);
+};
+
+// Multipliers of the material textures like the glTF factors, selected per instance
+struct alignas(16) MaterialFactors
+{
+    vec4<float> albedo;
+    float       roughness;
+    float       metallic;
+    vec2<float> reserved;
+};
+
+constexpr uint32_t MAX_MATERIALS = 256;
+
+struct alignas(16) MaterialTable
+{
+    MaterialFactors factors[MAX_MATERIALS];
 };
 
 class CubemapModel : public ModelBase
@@ -51,5 +210,5 @@ public:
         {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)}
     };
 
-    void load(const VulkanDevice *device, VkQueue queue);
+    void load(MeshRegistry &registry, UploadBatch &upload);
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "VulkanRingBuffer.hpp"
+
+void RingBuffer::create(const VulkanDevice *device, VkBufferUsageFlags usage, VkDeviceSize frameSize)
+{
+    uniformAlignment = max(device->gpuProperties.limits.minUniformBufferOffsetAlignment, VkDeviceSize(16));
+    storageAlignment = max(device->gpuProperties.limits.minStorageBufferOffsetAlignment, VkDeviceSize(16));
+    const VkDeviceSize frameAlignment = max(uniformAlignment, storageAlignment);
+    this->frameSize = (frameSize + frameAlignment - 1) & ~(frameAlignment - 1);
+
+    device->createBuffer(usage, MEM_FLAG_HOST_VISIBLE, this->frameSize * MAX_IMAGES_IN_FLIGHT, buffer);
+    buffer.map(device->device);
+
+    m_begin = 0;
+    m_cursor = 0;
+    m_end = this->frameSize;
+}
+
+void RingBuffer::destroy(VkDevice device)
+{
+    buffer.unmap(device);
+    buffer.destroy(device);
+}
+
+void RingBuffer::beginFrame(size_t frame)
+{
+    m_begin = frameSize * frame;
+    m_cursor = m_begin;
+    m_end = m_begin + frameSize;
+}
+
+RingAllocation RingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    RingAllocation allocation{};
+
+    const auto offset = (m_cursor + alignment - 1) & ~(alignment - 1);
+    mv_dbg_assert(offset + size <= m_end, "Frame ring buffer partition exhausted");
+    if(offset + size > m_end)
+        return allocation;
+
+    m_cursor = offset + size;
+
+    allocation.mapped = static_cast<uint8_t*>(buffer.mapped) + offset;
+    allocation.offset = offset;
+    allocation.size = size;
+    return allocation;
+}
+
+void RingBuffer::trim(RingAllocation &allocation, VkDeviceSize usedSize)
+{
+    if(allocation.mapped == nullptr || allocation.offset + allocation.size != m_cursor)
+        return;
+
+    m_cursor = allocation.offset + usedSize;
+    allocation.size = usedSize;
+}
\ No newline at end of file
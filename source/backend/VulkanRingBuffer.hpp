@@ -0,0 +1,53 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+
+// One persistently mapped buffer split into a partition per frame in flight.
+// Per-frame data is bump allocated from the partition of the current frame,
+// which prepareFrame has already fenced, and bound with dynamic offsets.
+
+struct RingAllocation
+{
+    void*           mapped;
+    VkDeviceSize    offset;
+    VkDeviceSize    size;
+};
+
+class RingBuffer
+{
+public:
+    void create(const VulkanDevice *device, VkBufferUsageFlags usage, VkDeviceSize frameSize);
+    void destroy(VkDevice device);
+
+    void beginFrame(size_t frame);
+    RingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment); // alignment must be a power of two
+
+    // Gives back the unused tail when the allocation is the most recent one
+    void trim(RingAllocation &allocation, VkDeviceSize usedSize);
+
+    template<typename T>
+    uint32_t push(const T &value)
+    {
+        auto allocation = allocate(sizeof(T), uniformAlignment);
+        if(allocation.mapped != nullptr)
+            *static_cast<T*>(allocation.mapped) = value;
+        return uint32_t(allocation.offset);
+    }
+
+    // Descriptor covering a single T at dynamic offset 0
+    template<typename T>
+    VkDescriptorBufferInfo descriptor() const
+    {
+        return VkDescriptorBufferInfo{buffer.data, 0, sizeof(T)};
+    }
+
+    VulkanBuffer    buffer;
+    VkDeviceSize    frameSize;
+    VkDeviceSize    uniformAlignment;
+    VkDeviceSize    storageAlignment;   // Dynamic storage buffer offsets, only with the usage bit
+
+private:
+    VkDeviceSize    m_begin;
+    VkDeviceSize    m_cursor;
+    VkDeviceSize    m_end;
+};
\ No newline at end of file
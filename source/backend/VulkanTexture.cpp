@@ -1,13 +1,30 @@
 #include "VulkanTexture.hpp"
+#include "ktx2.hpp"
+#include "pixel_convert.hpp"
+#include <string.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../../vendor/stb/stb_image.h"
 #undef STB_IMAGE_IMPLE
 
+// stb decodes from a mapping of the file, in place rather than through stdio buffers
+static io::file_map MapImageFile(const char *filename)
+{
+    io::file_map map = {};
+    auto file = io::Open<io::cmd::read>(filename);
+    if(io::IsValid(file))
+        map = io::Map(file, io::access::sequential, true);
+    io::Close(file);
+
+    if(map.size > size_t(INT32_MAX))
+        io::Unmap(map);
+    return map;
+}
+
 void TextureBase::destroy(VkDevice device)
 {
     vkDestroySampler(device, sampler, nullptr);
-    vkFreeMemory(device, memory, nullptr);
+    memory.release();
     vkDestroyImageView(device, view, nullptr);
     vkDestroyImage(device, image, nullptr);
 }
@@ -19,95 +36,260 @@ void TextureBase::updateDescriptor()
     descriptor.sampler = sampler;
 }
 
+// Single 2D images without supercompression, in a format the texture code knows the size of
+static bool ReadKTX2(const io::file_map &map, ImageFile &file)
+{
+    ktx2_header header;
+    memcpy(&header, map.data, sizeof(header));
+
+    const auto format = VkFormat(header.vkFormat);
+    const auto blockSize = vkTools::FormatBlockSize(format);
+    const auto texelSize = vkTools::FormatSize(format);
+    const uint32_t levelCount = max(header.levelCount, 1u);
+    if((blockSize == 0 && texelSize == 0) || header.pixelWidth == 0 || header.pixelHeight == 0 ||
+       header.pixelDepth > 0 || header.layerCount > 1 || header.faceCount != 1 ||
+       header.supercompressionScheme != 0 || levelCount > MAX_MIP_LEVELS ||
+       levelCount > uint32_t(std::bit_width(max(header.pixelWidth, header.pixelHeight))) ||
+       sizeof(header) + levelCount * sizeof(ktx2_level) > map.size)
+        return false;
+
+    ktx2_level levels[MAX_MIP_LEVELS];
+    memcpy(levels, static_cast<const uint8_t*>(map.data) + sizeof(header), levelCount * sizeof(ktx2_level));
+
+    // Offsets the file aligns to its texel blocks also satisfy buffer to image copies
+    const VkExtent2D extent = {header.pixelWidth, header.pixelHeight};
+    const uint64_t alignment = vkTools::CopyAlignment(format);
+    uint64_t begin = UINT64_MAX, end = 0;
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        const auto &level = levels[i];
+        if(level.byteOffset % alignment != 0 || level.byteOffset > map.size ||
+           level.byteLength > map.size - level.byteOffset ||
+           level.byteLength < vkTools::ImageLevelSize(format, extent, i))
+            return false;
+
+        begin = min(begin, level.byteOffset);
+        end = max(end, level.byteOffset + level.byteLength);
+    }
+
+    file.pixels = const_cast<uint8_t*>(static_cast<const uint8_t*>(map.data)) + begin;
+    file.extent = extent;
+    file.format = format;
+    file.bytesPerPixel = texelSize;
+    file.mipLevels = levelCount;
+    file.size = end - begin;
+    for (uint32_t i = 0; i < levelCount; i++)
+        file.levelOffsets[i] = levels[i].byteOffset - begin;
+    file.map = map;
+    file.heapFreeFlag = true;
+    return true;
+}
+
 ImageFile Texture2D::loadFile(const char *filename, VkFormat format, uint32_t reqComp)
 {
-    ImageFile file;
+    auto map = MapImageFile(filename);
+
+    // NOTE(arle): KTX2 levels are already in the layout the GPU samples, the file stays
+    // mapped and is copied straight into staging memory
+    if(map.size >= sizeof(ktx2_header) && memcmp(map.data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0)
+    {
+        ImageFile file = {};
+        if(ReadKTX2(map, file))
+            return file;
+
+        io::Unmap(map);
+        return wrapPixels(TEX2D_DEFAULT, {1, 1}, VK_FORMAT_R8G8B8A8_SRGB, 4);
+    }
+
     int x = 0, y = 0, channels = 0;
-    auto pixels = stbi_load(filename, &x, &y, &channels, reqComp);
+    auto pixels = map.data ? stbi_load_from_memory(static_cast<const stbi_uc*>(map.data), int(map.size),
+                                                   &x, &y, &channels, reqComp) : nullptr;
+    if(map.data)
+        io::Unmap(map);
 
     if(pixels == nullptr)
+        return wrapPixels(TEX2D_DEFAULT, {1, 1}, VK_FORMAT_R8G8B8A8_SRGB, 4);
+
+    auto file = wrapPixels(pixels, {uint32_t(x), uint32_t(y)}, format, reqComp);
+    file.heapFreeFlag = true;
+    return file;
+}
+
+ImageFile Texture2D::loadChannels(const char *const *filenames, uint32_t count, VkFormat format)
+{
+    if(count == 1)
+        return loadFile(filenames[0], format);
+
+    // NOTE(arle): The first image is decoded to four channels and the others are written
+    // into its pixels, which keeps stb_image the owner of the buffer
+    auto file = loadFile(filenames[0], format, 4);
+    bool packed = count <= 4 && file.heapFreeFlag && file.map.data == nullptr;
+    const size_t texelCount = size_t(file.extent.width) * file.extent.height;
+    for (uint32_t i = 1; i < count && packed; i++)
     {
-        file.pixels = const_cast<uint8_t*>(TEX2D_DEFAULT);
-        file.extent = {1, 1};
-        file.bytesPerPixel = 4;
-        file.format = VK_FORMAT_R8G8B8A8_SRGB;
-        file.heapFreeFlag = false;
+        auto channel = loadFile(filenames[i], format, 1);
+        packed = channel.heapFreeFlag && channel.map.data == nullptr &&
+                 channel.extent.width == file.extent.width && channel.extent.height == file.extent.height;
+        for (size_t texel = 0; texel < texelCount && packed; texel++)
+            file.pixels[texel * 4 + i] = channel.pixels[texel];
+        freeFile(channel);
     }
-    else
+
+    if(!packed)
     {
-        file.pixels = pixels;
-        file.extent = {static_cast<uint32_t>(x), static_cast<uint32_t>(y)};
-        file.bytesPerPixel = reqComp;
-        file.format = format;
-        file.heapFreeFlag = true;
+        freeFile(file);
+        return wrapPixels(TEX2D_DEFAULT, {1, 1}, VK_FORMAT_R8G8B8A8_SRGB, 4);
     }
 
+    for (size_t texel = 0; texel < texelCount; texel++)
+    {
+        for (uint32_t i = count; i < 4; i++)
+            file.pixels[texel * 4 + i] = 255;
+    }
     return file;
 }
 
 void Texture2D::freeFile(ImageFile &file)
 {
-    if(file.heapFreeFlag)
+    if(file.map.data)
+        io::Unmap(file.map);
+    else if(file.heapFreeFlag)
         stbi_image_free(file.pixels);
     file.pixels = nullptr;
 }
 
-void Texture2D::create(const VulkanDevice *device,
-                              VkQueue queue,
-                              const ImageFile &file,
-                              bool genMipMaps)
+ImageFile Texture2D::wrapPixels(const uint8_t *pixels, VkExtent2D extent, VkFormat format, uint32_t bytesPerPixel)
 {
-    extent = file.extent;
-    format = file.format;
-    mipLevels = 1;
+    ImageFile file = {};
+    file.pixels = const_cast<uint8_t*>(pixels);
+    file.extent = extent;
+    file.format = format;
+    file.bytesPerPixel = bytesPerPixel;
+    file.mipLevels = 1;
+    file.size = VkDeviceSize(bytesPerPixel) * extent.width * extent.height;
+    return file;
+}
 
-    VulkanBuffer transfer;
-    device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEM_FLAG_HOST_VISIBLE,
-                         file.bytesPerPixel * extent.width * extent.height,
-                         transfer, file.pixels);
+uint32_t Texture2D::copyRegions(const ImageFile &file, VkDeviceSize bufferOffset, VkBufferImageCopy *regions)
+{
+    for (uint32_t level = 0; level < file.mipLevels; level++)
+    {
+        const VkExtent2D extent = {max(file.extent.width >> level, 1u), max(file.extent.height >> level, 1u)};
+        regions[level] = vkInits::bufferImageCopy(extent);
+        regions[level].imageSubresource.mipLevel = level;
+        regions[level].bufferOffset = bufferOffset + file.levelOffsets[level];
+    }
+    return file.mipLevels;
+}
 
-    if(genMipMaps && device->linearFilterSupport(format, VK_IMAGE_TILING_OPTIMAL))
+bool Texture2D::blitsMipMaps(const VulkanDevice *device, VkFormat format)
+{
+    // Mips are blitted down from level 0, which needs linear filtering of the format and
+    // blits from and to it. Block compressed formats can never be blit destinations
+    constexpr VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return device->formatSupport(format, blitFeatures);
+}
+
+bool Texture2D::mipChainLayout(const ImageFile &file, ImageFile &chain)
+{
+    const uint32_t levelCount = min(mipChain::LevelCount(file.format, file.extent), MAX_MIP_LEVELS);
+    if(file.mipLevels != 1 || levelCount < 2 || file.bytesPerPixel != vkTools::FormatSize(file.format))
+        return false;
+
+    chain = file;
+    chain.mipLevels = levelCount;
+    chain.size = 0;
+    const VkDeviceSize alignment = vkTools::CopyAlignment(file.format);
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        chain.size = (chain.size + alignment - 1) / alignment * alignment;
+        chain.levelOffsets[level] = chain.size;
+        chain.size += vkTools::ImageLevelSize(file.format, file.extent, level);
+    }
+    return true;
+}
+
+void Texture2D::prepare(const VulkanDevice *device, VkExtent2D size, VkFormat imageFormat,
+                        bool genMipMaps, uint32_t levels)
+{
+    extent = size;
+    format = imageFormat;
+    mipLevels = levels;
+
+    auto imageInfo = vkInits::imageCreateInfo();
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.format = format;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+
+    if(levels == 1 && genMipMaps && blitsMipMaps(device, format))
     {
         mipLevels = 1 + uint32_t(std::floor(std::log2(max(extent.width, extent.height))));
+        imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    imageInfo.mipLevels = mipLevels;
+    vkCreateImage(device->device, &imageInfo, nullptr, &image);
 
-        auto imageInfo = vkInits::imageCreateInfo();
-        imageInfo.extent = {extent.width, extent.height, 1};
-        imageInfo.format = format;
-        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                          VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.mipLevels = mipLevels;
-        vkCreateImage(device->device, &imageInfo, nullptr, &image);
+    memory = device->allocateImageMemory(image, MEM_FLAG_GPU_LOCAL);
 
-        VkMemoryRequirements memReqs{};
-        vkGetImageMemoryRequirements(device->device, image, &memReqs);
+    auto viewInfo = vkInits::imageViewCreateInfo();
+    viewInfo.image = image;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = mipLevels;
+    vkCreateImageView(device->device, &viewInfo, nullptr, &view);
 
-        auto allocInfo = device->getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-        vkAllocateMemory(device->device, &allocInfo, nullptr, &memory);
-        vkBindImageMemory(device->device, image, memory, 0);
+    auto samplerInfo = vkInits::samplerCreateInfo(float(mipLevels));
+    vkCreateSampler(device->device, &samplerInfo, nullptr, &sampler);
 
-        VkImageSubresourceRange subResourceRange{};
-        subResourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        subResourceRange.baseArrayLayer = 0;
-        subResourceRange.baseMipLevel = 0;
-        subResourceRange.layerCount = 1;
-        subResourceRange.levelCount = 1;
+    updateDescriptor();
+}
 
-        auto command = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+void Texture2D::recordMipMaps(VkCommandBuffer command) const
+{
+    for (uint32_t level = 1; level < mipLevels; level++)
+    {
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcOffsets[0] = {};
+        blit.srcOffsets[1].x = int32_t(max(extent.width >> (level - 1), 1u));
+        blit.srcOffsets[1].y = int32_t(max(extent.height >> (level - 1), 1u));
+        blit.srcOffsets[1].z = 1;
+
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[0] = {};
+        blit.dstOffsets[1].x = int32_t(max(extent.width >> level, 1u));
+        blit.dstOffsets[1].y = int32_t(max(extent.height >> level, 1u));
+        blit.dstOffsets[1].z = 1;
+
+        VkImageSubresourceRange dstSubRange{};
+        dstSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        dstSubRange.baseMipLevel = level;
+        dstSubRange.layerCount = 1;
+        dstSubRange.levelCount = 1;
 
         vkTools::InsertMemoryarrier(command,
                                     VK_IMAGE_LAYOUT_UNDEFINED,
                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                                     VK_ACCESS_NONE,
                                     VK_ACCESS_TRANSFER_WRITE_BIT,
-                                    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
                                     VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                    subResourceRange,
-                                    image);
+                                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                    dstSubRange, image);
 
-        const auto copyRegion = vkInits::bufferImageCopy(extent);
-        vkCmdCopyBufferToImage(command, transfer.data, image,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        vkCmdBlitImage(command,
+                       image,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1,
+                       &blit,
+                       VK_FILTER_LINEAR);
 
         vkTools::InsertMemoryarrier(command,
                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -116,150 +298,89 @@ void Texture2D::create(const VulkanDevice *device,
                                     VK_ACCESS_TRANSFER_READ_BIT,
                                     VK_PIPELINE_STAGE_TRANSFER_BIT,
                                     VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                    subResourceRange,
-                                    image);
-
-        device->flushCommandBuffer(command, queue);
-        command = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-        for (uint32_t level = 1; level < mipLevels; level++)
-        {
-            VkImageBlit blit{};
-            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.srcSubresource.layerCount = 1;
-            blit.srcSubresource.mipLevel = level - 1;
-            blit.srcOffsets[0] = {};
-            blit.srcOffsets[1].x = int32_t(extent.width >> (level - 1));
-            blit.srcOffsets[1].y = int32_t(extent.height >> (level - 1));
-            blit.srcOffsets[1].z = 1;
-
-            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.dstSubresource.layerCount = 1;
-            blit.dstSubresource.mipLevel = level;
-            blit.dstOffsets[0] = {};
-            blit.dstOffsets[1].x = int32_t(extent.width >> level);
-            blit.dstOffsets[1].y = int32_t(extent.height >> level);
-            blit.dstOffsets[1].z = 1;
-
-            VkImageSubresourceRange dstSubRange{};
-            dstSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            dstSubRange.baseMipLevel = level;
-            dstSubRange.layerCount = 1;
-            dstSubRange.levelCount = 1;
-
-            vkTools::InsertMemoryarrier(command,
-                                        VK_IMAGE_LAYOUT_UNDEFINED,
-                                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                        VK_ACCESS_NONE,
-                                        VK_ACCESS_TRANSFER_WRITE_BIT,
-                                        VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                        VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                        dstSubRange, image);
-
-            vkCmdBlitImage(command,
-                           image,
-                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                           image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           1,
-                           &blit,
-                           VK_FILTER_LINEAR);
-
-            vkTools::InsertMemoryarrier(command,
-                                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                        VK_ACCESS_TRANSFER_WRITE_BIT,
-                                        VK_ACCESS_TRANSFER_READ_BIT,
-                                        VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                        VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                        dstSubRange, image);
-        }
-
-        subResourceRange.levelCount = mipLevels;
-        vkTools::InsertMemoryarrier(command,
-                                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                    VK_ACCESS_TRANSFER_READ_BIT,
-                                    VK_ACCESS_SHADER_READ_BIT,
-                                    VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                                    subResourceRange, image);
-
-        device->flushCommandBuffer(command, queue);
+                                    dstSubRange, image);
     }
-    else
-    {
-        auto imageInfo = vkInits::imageCreateInfo();
-        imageInfo.extent = {extent.width, extent.height, 1};
-        imageInfo.format = format;
-        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.mipLevels = mipLevels;
-        vkCreateImage(device->device, &imageInfo, nullptr, &image);
-
-        VkMemoryRequirements memReqs{};
-        vkGetImageMemoryRequirements(device->device, image, &memReqs);
-
-        auto allocInfo = device->getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-        vkAllocateMemory(device->device, &allocInfo, nullptr, &memory);
-        vkBindImageMemory(device->device, image, memory, 0);
 
-        auto command = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-        vkTools::SetImageLayout(command,
-                                VK_IMAGE_LAYOUT_UNDEFINED,
-                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                image);
-
-        const auto copyRegion = vkInits::bufferImageCopy(extent);
-        vkCmdCopyBufferToImage(command, transfer.data, image,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-        vkTools::SetImageLayout(command,
-                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    VkImageSubresourceRange subResourceRange{};
+    subResourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subResourceRange.layerCount = 1;
+    subResourceRange.levelCount = mipLevels;
+    vkTools::InsertMemoryarrier(command,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_ACCESS_TRANSFER_READ_BIT,
+                                VK_ACCESS_SHADER_READ_BIT,
                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                                image);
+                                subResourceRange, image);
+}
 
-        device->flushCommandBuffer(command, queue);
-    }
+void Texture2D::create(const VulkanDevice *device,
+                              UploadBatch &upload,
+                              const ImageFile &file,
+                              bool genMipMaps)
+{
+    // NOTE(arle): Chains the device can not blit, half and float images on some hardware,
+    // are filtered on the CPU. Block compressed files bring their levels from the encoder
+    if(genMipMaps && file.mipLevels == 1 && !blitsMipMaps(device, file.format) &&
+       createMipChain(device, upload, file, mipChain::PreferredFilter(file.format)))
+        return;
 
-    transfer.destroy(device->device);
+    prepare(device, file.extent, file.format, genMipMaps, file.mipLevels);
 
-    auto viewInfo = vkInits::imageViewCreateInfo();
-    viewInfo.image = image;
-    viewInfo.format = format;
-    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    viewInfo.subresourceRange.levelCount = mipLevels;
-    vkCreateImageView(device->device, &viewInfo, nullptr, &view);
+    // A mip chain the file does not have follows the copy in the same submission
+    const bool blitMips = mipLevels > file.mipLevels;
+    const auto layout = blitMips ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    auto samplerInfo = vkInits::samplerCreateInfo();
-    vkCreateSampler(device->device, &samplerInfo, nullptr, &sampler);
+    VkBufferImageCopy regions[MAX_MIP_LEVELS];
+    const auto regionCount = copyRegions(file, 0, regions);
+    memcpy(upload.stageImage(image, file.format, regions, regionCount, file.size, layout), file.pixels, file.size);
 
-    updateDescriptor();
+    if(blitMips)
+        recordMipMaps(upload.commandBuffer());
+}
+
+bool Texture2D::createMipChain(const VulkanDevice *device, UploadBatch &upload, const ImageFile &file,
+                               mip_filter filter, ThreadPool *pool)
+{
+    ImageFile chain;
+    if(!mipChainLayout(file, chain))
+        return false;
+
+    prepare(device, file.extent, file.format, false, chain.mipLevels);
+
+    VkBufferImageCopy regions[MAX_MIP_LEVELS];
+    const auto regionCount = copyRegions(chain, 0, regions);
+    auto staged = static_cast<uint8_t*>(upload.stageImage(image, chain.format, regions, regionCount, chain.size));
+    mipChain::Generate(file.pixels, file.format, file.extent, chain.mipLevels, chain.levelOffsets, staged, filter, pool);
+    return true;
 }
 
-CoreResult HDRImage::load(const VulkanDevice *device, VkQueue queue, const char *filename)
+CoreResult HDRImage::load(const VulkanDevice *device, UploadBatch &upload, const char *filename, VkFormat storage)
 {
+    if(storage != VK_FORMAT_R32G32B32A32_SFLOAT && storage != VK_FORMAT_R16G16B16A16_SFLOAT &&
+       storage != VK_FORMAT_B10G11R11_UFLOAT_PACK32)
+        storage = VK_FORMAT_R16G16B16A16_SFLOAT;
+    if(!device->linearFilterSupport(storage, VK_IMAGE_TILING_OPTIMAL))
+        storage = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+    // NOTE(arle): Only RGBA32F is staged as decoded, the packed formats are converted from
+    // RGB and need no alpha in the decoded image
+    const int components = storage == VK_FORMAT_R32G32B32A32_SFLOAT ? 4 : 3;
+
     int x = 0, y = 0, channels = 0;
-    auto pixels = stbi_loadf(filename, &x, &y, &channels, 4);
+    auto map = MapImageFile(filename);
+    auto pixels = map.data ? stbi_loadf_from_memory(static_cast<const stbi_uc*>(map.data), int(map.size),
+                                                    &x, &y, &channels, components) : nullptr;
+    if(map.data)
+        io::Unmap(map);
 
-    format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    format = storage;
     extent = {uint32_t(x), uint32_t(y)};
     mipLevels = 1;
 
     if(pixels != nullptr)
     {
-        VulkanBuffer transfer;
-        device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEM_FLAG_HOST_VISIBLE,
-                             16 * extent.width * extent.height,
-                             transfer, pixels);
-
-        stbi_image_free(pixels);
-
         auto imageInfo = vkInits::imageCreateInfo();
         imageInfo.extent.width = extent.width;
         imageInfo.extent.height = extent.height;
@@ -271,12 +392,7 @@ CoreResult HDRImage::load(const VulkanDevice *device, VkQueue queue, const char
         imageInfo.arrayLayers = 1;
         vkCreateImage(device->device, &imageInfo, nullptr, &image);
 
-        VkMemoryRequirements memReqs{};
-        vkGetImageMemoryRequirements(device->device, image, &memReqs);
-
-        auto allocInfo = device->getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-        vkAllocateMemory(device->device, &allocInfo, nullptr, &memory);
-        vkBindImageMemory(device->device, image, memory, 0);
+        memory = device->allocateImageMemory(image, MEM_FLAG_GPU_LOCAL);
 
         auto samplerInfo = vkInits::samplerCreateInfo();
         vkCreateSampler(device->device, &samplerInfo, nullptr, &sampler);
@@ -288,30 +404,23 @@ CoreResult HDRImage::load(const VulkanDevice *device, VkQueue queue, const char
         viewInfo.subresourceRange.levelCount = mipLevels;
         vkCreateImageView(device->device, &viewInfo, nullptr, &view);
 
-        auto cmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-        vkTools::SetImageLayout(cmd,
-                                VK_IMAGE_LAYOUT_UNDEFINED,
-                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                                image);
+        const size_t texelCount = size_t(extent.width) * extent.height;
+        const auto size = VkDeviceSize(vkTools::FormatSize(format)) * texelCount;
+        auto target = upload.stageImage(image, format, extent, size);
 
-        const auto bufferCopy = vkInits::bufferImageCopy(extent);
-        vkCmdCopyBufferToImage(cmd, transfer.data, image,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               1, &bufferCopy);
-
-        vkTools::SetImageLayout(cmd,
-                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                                image);
-
-        device->flushCommandBuffer(cmd, queue);
-
-        transfer.destroy(device->device);
+        switch (format)
+        {
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                pixelConvert::ToHalf(pixels, 3, texelCount, static_cast<uint16_t*>(target));
+                break;
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                pixelConvert::ToB10G11R11(pixels, 3, texelCount, static_cast<uint32_t*>(target));
+                break;
+            default:
+                memcpy(target, pixels, size);
+                break;
+        }
+        stbi_image_free(pixels);
 
         updateDescriptor();
 
@@ -321,11 +430,12 @@ CoreResult HDRImage::load(const VulkanDevice *device, VkQueue queue, const char
     return CoreResult::Source_Missing;
 }
 
-void TextureCubeMap::prepare(const VulkanDevice *device)
+void TextureCubeMap::prepare(const VulkanDevice *device, VkImageUsageFlags usage)
 {
     auto imageInfo = vkInits::imageCreateInfo();
     imageInfo.format = format;
-    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | usage;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.extent = {extent.width, extent.height, 1};
     imageInfo.arrayLayers = 6;
@@ -333,12 +443,7 @@ void TextureCubeMap::prepare(const VulkanDevice *device)
     imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
     vkCreateImage(device->device, &imageInfo, nullptr, &image);
 
-    VkMemoryRequirements memReqs{};
-    vkGetImageMemoryRequirements(device->device, image, &memReqs);
-
-    auto allocInfo = device->getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-    vkAllocateMemory(device->device, &allocInfo, nullptr, &memory);
-    vkBindImageMemory(device->device, image, memory, 0);
+    memory = device->allocateImageMemory(image, MEM_FLAG_GPU_LOCAL);
 
     auto samplerInfo = vkInits::samplerCreateInfo(float(mipLevels));
     samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
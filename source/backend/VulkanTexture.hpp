@@ -2,8 +2,12 @@
 
 #include "vulkan_initialisers.hpp"
 #include "VulkanDevice.hpp"
+#include "VulkanImageCache.hpp"
+#include "upload_batch.hpp"
+#include "mip_chain.hpp"
 
 constexpr uint8_t TEX2D_DEFAULT[] = {255, 255, 225, 255};
+constexpr uint32_t MAX_MIP_LEVELS = 16;
 
 class TextureBase
 {
@@ -20,40 +24,90 @@ public:
 protected:
     void updateDescriptor();
 
-    VkDeviceMemory          memory;
+    MemoryAllocation        memory;
     VkSampler               sampler;
 };
 
+// Levels follow each other from pixels, in whatever order the file keeps them
 struct ImageFile
 {
-    uint8_t*    pixels;
-    VkExtent2D  extent;
-    VkFormat    format;
-    uint32_t    bytesPerPixel;
-    bool        heapFreeFlag;
+    uint8_t*        pixels;
+    VkExtent2D      extent;
+    VkFormat        format;
+    uint32_t        bytesPerPixel;  // 0 for block compressed formats
+    uint32_t        mipLevels;
+    VkDeviceSize    size;           // Of all levels
+    VkDeviceSize    levelOffsets[MAX_MIP_LEVELS];
+    io::file_map    map;            // KTX2 files are uploaded straight from their mapping
+    bool            heapFreeFlag;   // Loaded from a file, freeFile releases the pixels
 };
 
 class Texture2D : public TextureBase
 {
 public:
+    // KTX2 files are recognised by their identifier and keep their own format and levels,
+    // anything else is decoded by stb_image to reqComp channels of format
     static ImageFile loadFile(const char *filename, VkFormat format, uint32_t reqComp = 4);
     static void freeFile(ImageFile &file);
 
+    // Packs greyscale images into the channels of one RGBA8 image, file i fills channel i and
+    // channels past count are 1. The images have to be the same size, otherwise the default
+    // comes back. A single file is loaded as is
+    static ImageFile loadChannels(const char *const *filenames, uint32_t count, VkFormat format);
+
+    // Single level file of pixels owned by the caller
+    static ImageFile wrapPixels(const uint8_t *pixels, VkExtent2D extent, VkFormat format, uint32_t bytesPerPixel);
+
+    // Buffer to image copies of every level in the file, with its pixels at bufferOffset
+    static uint32_t copyRegions(const ImageFile &file, VkDeviceSize bufferOffset, VkBufferImageCopy *regions);
+
+    // Whether the device can blit mip chains of the format, create filters the others on the CPU
+    static bool blitsMipMaps(const VulkanDevice *device, VkFormat format);
+
+    // Layout of the full chain of a single level file as mipChain::Generate writes it, false
+    // when the CPU can not filter its format. The pixels still only hold level 0
+    static bool mipChainLayout(const ImageFile &file, ImageFile &chain);
+
+    // Image, view and sampler with undefined contents. Levels beyond the first come from the
+    // file, without them genMipMaps adds a chain when the format can be blitted
+    void prepare(const VulkanDevice *device, VkExtent2D size, VkFormat imageFormat,
+                 bool genMipMaps = false, uint32_t levels = 1);
+
+    // Blits the mip chain down from level 0, which has to be in TRANSFER_SRC_OPTIMAL.
+    // Every level ends up shader readable
+    void recordMipMaps(VkCommandBuffer command) const;
+
+    // The device has to be able to sample the format of the file
     void create(const VulkanDevice *device,
-                      VkQueue queue,
+                      UploadBatch &upload,
                       const ImageFile &file,
                       bool genMipMaps = false);
+
+    // create with a mip chain filtered on the CPU straight into the staging memory, whether
+    // or not the device could blit it. False when the format can not be filtered
+    bool createMipChain(const VulkanDevice *device, UploadBatch &upload, const ImageFile &file,
+                        mip_filter filter, ThreadPool *pool = nullptr);
 };
 
-// Loads HDR images with 32-bit float precision
+// Loads HDR images, decoded as 32-bit floats and converted to the storage format while they
+// are staged. R16G16B16A16_SFLOAT halves the staging and image memory of R32G32B32A32_SFLOAT,
+// B10G11R11_UFLOAT_PACK32 quarters it but drops the sign and keeps 5 to 6 mantissa bits.
+// Formats the device can not filter linearly fall back to R16G16B16A16_SFLOAT
 class HDRImage : public TextureBase
 {
 public:
-    CoreResult load(const VulkanDevice *device, VkQueue queue, const char *filename);
+    CoreResult load(const VulkanDevice *device, UploadBatch &upload, const char *filename,
+                    VkFormat storage = VK_FORMAT_R16G16B16A16_SFLOAT);
 };
 
 class TextureCubeMap : public TextureBase
 {
 public:
-    void prepare(const VulkanDevice *device);
+    // Usage is added to sampling and transfers, storage for maps baked by compute
+    void prepare(const VulkanDevice *device, VkImageUsageFlags usage = 0);
+
+    ImageCacheDesc cacheDesc() const
+    {
+        return {format, extent, mipLevels, 6};
+    }
 };
\ No newline at end of file
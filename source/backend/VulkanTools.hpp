@@ -99,5 +99,86 @@ namespace vkTools
         vkCmdPipelineBarrier(cmd, srcStageMask, dstStageMask, 0, 0, nullptr,
                              0, nullptr, 1, &imageBarrier);
     }
+
+    // Bytes per texel of uncompressed formats, 0 for anything else
+    TOOLS_API uint32_t FormatSize(VkFormat format)
+    {
+        switch (format)
+        {
+            case VK_FORMAT_R8_UNORM:
+            case VK_FORMAT_R8_SRGB:
+                return 1;
+            case VK_FORMAT_R8G8_UNORM:
+            case VK_FORMAT_R16_SFLOAT:
+                return 2;
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+            case VK_FORMAT_R16G16_SFLOAT:
+            case VK_FORMAT_R32_SFLOAT:
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                return 4;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+            case VK_FORMAT_R32G32_SFLOAT:
+                return 8;
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                return 16;
+            default:
+                return 0;
+        }
+    }
+
+    // Bytes per 4x4 block of BC compressed formats, 0 for anything else
+    TOOLS_API uint32_t FormatBlockSize(VkFormat format)
+    {
+        switch (format)
+        {
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+            case VK_FORMAT_BC4_SNORM_BLOCK:
+                return 8;
+            case VK_FORMAT_BC2_UNORM_BLOCK:
+            case VK_FORMAT_BC2_SRGB_BLOCK:
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            case VK_FORMAT_BC5_SNORM_BLOCK:
+            case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+            case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+                return 16;
+            default:
+                return 0;
+        }
+    }
+
+    // Buffer offsets of buffer to image copies have to be multiples of both the texel or block
+    // size and 4, their least common multiple is 12 for a 3 byte texel and 48 for a 12 byte one
+    TOOLS_API uint32_t CopyAlignment(VkFormat format)
+    {
+        const uint32_t size = FormatBlockSize(format) ? FormatBlockSize(format) : FormatSize(format);
+        if(size == 0)
+            return 4;
+
+        uint32_t alignment = size;
+        while (alignment % 4 != 0)
+            alignment += size;
+        return alignment;
+    }
+
+    // Tightly packed bytes of one mip level, 0 when the format is unknown
+    TOOLS_API VkDeviceSize ImageLevelSize(VkFormat format, VkExtent2D extent, uint32_t level)
+    {
+        const VkDeviceSize width = max(extent.width >> level, 1u);
+        const VkDeviceSize height = max(extent.height >> level, 1u);
+        if(const auto blockSize = FormatBlockSize(format))
+            return ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+        return width * height * FormatSize(format);
+    }
 #undef TOOLS_API
 }
\ No newline at end of file
@@ -0,0 +1,608 @@
+#include "asset_loader.hpp"
+#include <stdio.h>
+#include <string.h>
+
+// Ring allocation sizes, their starts are also aligned for copies of the job's format
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+static VkDeviceSize ImageMemorySize(const Texture2D &texture)
+{
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < texture.mipLevels; level++)
+        size += vkTools::ImageLevelSize(texture.format, texture.extent, level);
+    return size;
+}
+
+// Levels of a chain from Texture2D::mipChainLayout. Each worker filters its own texture,
+// the pool is already busy with the decodes
+static void GenerateMipChain(const ImageFile &chain, uint8_t *target)
+{
+    mipChain::Generate(chain.pixels, chain.format, chain.extent, chain.mipLevels, chain.levelOffsets, target,
+                       mipChain::PreferredFilter(chain.format));
+}
+
+void AssetLoader::init(const VulkanDevice *vulkanDevice, VkQueue graphics, VkQueue transfer, uint32_t threadCount)
+{
+    device = vulkanDevice;
+    graphicsQueue = graphics;
+    transferQueue = transfer;
+    ownershipTransfer = device->queueBits.transfer != device->queueBits.graphics;
+
+    for (auto &job : jobs)
+        job.state.store(job_state::queued, std::memory_order_relaxed);
+    jobCount = 0;
+    retiredCount = 0;
+    readyUnreported = 0;
+    published.store(0, std::memory_order_relaxed);
+    decodeBase = 0;
+    decodeEnd = 0;
+    batchCount = 0;
+    flushTime = 0.0;
+    loadStats = {};
+    quit = false;
+
+    coordinator = nullptr;
+    syncPending = false;
+    synchronous = !device->timelineSemaphores;
+    if(synchronous)
+        return;
+
+    if(threadCount == 0)
+        threadCount = max(pltf::ProcessorCount(), 2u) - 1;
+
+    // NOTE(arle): The coordinator runs the pool's loops, parallelFor blocks its caller and
+    // that must not be the render thread
+    pool.init(threadCount);
+    wake = pltf::SemaphoreCreate(0);
+    coordinator = pltf::ThreadCreate(coordinatorMain, this);
+    if(coordinator == nullptr)
+    {
+        pool.destroy();
+        pltf::SemaphoreDestroy(wake);
+        synchronous = true;
+        return;
+    }
+
+    device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEM_FLAG_HOST_VISIBLE, ASSET_STAGING_SIZE, ring);
+    ring.map(device->device);
+    ringLock = pltf::SemaphoreCreate(1);
+    ringSpace = pltf::SemaphoreCreate(0);
+    ringWaiters = 0;
+    ringPositions = {0, 0, ASSET_STAGING_SIZE};
+    ringOrderCount = 0;
+    ringOrderFreed = 0;
+
+    auto poolInfo = vkInits::commandPoolCreateInfo(device->queueBits.transfer);
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    vkCreateCommandPool(device->device, &poolInfo, nullptr, &transferPool);
+    poolInfo.queueFamilyIndex = device->queueBits.graphics;
+    vkCreateCommandPool(device->device, &poolInfo, nullptr, &graphicsPool);
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    auto semaphoreInfo = vkInits::semaphoreCreateInfo();
+    semaphoreInfo.pNext = &timelineInfo;
+    vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &transferTimeline);
+    vkCreateSemaphore(device->device, &semaphoreInfo, nullptr, &graphicsTimeline);
+    transferSubmitted = 0;
+    graphicsSubmitted = 0;
+}
+
+void AssetLoader::destroy()
+{
+    if(syncPending)
+        flush();
+
+    if(!synchronous)
+    {
+        // Workers waiting for ring space or still decoding give up their jobs
+        quit = true;
+        pltf::SemaphoreSignal(ringSpace, pool.threadCount());
+        pltf::SemaphoreSignal(wake);
+        pltf::ThreadJoin(coordinator);
+        pool.destroy();
+
+        pltf::SemaphoreDestroy(wake);
+        pltf::SemaphoreDestroy(ringLock);
+        pltf::SemaphoreDestroy(ringSpace);
+        ring.destroy(device->device);
+
+        vkDestroyCommandPool(device->device, transferPool, nullptr);
+        vkDestroyCommandPool(device->device, graphicsPool, nullptr);
+        vkDestroySemaphore(device->device, transferTimeline, nullptr);
+        vkDestroySemaphore(device->device, graphicsTimeline, nullptr);
+    }
+
+    for (uint32_t i = 0; i < jobCount; i++)
+    {
+        auto &job = jobs[i];
+        if(job.state.load(std::memory_order_acquire) == job_state::ready)
+            continue;
+
+        Texture2D::freeFile(job.file);
+        job.staging.destroy(device->device);
+        job.texture.destroy(device->device);
+    }
+    jobCount = 0;
+    retiredCount = 0;
+}
+
+asset_handle AssetLoader::loadTexture(const char *filename, VkFormat format, Texture2D &target, bool genMipMaps)
+{
+    return loadPacked(&filename, 1, format, target, genMipMaps);
+}
+
+asset_handle AssetLoader::loadPacked(const char *const *filenames, uint32_t count, VkFormat format,
+                                     Texture2D &target, bool genMipMaps)
+{
+    count = min(count, MAX_PACKED_CHANNELS);
+
+    // Past the job limit textures are loaded right away
+    if(jobCount == MAX_ASSET_LOADS)
+    {
+        UploadBatch upload;
+        upload.begin(device, graphicsQueue);
+        auto file = Texture2D::loadChannels(filenames, count, format);
+        if(!device->formatSupport(file.format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+        {
+            Texture2D::freeFile(file);
+            file = Texture2D::wrapPixels(TEX2D_DEFAULT, {1, 1}, VK_FORMAT_R8G8B8A8_SRGB, 4);
+        }
+        target.create(device, upload, file, genMipMaps);
+        Texture2D::freeFile(file);
+        upload.end();
+        return ASSET_LOADED;
+    }
+
+    const asset_handle handle = jobCount++;
+    auto &job = jobs[handle];
+    for (uint32_t i = 0; i < count; i++)
+        snprintf(job.paths[i], sizeof(job.paths[i]), "%s", filenames[i]);
+    job.pathCount = count;
+    job.format = format;
+    job.genMipMaps = genMipMaps;
+    job.target = &target;
+    job.texture = Texture2D{};
+    job.file = {};
+    job.cpuMipChain = false;
+    job.staging = {};
+    job.stagingOffset = 0;
+    job.stagingEnd = 0;
+    job.transferValue = 0;
+    job.graphicsValue = 0;
+    job.decodeSeconds = 0.0;
+    job.retired = false;
+    job.state.store(job_state::queued, std::memory_order_relaxed);
+
+    if(synchronous)
+        loadSynchronous(job);
+    return handle;
+}
+
+void AssetLoader::loadSynchronous(job_T &job)
+{
+    // Loads without the workers are staged into one batch, which flush submits
+    if(!syncPending)
+    {
+        flushTime = pltf::GetTime();
+        syncUpload.begin(device, graphicsQueue);
+        syncPending = true;
+    }
+
+    const auto begin = pltf::GetTime();
+    auto file = loadJobFile(job);
+    loadStats.decodeSeconds += pltf::GetTime() - begin;
+
+    if(!file.heapFreeFlag || !device->formatSupport(file.format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+    {
+        Texture2D::freeFile(file);
+        job.state.store(job_state::failed, std::memory_order_relaxed);
+        job.retired = true;
+        retiredCount++;
+        loadStats.failed++;
+        return;
+    }
+
+    job.target->create(device, syncUpload, file, job.genMipMaps);
+    loadStats.bytes += file.size;
+    loadStats.imageBytes += ImageMemorySize(*job.target);
+    Texture2D::freeFile(file);
+
+    job.state.store(job_state::uploading, std::memory_order_relaxed);
+}
+
+void AssetLoader::flush()
+{
+    if(synchronous)
+    {
+        if(!syncPending)
+            return;
+
+        syncUpload.end();
+        syncPending = false;
+        for (uint32_t i = 0; i < jobCount; i++)
+        {
+            auto &job = jobs[i];
+            if(job.retired)
+                continue;
+
+            job.state.store(job_state::ready, std::memory_order_relaxed);
+            job.retired = true;
+            retiredCount++;
+            readyUnreported++;
+            loadStats.textures++;
+        }
+        loadStats.seconds += pltf::GetTime() - flushTime;
+        return;
+    }
+
+    if(published.load(std::memory_order_relaxed) == jobCount)
+        return;
+
+    // Load times are measured per burst, from the first flush after everything settled
+    if(retiredCount == published.load(std::memory_order_relaxed))
+        flushTime = pltf::GetTime();
+    published.store(jobCount, std::memory_order_release);
+    pltf::SemaphoreSignal(wake);
+}
+
+void AssetLoader::coordinatorMain(void *param)
+{
+    auto loader = static_cast<AssetLoader*>(param);
+    for (;;)
+    {
+        pltf::SemaphoreWait(loader->wake);
+        if(loader->quit)
+            return;
+
+        // Several flushes may have piled up behind a running loop, they are taken together
+        loader->decodeBase = loader->decodeEnd;
+        loader->decodeEnd = loader->published.load(std::memory_order_acquire);
+        if(loader->decodeEnd > loader->decodeBase)
+            loader->pool.parallelFor(loader->decodeEnd - loader->decodeBase, decodeTask, loader);
+    }
+}
+
+void AssetLoader::decodeTask(void *data, uint32_t index)
+{
+    auto loader = static_cast<AssetLoader*>(data);
+    loader->decode(loader->jobs[loader->decodeBase + index]);
+}
+
+ImageFile AssetLoader::loadJobFile(const job_T &job)
+{
+    const char *filenames[MAX_PACKED_CHANNELS];
+    for (uint32_t i = 0; i < job.pathCount; i++)
+        filenames[i] = job.paths[i];
+    return Texture2D::loadChannels(filenames, job.pathCount, job.format);
+}
+
+void AssetLoader::decode(job_T &job)
+{
+    if(quit)
+    {
+        job.state.store(job_state::failed, std::memory_order_release);
+        return;
+    }
+
+    const auto begin = pltf::GetTime();
+    job.file = loadJobFile(job);
+
+    // Missing files come back as the 1x1 default, the placeholder stays in their place.
+    // So do KTX2 files in a format the device can not sample
+    if(!job.file.heapFreeFlag || !device->formatSupport(job.file.format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+    {
+        Texture2D::freeFile(job.file);
+        job.file = {};
+        job.state.store(job_state::failed, std::memory_order_release);
+        return;
+    }
+
+    // Chains the device can not blit are filtered here, the worker's own share of the pool
+    ImageFile chain;
+    job.cpuMipChain = job.genMipMaps && !Texture2D::blitsMipMaps(device, job.file.format) &&
+                      Texture2D::mipChainLayout(job.file, chain);
+    if(job.cpuMipChain)
+        job.file = chain;
+
+    // NOTE(arle): Buffers can only be created on the main thread, images that would never
+    // fit the ring keep their pixels and get a staging buffer of their own there
+    const auto size = job.file.size;
+    if(size <= ASSET_STAGING_SIZE)
+    {
+        if(!reserveStaging(size, vkTools::CopyAlignment(job.file.format), uint32_t(&job - jobs)))
+        {
+            Texture2D::freeFile(job.file);
+            job.state.store(job_state::failed, std::memory_order_release);
+            return;
+        }
+
+        auto staged = static_cast<uint8_t*>(ring.mapped) + job.stagingOffset;
+        if(job.cpuMipChain)
+            GenerateMipChain(job.file, staged);
+        else
+            memcpy(staged, job.file.pixels, size);
+        Texture2D::freeFile(job.file);
+    }
+    job.decodeSeconds = pltf::GetTime() - begin;
+    job.state.store(job_state::staged, std::memory_order_release);
+}
+
+bool AssetLoader::reserveStaging(VkDeviceSize size, VkDeviceSize alignment, uint32_t jobIndex)
+{
+    auto &job = jobs[jobIndex];
+    size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+    for (;;)
+    {
+        pltf::SemaphoreWait(ringLock);
+
+        uint64_t start = 0;
+        if(stagingRing::Reserve(ringPositions, size, alignment, start))
+        {
+            job.stagingOffset = start % ASSET_STAGING_SIZE;
+            job.stagingEnd = start + size;
+            ringOrder[ringOrderCount++] = jobIndex;
+            pltf::SemaphoreSignal(ringLock);
+            return true;
+        }
+
+        ringWaiters++;
+        pltf::SemaphoreSignal(ringLock);
+
+        pltf::SemaphoreWait(ringSpace);
+        if(quit)
+            return false;
+    }
+}
+
+void AssetLoader::releaseStaging(uint64_t transferDone)
+{
+    pltf::SemaphoreWait(ringLock);
+
+    // Space is given back in allocation order, a copy still in flight holds up the rest
+    bool released = false;
+    while (ringOrderFreed < ringOrderCount)
+    {
+        const auto &job = jobs[ringOrder[ringOrderFreed]];
+        const auto state = job.state.load(std::memory_order_acquire);
+        const bool submitted = state == job_state::uploading || state == job_state::ready;
+        if(!submitted || job.transferValue > transferDone)
+            break;
+
+        stagingRing::Release(ringPositions, job.stagingEnd);
+        ringOrderFreed++;
+        released = true;
+    }
+
+    if(released && ringWaiters > 0)
+    {
+        pltf::SemaphoreSignal(ringSpace, ringWaiters);
+        ringWaiters = 0;
+    }
+
+    pltf::SemaphoreSignal(ringLock);
+}
+
+uint32_t AssetLoader::update()
+{
+    if(synchronous)
+    {
+        const auto count = readyUnreported;
+        readyUnreported = 0;
+        return count;
+    }
+
+    uint64_t transferDone = 0, graphicsDone = 0;
+    vkGetSemaphoreCounterValue(device->device, transferTimeline, &transferDone);
+    vkGetSemaphoreCounterValue(device->device, graphicsTimeline, &graphicsDone);
+
+    // Retire finished work
+
+    uint32_t readyCount = 0;
+    const uint32_t publishedCount = published.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < publishedCount; i++)
+    {
+        auto &job = jobs[i];
+        if(job.retired)
+            continue;
+
+        const auto state = job.state.load(std::memory_order_acquire);
+        if(state == job_state::failed)
+        {
+            job.retired = true;
+            retiredCount++;
+            loadStats.failed++;
+            loadStats.decodeSeconds += job.decodeSeconds;
+        }
+        else if(state == job_state::uploading && job.graphicsValue <= graphicsDone)
+        {
+            job.staging.destroy(device->device);
+            job.staging = {};
+
+            *job.target = job.texture;
+            job.state.store(job_state::ready, std::memory_order_relaxed);
+            job.retired = true;
+            retiredCount++;
+            readyCount++;
+            loadStats.textures++;
+            loadStats.decodeSeconds += job.decodeSeconds;
+        }
+    }
+
+    for (uint32_t i = 0; i < batchCount;)
+    {
+        if(batches[i].graphicsValue <= graphicsDone)
+        {
+            vkFreeCommandBuffers(device->device, transferPool, 1, &batches[i].transfer);
+            vkFreeCommandBuffers(device->device, graphicsPool, 1, &batches[i].graphics);
+            batches[i] = batches[--batchCount];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    releaseStaging(transferDone);
+
+    submitStaged();
+
+    if(readyCount > 0 && idle())
+        loadStats.seconds = pltf::GetTime() - flushTime;
+    return readyCount;
+}
+
+void AssetLoader::submitStaged()
+{
+    uint32_t staged[MAX_ASSET_LOADS];
+    uint32_t stagedCount = 0;
+    const uint32_t publishedCount = published.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < publishedCount; i++)
+    {
+        if(jobs[i].state.load(std::memory_order_acquire) == job_state::staged)
+            staged[stagedCount++] = i;
+    }
+    if(stagedCount == 0)
+        return;
+
+    auto &batch = batches[batchCount++];
+    const auto beginInfo = vkInits::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    auto allocateInfo = vkInits::commandBufferAllocateInfo(transferPool, 1);
+    vkAllocateCommandBuffers(device->device, &allocateInfo, &batch.transfer);
+    allocateInfo.commandPool = graphicsPool;
+    vkAllocateCommandBuffers(device->device, &allocateInfo, &batch.graphics);
+
+    vkBeginCommandBuffer(batch.transfer, &beginInfo);
+    vkBeginCommandBuffer(batch.graphics, &beginInfo);
+
+    const uint64_t transferValue = ++transferSubmitted;
+    const uint64_t graphicsValue = ++graphicsSubmitted;
+
+    for (uint32_t i = 0; i < stagedCount; i++)
+    {
+        auto &job = jobs[staged[i]];
+        auto &texture = job.texture;
+        texture.prepare(device, job.file.extent, job.file.format, job.genMipMaps, job.file.mipLevels);
+
+        loadStats.bytes += job.file.size;
+        loadStats.imageBytes += ImageMemorySize(texture);
+
+        VkBuffer source = ring.data;
+        VkDeviceSize sourceOffset = job.stagingOffset;
+        if(job.file.pixels != nullptr)
+        {
+            device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEM_FLAG_HOST_VISIBLE, job.file.size,
+                                 job.staging, job.cpuMipChain ? nullptr : job.file.pixels);
+            if(job.cpuMipChain)
+            {
+                job.staging.map(device->device);
+                GenerateMipChain(job.file, static_cast<uint8_t*>(job.staging.mapped));
+                job.staging.unmap(device->device);
+            }
+            Texture2D::freeFile(job.file);
+            source = job.staging.data;
+            sourceOffset = 0;
+        }
+
+        auto levels = vkInits::imageSubresourceRange();
+        levels.levelCount = job.file.mipLevels;
+        vkTools::SetImageLayout(batch.transfer,
+                                VK_IMAGE_LAYOUT_UNDEFINED,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                texture.image,
+                                levels);
+
+        VkBufferImageCopy regions[MAX_MIP_LEVELS];
+        const auto regionCount = Texture2D::copyRegions(job.file, sourceOffset, regions);
+        vkCmdCopyBufferToImage(batch.transfer, source, texture.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, regions);
+
+        // Level 0 is blitted from when the mip chain is generated, sampled directly otherwise
+        const bool mips = texture.mipLevels > job.file.mipLevels;
+        const auto finalLayout = mips ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        const VkAccessFlags finalAccess = mips ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+        const VkPipelineStageFlags finalStage = mips ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+        // NOTE(arle): Exclusive images change owner with a matching release on the transfer
+        // queue and acquire on the graphics queue, the layout transition happens once between
+        // the two. With a single family the release alone is an ordinary barrier
+        auto barrier = vkInits::imageMemoryBarrier(texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout);
+        barrier.subresourceRange = levels;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = ownershipTransfer ? 0 : finalAccess;
+        if(ownershipTransfer)
+        {
+            barrier.srcQueueFamilyIndex = device->queueBits.transfer;
+            barrier.dstQueueFamilyIndex = device->queueBits.graphics;
+        }
+        vkCmdPipelineBarrier(batch.transfer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             ownershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : finalStage,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        if(ownershipTransfer)
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = finalAccess;
+            vkCmdPipelineBarrier(batch.graphics, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, finalStage,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+
+        // Transfer queues have no blits, the mip chain is built on the graphics queue
+        if(mips)
+            texture.recordMipMaps(batch.graphics);
+
+        job.transferValue = transferValue;
+        job.graphicsValue = graphicsValue;
+        job.state.store(job_state::uploading, std::memory_order_relaxed);
+    }
+
+    vkEndCommandBuffer(batch.transfer);
+    vkEndCommandBuffer(batch.graphics);
+    batch.graphicsValue = graphicsValue;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &transferValue;
+
+    auto submitInfo = vkInits::submitInfo(&batch.transfer, 1);
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &transferTimeline;
+    vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+
+    // The graphics half waits on the GPU, the host never blocks on the copies
+    const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &transferValue;
+    timelineInfo.pSignalSemaphoreValues = &graphicsValue;
+
+    submitInfo = vkInits::submitInfo(&batch.graphics, 1);
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &transferTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &graphicsTimeline;
+    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+}
+
+bool AssetLoader::ready(asset_handle handle) const
+{
+    if(handle == ASSET_LOADED)
+        return true;
+    return handle < jobCount && jobs[handle].state.load(std::memory_order_relaxed) == job_state::ready;
+}
+
+bool AssetLoader::failed(asset_handle handle) const
+{
+    return handle < jobCount && jobs[handle].retired &&
+           jobs[handle].state.load(std::memory_order_relaxed) == job_state::failed;
+}
\ No newline at end of file
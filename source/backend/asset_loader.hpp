@@ -0,0 +1,153 @@
+#pragma once
+
+#include "VulkanTexture.hpp"
+#include "thread_pool.hpp"
+#include "upload_batch.hpp"
+#include "staging_ring.hpp"
+
+// Streams textures in while frames keep rendering. Files are decoded on a thread pool
+// straight into a persistently mapped staging ring, the main thread records the copies on
+// the transfer queue and hands the images over to the graphics queue, which blits the mip
+// chains. Formats the device can not blit get their chain from the worker instead, filtered
+// straight into the ring. Both queues signal a timeline semaphore per submission, a texture is ready once
+// the graphics timeline has passed the value of its batch. Until then the caller keeps
+// drawing with a placeholder.
+//
+// Devices without timeline semaphores (before 1.2) decode on the calling thread as the
+// textures are queued and upload them in one batch on the graphics queue when flushed.
+
+constexpr uint32_t MAX_ASSET_LOADS = 64;
+constexpr VkDeviceSize ASSET_STAGING_SIZE = MegaBytes(64);
+constexpr uint32_t MAX_PACKED_CHANNELS = 4;
+
+using asset_handle = uint32_t;
+constexpr asset_handle ASSET_LOADED = MAX_ASSET_LOADS; // Loaded on the spot, the job limit was reached
+
+struct AssetLoadStats
+{
+    uint32_t    textures;
+    uint32_t    failed;
+    uint64_t    bytes;          // Texel data uploaded, every level the files hold
+    uint64_t    imageBytes;     // Of all levels once mips are generated, about what the images take up
+    double      decodeSeconds;  // Summed over all workers
+    double      seconds;        // First flush to the last texture becoming ready
+};
+
+class AssetLoader
+{
+public:
+    // 0 threads leaves one processor to the render thread
+    void init(const VulkanDevice *device, VkQueue graphicsQueue, VkQueue transferQueue, uint32_t threadCount = 0);
+
+    // The device has to be idle, textures that were not handed over yet are destroyed
+    void destroy();
+
+    // target is only written once the texture is ready, it has to stay in place until then
+    asset_handle loadTexture(const char *filename, VkFormat format, Texture2D &target, bool genMipMaps = false);
+
+    // One RGBA8 texture from up to MAX_PACKED_CHANNELS greyscale images, see Texture2D::loadChannels
+    asset_handle loadPacked(const char *const *filenames, uint32_t count, VkFormat format, Texture2D &target,
+                            bool genMipMaps = false);
+
+    // Starts decoding everything queued since the last flush
+    void flush();
+
+    // Submits finished decodes and retires finished uploads, main thread only.
+    // Returns how many textures became ready since the last call
+    uint32_t update();
+
+    bool ready(asset_handle handle) const;
+    bool failed(asset_handle handle) const;
+    bool idle() const {return retiredCount == jobCount;}
+
+    const AssetLoadStats &stats() const {return loadStats;}
+
+private:
+    enum class job_state : uint32_t
+    {
+        queued,
+        staged,     // Decoded, texels are in the staging ring or still in file
+        failed,
+        uploading,
+        ready
+    };
+
+    struct job_T
+    {
+        char                    paths[MAX_PACKED_CHANNELS][256];
+        uint32_t                pathCount;
+        VkFormat                format;
+        bool                    genMipMaps;
+        Texture2D*              target;
+        Texture2D               texture;
+        ImageFile               file;           // Pixels are kept for images larger than the ring
+        bool                    cpuMipChain;    // file has the chain's layout, pixels only level 0
+        VulkanBuffer            staging;        // Dedicated staging of those
+        VkDeviceSize            stagingOffset;
+        uint64_t                stagingEnd;     // Ring position past this job, 0 outside the ring
+        uint64_t                transferValue;
+        uint64_t                graphicsValue;
+        double                  decodeSeconds;
+        bool                    retired;
+        std::atomic<job_state>  state;
+    };
+
+    struct batch_T
+    {
+        VkCommandBuffer         transfer;
+        VkCommandBuffer         graphics;
+        uint64_t                graphicsValue;
+    };
+
+    static void coordinatorMain(void *param);
+    static void decodeTask(void *data, uint32_t index);
+    static ImageFile loadJobFile(const job_T &job);
+    void decode(job_T &job);
+    bool reserveStaging(VkDeviceSize size, VkDeviceSize alignment, uint32_t jobIndex);
+    void releaseStaging(uint64_t transferDone);
+    void submitStaged();
+    void loadSynchronous(job_T &job);
+
+    const VulkanDevice*     device;
+    VkQueue                 graphicsQueue;
+    VkQueue                 transferQueue;
+    bool                    synchronous;
+    bool                    syncPending;        // syncUpload has loads that were not flushed
+    UploadBatch             syncUpload;
+    bool                    ownershipTransfer;  // Transfer and graphics families differ
+
+    job_T                   jobs[MAX_ASSET_LOADS];
+    uint32_t                jobCount;
+    uint32_t                retiredCount;
+    uint32_t                readyUnreported;
+    std::atomic<uint32_t>   published;          // Jobs handed to the coordinator
+    uint32_t                decodeBase;         // First job of the running parallelFor
+    uint32_t                decodeEnd;
+
+    ThreadPool              pool;
+    pltf::thread            coordinator;
+    pltf::semaphore         wake;
+    std::atomic<bool>       quit;
+
+    // Staging ring, positions guarded by ringLock
+    VulkanBuffer            ring;
+    pltf::semaphore         ringLock;
+    pltf::semaphore         ringSpace;
+    uint32_t                ringWaiters;
+    StagingRing             ringPositions;
+    uint32_t                ringOrder[MAX_ASSET_LOADS]; // Jobs in allocation order
+    uint32_t                ringOrderCount;
+    uint32_t                ringOrderFreed;
+
+    VkCommandPool           transferPool;
+    VkCommandPool           graphicsPool;
+    VkSemaphore             transferTimeline;
+    VkSemaphore             graphicsTimeline;
+    uint64_t                transferSubmitted;
+    uint64_t                graphicsSubmitted;
+    batch_T                 batches[MAX_ASSET_LOADS];
+    uint32_t                batchCount;
+
+    double                  flushTime;
+    AssetLoadStats          loadStats;
+};
\ No newline at end of file
@@ -77,4 +77,9 @@ void Camera::updateVectors()
     m_front = normalise(vec3(yawCosine * pitchCosine, pitchSine, yawSine * pitchCosine));
     m_right = normalise(cross(m_front, GLOBAL_UP));
     m_up = normalise(cross(m_right, m_front));
-}
\ No newline at end of file
+}
+
+Frustum Camera::frustum() const
+{
+    return culling::ExtractFrustum(m_view * m_proj);
+}
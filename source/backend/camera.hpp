@@ -2,6 +2,7 @@
 
 #include "../mv_utils/mat4.hpp"
 #include "VulkanDevice.hpp"
+#include "culling.hpp"
 
 struct CameraControls
 {
@@ -60,6 +61,9 @@ public:
     MvpMatrix getModelViewProjection();
     ModelViewMatrix getModelView();
 
+    // World space planes of the view and projection the last update built
+    Frustum frustum() const;
+
     float           fov;
     float           sensitivity;
     CameraControls  controls;
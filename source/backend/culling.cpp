@@ -0,0 +1,293 @@
+#include "culling.hpp"
+#include "../mv_utils/cpu_features.hpp"
+#include <immintrin.h>
+#include <cmath>
+
+constexpr uint32_t PLANE_COUNT = 6;
+
+Frustum culling::ExtractFrustum(mat4x4 viewProjection)
+{
+    // Clip space is v * viewProjection, so column j of the matrix gives clip coordinate j.
+    // Each plane is w plus or minus one of x, y, z
+    const auto &m = viewProjection;
+    const auto column = [&m](uint32_t j)
+    {
+        return vec4(m(0, j), m(1, j), m(2, j), m(3, j));
+    };
+    const auto x = column(0), y = column(1), z = column(2), w = column(3);
+
+    Frustum frustum;
+    frustum.planes[0] = w + x;
+    frustum.planes[1] = w - x;
+    frustum.planes[2] = w + y;
+    frustum.planes[3] = w - y;
+    frustum.planes[4] = w + z;
+    frustum.planes[5] = w - z;
+
+    for (auto &plane : frustum.planes)
+    {
+        const float len = length(vec3(plane.x, plane.y, plane.z));
+        plane = plane * (len > 0.0f ? 1.0f / len : 0.0f);
+    }
+    return frustum;
+}
+
+ModelBounds culling::FromBox(BoundingBox box)
+{
+    if(box.min.x > box.max.x)
+        box = {vec3(0.0f), vec3(0.0f)};
+
+    ModelBounds bounds;
+    bounds.box = box;
+    bounds.sphere.centre = (box.min + box.max) * 0.5f;
+    bounds.sphere.radius = length(box.max - box.min) * 0.5f;
+    return bounds;
+}
+
+ModelBounds culling::ComputeBounds(const vec3<float> *positions, size_t count, size_t stride)
+{
+    auto box = EmptyBox();
+    auto bytes = reinterpret_cast<const uint8_t*>(positions);
+    for (size_t i = 0; i < count; i++)
+        Extend(box, *reinterpret_cast<const vec3<float>*>(bytes + i * stride));
+    return FromBox(box);
+}
+
+BoundingBox culling::TransformBox(BoundingBox box, mat4x4 m)
+{
+    // NOTE(arle): Arvo's method, the centre moves with the matrix and each new half size is
+    // the old ones through the absolute values of the upper 3x3
+    const auto centre = transformPoint((box.min + box.max) * 0.5f, m);
+    const auto extent = (box.max - box.min) * 0.5f;
+    vec3<float> newExtent;
+    newExtent.x = std::fabs(m(0, 0)) * extent.x + std::fabs(m(1, 0)) * extent.y + std::fabs(m(2, 0)) * extent.z;
+    newExtent.y = std::fabs(m(0, 1)) * extent.x + std::fabs(m(1, 1)) * extent.y + std::fabs(m(2, 1)) * extent.z;
+    newExtent.z = std::fabs(m(0, 2)) * extent.x + std::fabs(m(1, 2)) * extent.y + std::fabs(m(2, 2)) * extent.z;
+    return {centre - newExtent, centre + newExtent};
+}
+
+BoundingSphere culling::TransformSphere(BoundingSphere sphere, mat4x4 m)
+{
+    const float scaleSq = max(max(m(0, 0) * m(0, 0) + m(0, 1) * m(0, 1) + m(0, 2) * m(0, 2),
+                                  m(1, 0) * m(1, 0) + m(1, 1) * m(1, 1) + m(1, 2) * m(1, 2)),
+                              m(2, 0) * m(2, 0) + m(2, 1) * m(2, 1) + m(2, 2) * m(2, 2));
+    return {transformPoint(sphere.centre, m), sphere.radius * std::sqrt(scaleSq)};
+}
+
+// Scalar tests, the reference the batches match
+
+static inline bool SphereCulled(const Frustum &frustum, float x, float y, float z, float radius)
+{
+    for (const auto &p : frustum.planes)
+    {
+        const float d = p.x * x + p.y * y + p.z * z + p.w;
+        if(d < -radius)
+            return true;
+    }
+    return false;
+}
+
+static inline bool BoxCulled(const Frustum &frustum, float cx, float cy, float cz, float ex, float ey, float ez)
+{
+    for (const auto &p : frustum.planes)
+    {
+        const float d = p.x * cx + p.y * cy + p.z * cz + p.w;
+        const float e = std::fabs(p.x) * ex + std::fabs(p.y) * ey + std::fabs(p.z) * ez;
+        if(d + e < 0.0f)
+            return true;
+    }
+    return false;
+}
+
+bool culling::SphereVisible(const Frustum &frustum, BoundingSphere sphere)
+{
+    return !SphereCulled(frustum, sphere.centre.x, sphere.centre.y, sphere.centre.z, sphere.radius);
+}
+
+bool culling::BoxVisible(const Frustum &frustum, BoundingBox box)
+{
+    const auto c = (box.min + box.max) * 0.5f;
+    const auto e = (box.max - box.min) * 0.5f;
+    return !BoxCulled(frustum, c.x, c.y, c.z, e.x, e.y, e.z);
+}
+
+// NOTE(arle): Every lane's index is written and the cursor only moves past the visible ones,
+// no branch on the mask. The cursor never passes the lane it writes, so the output needs no
+// slack beyond count
+static inline uint32_t Emit(uint32_t visibleMask, uint32_t lanes, uint32_t first, uint32_t *visible, uint32_t cursor)
+{
+    for (uint32_t k = 0; k < lanes; k++)
+    {
+        visible[cursor] = first + k;
+        cursor += (visibleMask >> k) & 1;
+    }
+    return cursor;
+}
+
+static uint32_t CullSpheresScalar(const Frustum &frustum, const SphereBatch &batch, uint32_t first, uint32_t *visible,
+                                  uint32_t cursor)
+{
+    for (uint32_t i = first; i < batch.count; i++)
+    {
+        visible[cursor] = i;
+        cursor += SphereCulled(frustum, batch.x[i], batch.y[i], batch.z[i], batch.radius[i]) ? 0 : 1;
+    }
+    return cursor;
+}
+
+static uint32_t CullBoxesScalar(const Frustum &frustum, const BoxBatch &batch, uint32_t first, uint32_t *visible,
+                                uint32_t cursor)
+{
+    for (uint32_t i = first; i < batch.count; i++)
+    {
+        visible[cursor] = i;
+        cursor += BoxCulled(frustum, batch.centreX[i], batch.centreY[i], batch.centreZ[i],
+                            batch.extentX[i], batch.extentY[i], batch.extentZ[i]) ? 0 : 1;
+    }
+    return cursor;
+}
+
+static uint32_t CullSpheresSSE(const Frustum &frustum, const SphereBatch &batch, uint32_t *visible)
+{
+    uint32_t cursor = 0, i = 0;
+    for (; i + 4 <= batch.count; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(batch.x + i), y = _mm_loadu_ps(batch.y + i), z = _mm_loadu_ps(batch.z + i);
+        const __m128 negRadius = _mm_xor_ps(_mm_loadu_ps(batch.radius + i), _mm_set1_ps(-0.0f));
+
+        __m128 culled = _mm_setzero_ps();
+        for (const auto &p : frustum.planes)
+        {
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), x), _mm_mul_ps(_mm_set1_ps(p.y), y));
+            d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z), z)), _mm_set1_ps(p.w));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(d, negRadius));
+        }
+        cursor = Emit(~_mm_movemask_ps(culled) & 0xF, 4, i, visible, cursor);
+    }
+    return CullSpheresScalar(frustum, batch, i, visible, cursor);
+}
+
+static uint32_t CullBoxesSSE(const Frustum &frustum, const BoxBatch &batch, uint32_t *visible)
+{
+    uint32_t cursor = 0, i = 0;
+    for (; i + 4 <= batch.count; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(batch.centreX + i), cy = _mm_loadu_ps(batch.centreY + i);
+        const __m128 cz = _mm_loadu_ps(batch.centreZ + i);
+        const __m128 ex = _mm_loadu_ps(batch.extentX + i), ey = _mm_loadu_ps(batch.extentY + i);
+        const __m128 ez = _mm_loadu_ps(batch.extentZ + i);
+
+        __m128 culled = _mm_setzero_ps();
+        for (const auto &p : frustum.planes)
+        {
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), cx), _mm_mul_ps(_mm_set1_ps(p.y), cy));
+            d = _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z), cz)), _mm_set1_ps(p.w));
+            __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(p.x)), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(p.y)), ey));
+            e = _mm_add_ps(e, _mm_mul_ps(_mm_set1_ps(std::fabs(p.z)), ez));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(_mm_add_ps(d, e), _mm_setzero_ps()));
+        }
+        cursor = Emit(~_mm_movemask_ps(culled) & 0xF, 4, i, visible, cursor);
+    }
+    return CullBoxesScalar(frustum, batch, i, visible, cursor);
+}
+
+TARGET_AVX static uint32_t CullSpheresAVX(const Frustum &frustum, const SphereBatch &batch, uint32_t *visible)
+{
+    __m256 px[PLANE_COUNT], py[PLANE_COUNT], pz[PLANE_COUNT], pw[PLANE_COUNT];
+    for (uint32_t p = 0; p < PLANE_COUNT; p++)
+    {
+        px[p] = _mm256_set1_ps(frustum.planes[p].x);
+        py[p] = _mm256_set1_ps(frustum.planes[p].y);
+        pz[p] = _mm256_set1_ps(frustum.planes[p].z);
+        pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+    }
+
+    uint32_t cursor = 0, i = 0;
+    for (; i + 8 <= batch.count; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(batch.x + i), y = _mm256_loadu_ps(batch.y + i);
+        const __m256 z = _mm256_loadu_ps(batch.z + i);
+        const __m256 negRadius = _mm256_xor_ps(_mm256_loadu_ps(batch.radius + i), _mm256_set1_ps(-0.0f));
+
+        __m256 culled = _mm256_setzero_ps();
+        for (uint32_t p = 0; p < PLANE_COUNT; p++)
+        {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y));
+            d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(pz[p], z)), pw[p]);
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(d, negRadius, _CMP_LT_OQ));
+        }
+        cursor = Emit(~_mm256_movemask_ps(culled) & 0xFF, 8, i, visible, cursor);
+    }
+    return CullSpheresScalar(frustum, batch, i, visible, cursor);
+}
+
+TARGET_AVX static uint32_t CullBoxesAVX(const Frustum &frustum, const BoxBatch &batch, uint32_t *visible)
+{
+    __m256 px[PLANE_COUNT], py[PLANE_COUNT], pz[PLANE_COUNT], pw[PLANE_COUNT];
+    __m256 ax[PLANE_COUNT], ay[PLANE_COUNT], az[PLANE_COUNT];
+    for (uint32_t p = 0; p < PLANE_COUNT; p++)
+    {
+        const auto &plane = frustum.planes[p];
+        px[p] = _mm256_set1_ps(plane.x);
+        py[p] = _mm256_set1_ps(plane.y);
+        pz[p] = _mm256_set1_ps(plane.z);
+        pw[p] = _mm256_set1_ps(plane.w);
+        ax[p] = _mm256_set1_ps(std::fabs(plane.x));
+        ay[p] = _mm256_set1_ps(std::fabs(plane.y));
+        az[p] = _mm256_set1_ps(std::fabs(plane.z));
+    }
+
+    uint32_t cursor = 0, i = 0;
+    for (; i + 8 <= batch.count; i += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(batch.centreX + i), cy = _mm256_loadu_ps(batch.centreY + i);
+        const __m256 cz = _mm256_loadu_ps(batch.centreZ + i);
+        const __m256 ex = _mm256_loadu_ps(batch.extentX + i), ey = _mm256_loadu_ps(batch.extentY + i);
+        const __m256 ez = _mm256_loadu_ps(batch.extentZ + i);
+
+        __m256 culled = _mm256_setzero_ps();
+        for (uint32_t p = 0; p < PLANE_COUNT; p++)
+        {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(px[p], cx), _mm256_mul_ps(py[p], cy));
+            d = _mm256_add_ps(_mm256_add_ps(d, _mm256_mul_ps(pz[p], cz)), pw[p]);
+            __m256 e = _mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey));
+            e = _mm256_add_ps(e, _mm256_mul_ps(az[p], ez));
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(_mm256_add_ps(d, e), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        cursor = Emit(~_mm256_movemask_ps(culled) & 0xFF, 8, i, visible, cursor);
+    }
+    return CullBoxesScalar(frustum, batch, i, visible, cursor);
+}
+
+static simd_path Resolve(simd_path path)
+{
+    if(path == simd_path::best || (path == simd_path::avx && !cpu::Features().avx))
+        return cpu::Features().avx ? simd_path::avx : simd_path::sse;
+    return path;
+}
+
+uint32_t culling::CullSpheres(const Frustum &frustum, const SphereBatch &batch, uint32_t *visible, simd_path path)
+{
+    switch (Resolve(path))
+    {
+        case simd_path::scalar:
+            return CullSpheresScalar(frustum, batch, 0, visible, 0);
+        case simd_path::avx:
+            return CullSpheresAVX(frustum, batch, visible);
+        default:
+            return CullSpheresSSE(frustum, batch, visible);
+    }
+}
+
+uint32_t culling::CullBoxes(const Frustum &frustum, const BoxBatch &batch, uint32_t *visible, simd_path path)
+{
+    switch (Resolve(path))
+    {
+        case simd_path::scalar:
+            return CullBoxesScalar(frustum, batch, 0, visible, 0);
+        case simd_path::avx:
+            return CullBoxesAVX(frustum, batch, visible);
+        default:
+            return CullBoxesSSE(frustum, batch, visible);
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../base.hpp"
+
+// Bounding volumes and view frustum tests. Single volumes are tested directly, batches are
+// given as structure of arrays and tested four (SSE) or eight (AVX) at a time, writing out
+// the indices that survive. All paths evaluate the planes in the same order and return the
+// same indices.
+//
+// Planes come from the view projection matrix, with the OpenGL style -w to w depth range
+// mat4x4::perspective produces. Vulkan clips depth at 0 instead, so the near plane tested
+// here lies slightly in front of the real one and never culls anything visible.
+
+struct BoundingBox
+{
+    vec3<float> min;
+    vec3<float> max;
+};
+
+struct BoundingSphere
+{
+    vec3<float> centre;
+    float       radius;
+};
+
+// Model space, computed when a model is loaded
+struct ModelBounds
+{
+    BoundingBox     box;
+    BoundingSphere  sphere;
+};
+
+// Left, right, bottom, top, near, far. xyz is the unit normal pointing inwards, a point p is
+// inside a plane when dot(xyz, p) + w >= 0
+struct Frustum
+{
+    vec4<float> planes[6];
+};
+
+// Batches of count volumes, one array per component
+struct SphereBatch
+{
+    const float*    x;
+    const float*    y;
+    const float*    z;
+    const float*    radius;
+    uint32_t        count;
+};
+
+struct BoxBatch
+{
+    const float*    centreX;
+    const float*    centreY;
+    const float*    centreZ;
+    const float*    extentX;    // Half sizes
+    const float*    extentY;
+    const float*    extentZ;
+    uint32_t        count;
+};
+
+// Uniforms of shaders/instance_cull.comp, the GPU version of TransformBox and CullBoxes
+// over every instance of one model
+struct alignas(16) CullUniforms
+{
+    Frustum     frustum;
+    vec4<float> boxCentre;      // Model space, w unused
+    vec4<float> boxExtent;
+    uint32_t    instanceCount;
+    uint32_t    commandCount;   // Draw commands of the model, one per primitive
+    uint32_t    reserved[2];
+};
+
+// Start of the buffer the cull shader writes the draws to, the commands follow it
+struct CullDrawHeader
+{
+    uint32_t    drawCount;      // Count buffer of vkCmdDrawIndexedIndirectCount
+    uint32_t    visibleCount;
+    uint32_t    reserved[2];
+};
+
+namespace culling
+{
+    // viewProjection is view * projection in mat4x4 order
+    Frustum ExtractFrustum(mat4x4 viewProjection);
+
+    // Encloses every point, the sphere is centred on the box. Empty input gives an empty box
+    // at the origin
+    ModelBounds ComputeBounds(const vec3<float> *positions, size_t count, size_t stride = sizeof(vec3<float>));
+
+    // Grows box to take in point, start from EmptyBox
+    inline BoundingBox EmptyBox()
+    {
+        return {vec3(3.402823e+38f), vec3(-3.402823e+38f)};
+    }
+
+    inline void Extend(BoundingBox &box, vec3<float> point)
+    {
+        box.min = vec3(min(box.min.x, point.x), min(box.min.y, point.y), min(box.min.z, point.z));
+        box.max = vec3(max(box.max.x, point.x), max(box.max.y, point.y), max(box.max.z, point.z));
+    }
+
+    // Sphere around the box, empty boxes become a point at the origin
+    ModelBounds FromBox(BoundingBox box);
+
+    // Axis aligned box around the transformed box
+    BoundingBox TransformBox(BoundingBox box, mat4x4 m);
+
+    // Radius grows with the largest axis scale of m
+    BoundingSphere TransformSphere(BoundingSphere sphere, mat4x4 m);
+
+    bool BoxVisible(const Frustum &frustum, BoundingBox box);
+    bool SphereVisible(const Frustum &frustum, BoundingSphere sphere);
+
+    // Indices of the volumes at least partly inside, ascending, returns how many. visible
+    // needs room for batch.count
+    uint32_t CullSpheres(const Frustum &frustum, const SphereBatch &batch, uint32_t *visible,
+                         simd_path path = simd_path::best);
+    uint32_t CullBoxes(const Frustum &frustum, const BoxBatch &batch, uint32_t *visible,
+                       simd_path path = simd_path::best);
+}
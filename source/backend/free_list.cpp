@@ -0,0 +1,91 @@
+#include "free_list.hpp"
+#include <string.h>
+
+void freeList::Create(FreeList &list, uint32_t used, uint32_t capacity)
+{
+    list = {new FreeRange[16], 0, 16};
+    Reset(list, used, capacity);
+}
+
+void freeList::Destroy(FreeList &list)
+{
+    delete[] list.ranges;
+    list = {};
+}
+
+bool freeList::Take(FreeList &list, uint32_t count, uint32_t &offset)
+{
+    for (uint32_t i = 0; i < list.count; i++)
+    {
+        auto &range = list.ranges[i];
+        if(range.count < count)
+            continue;
+
+        offset = range.offset;
+        range.offset += count;
+        range.count -= count;
+        if(range.count == 0)
+        {
+            memmove(list.ranges + i, list.ranges + i + 1, sizeof(FreeRange) * (list.count - i - 1));
+            list.count--;
+        }
+        return true;
+    }
+    return false;
+}
+
+void freeList::Release(FreeList &list, uint32_t offset, uint32_t count)
+{
+    if(count == 0)
+        return;
+
+    uint32_t i = 0;
+    while(i < list.count && list.ranges[i].offset < offset)
+        i++;
+
+    const bool joinsPrevious = i > 0 && list.ranges[i - 1].offset + list.ranges[i - 1].count == offset;
+    const bool joinsNext = i < list.count && offset + count == list.ranges[i].offset;
+    if(joinsPrevious && joinsNext)
+    {
+        list.ranges[i - 1].count += count + list.ranges[i].count;
+        memmove(list.ranges + i, list.ranges + i + 1, sizeof(FreeRange) * (list.count - i - 1));
+        list.count--;
+        return;
+    }
+    if(joinsPrevious)
+    {
+        list.ranges[i - 1].count += count;
+        return;
+    }
+    if(joinsNext)
+    {
+        list.ranges[i].offset = offset;
+        list.ranges[i].count += count;
+        return;
+    }
+
+    if(list.count == list.capacity)
+    {
+        auto ranges = new FreeRange[list.capacity * 2];
+        memcpy(ranges, list.ranges, sizeof(FreeRange) * list.count);
+        delete[] list.ranges;
+        list.ranges = ranges;
+        list.capacity *= 2;
+    }
+
+    memmove(list.ranges + i + 1, list.ranges + i, sizeof(FreeRange) * (list.count - i));
+    list.ranges[i] = {offset, count};
+    list.count++;
+}
+
+bool freeList::Packed(const FreeList &list, uint32_t capacity)
+{
+    return list.count == 0 || (list.count == 1 && list.ranges[0].offset + list.ranges[0].count == capacity);
+}
+
+void freeList::Reset(FreeList &list, uint32_t used, uint32_t capacity)
+{
+    list.count = 0;
+    if(used < capacity)
+        list.ranges[list.count++] = {used, capacity - used};
+}
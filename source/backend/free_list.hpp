@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../base.hpp"
+
+// Ranges of elements in a buffer of fixed capacity, taken first fit. Free ranges are kept
+// sorted by offset and merged with their neighbours on release, so a list whose ranges were
+// all given back is a single range again. MeshRegistry keeps one per buffer.
+
+struct FreeRange
+{
+    uint32_t    offset;
+    uint32_t    count;
+};
+
+struct FreeList
+{
+    FreeRange*  ranges;
+    uint32_t    count;
+    uint32_t    capacity;   // Of ranges, it doubles when full
+};
+
+namespace freeList
+{
+    // Everything past used up to capacity is free
+    void Create(FreeList &list, uint32_t used, uint32_t capacity);
+    void Destroy(FreeList &list);
+
+    // Lowest offset with room for count, false when no range is large enough
+    bool Take(FreeList &list, uint32_t count, uint32_t &offset);
+    void Release(FreeList &list, uint32_t offset, uint32_t count);
+
+    // Back to a single range past used, after the live elements were moved to the front
+    void Reset(FreeList &list, uint32_t used, uint32_t capacity);
+
+    // Only the tail is free
+    bool Packed(const FreeList &list, uint32_t capacity);
+}
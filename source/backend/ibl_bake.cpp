@@ -0,0 +1,407 @@
+#include "ibl_bake.hpp"
+#include "../mv_utils/spherical_harmonics.hpp"
+#include <cmath>
+
+constexpr uint32_t BRDF_SAMPLE_COUNT = 1024;        // NUM_SAMPLES in brdf.frag
+constexpr float IRRADIANCE_SAMPLE_DELTA = 0.025f;   // sampleDelta in irradiance.comp
+constexpr uint32_t BAKE_TILE_SIZE = 16;
+constexpr uint32_t BAKE_MAX_LEVELS = 16;
+
+// Hammersley Points on the Hemisphere by Holger Dammertz
+// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+static vec2<float> Hammersley(uint32_t i, uint32_t n)
+{
+    uint32_t bits = (i << 16u) | (i >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+}
+
+// random() from the shaders, it rotates the sample pattern per direction
+static float ShaderRandom(float x, float y)
+{
+    const float dt = x * 12.9898f + y * 78.233f;
+    const float sn = dt - 3.14f * std::floor(dt / 3.14f);
+    const float value = std::sin(sn) * 43758.5453f;
+    return value - std::floor(value);
+}
+
+// Orthonormal frame around n, the one ImportanceSampleGGX in the shaders builds
+static void SampleFrame(vec3<float> n, vec3<float> &tangentX, vec3<float> &tangentY)
+{
+    const auto up = std::fabs(n.z) < 0.999f ? vec3(0.0f, 0.0f, 1.0f) : vec3(1.0f, 0.0f, 0.0f);
+    tangentX = normalise(cross(up, n));
+    tangentY = cross(n, tangentX);
+}
+
+static vec3<float> ImportanceSampleGGX(vec2<float> xi, float roughness, vec3<float> n)
+{
+    const float a = roughness * roughness;
+
+    const float phi = 2.0f * PI32 * xi.x + ShaderRandom(n.x, n.z) * 0.1f;
+    const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+    const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+    vec3<float> tangentX, tangentY;
+    SampleFrame(n, tangentX, tangentY);
+
+    return normalise(tangentX * (sinTheta * std::cos(phi)) + tangentY * (sinTheta * std::sin(phi)) + n * cosTheta);
+}
+
+// Bilinear lookup of the base level. Samples near a face edge clamp to it instead of
+// blending with the neighbouring face like seamless cubemap filtering does
+static vec3<float> SampleCubemap(const CubemapSource &cube, vec3<float> dir)
+{
+    const float absX = std::fabs(dir.x);
+    const float absY = std::fabs(dir.y);
+    const float absZ = std::fabs(dir.z);
+
+    uint32_t face;
+    float sc, tc, ma;
+    if(absX >= absY && absX >= absZ)
+    {
+        face = dir.x >= 0.0f ? 0 : 1;
+        sc = dir.x >= 0.0f ? -dir.z : dir.z;
+        tc = -dir.y;
+        ma = absX;
+    }
+    else if(absY >= absZ)
+    {
+        face = dir.y >= 0.0f ? 2 : 3;
+        sc = dir.x;
+        tc = dir.y >= 0.0f ? dir.z : -dir.z;
+        ma = absY;
+    }
+    else
+    {
+        face = dir.z >= 0.0f ? 4 : 5;
+        sc = dir.z >= 0.0f ? dir.x : -dir.x;
+        tc = -dir.y;
+        ma = absZ;
+    }
+
+    const float size = float(cube.size);
+    const float scale = 0.5f * size / ma;
+    const float s = sc * scale + 0.5f * size - 0.5f;
+    const float t = tc * scale + 0.5f * size - 0.5f;
+
+    // Coordinates are at least -0.5, truncating the shifted value floors it
+    const int32_t s0 = int32_t(s + 1.0f) - 1;
+    const int32_t t0 = int32_t(t + 1.0f) - 1;
+    const float fs = s - float(s0);
+    const float ft = t - float(t0);
+
+    const int32_t last = int32_t(cube.size) - 1;
+    const size_t x0 = size_t(clamp(s0, 0, last));
+    const size_t x1 = size_t(clamp(s0 + 1, 0, last));
+    const size_t y0 = size_t(clamp(t0, 0, last)) * cube.size;
+    const size_t y1 = size_t(clamp(t0 + 1, 0, last)) * cube.size;
+
+    const float *faceTexels = cube.texels + size_t(face) * cube.size * cube.size * 4;
+    const float *p00 = faceTexels + (y0 + x0) * 4;
+    const float *p10 = faceTexels + (y0 + x1) * 4;
+    const float *p01 = faceTexels + (y1 + x0) * 4;
+    const float *p11 = faceTexels + (y1 + x1) * 4;
+
+    const float w00 = (1.0f - fs) * (1.0f - ft);
+    const float w10 = fs * (1.0f - ft);
+    const float w01 = (1.0f - fs) * ft;
+    const float w11 = fs * ft;
+
+    return vec3(p00[0] * w00 + p10[0] * w10 + p01[0] * w01 + p11[0] * w11,
+                p00[1] * w00 + p10[1] * w10 + p01[1] * w01 + p11[1] * w11,
+                p00[2] * w00 + p10[2] * w10 + p01[2] * w01 + p11[2] * w11);
+}
+
+// Cubemap bakes
+
+struct CubeBakeJob;
+using texel_proc = vec3<float>(*)(const CubeBakeJob &job, uint32_t level, vec3<float> n);
+
+struct CubeBakeJob
+{
+    const CubemapSource*    environment;
+    uint16_t*               output;
+    texel_proc              texel;
+    const void*             levelData; // Bake specific, indexed by level
+    uint32_t                dimension;
+    uint32_t                levelCount;
+    uint32_t                firstTile[BAKE_MAX_LEVELS + 1];
+    size_t                  levelOffset[BAKE_MAX_LEVELS]; // In halves
+};
+
+static void BakeCubeTile(void *data, uint32_t index)
+{
+    const auto &job = *static_cast<const CubeBakeJob*>(data);
+
+    uint32_t level = 0;
+    while(index >= job.firstTile[level + 1])
+        level++;
+
+    const uint32_t size = max(job.dimension >> level, 1u);
+    const uint32_t tilesPerSide = (size + BAKE_TILE_SIZE - 1) / BAKE_TILE_SIZE;
+    const uint32_t local = index - job.firstTile[level];
+    const uint32_t face = local / (tilesPerSide * tilesPerSide);
+    const uint32_t tileX = (local % tilesPerSide) * BAKE_TILE_SIZE;
+    const uint32_t tileY = (local / tilesPerSide % tilesPerSide) * BAKE_TILE_SIZE;
+
+    uint16_t *faceOutput = job.output + job.levelOffset[level] + size_t(face) * size * size * 4;
+
+    for (uint32_t y = tileY; y < min(tileY + BAKE_TILE_SIZE, size); y++)
+    {
+        for (uint32_t x = tileX; x < min(tileX + BAKE_TILE_SIZE, size); x++)
+        {
+            // Texel centre, the same direction CubeDirection gives in the compute filters
+            const float u = (float(x) + 0.5f) / float(size) * 2.0f - 1.0f;
+            const float v = (float(y) + 0.5f) / float(size) * 2.0f - 1.0f;
+
+            const auto colour = job.texel(job, level, CubeFaceDirection(face, u, v));
+
+            uint16_t *texel = faceOutput + (size_t(y) * size + x) * 4;
+            texel[0] = FloatToHalf(colour.x);
+            texel[1] = FloatToHalf(colour.y);
+            texel[2] = FloatToHalf(colour.z);
+            texel[3] = FloatToHalf(1.0f);
+        }
+    }
+}
+
+static void BakeCubemap(ThreadPool &pool, CubeBakeJob &job)
+{
+    job.levelCount = min(job.levelCount, BAKE_MAX_LEVELS);
+
+    uint32_t tiles = 0;
+    size_t offset = 0;
+    for (uint32_t level = 0; level < job.levelCount; level++)
+    {
+        const uint32_t size = max(job.dimension >> level, 1u);
+        const uint32_t tilesPerSide = (size + BAKE_TILE_SIZE - 1) / BAKE_TILE_SIZE;
+
+        job.firstTile[level] = tiles;
+        job.levelOffset[level] = offset;
+        tiles += tilesPerSide * tilesPerSide * 6;
+        offset += size_t(size) * size * 6 * 4;
+    }
+    job.firstTile[job.levelCount] = tiles;
+
+    pool.parallelFor(tiles, BakeCubeTile, &job);
+}
+
+// Irradiance
+
+struct IrradianceSamples
+{
+    vec4<float>*    directions; // Tangent space direction, cos(theta) * sin(theta) weight in w
+    uint32_t        count;
+};
+
+static vec3<float> IrradianceTexel(const CubeBakeJob &job, uint32_t, vec3<float> n)
+{
+    const auto &samples = *static_cast<const IrradianceSamples*>(job.levelData);
+
+    const auto right = normalise(cross(vec3(0.0f, 1.0f, 0.0f), n));
+    const auto forward = normalise(cross(n, right));
+
+    auto irradiance = vec3(0.0f);
+    for (uint32_t i = 0; i < samples.count; i++)
+    {
+        const auto &d = samples.directions[i];
+        irradiance += SampleCubemap(*job.environment, right * d.x + forward * d.y + n * d.z) * d.w;
+    }
+
+    return irradiance * (PI32 / float(samples.count));
+}
+
+void iblBake::IrradianceMap(ThreadPool &pool, const CubemapSource &environment,
+                            uint32_t dimension, uint32_t mipLevels, uint16_t *output)
+{
+    // The hemisphere walk is the same for every texel, only the frame around it changes.
+    // Stepped in float exactly like the shader so the sample count matches too
+    uint32_t count = 0;
+    for (float phi = 0.0f; phi < 2.0f * PI32; phi += IRRADIANCE_SAMPLE_DELTA)
+        for (float theta = 0.0f; theta < 0.5f * PI32; theta += IRRADIANCE_SAMPLE_DELTA)
+            count++;
+
+    IrradianceSamples samples = {new vec4<float>[count], 0};
+    for (float phi = 0.0f; phi < 2.0f * PI32; phi += IRRADIANCE_SAMPLE_DELTA)
+    {
+        for (float theta = 0.0f; theta < 0.5f * PI32; theta += IRRADIANCE_SAMPLE_DELTA)
+        {
+            const float sinTheta = std::sin(theta);
+            const float cosTheta = std::cos(theta);
+            samples.directions[samples.count++] = vec4(sinTheta * std::cos(phi), sinTheta * std::sin(phi),
+                                                       cosTheta, cosTheta * sinTheta);
+        }
+    }
+
+    CubeBakeJob job{};
+    job.environment = &environment;
+    job.output = output;
+    job.texel = IrradianceTexel;
+    job.levelData = &samples;
+    job.dimension = dimension;
+    job.levelCount = mipLevels;
+    BakeCubemap(pool, job);
+
+    delete[] samples.directions;
+}
+
+// Prefiltered
+
+struct PrefilterSample
+{
+    float           cosPhi;
+    float           sinPhi;
+    float           radial; // Tangent plane length of L
+    float           axial;  // N.L, also the sample weight
+};
+
+struct PrefilterLevel
+{
+    float           roughness;
+    uint32_t        count;
+    PrefilterSample samples[PREFILTER_SAMPLE_COUNT];
+};
+
+static vec3<float> PrefilteredTexel(const CubeBakeJob &job, uint32_t level, vec3<float> n)
+{
+    const auto &table = static_cast<const PrefilterLevel*>(job.levelData)[level];
+
+    // Every GGX sample collapses onto the normal
+    if(table.roughness == 0.0f)
+        return SampleCubemap(*job.environment, n);
+
+    vec3<float> tangentX, tangentY;
+    SampleFrame(n, tangentX, tangentY);
+
+    const float jitter = ShaderRandom(n.x, n.z) * 0.1f;
+    const float cosJitter = std::cos(jitter);
+    const float sinJitter = std::sin(jitter);
+
+    // NOTE(arle): With N = V = R the reflected L only depends on the half vector's angles,
+    // the table holds it in tangent space and the per texel jitter rotates it around N
+    auto colour = vec3(0.0f);
+    float weight = 0.0f;
+    for (uint32_t i = 0; i < table.count; i++)
+    {
+        const auto &s = table.samples[i];
+        const float cosPhi = s.cosPhi * cosJitter - s.sinPhi * sinJitter;
+        const float sinPhi = s.sinPhi * cosJitter + s.cosPhi * sinJitter;
+
+        const auto L = tangentX * (s.radial * cosPhi) + tangentY * (s.radial * sinPhi) + n * s.axial;
+        colour += SampleCubemap(*job.environment, L) * s.axial;
+        weight += s.axial;
+    }
+
+    return colour / weight;
+}
+
+void iblBake::PrefilteredMap(ThreadPool &pool, const CubemapSource &environment,
+                             uint32_t dimension, uint32_t mipLevels, uint16_t *output)
+{
+    mipLevels = min(mipLevels, BAKE_MAX_LEVELS);
+
+    // The environment has a single level, so the shader's pdf based lod selection always
+    // lands on the base level and is left out here
+    auto levels = new PrefilterLevel[mipLevels];
+    for (uint32_t level = 0; level < mipLevels; level++)
+    {
+        auto &table = levels[level];
+        table.roughness = mipLevels > 1 ? float(level) / float(mipLevels - 1) : 0.0f;
+        table.count = 0;
+
+        const float a = table.roughness * table.roughness;
+        for (uint32_t i = 0; i < PREFILTER_SAMPLE_COUNT; i++)
+        {
+            const auto xi = Hammersley(i, PREFILTER_SAMPLE_COUNT);
+            const float phi = 2.0f * PI32 * xi.x;
+            const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+            const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+            // L = 2 (V.H) H - V with V = N, samples below the horizon carry no weight
+            const float axial = 2.0f * cosTheta * cosTheta - 1.0f;
+            if(axial > 0.0f)
+                table.samples[table.count++] = {std::cos(phi), std::sin(phi), 2.0f * cosTheta * sinTheta, axial};
+        }
+    }
+
+    CubeBakeJob job{};
+    job.environment = &environment;
+    job.output = output;
+    job.texel = PrefilteredTexel;
+    job.levelData = levels;
+    job.dimension = dimension;
+    job.levelCount = mipLevels;
+    BakeCubemap(pool, job);
+
+    delete[] levels;
+}
+
+// BRDF lookup table
+
+struct BrdfJob
+{
+    uint16_t*       output;
+    uint32_t        dimension;
+};
+
+static float GeometrySchlickSmithGGX(float dotNL, float dotNV, float roughness)
+{
+    // k for IBL
+    const float k = (roughness * roughness) / 2.0f;
+    const float GL = dotNL / (dotNL * (1.0f - k) + k);
+    const float GV = dotNV / (dotNV * (1.0f - k) + k);
+    return GL * GV;
+}
+
+static void BakeBrdfRow(void *data, uint32_t y)
+{
+    const auto &job = *static_cast<const BrdfJob*>(data);
+    const auto N = vec3(0.0f, 0.0f, 1.0f);
+
+    // Roughness is constant along a row, so are the half vectors
+    const float roughness = 1.0f - (float(y) + 0.5f) / float(job.dimension);
+
+    vec3<float> halfVectors[BRDF_SAMPLE_COUNT];
+    for (uint32_t i = 0; i < BRDF_SAMPLE_COUNT; i++)
+        halfVectors[i] = ImportanceSampleGGX(Hammersley(i, BRDF_SAMPLE_COUNT), roughness, N);
+
+    uint16_t *row = job.output + size_t(y) * job.dimension * 2;
+    for (uint32_t x = 0; x < job.dimension; x++)
+    {
+        const float NdotV = (float(x) + 0.5f) / float(job.dimension);
+        const auto V = vec3(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+
+        float A = 0.0f;
+        float B = 0.0f;
+        for (uint32_t i = 0; i < BRDF_SAMPLE_COUNT; i++)
+        {
+            const auto &H = halfVectors[i];
+            const auto L = normalise(H * (2.0f * dot(V, H)) - V);
+
+            const float NdotL = max(L.z, 0.0f);
+            const float NdotH = max(H.z, 0.0f);
+            const float VdotH = max(dot(V, H), 0.0f);
+
+            if(NdotL > 0.0f)
+            {
+                const float G = GeometrySchlickSmithGGX(NdotL, NdotV, roughness);
+                const float GVis = G * VdotH / (NdotH * NdotV);
+                const float Fc = std::pow(1.0f - VdotH, 5.0f);
+                A += (1.0f - Fc) * GVis;
+                B += Fc * GVis;
+            }
+        }
+
+        row[x * 2 + 0] = FloatToHalf(A / float(BRDF_SAMPLE_COUNT));
+        row[x * 2 + 1] = FloatToHalf(B / float(BRDF_SAMPLE_COUNT));
+    }
+}
+
+void iblBake::BrdfLUT(ThreadPool &pool, uint32_t dimension, uint16_t *output)
+{
+    BrdfJob job = {output, dimension};
+    pool.parallelFor(dimension, BakeBrdfRow, &job);
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+// CPU implementation of the IBL bake, the same integrals as brdf.frag, irradiance.comp and
+// prefiltered.comp. Needs no device, so maps can be baked on machines without a GPU and
+// serve as a reference for the GPU bake. Results are half floats in the image cache's
+// packed layout, mip-major with all faces of a level together, ready for imageCache::Upload.
+//
+// Work is split into tiles over faces, mips and texels and spread across the thread pool.
+
+// GGX samples per prefiltered texel, here and as specialization constant 0 of prefiltered.comp.
+// Cached prefiltered maps are keyed on it
+constexpr uint32_t PREFILTER_SAMPLE_COUNT = 1024;
+
+struct CubemapSource
+{
+    const float*    texels; // RGBA32F, +X, -X, +Y, -Y, +Z, -Z faces of size x size
+    uint32_t        size;
+};
+
+namespace iblBake
+{
+    using cubemap_bake = void(*)(ThreadPool &pool, const CubemapSource &environment,
+                                 uint32_t dimension, uint32_t mipLevels, uint16_t *output);
+
+    // R16G16_SFLOAT scale and bias. Rows run from roughness 1 down to 0, the way the
+    // render pass bake lays them out
+    void BrdfLUT(ThreadPool &pool, uint32_t dimension, uint16_t *output);
+
+    // R16G16B16A16_SFLOAT, every level integrated from the environment at its own resolution
+    void IrradianceMap(ThreadPool &pool, const CubemapSource &environment,
+                       uint32_t dimension, uint32_t mipLevels, uint16_t *output);
+
+    // R16G16B16A16_SFLOAT, roughness rises linearly from 0 on the first level to 1 on the last
+    void PrefilteredMap(ThreadPool &pool, const CubemapSource &environment,
+                        uint32_t dimension, uint32_t mipLevels, uint16_t *output);
+}
\ No newline at end of file
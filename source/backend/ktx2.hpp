@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+// KTX 2.0 container layout as far as the texture loader and tools/texture_compress use it,
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html. A file starts with the header,
+// followed by one ktx2_level per mip level, level 0 first. Level data is stored from the
+// smallest level up, each aligned to the least common multiple of the texel block size and 4.
+
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct ktx2_header
+{
+    uint8_t     identifier[12];
+    uint32_t    vkFormat;
+    uint32_t    typeSize;
+    uint32_t    pixelWidth;
+    uint32_t    pixelHeight;
+    uint32_t    pixelDepth;             // 0 for 2D images
+    uint32_t    layerCount;             // 0 when not an array
+    uint32_t    faceCount;
+    uint32_t    levelCount;             // 0 asks the loader to generate mips
+    uint32_t    supercompressionScheme;
+
+    uint32_t    dfdByteOffset;
+    uint32_t    dfdByteLength;
+    uint32_t    kvdByteOffset;
+    uint32_t    kvdByteLength;
+    uint64_t    sgdByteOffset;
+    uint64_t    sgdByteLength;
+};
+
+struct ktx2_level
+{
+    uint64_t    byteOffset;
+    uint64_t    byteLength;
+    uint64_t    uncompressedByteLength;
+};
+
+static_assert(sizeof(ktx2_header) == 80 && sizeof(ktx2_level) == 24, "KTX2 structures must match the file layout");
\ No newline at end of file
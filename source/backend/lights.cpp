@@ -1,13 +1,7 @@
 #include "lights.hpp"
 
-void SceneLight::init(const VulkanDevice *device)
+void SceneLight::init()
 {
-    for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
-    {
-        device->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MEM_FLAG_HOST_VISIBLE,
-                            sizeof(LightData), buffers[i]);
-    }
-
     pointLights[0].strength = 200.0f;
     pointLights[0].position = vec3(5.0f, 1.0f, -5.0f);
     pointLights[0].colour = GetColour(255, 247, 207);
@@ -23,32 +17,22 @@ void SceneLight::init(const VulkanDevice *device)
     pointLights[3].strength = 0.0f;
     pointLights[3].position = vec3(0.0f);
     pointLights[3].colour = vec4(0.0f);
-
-    update(device->device);
 }
 
-void SceneLight::destroy(VkDevice device)
+uint32_t SceneLight::update(RingBuffer &frameData) const
 {
-    for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
-        buffers[i].destroy(device);
-}
-
-void SceneLight::update(VkDevice device)
-{
-    for (size_t image = 0; image < MAX_IMAGES_IN_FLIGHT; image++)
+    LightData data{};
+    for (size_t i = 0; i < arraysize(pointLights); i++)
     {
-        buffers[image].map(device);
+        data.positions[i] = vec4(pointLights[i].position, 1.0f);
+        data.colours[i] = pointLights[i].colour * pointLights[i].strength;
+    }
 
-        auto mapped = static_cast<LightData*>(buffers[image].mapped);
-        for (size_t i = 0; i < arraysize(pointLights); i++)
-        {
-            mapped->positions[i] = vec4(pointLights[i].position, 1.0f);
-            mapped->colours[i] = pointLights[i].colour * pointLights[i].strength;
-        }
+    data.exposure = exposure;
+    data.gamma = gamma;
 
-        mapped->exposure = exposure;
-        mapped->gamma = gamma;
+    for (size_t i = 0; i < SH9_COUNT; i++)
+        data.irradianceSH[i] = irradianceSH.coeffs[i];
 
-        buffers[image].unmap(device);
-    }
+    return frameData.push(data);
 }
\ No newline at end of file
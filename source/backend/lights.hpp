@@ -1,6 +1,7 @@
 #pragma once
 
-#include "VulkanDevice.hpp"
+#include "VulkanRingBuffer.hpp"
+#include "../mv_utils/spherical_harmonics.hpp"
 
 constexpr size_t LIGHTS_COUNT = 4;
 
@@ -11,6 +12,7 @@ struct alignas(16) LightData
     float exposure;
     float gamma;
     vec2<float> reserved;
+    vec4<float> irradianceSH[SH9_COUNT]; // Only read by the IRRADIANCE_SH shader variant
 };
 
 struct PointLight
@@ -23,12 +25,13 @@ struct PointLight
 class SceneLight
 {
 public:
-    void init(const VulkanDevice *device);
-    void destroy(VkDevice device);
-    void update(VkDevice device);
+    void init();
+
+    // Writes this frame's light data and returns its dynamic offset
+    uint32_t update(RingBuffer &frameData) const;
 
     float           exposure;
     float           gamma;
     PointLight      pointLights[4];
-    VulkanBuffer    buffers[MAX_IMAGES_IN_FLIGHT];
+    SH9             irradianceSH;
 };
\ No newline at end of file
@@ -0,0 +1,1278 @@
+#include "mesh_import.hpp"
+#include "../mv_utils/json.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+
+using Vertex = Model3D::Vertex;
+
+constexpr uint32_t GLTF_MAX_BUFFERS = 64;
+constexpr uint32_t GLTF_MAX_DEPTH = 64;
+constexpr uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+constexpr uint32_t GLTF_MODE_TRIANGLES = 4;
+
+enum class mesh_format
+{
+    gltf,
+    obj
+};
+
+template<typename T>
+struct growable
+{
+    T           *data;
+    uint32_t    count;
+    uint32_t    capacity;
+
+    void reserve(uint32_t required)
+    {
+        if(required <= capacity)
+            return;
+
+        const auto grownCapacity = max(required, max(capacity * 2, 64u));
+        auto grown = new T[grownCapacity];
+        if(count > 0)
+            memcpy(grown, data, sizeof(T) * count);
+        delete[] data;
+        data = grown;
+        capacity = grownCapacity;
+    }
+
+    void push(const T &value)
+    {
+        reserve(count + 1);
+        data[count++] = value;
+    }
+
+    void free()
+    {
+        delete[] data;
+        *this = {};
+    }
+};
+
+struct gltf_accessor
+{
+    const uint8_t   *data;  // nullptr reads as zero
+    uint32_t        count;
+    uint32_t        stride;
+    uint32_t        componentType;
+    uint32_t        components;
+    bool            normalized;
+};
+
+// One node instance of a mesh primitive, in the order of MeshImport::primitives
+struct gltf_instance
+{
+    int32_t     primitive;
+    float       world[16];
+};
+
+struct MeshImport::state_T
+{
+    mesh_format     format;
+
+    // glTF
+    io::file_map    file;
+    io::file_map    externalBuffers[GLTF_MAX_BUFFERS];
+    view<const uint8_t> buffers[GLTF_MAX_BUFFERS];
+    uint32_t        bufferCount;
+    json::document  doc;
+    int32_t         *accessors;
+    int32_t         *bufferViews;
+    uint32_t        accessorCount;
+    uint32_t        bufferViewCount;
+    gltf_instance   *instances;
+
+    // OBJ, decoded on open
+    Vertex          *vertices;
+    uint32_t        *indices;
+};
+
+// Column major 4x4, the glTF node matrix layout
+
+static void MatrixIdentity(float (&m)[16])
+{
+    memset(m, 0, sizeof(m));
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+static void MatrixMultiply(const float (&a)[16], const float (&b)[16], float (&result)[16])
+{
+    for (uint32_t col = 0; col < 4; col++)
+    {
+        for (uint32_t row = 0; row < 4; row++)
+        {
+            result[col * 4 + row] = a[row] * b[col * 4] +
+                                    a[4 + row] * b[col * 4 + 1] +
+                                    a[8 + row] * b[col * 4 + 2] +
+                                    a[12 + row] * b[col * 4 + 3];
+        }
+    }
+}
+
+// Node matrix, or T * R * S from its translation, rotation (quaternion) and scale
+static void NodeMatrix(const json::document &doc, int32_t node, float (&m)[16])
+{
+    MatrixIdentity(m);
+
+    const auto matrix = json::Find(doc, node, "matrix");
+    if(json::Count(doc, matrix) == 16)
+    {
+        auto element = json::First(doc, matrix);
+        for (uint32_t i = 0; i < 16; i++, element = json::Next(doc, element))
+            m[i] = float(json::Number(doc, element));
+        return;
+    }
+
+    float t[3] = {0.0f, 0.0f, 0.0f};
+    float r[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    float s[3] = {1.0f, 1.0f, 1.0f};
+
+    auto readArray = [&](const char *key, float *values, uint32_t count)
+    {
+        const auto array = json::Find(doc, node, key);
+        if(json::Count(doc, array) != count)
+            return;
+
+        auto element = json::First(doc, array);
+        for (uint32_t i = 0; i < count; i++, element = json::Next(doc, element))
+            values[i] = float(json::Number(doc, element));
+    };
+
+    readArray("translation", t, 3);
+    readArray("rotation", r, 4);
+    readArray("scale", s, 3);
+
+    const float x = r[0], y = r[1], z = r[2], w = r[3];
+    m[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+    m[1] = (2.0f * (x * y + z * w)) * s[0];
+    m[2] = (2.0f * (x * z - y * w)) * s[0];
+    m[4] = (2.0f * (x * y - z * w)) * s[1];
+    m[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+    m[6] = (2.0f * (y * z + x * w)) * s[1];
+    m[8] = (2.0f * (x * z + y * w)) * s[2];
+    m[9] = (2.0f * (y * z - x * w)) * s[2];
+    m[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+    m[12] = t[0];
+    m[13] = t[1];
+    m[14] = t[2];
+}
+
+static vec3<float> SafeNormalise(vec3<float> v)
+{
+    const float lengthSq = v.x * v.x + v.y * v.y + v.z * v.z;
+    return lengthSq > 0.0f ? v * (1.0f / std::sqrt(lengthSq)) : vec3(0.0f, 0.0f, 0.0f);
+}
+
+// Area weighted face normals for every vertex whose normal is zero
+static void GenerateNormals(Vertex *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount)
+{
+    auto normals = new vec3<float>[vertexCount];
+    memset(normals, 0, sizeof(vec3<float>) * vertexCount);
+
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const auto p0 = vertices[indices[i]].position;
+        const auto e1 = vertices[indices[i + 1]].position - p0;
+        const auto e2 = vertices[indices[i + 2]].position - p0;
+        const auto faceNormal = vec3(e1.y * e2.z - e1.z * e2.y,
+                                     e1.z * e2.x - e1.x * e2.z,
+                                     e1.x * e2.y - e1.y * e2.x);
+        normals[indices[i]] += faceNormal;
+        normals[indices[i + 1]] += faceNormal;
+        normals[indices[i + 2]] += faceNormal;
+    }
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const auto n = vertices[i].normal;
+        if(n.x == 0.0f && n.y == 0.0f && n.z == 0.0f)
+            vertices[i].normal = SafeNormalise(normals[i]);
+    }
+
+    delete[] normals;
+}
+
+static void WriteIndices(const uint32_t *source, uint32_t count, VkIndexType type, void *dst)
+{
+    if(type == VK_INDEX_TYPE_UINT16)
+    {
+        auto indices = static_cast<uint16_t*>(dst);
+        for (uint32_t i = 0; i < count; i++)
+            indices[i] = uint16_t(source[i]);
+    }
+    else
+    {
+        memcpy(dst, source, sizeof(uint32_t) * count);
+    }
+}
+
+static bool HasExtension(const char *filename, const char *extension)
+{
+    const auto length = strlen(filename);
+    const auto extensionLength = strlen(extension);
+    if(length < extensionLength)
+        return false;
+
+    const char *suffix = filename + length - extensionLength;
+    for (size_t i = 0; i < extensionLength; i++)
+    {
+        char c = suffix[i];
+        if(c >= 'A' && c <= 'Z')
+            c = char(c - 'A' + 'a');
+        if(c != extension[i])
+            return false;
+    }
+    return true;
+}
+
+// Nearly every byte gets read, so the whole file is prefetched. glTF attribute streams
+// are each read front to back, which sequential read ahead handles fine
+static io::file_map MapFile(const char *filename)
+{
+    io::file_map map = {};
+    auto file = io::Open<io::cmd::read>(filename);
+    if(io::IsValid(file))
+        map = io::Map(file, io::access::sequential, true);
+    io::Close(file);
+    return map;
+}
+
+// Sizes the mesh from the primitive counts and lays the primitives out back to back
+static bool LayoutPrimitives(MeshImport &mesh, const uint32_t *vertexCounts)
+{
+    uint64_t vertexTotal = 0, indexTotal = 0;
+    uint32_t largestPrimitive = 0;
+    for (uint32_t i = 0; i < mesh.primitiveCount; i++)
+    {
+        auto &primitive = mesh.primitives[i];
+        primitive.firstIndex = uint32_t(indexTotal);
+        primitive.vertexOffset = int32_t(vertexTotal);
+
+        vertexTotal += vertexCounts[i];
+        indexTotal += primitive.indexCount;
+        largestPrimitive = max(largestPrimitive, vertexCounts[i]);
+
+        if(vertexTotal > uint64_t(INT32_MAX) || indexTotal > uint64_t(UINT32_MAX))
+        {
+            mesh.error = "Mesh exceeds 32 bit vertex or index counts";
+            return false;
+        }
+    }
+
+    if(vertexTotal == 0 || indexTotal == 0)
+    {
+        mesh.error = "Mesh has no triangles";
+        return false;
+    }
+
+    mesh.vertexCount = uint32_t(vertexTotal);
+    mesh.indexCount = uint32_t(indexTotal);
+    // NOTE(arle): Indices are local to their primitive and rebased by vertexOffset
+    // at draw time, so only the largest primitive decides the index width
+    mesh.indexType = largestPrimitive <= 0x10000 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    return true;
+}
+
+//
+// glTF
+//
+
+static uint32_t ComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case 5120: case 5121: return 1;
+    case 5122: case 5123: return 2;
+    case 5125: case 5126: return 4;
+    default: return 0;
+    }
+}
+
+static uint32_t ComponentCount(view<const char> type)
+{
+    struct {const char *name; uint32_t count;} types[] = {
+        {"SCALAR", 1}, {"VEC2", 2}, {"VEC3", 3}, {"VEC4", 4}, {"MAT2", 4}, {"MAT3", 9}, {"MAT4", 16}
+    };
+    for (const auto &t : types)
+    {
+        if(strlen(t.name) == type.count && memcmp(t.name, type.data, type.count) == 0)
+            return t.count;
+    }
+    return 0;
+}
+
+static float ReadComponent(const uint8_t *data, uint32_t componentType, bool normalized)
+{
+    switch (componentType)
+    {
+    case 5120:
+    {
+        const auto value = float(*reinterpret_cast<const int8_t*>(data));
+        return normalized ? max(value / 127.0f, -1.0f) : value;
+    }
+    case 5121:
+    {
+        const auto value = float(*data);
+        return normalized ? value / 255.0f : value;
+    }
+    case 5122:
+    {
+        int16_t value;
+        memcpy(&value, data, sizeof(value));
+        return normalized ? max(float(value) / 32767.0f, -1.0f) : float(value);
+    }
+    case 5123:
+    {
+        uint16_t value;
+        memcpy(&value, data, sizeof(value));
+        return normalized ? float(value) / 65535.0f : float(value);
+    }
+    case 5125:
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return float(value);
+    }
+    default:
+    {
+        float value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    }
+}
+
+static uint32_t ReadIndex(const gltf_accessor &accessor, uint32_t i)
+{
+    if(accessor.data == nullptr)
+        return 0;
+
+    const uint8_t *element = accessor.data + size_t(i) * accessor.stride;
+    switch (accessor.componentType)
+    {
+    case 5121:
+        return *element;
+    case 5123:
+    {
+        uint16_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    default:
+    {
+        uint32_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    }
+}
+
+template<size_t N>
+static void ReadElement(const gltf_accessor &accessor, uint32_t i, float (&values)[N])
+{
+    if(accessor.data == nullptr)
+    {
+        memset(values, 0, sizeof(values));
+        return;
+    }
+
+    const uint8_t *element = accessor.data + size_t(i) * accessor.stride;
+    if(accessor.componentType == 5126)
+    {
+        memcpy(values, element, sizeof(values));
+        return;
+    }
+
+    const auto componentSize = ComponentSize(accessor.componentType);
+    for (size_t c = 0; c < N; c++)
+        values[c] = ReadComponent(element + c * componentSize, accessor.componentType, accessor.normalized);
+}
+
+// Resolves an accessor to a pointer into its mapped buffer, bounds checked
+static bool ResolveAccessor(const MeshImport::state_T &state, int64_t index, gltf_accessor &accessor)
+{
+    accessor = {};
+    if(index < 0 || index >= int64_t(state.accessorCount))
+        return false;
+
+    const auto &doc = state.doc;
+    const auto token = state.accessors[index];
+    if(json::Find(doc, token, "sparse") != json::INVALID)
+        return false;
+
+    const auto count = json::Integer(doc, json::Find(doc, token, "count"));
+    if(count < 0 || count > int64_t(UINT32_MAX))
+        return false;
+    accessor.count = uint32_t(count);
+    accessor.componentType = uint32_t(json::Integer(doc, json::Find(doc, token, "componentType")));
+    accessor.components = ComponentCount(json::String(doc, json::Find(doc, token, "type")));
+    accessor.normalized = json::Boolean(doc, json::Find(doc, token, "normalized"));
+
+    const auto componentSize = ComponentSize(accessor.componentType);
+    const auto elementSize = componentSize * accessor.components;
+    if(elementSize == 0)
+        return false;
+
+    // Accessors without a buffer view are all zeros
+    const auto viewIndex = json::Integer(doc, json::Find(doc, token, "bufferView"), -1);
+    if(viewIndex < 0)
+        return true;
+    if(viewIndex >= int64_t(state.bufferViewCount))
+        return false;
+
+    const auto bufferView = state.bufferViews[viewIndex];
+    const auto bufferIndex = json::Integer(doc, json::Find(doc, bufferView, "buffer"), -1);
+    if(bufferIndex < 0 || bufferIndex >= int64_t(state.bufferCount))
+        return false;
+
+    const auto &buffer = state.buffers[bufferIndex];
+    const auto viewOffset = json::Integer(doc, json::Find(doc, bufferView, "byteOffset"));
+    const auto viewLength = json::Integer(doc, json::Find(doc, bufferView, "byteLength"));
+    const auto accessorOffset = json::Integer(doc, json::Find(doc, token, "byteOffset"));
+    const auto stride = json::Integer(doc, json::Find(doc, bufferView, "byteStride"), elementSize);
+
+    // Range checked before the casts, the sums below then cannot wrap
+    const auto bufferSize = int64_t(buffer.count);
+    if(viewOffset < 0 || viewOffset > bufferSize || viewLength < 0 || viewLength > bufferSize ||
+       accessorOffset < 0 || accessorOffset > bufferSize || stride <= 0 || stride > bufferSize)
+        return false;
+    accessor.stride = uint32_t(stride);
+
+    const uint64_t accessorSize = accessor.count > 0 ? uint64_t(accessor.stride) * (accessor.count - 1) + elementSize : 0;
+    if(uint64_t(viewOffset + viewLength) > buffer.count || uint64_t(accessorOffset) + accessorSize > uint64_t(viewLength))
+        return false;
+
+    accessor.data = buffer.data + viewOffset + accessorOffset;
+    return true;
+}
+
+// Index table of a top level array, so lookups don't walk the token list
+static int32_t *IndexArray(const json::document &doc, const char *key, uint32_t &count)
+{
+    const auto array = json::Find(doc, 0, key);
+    count = json::Count(doc, array);
+    if(count == 0 || doc.tokens[array].kind != json::type::array)
+    {
+        count = 0;
+        return nullptr;
+    }
+
+    auto tokens = new int32_t[count];
+    auto element = json::First(doc, array);
+    for (uint32_t i = 0; i < count; i++, element = json::Next(doc, element))
+        tokens[i] = element;
+    return tokens;
+}
+
+static bool OpenBuffers(const char *filename, const view<const uint8_t> &binChunk, MeshImport &mesh)
+{
+    auto &state = *mesh.state;
+    const auto &doc = state.doc;
+
+    const auto buffers = json::Find(doc, 0, "buffers");
+    state.bufferCount = json::Count(doc, buffers);
+    if(state.bufferCount > GLTF_MAX_BUFFERS)
+    {
+        mesh.error = "Too many glTF buffers";
+        return false;
+    }
+
+    // External URIs are relative to the .gltf
+    size_t directoryLength = 0;
+    for (size_t i = 0; filename[i]; i++)
+    {
+        if(filename[i] == '/' || filename[i] == '\\')
+            directoryLength = i + 1;
+    }
+
+    auto buffer = json::First(doc, buffers);
+    for (uint32_t i = 0; i < state.bufferCount; i++, buffer = json::Next(doc, buffer))
+    {
+        const auto uri = json::String(doc, json::Find(doc, buffer, "uri"));
+        const auto byteLength = uint64_t(json::Integer(doc, json::Find(doc, buffer, "byteLength")));
+
+        if(uri.data == nullptr)
+        {
+            // The GLB binary chunk, may be padded past byteLength
+            if(i != 0 || binChunk.data == nullptr || binChunk.count < byteLength)
+            {
+                mesh.error = "glTF buffer without uri or binary chunk";
+                return false;
+            }
+            state.buffers[i] = view(binChunk.data, size_t(byteLength));
+            continue;
+        }
+
+        if(uri.count >= 5 && memcmp(uri.data, "data:", 5) == 0)
+        {
+            mesh.error = "Embedded base64 glTF buffers are not supported, use .glb or external .bin";
+            return false;
+        }
+
+        char path[512];
+        size_t length = min(directoryLength, sizeof(path) - 1);
+        memcpy(path, filename, length);
+        for (size_t c = 0; c < uri.count && length < sizeof(path) - 1; c++)
+        {
+            // Percent decoding, enough for spaces and the like in file names
+            if(uri[c] == '%' && c + 2 < uri.count)
+            {
+                unsigned value = 0;
+                if(sscanf(uri.data + c + 1, "%2x", &value) == 1)
+                {
+                    path[length++] = char(value);
+                    c += 2;
+                    continue;
+                }
+            }
+            path[length++] = uri[c];
+        }
+        path[length] = '\0';
+
+        state.externalBuffers[i] = MapFile(path);
+        if(state.externalBuffers[i].data == nullptr || state.externalBuffers[i].size < byteLength)
+        {
+            mesh.error = "Failed to map glTF buffer";
+            return false;
+        }
+        state.buffers[i] = view(static_cast<const uint8_t*>(state.externalBuffers[i].data), size_t(byteLength));
+    }
+    return true;
+}
+
+// Walks the default scene and records every triangle primitive instance
+static bool CollectInstances(MeshImport &mesh, growable<gltf_instance> &instances)
+{
+    const auto &doc = mesh.state->doc;
+    const auto meshes = json::Find(doc, 0, "meshes");
+    const auto nodes = json::Find(doc, 0, "nodes");
+    const auto nodeCount = json::Count(doc, nodes);
+
+    auto addMesh = [&](int64_t meshIndex, const float (&world)[16])
+    {
+        const auto meshToken = json::At(doc, meshes, uint32_t(meshIndex));
+        const auto primitives = json::Find(doc, meshToken, "primitives");
+
+        auto primitive = json::First(doc, primitives);
+        for (uint32_t p = 0; p < json::Count(doc, primitives); p++, primitive = json::Next(doc, primitive))
+        {
+            const auto mode = json::Integer(doc, json::Find(doc, primitive, "mode"), GLTF_MODE_TRIANGLES);
+            if(mode != GLTF_MODE_TRIANGLES)
+                continue;
+
+            gltf_instance instance;
+            instance.primitive = primitive;
+            memcpy(instance.world, world, sizeof(world));
+            instances.push(instance);
+        }
+    };
+
+    const auto scenes = json::Find(doc, 0, "scenes");
+    if(json::Count(doc, scenes) == 0)
+    {
+        // No scene, every mesh once untransformed
+        float identity[16];
+        MatrixIdentity(identity);
+        for (uint32_t m = 0; m < json::Count(doc, meshes); m++)
+            addMesh(m, identity);
+        return true;
+    }
+
+    const auto sceneIndex = json::Integer(doc, json::Find(doc, 0, "scene"));
+    const auto scene = json::At(doc, scenes, uint32_t(sceneIndex));
+    const auto roots = json::Find(doc, scene, "nodes");
+
+    struct node_entry
+    {
+        int32_t node;
+        uint32_t depth;
+        float   parent[16];
+    };
+    growable<node_entry> stack = {};
+
+    node_entry root{};
+    MatrixIdentity(root.parent);
+    auto element = json::First(doc, roots);
+    for (uint32_t i = 0; i < json::Count(doc, roots); i++, element = json::Next(doc, element))
+    {
+        root.node = int32_t(json::Integer(doc, element, -1));
+        stack.push(root);
+    }
+
+    uint32_t visited = 0;
+    bool valid = true;
+    while (stack.count > 0 && valid)
+    {
+        const auto entry = stack.data[--stack.count];
+        const auto node = json::At(doc, nodes, uint32_t(entry.node));
+        // Nodes form a forest, more visits than nodes means a cycle
+        if(node == json::INVALID || entry.depth >= GLTF_MAX_DEPTH || ++visited > nodeCount)
+        {
+            valid = false;
+            break;
+        }
+
+        float local[16];
+        node_entry child{};
+        NodeMatrix(doc, node, local);
+        MatrixMultiply(entry.parent, local, child.parent);
+        child.depth = entry.depth + 1;
+
+        const auto meshIndex = json::Integer(doc, json::Find(doc, node, "mesh"), -1);
+        if(meshIndex >= 0 && meshIndex < json::Count(doc, meshes))
+            addMesh(meshIndex, child.parent);
+
+        const auto children = json::Find(doc, node, "children");
+        auto childElement = json::First(doc, children);
+        for (uint32_t i = 0; i < json::Count(doc, children); i++, childElement = json::Next(doc, childElement))
+        {
+            child.node = int32_t(json::Integer(doc, childElement, -1));
+            stack.push(child);
+        }
+    }
+
+    stack.free();
+    if(!valid)
+        mesh.error = "Invalid glTF node hierarchy";
+    return valid;
+}
+
+static bool OpenGltf(const char *filename, MeshImport &mesh)
+{
+    auto &state = *mesh.state;
+    state.file = MapFile(filename);
+    if(state.file.data == nullptr)
+    {
+        mesh.error = "Failed to map glTF file";
+        return false;
+    }
+
+    const auto bytes = static_cast<const uint8_t*>(state.file.data);
+    view<const char> jsonText(reinterpret_cast<const char*>(bytes), state.file.size);
+    view<const uint8_t> binChunk(nullptr, 0);
+
+    uint32_t header[3] = {};
+    if(state.file.size >= sizeof(header))
+        memcpy(header, bytes, sizeof(header));
+
+    if(header[0] == GLB_MAGIC)
+    {
+        const size_t length = min(size_t(header[2]), state.file.size);
+        size_t offset = sizeof(header);
+        jsonText = view<const char>(nullptr, 0);
+
+        while (offset + 8 <= length)
+        {
+            uint32_t chunk[2];
+            memcpy(chunk, bytes + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if(chunk[0] > length - offset)
+                break;
+
+            if(chunk[1] == GLB_CHUNK_JSON && jsonText.data == nullptr)
+                jsonText = view(reinterpret_cast<const char*>(bytes + offset), size_t(chunk[0]));
+            else if(chunk[1] == GLB_CHUNK_BIN && binChunk.data == nullptr)
+                binChunk = view(bytes + offset, size_t(chunk[0]));
+
+            offset += (size_t(chunk[0]) + 3) & ~size_t(3);
+        }
+
+        if(header[1] != 2 || jsonText.data == nullptr)
+        {
+            mesh.error = "Invalid GLB container";
+            return false;
+        }
+    }
+
+    if(!json::Parse(jsonText.data, jsonText.count, state.doc) || state.doc.tokens[0].kind != json::type::object)
+    {
+        mesh.error = "Failed to parse glTF JSON";
+        return false;
+    }
+
+    const auto &doc = state.doc;
+    if(json::Count(doc, json::Find(doc, 0, "extensionsRequired")) > 0)
+    {
+        mesh.error = "glTF requires unsupported extensions";
+        return false;
+    }
+
+    if(!OpenBuffers(filename, binChunk, mesh))
+        return false;
+
+    state.accessors = IndexArray(doc, "accessors", state.accessorCount);
+    state.bufferViews = IndexArray(doc, "bufferViews", state.bufferViewCount);
+    mesh.materialCount = json::Count(doc, json::Find(doc, 0, "materials"));
+
+    growable<gltf_instance> instances = {};
+    if(!CollectInstances(mesh, instances))
+    {
+        instances.free();
+        return false;
+    }
+
+    state.instances = instances.data;
+    mesh.primitiveCount = instances.count;
+    mesh.primitives = new MeshImport::Primitive[max(instances.count, 1u)];
+    auto vertexCounts = new uint32_t[max(instances.count, 1u)];
+
+    bool valid = true;
+    for (uint32_t i = 0; i < instances.count && valid; i++)
+    {
+        const auto primitive = instances.data[i].primitive;
+        const auto attributes = json::Find(doc, primitive, "attributes");
+
+        gltf_accessor position, indices;
+        valid = ResolveAccessor(state, json::Integer(doc, json::Find(doc, attributes, "POSITION"), -1), position) &&
+                position.components == 3;
+
+        const auto indicesIndex = json::Integer(doc, json::Find(doc, primitive, "indices"), -1);
+        if(valid && indicesIndex >= 0)
+        {
+            valid = ResolveAccessor(state, indicesIndex, indices) && indices.components == 1 &&
+                    (indices.componentType == 5121 || indices.componentType == 5123 || indices.componentType == 5125);
+        }
+
+        vertexCounts[i] = position.count;
+        mesh.primitives[i].indexCount = position.count == 0 ? 0 :
+                                        (indicesIndex >= 0 ? indices.count : position.count) / 3 * 3;
+        mesh.primitives[i].material = int32_t(json::Integer(doc, json::Find(doc, primitive, "material"), -1));
+    }
+
+    if(valid)
+        valid = LayoutPrimitives(mesh, vertexCounts);
+    else
+        mesh.error = "Invalid glTF accessor";
+
+    delete[] vertexCounts;
+    return valid;
+}
+
+static BoundingBox FillGltf(const MeshImport &mesh, Vertex *vertices, void *indices)
+{
+    auto bounds = culling::EmptyBox();
+    const auto &state = *mesh.state;
+    const auto &doc = state.doc;
+    const auto indexSize = meshImport::IndexSize(mesh.indexType);
+
+    for (uint32_t p = 0; p < mesh.primitiveCount; p++)
+    {
+        const auto &instance = state.instances[p];
+        const auto &primitive = mesh.primitives[p];
+        const auto attributes = json::Find(doc, instance.primitive, "attributes");
+
+        gltf_accessor position, normal, uv, index;
+        ResolveAccessor(state, json::Integer(doc, json::Find(doc, attributes, "POSITION"), -1), position);
+        const bool hasNormals = ResolveAccessor(state, json::Integer(doc, json::Find(doc, attributes, "NORMAL"), -1), normal) &&
+                                normal.components == 3 && normal.count == position.count;
+        const bool hasUVs = ResolveAccessor(state, json::Integer(doc, json::Find(doc, attributes, "TEXCOORD_0"), -1), uv) &&
+                            uv.components == 2 && uv.count == position.count;
+        const bool indexed = ResolveAccessor(state, json::Integer(doc, json::Find(doc, instance.primitive, "indices"), -1), index);
+
+        // Normals go through the cofactor matrix, which is the inverse transpose scaled by the
+        // determinant. Mirroring transforms flip the winding
+        const auto &m = instance.world;
+        const float cofactor[9] = {
+            m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+            m[2] * m[9] - m[1] * m[10], m[0] * m[10] - m[2] * m[8], m[1] * m[8] - m[0] * m[9],
+            m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4]
+        };
+        const float determinant = m[0] * cofactor[0] + m[1] * cofactor[1] + m[2] * cofactor[2];
+        const float normalSign = determinant < 0.0f ? -1.0f : 1.0f;
+
+        // NOTE(arle): Without normals the vertices are needed again to generate them, that
+        // happens in host memory since the destination is usually uncached staging memory
+        const uint32_t vertexCount = position.count;
+        Vertex *dstVertices = vertices + primitive.vertexOffset;
+        Vertex *target = hasNormals ? dstVertices : new Vertex[vertexCount];
+
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            float p3[3], n3[3], t2[2];
+            ReadElement(position, v, p3);
+
+            Vertex vertex;
+            vertex.position = vec3(m[0] * p3[0] + m[4] * p3[1] + m[8] * p3[2] + m[12],
+                                   m[1] * p3[0] + m[5] * p3[1] + m[9] * p3[2] + m[13],
+                                   m[2] * p3[0] + m[6] * p3[1] + m[10] * p3[2] + m[14]);
+
+            vertex.normal = vec3(0.0f, 0.0f, 0.0f);
+            if(hasNormals)
+            {
+                ReadElement(normal, v, n3);
+                vertex.normal = SafeNormalise(vec3(cofactor[0] * n3[0] + cofactor[3] * n3[1] + cofactor[6] * n3[2],
+                                                   cofactor[1] * n3[0] + cofactor[4] * n3[1] + cofactor[7] * n3[2],
+                                                   cofactor[2] * n3[0] + cofactor[5] * n3[1] + cofactor[8] * n3[2]) * normalSign);
+            }
+
+            vertex.uv = vec2(0.0f, 0.0f);
+            if(hasUVs)
+            {
+                ReadElement(uv, v, t2);
+                vertex.uv = vec2(t2[0], t2[1]);
+            }
+
+            target[v] = vertex;
+            culling::Extend(bounds, vertex.position);
+        }
+
+        // Indices are decoded into chunks and written out in one go, clamped so a broken
+        // file can't make the GPU fetch past the primitive
+        constexpr uint32_t CHUNK = 1023;
+        uint32_t chunk[CHUNK];
+        uint32_t *generated = hasNormals ? nullptr : new uint32_t[max(primitive.indexCount, 1u)];
+        uint8_t *dstIndices = static_cast<uint8_t*>(indices) + size_t(primitive.firstIndex) * indexSize;
+
+        for (uint32_t first = 0; first < primitive.indexCount; first += CHUNK)
+        {
+            const auto count = min(CHUNK, primitive.indexCount - first);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const auto value = indexed ? ReadIndex(index, first + i) : first + i;
+                chunk[i] = min(value, vertexCount - 1);
+            }
+
+            if(determinant < 0.0f)
+            {
+                // CHUNK is a multiple of 3, triangles never straddle chunks
+                for (uint32_t i = 0; i + 2 < count; i += 3)
+                {
+                    const auto swap = chunk[i + 1];
+                    chunk[i + 1] = chunk[i + 2];
+                    chunk[i + 2] = swap;
+                }
+            }
+
+            if(generated)
+                memcpy(generated + first, chunk, sizeof(uint32_t) * count);
+            WriteIndices(chunk, count, mesh.indexType, dstIndices + size_t(first) * indexSize);
+        }
+
+        if(!hasNormals)
+        {
+            GenerateNormals(target, vertexCount, generated, primitive.indexCount);
+            memcpy(dstVertices, target, sizeof(Vertex) * vertexCount);
+            delete[] target;
+            delete[] generated;
+        }
+    }
+
+    return bounds;
+}
+
+//
+// OBJ
+//
+
+struct obj_corner
+{
+    int32_t position;
+    int32_t uv;
+    int32_t normal;
+};
+
+static bool IsLineSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *SkipSpaces(const char *c, const char *end)
+{
+    while (c < end && IsLineSpace(*c))
+        c++;
+    return c;
+}
+
+static const char *NextLine(const char *c, const char *end)
+{
+    while (c < end && *c != '\n')
+        c++;
+    return c < end ? c + 1 : end;
+}
+
+// The file isn't null terminated, strtod and friends could read past the mapping
+static const char *ParseFloat(const char *c, const char *end, float &result)
+{
+    c = SkipSpaces(c, end);
+
+    double sign = 1.0;
+    if(c < end && (*c == '-' || *c == '+'))
+        sign = *c++ == '-' ? -1.0 : 1.0;
+
+    double value = 0.0;
+    while (c < end && json::IsDigit(*c))
+        value = value * 10.0 + double(*c++ - '0');
+
+    if(c < end && *c == '.')
+    {
+        c++;
+        double scale = 0.1;
+        while (c < end && json::IsDigit(*c))
+        {
+            value += double(*c++ - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+
+    if(c < end && (*c == 'e' || *c == 'E'))
+    {
+        c++;
+        bool negative = false;
+        if(c < end && (*c == '-' || *c == '+'))
+            negative = *c++ == '-';
+
+        int32_t exponent = 0;
+        while (c < end && json::IsDigit(*c))
+            exponent = min(exponent * 10 + (*c++ - '0'), 64);
+
+        for (int32_t i = 0; i < exponent; i++)
+            value = negative ? value * 0.1 : value * 10.0;
+    }
+
+    result = float(sign * value);
+    return c;
+}
+
+static const char *ParseInt(const char *c, const char *end, int32_t &result)
+{
+    bool negative = false;
+    if(c < end && *c == '-')
+    {
+        negative = true;
+        c++;
+    }
+
+    int64_t value = 0;
+    while (c < end && json::IsDigit(*c))
+        value = min(value * 10 + (*c++ - '0'), int64_t(INT32_MAX));
+
+    result = int32_t(negative ? -value : value);
+    return c;
+}
+
+// OBJ indices are 1 based or negative relative to the end, -1 when absent or out of range
+static int32_t ResolveObjIndex(int32_t index, uint32_t count)
+{
+    const int64_t resolved = index < 0 ? int64_t(count) + index : int64_t(index) - 1;
+    return resolved >= 0 && resolved < int64_t(count) ? int32_t(resolved) : -1;
+}
+
+static bool OpenObj(const char *filename, MeshImport &mesh)
+{
+    auto &state = *mesh.state;
+    auto map = MapFile(filename);
+    if(map.data == nullptr)
+    {
+        mesh.error = "Failed to map OBJ file";
+        return false;
+    }
+
+    growable<vec3<float>> positions = {}, normals = {};
+    growable<vec2<float>> uvs = {};
+    growable<obj_corner> corners = {}, face = {};
+    growable<int32_t> triangleMaterials = {};
+    growable<view<const char>> materials = {};
+    int32_t material = -1;
+    bool valid = true;
+
+    const char *c = static_cast<const char*>(map.data);
+    const char *end = c + map.size;
+    while (c < end && valid)
+    {
+        c = SkipSpaces(c, end);
+        const char *lineEnd = c;
+        while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '#')
+            lineEnd++;
+
+        const auto keyword = [&](const char *name)
+        {
+            const auto length = strlen(name);
+            return size_t(lineEnd - c) > length && memcmp(c, name, length) == 0 && IsLineSpace(c[length]);
+        };
+
+        if(keyword("v"))
+        {
+            vec3<float> p;
+            auto cursor = ParseFloat(c + 1, lineEnd, p.x);
+            cursor = ParseFloat(cursor, lineEnd, p.y);
+            ParseFloat(cursor, lineEnd, p.z);
+            positions.push(p);
+        }
+        else if(keyword("vn"))
+        {
+            vec3<float> n;
+            auto cursor = ParseFloat(c + 2, lineEnd, n.x);
+            cursor = ParseFloat(cursor, lineEnd, n.y);
+            ParseFloat(cursor, lineEnd, n.z);
+            normals.push(n);
+        }
+        else if(keyword("vt"))
+        {
+            vec2<float> t;
+            ParseFloat(ParseFloat(c + 2, lineEnd, t.x), lineEnd, t.y);
+            // OBJ has v pointing up, Vulkan samples top down
+            t.y = 1.0f - t.y;
+            uvs.push(t);
+        }
+        else if(keyword("f"))
+        {
+            face.count = 0;
+            auto cursor = SkipSpaces(c + 1, lineEnd);
+            while (cursor < lineEnd)
+            {
+                int32_t p = 0, t = 0, n = 0;
+                cursor = ParseInt(cursor, lineEnd, p);
+                if(cursor < lineEnd && *cursor == '/')
+                {
+                    cursor++;
+                    if(cursor < lineEnd && *cursor != '/')
+                        cursor = ParseInt(cursor, lineEnd, t);
+                    if(cursor < lineEnd && *cursor == '/')
+                        cursor = ParseInt(cursor + 1, lineEnd, n);
+                }
+
+                obj_corner corner;
+                corner.position = ResolveObjIndex(p, positions.count);
+                corner.uv = t != 0 ? ResolveObjIndex(t, uvs.count) : -1;
+                corner.normal = n != 0 ? ResolveObjIndex(n, normals.count) : -1;
+                valid = corner.position >= 0;
+                if(!valid)
+                    break;
+
+                face.push(corner);
+                while (cursor < lineEnd && !IsLineSpace(*cursor))
+                    cursor++;
+                cursor = SkipSpaces(cursor, lineEnd);
+            }
+
+            // Fan triangulation, fine for the convex polygons exporters write
+            for (uint32_t i = 1; i + 1 < face.count && valid; i++)
+            {
+                corners.push(face.data[0]);
+                corners.push(face.data[i]);
+                corners.push(face.data[i + 1]);
+                triangleMaterials.push(material);
+            }
+        }
+        else if(keyword("usemtl"))
+        {
+            const char *name = SkipSpaces(c + 6, lineEnd);
+            const char *nameEnd = lineEnd;
+            while (nameEnd > name && IsLineSpace(nameEnd[-1]))
+                nameEnd--;
+
+            const auto length = size_t(nameEnd - name);
+            material = -1;
+            for (uint32_t i = 0; i < materials.count && material < 0; i++)
+            {
+                if(materials.data[i].count == length && memcmp(materials.data[i].data, name, length) == 0)
+                    material = int32_t(i);
+            }
+            if(material < 0)
+            {
+                material = int32_t(materials.count);
+                materials.push(view(name, length));
+            }
+        }
+
+        c = NextLine(lineEnd, end);
+    }
+
+    const uint32_t triangleCount = triangleMaterials.count;
+    if(!valid)
+        mesh.error = "Invalid OBJ face";
+
+    // Triangles are bucketed per material (slot 0 is no material) and every bucket welds
+    // its own position/uv/normal combinations into vertices
+    const uint32_t bucketCount = materials.count + 1;
+    auto bucketStart = new uint32_t[bucketCount + 1];
+    memset(bucketStart, 0, sizeof(uint32_t) * (bucketCount + 1));
+    auto order = new uint32_t[max(triangleCount, 1u)];
+
+    if(valid)
+    {
+        for (uint32_t t = 0; t < triangleCount; t++)
+            bucketStart[triangleMaterials.data[t] + 2]++;
+        for (uint32_t b = 1; b <= bucketCount; b++)
+            bucketStart[b] += bucketStart[b - 1];
+        for (uint32_t t = 0; t < triangleCount; t++)
+            order[bucketStart[triangleMaterials.data[t] + 1]++] = t;
+
+        mesh.primitiveCount = 0;
+        for (uint32_t b = 0; b < bucketCount; b++)
+            mesh.primitiveCount += (b == 0 ? bucketStart[0] : bucketStart[b] - bucketStart[b - 1]) > 0 ? 1 : 0;
+    }
+
+    mesh.materialCount = materials.count;
+    mesh.primitives = new MeshImport::Primitive[max(mesh.primitiveCount, 1u)];
+    auto vertexCounts = new uint32_t[max(mesh.primitiveCount, 1u)];
+
+    if(valid)
+    {
+        state.vertices = new Vertex[max(corners.count, 1u)];
+        state.indices = new uint32_t[max(corners.count, 1u)];
+
+        // Allocated for the whole mesh, each bucket clears and probes only what its own
+        // corners need so many small materials do not pay for the largest one
+        uint32_t tableCapacity = 64;
+        while (tableCapacity < corners.count * 2)
+            tableCapacity *= 2;
+        auto table = new uint32_t[tableCapacity];
+        auto keys = new obj_corner[max(corners.count, 1u)];
+
+        uint32_t primitive = 0, vertexCount = 0, indexCount = 0, first = 0;
+        for (uint32_t b = 0; b < bucketCount; b++)
+        {
+            const uint32_t last = bucketStart[b];
+            if(last == first)
+                continue;
+
+            uint32_t tableSize = 64;
+            while (tableSize < (last - first) * 3 * 2)
+                tableSize *= 2;
+            memset(table, 0xFF, sizeof(uint32_t) * tableSize);
+            Vertex *bucketVertices = state.vertices + vertexCount;
+            uint32_t *bucketIndices = state.indices + indexCount;
+            uint32_t bucketVertexCount = 0;
+            bool missingNormals = false;
+
+            for (uint32_t t = first; t < last; t++)
+            {
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    const auto &corner = corners.data[order[t] * 3 + k];
+                    uint32_t hash = uint32_t(corner.position) * 0x9E3779B1u ^
+                                    uint32_t(corner.uv + 1) * 0x85EBCA77u ^
+                                    uint32_t(corner.normal + 1) * 0xC2B2AE3Du;
+                    hash ^= hash >> 15;
+
+                    uint32_t slot = hash & (tableSize - 1);
+                    for (;;)
+                    {
+                        const auto candidate = table[slot];
+                        if(candidate == UINT32_MAX)
+                        {
+                            Vertex vertex;
+                            vertex.position = positions.data[corner.position];
+                            vertex.uv = corner.uv >= 0 ? uvs.data[corner.uv] : vec2(0.0f, 0.0f);
+                            vertex.normal = corner.normal >= 0 ? SafeNormalise(normals.data[corner.normal]) : vec3(0.0f, 0.0f, 0.0f);
+                            missingNormals |= corner.normal < 0;
+
+                            table[slot] = bucketVertexCount;
+                            keys[bucketVertexCount] = corner;
+                            bucketVertices[bucketVertexCount] = vertex;
+                            bucketIndices[(t - first) * 3 + k] = bucketVertexCount++;
+                            break;
+                        }
+
+                        const auto &key = keys[candidate];
+                        if(key.position == corner.position && key.uv == corner.uv && key.normal == corner.normal)
+                        {
+                            bucketIndices[(t - first) * 3 + k] = candidate;
+                            break;
+                        }
+                        slot = (slot + 1) & (tableSize - 1);
+                    }
+                }
+            }
+
+            if(missingNormals)
+                GenerateNormals(bucketVertices, bucketVertexCount, bucketIndices, (last - first) * 3);
+
+            mesh.primitives[primitive].indexCount = (last - first) * 3;
+            mesh.primitives[primitive].material = int32_t(b) - 1;
+            vertexCounts[primitive++] = bucketVertexCount;
+            vertexCount += bucketVertexCount;
+            indexCount += (last - first) * 3;
+            first = last;
+        }
+
+        delete[] table;
+        delete[] keys;
+        valid = LayoutPrimitives(mesh, vertexCounts);
+    }
+
+    delete[] vertexCounts;
+    delete[] order;
+    delete[] bucketStart;
+    positions.free();
+    normals.free();
+    uvs.free();
+    corners.free();
+    face.free();
+    triangleMaterials.free();
+    materials.free();
+    io::Unmap(map);
+
+    return valid;
+}
+
+bool meshImport::Open(const char *filename, MeshImport &mesh)
+{
+    mesh = {};
+    mesh.state = new MeshImport::state_T{};
+
+    bool opened = false;
+    if(HasExtension(filename, ".gltf") || HasExtension(filename, ".glb"))
+    {
+        mesh.state->format = mesh_format::gltf;
+        opened = OpenGltf(filename, mesh);
+    }
+    else if(HasExtension(filename, ".obj"))
+    {
+        mesh.state->format = mesh_format::obj;
+        opened = OpenObj(filename, mesh);
+    }
+    else
+    {
+        mesh.error = "Unknown mesh file extension";
+    }
+
+    if(!opened)
+    {
+        const auto error = mesh.error;
+        Close(mesh);
+        mesh.error = error;
+    }
+    return opened;
+}
+
+BoundingBox meshImport::Fill(const MeshImport &mesh, Model3D::Vertex *vertices, void *indices)
+{
+    const auto &state = *mesh.state;
+    if(state.format == mesh_format::gltf)
+        return FillGltf(mesh, vertices, indices);
+
+    memcpy(vertices, state.vertices, sizeof(Vertex) * mesh.vertexCount);
+    WriteIndices(state.indices, mesh.indexCount, mesh.indexType, indices);
+    return culling::ComputeBounds(&state.vertices[0].position, mesh.vertexCount, sizeof(Vertex)).box;
+}
+
+void meshImport::Close(MeshImport &mesh)
+{
+    auto state = mesh.state;
+    if(state)
+    {
+        if(state->file.data)
+            io::Unmap(state->file);
+        for (uint32_t i = 0; i < GLTF_MAX_BUFFERS; i++)
+        {
+            if(state->externalBuffers[i].data)
+                io::Unmap(state->externalBuffers[i]);
+        }
+        json::Free(state->doc);
+        delete[] state->accessors;
+        delete[] state->bufferViews;
+        delete[] state->instances;
+        delete[] state->vertices;
+        delete[] state->indices;
+        delete state;
+    }
+
+    delete[] mesh.primitives;
+    mesh = {};
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../base.hpp"
+#include "VulkanModels.hpp"
+
+// Mesh importer for glTF 2.0 (.gltf with external buffers, .glb) and Wavefront OBJ.
+// Importing is split in two so the caller can allocate the destination first: Open
+// parses the file and sizes the mesh, Fill decodes vertices and indices straight into
+// caller memory (usually a mapped staging buffer). glTF buffers are read in place from
+// the mapped files, nothing is staged in between.
+//
+// Every glTF node instance of a mesh becomes its own set of primitives with the node's
+// world transform baked in, only triangle lists are imported. OBJ faces are fanned and
+// grouped into one primitive per usemtl.
+
+struct MeshImport
+{
+    using Primitive = Model3D::Primitive;
+
+    Primitive       *primitives;
+    uint32_t        primitiveCount;
+    uint32_t        materialCount;
+    uint32_t        vertexCount;
+    uint32_t        indexCount;
+    VkIndexType     indexType;      // 16 bit when every primitive fits, indices are primitive local.
+                                    // Fill writes this type, it may be widened to 32 bit after Open
+    const char      *error;         // Set when Open fails
+
+    struct state_T;
+    state_T         *state;
+};
+
+namespace meshImport
+{
+    // Picks the format from the file extension
+    bool Open(const char *filename, MeshImport &mesh);
+
+    // vertices holds vertexCount Vertex, indices indexCount indices of indexType. Returns
+    // the box around every position, gathered on the way so the staging memory is never read
+    BoundingBox Fill(const MeshImport &mesh, Model3D::Vertex *vertices, void *indices);
+
+    void Close(MeshImport &mesh);
+
+    constexpr size_t IndexSize(VkIndexType type)
+    {
+        return type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include "mesh_optimize.hpp"
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+
+// Forsyth's scoring constants, the LRU it models is larger than the FIFO the statistics use
+constexpr uint32_t SCORE_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+constexpr uint32_t VALENCE_TABLE_SIZE = 32;
+
+constexpr uint32_t NO_TRIANGLE = ~0u;
+
+struct ScoreTables
+{
+    float cache[SCORE_CACHE_SIZE];
+    float valence[VALENCE_TABLE_SIZE];
+};
+
+static ScoreTables MakeScoreTables()
+{
+    ScoreTables tables;
+    for (uint32_t i = 0; i < SCORE_CACHE_SIZE; i++)
+    {
+        // The last triangle's vertices score the same whatever their order, so it does not
+        // matter which of them was emitted first
+        const float scaler = 1.0f / float(SCORE_CACHE_SIZE - 3);
+        tables.cache[i] = i < 3 ? LAST_TRIANGLE_SCORE :
+                                  std::pow(1.0f - float(i - 3) * scaler, CACHE_DECAY_POWER);
+    }
+    for (uint32_t i = 0; i < VALENCE_TABLE_SIZE; i++)
+        tables.valence[i] = i > 0 ? VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER) : 0.0f;
+    return tables;
+}
+
+// Few triangles left on a vertex push it up so lone triangles are not left behind
+static float VertexScore(const ScoreTables &tables, int32_t cachePosition, uint32_t liveTriangles)
+{
+    if(liveTriangles == 0)
+        return -1.0f;
+
+    const float cacheScore = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+    const float valenceScore = liveTriangles < VALENCE_TABLE_SIZE ? tables.valence[liveTriangles] :
+                               VALENCE_BOOST_SCALE * std::pow(float(liveTriangles), -VALENCE_BOOST_POWER);
+    return cacheScore + valenceScore;
+}
+
+static const vec3<float> &Position(const vec3<float> *positions, size_t stride, uint32_t index)
+{
+    return *reinterpret_cast<const vec3<float>*>(reinterpret_cast<const uint8_t*>(positions) + index * stride);
+}
+
+VertexCacheStats meshOptimize::AnalyzeVertexCache(const uint32_t *indices, size_t indexCount, uint32_t vertexCount,
+                                                  uint32_t cacheSize)
+{
+    VertexCacheStats stats{};
+    stats.triangles = uint32_t(indexCount / 3);
+
+    // NOTE(arle): A vertex is in the FIFO while fewer than cacheSize misses happened since
+    // it was loaded, the clock starts far enough ahead that every vertex misses at first
+    auto loadedAt = new uint32_t[vertexCount]();
+    auto referenced = new bool[vertexCount]();
+    uint32_t clock = cacheSize + 1;
+    for (size_t i = 0; i < stats.triangles * size_t(3); i++)
+    {
+        const uint32_t vertex = indices[i];
+        if(clock - loadedAt[vertex] > cacheSize)
+        {
+            loadedAt[vertex] = clock++;
+            stats.transformed++;
+        }
+
+        stats.vertices += referenced[vertex] ? 0 : 1;
+        referenced[vertex] = true;
+    }
+
+    delete[] loadedAt;
+    delete[] referenced;
+    return stats;
+}
+
+void meshOptimize::OptimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount)
+{
+    const uint32_t triangleCount = uint32_t(indexCount / 3);
+    if(triangleCount < 2 || vertexCount == 0)
+        return;
+
+    static const ScoreTables tables = MakeScoreTables();
+
+    // Triangles of each vertex, the live ones at the front of its range
+    auto firstTriangle = new uint32_t[vertexCount + 1]();
+    for (size_t i = 0; i < triangleCount * size_t(3); i++)
+        firstTriangle[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        firstTriangle[v + 1] += firstTriangle[v];
+
+    auto liveTriangles = new uint32_t[vertexCount]();
+    auto vertexTriangles = new uint32_t[triangleCount * size_t(3)];
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t v = indices[3 * t + k];
+            vertexTriangles[firstTriangle[v] + liveTriangles[v]++] = t;
+        }
+    }
+
+    auto cachePosition = new int32_t[vertexCount];
+    auto vertexScore = new float[vertexCount];
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        cachePosition[v] = -1;
+        vertexScore[v] = VertexScore(tables, -1, liveTriangles[v]);
+    }
+
+    auto triangleScore = new float[triangleCount];
+    auto emitted = new bool[triangleCount]();
+    uint32_t bestTriangle = 0;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t *triangle = indices + 3 * t;
+        triangleScore[t] = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+        if(triangleScore[t] > triangleScore[bestTriangle])
+            bestTriangle = t;
+    }
+
+    // Moves a vertex's score to its new cache position and the difference onto its triangles
+    const auto rescore = [&](uint32_t v)
+    {
+        const float score = VertexScore(tables, cachePosition[v], liveTriangles[v]);
+        const float delta = score - vertexScore[v];
+        vertexScore[v] = score;
+
+        const uint32_t *triangles = vertexTriangles + firstTriangle[v];
+        for (uint32_t i = 0; i < liveTriangles[v]; i++)
+            triangleScore[triangles[i]] += delta;
+    };
+
+    auto output = new uint32_t[triangleCount * size_t(3)];
+    uint32_t cache[SCORE_CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    uint32_t nextInput = 0;
+
+    for (uint32_t written = 0; written < triangleCount; written++)
+    {
+        // Nothing in the cache has triangles left, carry on in input order
+        if(bestTriangle == NO_TRIANGLE)
+        {
+            while(emitted[nextInput])
+                nextInput++;
+            bestTriangle = nextInput;
+        }
+
+        const uint32_t *triangle = indices + 3 * bestTriangle;
+        memcpy(output + 3 * size_t(written), triangle, sizeof(uint32_t) * 3);
+        emitted[bestTriangle] = true;
+
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t v = triangle[k];
+            uint32_t *triangles = vertexTriangles + firstTriangle[v];
+            const uint32_t live = liveTriangles[v];
+            for (uint32_t i = 0; i < live; i++)
+            {
+                if(triangles[i] != bestTriangle)
+                    continue;
+
+                triangles[i] = triangles[live - 1];
+                triangles[live - 1] = bestTriangle;
+                liveTriangles[v]--;
+                break;
+            }
+        }
+
+        // The triangle's vertices move to the front, the rest keep their order behind them
+        uint32_t updated[SCORE_CACHE_SIZE + 3];
+        uint32_t updatedCount = 0;
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t v = triangle[k];
+            if(updatedCount == 0 || updated[0] != v)
+                updated[updatedCount++] = v;
+            if(updatedCount == 3 && updated[2] == updated[1])
+                updatedCount--;
+        }
+        for (uint32_t i = 0; i < cacheCount; i++)
+        {
+            const uint32_t v = cache[i];
+            if(v != triangle[0] && v != triangle[1] && v != triangle[2])
+                updated[updatedCount++] = v;
+        }
+
+        for (uint32_t i = SCORE_CACHE_SIZE; i < updatedCount; i++)
+        {
+            cachePosition[updated[i]] = -1;
+            rescore(updated[i]);
+        }
+
+        cacheCount = min(updatedCount, SCORE_CACHE_SIZE);
+        for (uint32_t i = 0; i < cacheCount; i++)
+        {
+            cache[i] = updated[i];
+            cachePosition[cache[i]] = int32_t(i);
+            rescore(cache[i]);
+        }
+
+        // Only triangles touching the cache can have gained
+        bestTriangle = NO_TRIANGLE;
+        float bestScore = -1.0f;
+        for (uint32_t i = 0; i < cacheCount; i++)
+        {
+            const uint32_t v = cache[i];
+            const uint32_t *triangles = vertexTriangles + firstTriangle[v];
+            for (uint32_t j = 0; j < liveTriangles[v]; j++)
+            {
+                if(triangleScore[triangles[j]] > bestScore)
+                {
+                    bestScore = triangleScore[triangles[j]];
+                    bestTriangle = triangles[j];
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output, sizeof(uint32_t) * 3 * size_t(triangleCount));
+
+    delete[] firstTriangle;
+    delete[] liveTriangles;
+    delete[] vertexTriangles;
+    delete[] cachePosition;
+    delete[] vertexScore;
+    delete[] triangleScore;
+    delete[] emitted;
+    delete[] output;
+}
+
+struct ClusterKey
+{
+    float       key;
+    uint32_t    cluster;
+};
+
+// Outermost first, ties keep the cache order
+static int CompareClusters(const void *a, const void *b)
+{
+    const auto &left = *static_cast<const ClusterKey*>(a);
+    const auto &right = *static_cast<const ClusterKey*>(b);
+    if(left.key != right.key)
+        return left.key > right.key ? -1 : 1;
+    return left.cluster < right.cluster ? -1 : (left.cluster > right.cluster ? 1 : 0);
+}
+
+void meshOptimize::OptimizeOverdraw(uint32_t *indices, size_t indexCount, const vec3<float> *positions,
+                                    uint32_t vertexCount, size_t stride, float threshold)
+{
+    const uint32_t triangleCount = uint32_t(indexCount / 3);
+    if(triangleCount < 2 || vertexCount == 0)
+        return;
+
+    // Misses per triangle in the cache order, a triangle missing all three starts a new
+    // cluster since the cache is cold there whatever comes before it
+    auto misses = new uint8_t[triangleCount];
+    auto loadedAt = new uint32_t[vertexCount]();
+    uint32_t clock = CACHE_SIZE + 1;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        misses[t] = 0;
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t v = indices[3 * t + k];
+            if(clock - loadedAt[v] > CACHE_SIZE)
+            {
+                loadedAt[v] = clock++;
+                misses[t]++;
+            }
+        }
+    }
+    delete[] loadedAt;
+
+    auto clusterStart = new uint32_t[triangleCount + 1];
+    uint32_t clusterCount = 0;
+    for (uint32_t start = 0; start < triangleCount;)
+    {
+        uint32_t end = start + 1;
+        uint32_t clusterMisses = misses[start];
+        while(end < triangleCount && misses[end] < 3)
+            clusterMisses += misses[end++];
+
+        // Cuts inside the hard cluster once the ratio so far is within threshold of the
+        // cluster's, at triangles that mostly miss anyway
+        const float limit = threshold * float(clusterMisses) / float(end - start);
+        uint32_t runStart = start, runMisses = 0;
+        clusterStart[clusterCount++] = start;
+        for (uint32_t t = start; t + 1 < end; t++)
+        {
+            runMisses += misses[t];
+            if(float(runMisses) <= limit * float(t + 1 - runStart) && misses[t + 1] >= 2)
+            {
+                clusterStart[clusterCount++] = t + 1;
+                runStart = t + 1;
+                runMisses = 0;
+            }
+        }
+        start = end;
+    }
+    clusterStart[clusterCount] = triangleCount;
+    delete[] misses;
+
+    // Area weighted centroids, the summed cross products point the way a cluster faces
+    auto clusterCentroid = new vec3<float>[clusterCount];
+    auto clusterNormal = new vec3<float>[clusterCount];
+    vec3<float> meshCentroid = vec3(0.0f);
+    float meshArea = 0.0f;
+    for (uint32_t c = 0; c < clusterCount; c++)
+    {
+        vec3<float> centroid = vec3(0.0f), normal = vec3(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            const auto &p0 = Position(positions, stride, indices[3 * t]);
+            const auto &p1 = Position(positions, stride, indices[3 * t + 1]);
+            const auto &p2 = Position(positions, stride, indices[3 * t + 2]);
+            const auto n = cross(p1 - p0, p2 - p0);
+            const float weight = length(n);
+
+            centroid = centroid + (p0 + p1 + p2) * (weight / 3.0f);
+            normal = normal + n;
+            area += weight;
+        }
+
+        meshCentroid = meshCentroid + centroid;
+        meshArea += area;
+        clusterCentroid[c] = area > 0.0f ? centroid * (1.0f / area) : vec3(0.0f);
+        clusterNormal[c] = normal;
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid * (1.0f / meshArea) : vec3(0.0f);
+
+    auto keys = new ClusterKey[clusterCount];
+    for (uint32_t c = 0; c < clusterCount; c++)
+    {
+        const float normalLength = length(clusterNormal[c]);
+        const float key = normalLength > 0.0f ? dot(clusterCentroid[c] - meshCentroid, clusterNormal[c]) / normalLength : 0.0f;
+        keys[c] = {key, c};
+    }
+    qsort(keys, clusterCount, sizeof(ClusterKey), CompareClusters);
+
+    auto output = new uint32_t[triangleCount * size_t(3)];
+    size_t cursor = 0;
+    for (uint32_t i = 0; i < clusterCount; i++)
+    {
+        const uint32_t c = keys[i].cluster;
+        const size_t count = size_t(clusterStart[c + 1] - clusterStart[c]) * 3;
+        memcpy(output + cursor, indices + size_t(clusterStart[c]) * 3, sizeof(uint32_t) * count);
+        cursor += count;
+    }
+    memcpy(indices, output, sizeof(uint32_t) * cursor);
+
+    delete[] clusterStart;
+    delete[] clusterCentroid;
+    delete[] clusterNormal;
+    delete[] keys;
+    delete[] output;
+}
+
+uint32_t meshOptimize::OptimizeVertexFetch(void *vertices, uint32_t *indices, size_t indexCount,
+                                           uint32_t vertexCount, size_t vertexSize)
+{
+    constexpr uint32_t UNUSED = ~0u;
+    auto remap = new uint32_t[vertexCount];
+    for (uint32_t v = 0; v < vertexCount; v++)
+        remap[v] = UNUSED;
+
+    uint32_t referenced = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        auto &target = remap[indices[i]];
+        if(target == UNUSED)
+            target = referenced++;
+        indices[i] = target;
+    }
+
+    uint32_t unreferenced = referenced;
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        if(remap[v] == UNUSED)
+            remap[v] = unreferenced++;
+    }
+
+    auto source = new uint8_t[vertexCount * vertexSize];
+    memcpy(source, vertices, vertexCount * vertexSize);
+    auto target = static_cast<uint8_t*>(vertices);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        memcpy(target + remap[v] * vertexSize, source + v * vertexSize, vertexSize);
+
+    delete[] source;
+    delete[] remap;
+    return referenced;
+}
+
+void meshOptimize::Optimize(void *vertices, uint32_t *indices, size_t indexCount, uint32_t vertexCount,
+                            size_t vertexSize, VertexCacheStats &before, VertexCacheStats &after)
+{
+    before = AnalyzeVertexCache(indices, indexCount, vertexCount);
+
+    OptimizeVertexCache(indices, indexCount, vertexCount);
+    OptimizeOverdraw(indices, indexCount, static_cast<const vec3<float>*>(vertices), vertexCount, vertexSize);
+    OptimizeVertexFetch(vertices, indices, indexCount, vertexCount, vertexSize);
+
+    after = AnalyzeVertexCache(indices, indexCount, vertexCount);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../base.hpp"
+
+// Triangle and vertex order of indexed triangle lists, run on the CPU copy of a mesh before
+// it is staged. Each function takes one list whose indices are local to its vertices, a
+// Model3D primitive is one call. Optimize runs all three passes in order:
+//
+//  - Vertex cache: Forsyth's linear speed scoring, triangles that reuse recently shaded
+//    vertices first
+//  - Overdraw: the cache order is cut into clusters where the cache would be cold anyway and
+//    the clusters are sorted outermost first (Tipsify, Sander, Nehab and Barczak 2007), so
+//    front faces tend to be drawn before what they hide
+//  - Vertex fetch: vertices renumbered in first use order, reads from the vertex buffer then
+//    move forward through memory
+//
+// The cache statistics simulate a FIFO post-transform cache of CACHE_SIZE entries.
+
+struct VertexCacheStats
+{
+    uint32_t    transformed;    // Cache misses, one vertex shader invocation each
+    uint32_t    triangles;
+    uint32_t    vertices;       // Referenced by the indices
+
+    // Average cache miss ratio, transformed vertices per triangle. 3 means no reuse, large
+    // regular grids approach 0.5
+    float acmr() const
+    {
+        return triangles > 0 ? float(transformed) / float(triangles) : 0.0f;
+    }
+
+    // Average transform to vertex ratio, 1 when every vertex is shaded once
+    float atvr() const
+    {
+        return vertices > 0 ? float(transformed) / float(vertices) : 0.0f;
+    }
+};
+
+namespace meshOptimize
+{
+    constexpr uint32_t CACHE_SIZE = 16;
+
+    VertexCacheStats AnalyzeVertexCache(const uint32_t *indices, size_t indexCount, uint32_t vertexCount,
+                                        uint32_t cacheSize = CACHE_SIZE);
+
+    // Reorders the triangles in place
+    void OptimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount);
+
+    // Expects the vertex cache order, threshold is how much the cache miss ratio of a cluster
+    // may grow over its share of the input for more clusters to sort
+    void OptimizeOverdraw(uint32_t *indices, size_t indexCount, const vec3<float> *positions,
+                          uint32_t vertexCount, size_t stride, float threshold = 1.05f);
+
+    // Moves the vertices into first use order and remaps the indices, unreferenced vertices
+    // end up behind the referenced ones. Returns how many are referenced
+    uint32_t OptimizeVertexFetch(void *vertices, uint32_t *indices, size_t indexCount,
+                                 uint32_t vertexCount, size_t vertexSize);
+
+    // The three passes in order, positions are at the start of each vertexSize vertex.
+    // before and after are the cache statistics of the input and the result
+    void Optimize(void *vertices, uint32_t *indices, size_t indexCount, uint32_t vertexCount,
+                  size_t vertexSize, VertexCacheStats &before, VertexCacheStats &after);
+}
@@ -0,0 +1,206 @@
+#include "mesh_registry.hpp"
+#include <string.h>
+
+void MeshRegistry::create(const VulkanDevice *device, VkQueue queue, uint32_t vertexStride,
+                          uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    m_device = device;
+    m_queue = queue;
+    m_vertexStride = vertexStride;
+    m_vertexCapacity = max(vertexCapacity, 1u);
+    m_indexCapacity = max(indexCapacity, 1u);
+    createBuffers(m_vertexCapacity, m_indexCapacity, m_vertices, m_indices);
+
+    freeList::Create(m_freeVertices, 0, m_vertexCapacity);
+    freeList::Create(m_freeIndices, 0, m_indexCapacity);
+
+    m_slotCapacity = 16;
+    m_slotCount = 0;
+    m_meshes = new Slot[m_slotCapacity];
+}
+
+void MeshRegistry::destroy()
+{
+    m_vertices.destroy(m_device->device);
+    m_indices.destroy(m_device->device);
+
+    freeList::Destroy(m_freeVertices);
+    freeList::Destroy(m_freeIndices);
+    delete[] m_meshes;
+    m_meshes = nullptr;
+    m_slotCount = 0;
+    m_slotCapacity = 0;
+}
+
+void MeshRegistry::createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity,
+                                 VulkanBuffer &vertices, VulkanBuffer &indices)
+{
+    // Transfer source for the copies of rebuild
+    m_device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                           MEM_FLAG_GPU_LOCAL,
+                           VkDeviceSize(vertexCapacity) * m_vertexStride,
+                           vertices);
+    m_device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                           MEM_FLAG_GPU_LOCAL,
+                           VkDeviceSize(indexCapacity) * sizeof(Index),
+                           indices);
+}
+
+mesh_handle MeshRegistry::allocate(UploadBatch &upload, uint32_t vertexCount, uint32_t indexCount,
+                                   void *&vertices, Index *&indices)
+{
+    vertices = nullptr;
+    indices = nullptr;
+
+    uint32_t firstVertex = 0, firstIndex = 0;
+    bool placed = freeList::Take(m_freeVertices, vertexCount, firstVertex);
+    if(placed && !freeList::Take(m_freeIndices, indexCount, firstIndex))
+    {
+        freeList::Release(m_freeVertices, firstVertex, vertexCount);
+        placed = false;
+    }
+
+    if(!placed)
+    {
+        // NOTE(arle): Copies already staged for the old buffers have to land before they are
+        // copied over, the batch is flushed before the rebuild reads them
+        const auto stats = this->stats();
+        upload.flush();
+        rebuild(max(m_vertexCapacity * 2, stats.vertices + vertexCount),
+                max(m_indexCapacity * 2, stats.indices + indexCount));
+
+        freeList::Take(m_freeVertices, vertexCount, firstVertex);
+        freeList::Take(m_freeIndices, indexCount, firstIndex);
+    }
+
+    mesh_handle mesh = 0;
+    while(mesh < m_slotCount && m_meshes[mesh].live)
+        mesh++;
+
+    if(mesh == m_slotCapacity)
+    {
+        auto slots = new Slot[m_slotCapacity * 2];
+        memcpy(slots, m_meshes, sizeof(Slot) * m_slotCount);
+        delete[] m_meshes;
+        m_meshes = slots;
+        m_slotCapacity *= 2;
+    }
+    m_slotCount = max(m_slotCount, mesh + 1);
+
+    m_meshes[mesh].range = {firstIndex, indexCount, int32_t(firstVertex), vertexCount};
+    m_meshes[mesh].live = true;
+
+    const VkDeviceSize vertexBytes = VkDeviceSize(vertexCount) * m_vertexStride;
+    const VkDeviceSize indexBytes = VkDeviceSize(indexCount) * sizeof(Index);
+    upload.reserve(vertexBytes + indexBytes, 2);
+    vertices = upload.stageBuffer(m_vertices.data, vertexBytes, VkDeviceSize(firstVertex) * m_vertexStride);
+    indices = static_cast<Index*>(upload.stageBuffer(m_indices.data, indexBytes, VkDeviceSize(firstIndex) * sizeof(Index)));
+    return mesh;
+}
+
+void MeshRegistry::free(mesh_handle mesh)
+{
+    if(mesh >= m_slotCount || !m_meshes[mesh].live)
+        return;
+
+    const auto &range = m_meshes[mesh].range;
+    freeList::Release(m_freeVertices, uint32_t(range.vertexOffset), range.vertexCount);
+    freeList::Release(m_freeIndices, range.firstIndex, range.indexCount);
+    m_meshes[mesh].live = false;
+}
+
+bool MeshRegistry::compact(UploadBatch &upload)
+{
+    if(freeList::Packed(m_freeVertices, m_vertexCapacity) && freeList::Packed(m_freeIndices, m_indexCapacity))
+        return false;
+
+    // Like growing in allocate, staged copies have to land in the old buffers first
+    upload.flush();
+    rebuild(m_vertexCapacity, m_indexCapacity);
+    return true;
+}
+
+void MeshRegistry::rebuild(uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    VulkanBuffer vertices, indices;
+    createBuffers(vertexCapacity, indexCapacity, vertices, indices);
+
+    auto cmd = m_device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    uint32_t vertexCursor = 0, indexCursor = 0;
+    for (uint32_t i = 0; i < m_slotCount; i++)
+    {
+        if(!m_meshes[i].live)
+            continue;
+
+        // Indices are relative to the first vertex and move unchanged
+        auto &range = m_meshes[i].range;
+        if(range.vertexCount > 0)
+        {
+            VkBufferCopy region{};
+            region.srcOffset = VkDeviceSize(range.vertexOffset) * m_vertexStride;
+            region.dstOffset = VkDeviceSize(vertexCursor) * m_vertexStride;
+            region.size = VkDeviceSize(range.vertexCount) * m_vertexStride;
+            vkCmdCopyBuffer(cmd, m_vertices.data, vertices.data, 1, &region);
+        }
+        if(range.indexCount > 0)
+        {
+            VkBufferCopy region{};
+            region.srcOffset = VkDeviceSize(range.firstIndex) * sizeof(Index);
+            region.dstOffset = VkDeviceSize(indexCursor) * sizeof(Index);
+            region.size = VkDeviceSize(range.indexCount) * sizeof(Index);
+            vkCmdCopyBuffer(cmd, m_indices.data, indices.data, 1, &region);
+        }
+
+        range.vertexOffset = int32_t(vertexCursor);
+        range.firstIndex = indexCursor;
+        vertexCursor += range.vertexCount;
+        indexCursor += range.indexCount;
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    m_device->flushCommandBuffer(cmd, m_queue);
+
+    m_vertices.destroy(m_device->device);
+    m_indices.destroy(m_device->device);
+    m_vertices = vertices;
+    m_indices = indices;
+    m_vertexCapacity = vertexCapacity;
+    m_indexCapacity = indexCapacity;
+
+    freeList::Reset(m_freeVertices, vertexCursor, vertexCapacity);
+    freeList::Reset(m_freeIndices, indexCursor, indexCapacity);
+}
+
+void MeshRegistry::bind(VkCommandBuffer cmd) const
+{
+    const VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cmd, 0, 1, &m_vertices.data, &offset);
+    vkCmdBindIndexBuffer(cmd, m_indices.data, 0, INDEX_TYPE);
+}
+
+MeshRegistryStats MeshRegistry::stats() const
+{
+    MeshRegistryStats stats{};
+    for (uint32_t i = 0; i < m_slotCount; i++)
+    {
+        if(!m_meshes[i].live)
+            continue;
+
+        stats.meshes++;
+        stats.vertices += m_meshes[i].range.vertexCount;
+        stats.indices += m_meshes[i].range.indexCount;
+    }
+    stats.vertexCapacity = m_vertexCapacity;
+    stats.indexCapacity = m_indexCapacity;
+    stats.freeRanges = m_freeVertices.count + m_freeIndices.count;
+    return stats;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+#include "upload_batch.hpp"
+#include "free_list.hpp"
+
+// Vertices and indices of many meshes sub-allocated from one device local vertex buffer and
+// one 32 bit index buffer. A mesh is addressed by (firstIndex, vertexOffset) like a primitive,
+// so every mesh in a registry draws after a single bind and their draws can share one
+// multi-draw. Strides differ between vertex layouts, each layout gets its own registry.
+//
+// Ranges are taken first fit from a FreeList per buffer. A full registry grows into buffers
+// twice the size, and compact moves the live meshes to the front of fresh buffers to close
+// the holes frees leave. Both copy on the GPU and wait for it, nothing in flight may still
+// read the registry then. Ranges move, look them up by handle when recording.
+
+using mesh_handle = uint32_t;
+constexpr mesh_handle INVALID_MESH = ~0u;
+
+struct MeshRange
+{
+    uint32_t    firstIndex;
+    uint32_t    indexCount;
+    int32_t     vertexOffset;
+    uint32_t    vertexCount;
+};
+
+struct MeshRegistryStats
+{
+    uint32_t    meshes;
+    uint32_t    vertices;       // In live meshes
+    uint32_t    indices;
+    uint32_t    vertexCapacity;
+    uint32_t    indexCapacity;
+    uint32_t    freeRanges;     // Free list entries of both buffers, at most 2 when compact
+};
+
+class MeshRegistry
+{
+public:
+    using Index = uint32_t;
+    static constexpr VkIndexType INDEX_TYPE = VK_INDEX_TYPE_UINT32;
+
+    // Copies for growing and compacting are submitted to queue
+    void create(const VulkanDevice *device, VkQueue queue, uint32_t vertexStride,
+                uint32_t vertexCapacity, uint32_t indexCapacity);
+    void destroy();
+
+    // Staging memory in the batch for the mesh's vertices and indices, indices are relative
+    // to the mesh's first vertex. Both pointers stay valid until the batch may flush again.
+    // Grows the buffers when they are full, which flushes the batch first
+    mesh_handle allocate(UploadBatch &upload, uint32_t vertexCount, uint32_t indexCount,
+                         void *&vertices, Index *&indices);
+
+    // The ranges are reused by later allocations, the GPU has to be done with the mesh
+    void free(mesh_handle mesh);
+
+    // Live meshes packed to the start of new buffers, returns false when there was nothing
+    // to close. Flushes the batch first when it does
+    bool compact(UploadBatch &upload);
+
+    const MeshRange &range(mesh_handle mesh) const { return m_meshes[mesh].range; }
+
+    // Binding 0 and the index buffer
+    void bind(VkCommandBuffer cmd) const;
+
+    MeshRegistryStats stats() const;
+
+private:
+    struct Slot
+    {
+        MeshRange   range;
+        bool        live;
+    };
+
+    void createBuffers(uint32_t vertexCapacity, uint32_t indexCapacity, VulkanBuffer &vertices, VulkanBuffer &indices);
+    // Copies every live mesh packed into buffers of the given capacity and switches to them
+    void rebuild(uint32_t vertexCapacity, uint32_t indexCapacity);
+
+    const VulkanDevice* m_device;
+    VkQueue             m_queue;
+    uint32_t            m_vertexStride;
+    uint32_t            m_vertexCapacity;
+    uint32_t            m_indexCapacity;
+    VulkanBuffer        m_vertices;
+    VulkanBuffer        m_indices;
+    FreeList            m_freeVertices;
+    FreeList            m_freeIndices;
+    Slot*               m_meshes;
+    uint32_t            m_slotCount;
+    uint32_t            m_slotCapacity;
+};
@@ -0,0 +1,398 @@
+#include "mip_chain.hpp"
+#include "pixel_convert.hpp"
+#include <bit>
+#include <cmath>
+#include <string.h>
+#include <emmintrin.h>
+
+constexpr uint32_t MIP_ROWS_PER_TASK = 8;
+constexpr uint32_t KAISER_TAPS = 6;
+constexpr float KAISER_ALPHA = 4.0f;
+constexpr float KAISER_RADIUS = 1.5f;       // In target texels, the reach of the outer taps
+constexpr uint32_t SRGB_ENCODE_STEPS = 4096;
+
+enum class texel_type
+{
+    none,
+    unorm8,
+    srgb8,
+    float16,
+    float32
+};
+
+static texel_type TexelType(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+            return texel_type::unorm8;
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return texel_type::srgb8;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return texel_type::float16;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return texel_type::float32;
+        default:
+            return texel_type::none;
+    }
+}
+
+static uint32_t TexelSize(texel_type type)
+{
+    switch (type)
+    {
+        case texel_type::unorm8:
+        case texel_type::srgb8:
+            return 4;
+        case texel_type::float16:
+            return 8;
+        case texel_type::float32:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+struct FilterTables
+{
+    float       srgbToLinear[256];
+    uint8_t     linearToSrgb[SRGB_ENCODE_STEPS + 1];    // Indexed by the square root of the linear value
+    float       kaiser[KAISER_TAPS];                    // Source texels -2.5 to 2.5 from the target centre
+};
+
+// Modified Bessel function of the first kind, the series converges fast for the window's range
+static float BesselI0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    for (uint32_t k = 1; k < 20; k++)
+    {
+        const float factor = x * 0.5f / float(k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+static FilterTables BuildTables()
+{
+    FilterTables tables;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        const float value = float(i) / 255.0f;
+        tables.srgbToLinear[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // NOTE(arle): Steps are even in the square root of the linear value, which follows the
+    // sRGB curve closely enough that neighbouring entries never differ by more than one
+    for (uint32_t i = 0; i <= SRGB_ENCODE_STEPS; i++)
+    {
+        const float root = float(i) / float(SRGB_ENCODE_STEPS);
+        const float linear = root * root;
+        const float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        tables.linearToSrgb[i] = uint8_t(srgb * 255.0f + 0.5f);
+    }
+
+    // Taps sit half a source texel apart from the target centre, a quarter of a target texel
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < KAISER_TAPS; i++)
+    {
+        const float distance = (float(i) - 2.5f) * 0.5f;
+        const float x = PI32 * distance;
+        const float sinc = std::sin(x) / x;
+        const float r = distance / KAISER_RADIUS;
+        const float window = BesselI0(KAISER_ALPHA * std::sqrt(1.0f - r * r)) / BesselI0(KAISER_ALPHA);
+
+        tables.kaiser[i] = sinc * window;
+        sum += tables.kaiser[i];
+    }
+    for (auto &weight : tables.kaiser)
+        weight /= sum;
+
+    return tables;
+}
+
+static const FilterTables &Tables()
+{
+    static const FilterTables tables = BuildTables();
+    return tables;
+}
+
+// Row of the source level as linear RGBA floats
+static void DecodeRow(const uint8_t *row, texel_type type, uint32_t width, float *out)
+{
+    const auto &tables = Tables();
+    switch (type)
+    {
+        case texel_type::unorm8:
+        {
+            const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+            const __m128i zero = _mm_setzero_si128();
+            uint32_t x = 0;
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+                const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+                _mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+                _mm_storeu_ps(out + x * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+                _mm_storeu_ps(out + x * 4 + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+                _mm_storeu_ps(out + x * 4 + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+            }
+            for (; x < width; x++)
+            {
+                for (uint32_t c = 0; c < 4; c++)
+                    out[x * 4 + c] = float(row[x * 4 + c]) / 255.0f;
+            }
+            break;
+        }
+        case texel_type::srgb8:
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                out[x * 4] = tables.srgbToLinear[row[x * 4]];
+                out[x * 4 + 1] = tables.srgbToLinear[row[x * 4 + 1]];
+                out[x * 4 + 2] = tables.srgbToLinear[row[x * 4 + 2]];
+                out[x * 4 + 3] = float(row[x * 4 + 3]) / 255.0f;
+            }
+            break;
+        }
+        case texel_type::float16:
+            pixelConvert::FromHalf(reinterpret_cast<const uint16_t*>(row), size_t(width) * 4, out);
+            break;
+        case texel_type::float32:
+            memcpy(out, row, size_t(width) * 16);
+            break;
+        default:
+            break;
+    }
+}
+
+// Linear RGBA floats to a row of the target level, 8-bit channels saturate
+static void EncodeRow(const float *row, texel_type type, uint32_t width, uint8_t *out)
+{
+    const auto &tables = Tables();
+    switch (type)
+    {
+        case texel_type::unorm8:
+        {
+            const __m128 scale = _mm_set1_ps(255.0f);
+            uint32_t x = 0;
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(row + x * 4), scale));
+                const __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(row + x * 4 + 4), scale));
+                const __m128i c = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(row + x * 4 + 8), scale));
+                const __m128i d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(row + x * 4 + 12), scale));
+                const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), bytes);
+            }
+            for (; x < width; x++)
+            {
+                const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(row + x * 4), scale));
+                const __m128i words = _mm_packs_epi32(a, a);
+                const uint32_t texel = uint32_t(_mm_cvtsi128_si32(_mm_packus_epi16(words, words)));
+                memcpy(out + x * 4, &texel, 4);
+            }
+            break;
+        }
+        case texel_type::srgb8:
+        {
+            // Colour channels look up the table by their square root, alpha is scaled
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 scale = _mm_setr_ps(float(SRGB_ENCODE_STEPS), float(SRGB_ENCODE_STEPS),
+                                             float(SRGB_ENCODE_STEPS), 255.0f);
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 alpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+            alignas(16) int32_t index[4];
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(row + x * 4), zero), one);
+                const __m128 mapped = _mm_or_ps(_mm_andnot_ps(alpha, _mm_sqrt_ps(value)), _mm_and_ps(alpha, value));
+                _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(mapped, scale), half)));
+
+                out[x * 4] = tables.linearToSrgb[index[0]];
+                out[x * 4 + 1] = tables.linearToSrgb[index[1]];
+                out[x * 4 + 2] = tables.linearToSrgb[index[2]];
+                out[x * 4 + 3] = uint8_t(index[3]);
+            }
+            break;
+        }
+        case texel_type::float16:
+            pixelConvert::ToHalf(row, 4, width, reinterpret_cast<uint16_t*>(out));
+            break;
+        case texel_type::float32:
+            memcpy(out, row, size_t(width) * 16);
+            break;
+        default:
+            break;
+    }
+}
+
+struct MipLevelJob
+{
+    const uint8_t*  source;         // The level above in sourceType
+    texel_type      sourceType;
+    uint32_t        sourceWidth;
+    uint32_t        sourceHeight;
+    uint32_t        width;
+    uint32_t        height;
+    texel_type      targetType;
+    uint8_t*        target;
+    float*          floats;         // Linear copy of the level for the next one, null on the last
+    const float*    weights;
+    uint32_t        taps;
+};
+
+// Target texel x is centred between source texels 2x and 2x + 1, taps past the edge repeat it
+static void FilterRow(const float *row, uint32_t width, const MipLevelJob &job, float *out)
+{
+    __m128 weights[KAISER_TAPS];
+    for (uint32_t t = 0; t < job.taps; t++)
+        weights[t] = _mm_set1_ps(job.weights[t]);
+
+    const int32_t firstTap = 1 - int32_t(job.taps / 2);
+    for (uint32_t x = 0; x < job.width; x++)
+    {
+        const int32_t begin = int32_t(x * 2) + firstTap;
+        __m128 sum = _mm_setzero_ps();
+        if(begin >= 0 && begin + int32_t(job.taps) <= int32_t(width))
+        {
+            for (uint32_t t = 0; t < job.taps; t++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + (begin + int32_t(t)) * 4), weights[t]));
+        }
+        else
+        {
+            for (uint32_t t = 0; t < job.taps; t++)
+            {
+                const int32_t sx = clamp(begin + int32_t(t), 0, int32_t(width) - 1);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx * 4), weights[t]));
+            }
+        }
+        _mm_storeu_ps(out + x * 4, sum);
+    }
+}
+
+// One band of target rows. The source rows it covers are filtered horizontally once, then
+// combined vertically per target row
+static void FilterBand(void *data, uint32_t band)
+{
+    const auto &job = *static_cast<const MipLevelJob*>(data);
+    const int32_t firstTap = 1 - int32_t(job.taps / 2);
+    const uint32_t y0 = band * MIP_ROWS_PER_TASK;
+    const uint32_t y1 = min(y0 + MIP_ROWS_PER_TASK, job.height);
+    const int32_t rowBegin = int32_t(y0 * 2) + firstTap;
+    const uint32_t rowCount = (y1 - y0 - 1) * 2 + job.taps;
+
+    const size_t rowFloats = size_t(job.width) * 4;
+    auto scratch = new float[size_t(job.sourceWidth) * 4 + rowFloats * (rowCount + 1)];
+    float *decoded = scratch;
+    float *filtered = decoded + size_t(job.sourceWidth) * 4;
+    float *result = filtered + rowFloats * rowCount;
+
+    const size_t sourcePitch = size_t(job.sourceWidth) * TexelSize(job.sourceType);
+    for (uint32_t r = 0; r < rowCount; r++)
+    {
+        const int32_t sy = clamp(rowBegin + int32_t(r), 0, int32_t(job.sourceHeight) - 1);
+        const uint8_t *sourceRow = job.source + size_t(sy) * sourcePitch;
+
+        const float *row = decoded;
+        if(job.sourceType == texel_type::float32)
+            row = reinterpret_cast<const float*>(sourceRow);
+        else
+            DecodeRow(sourceRow, job.sourceType, job.sourceWidth, decoded);
+
+        FilterRow(row, job.sourceWidth, job, filtered + rowFloats * r);
+    }
+
+    const size_t targetPitch = size_t(job.width) * TexelSize(job.targetType);
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        const float *rows = filtered + rowFloats * (y - y0) * 2;
+        for (size_t i = 0; i < rowFloats; i += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (uint32_t t = 0; t < job.taps; t++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows + rowFloats * t + i), _mm_set1_ps(job.weights[t])));
+            _mm_storeu_ps(result + i, sum);
+        }
+
+        if(job.floats)
+            memcpy(job.floats + rowFloats * y, result, rowFloats * sizeof(float));
+        EncodeRow(result, job.targetType, job.width, job.target + targetPitch * y);
+    }
+
+    delete[] scratch;
+}
+
+uint32_t mipChain::LevelCount(VkFormat format, VkExtent2D extent)
+{
+    if(TexelType(format) == texel_type::none || extent.width == 0 || extent.height == 0)
+        return 0;
+    return uint32_t(std::bit_width(max(extent.width, extent.height)));
+}
+
+mip_filter mipChain::PreferredFilter(VkFormat format)
+{
+    const auto type = TexelType(format);
+    return type == texel_type::float16 || type == texel_type::float32 ? mip_filter::box : mip_filter::kaiser;
+}
+
+void mipChain::Generate(const uint8_t *pixels, VkFormat format, VkExtent2D extent, uint32_t levelCount,
+                        const VkDeviceSize *levelOffsets, uint8_t *target, mip_filter filter, ThreadPool *pool)
+{
+    const auto type = TexelType(format);
+    const uint32_t texelSize = TexelSize(type);
+    if(texelSize == 0)
+        return;
+
+    memcpy(target + levelOffsets[0], pixels, size_t(texelSize) * extent.width * extent.height);
+    if(levelCount < 2)
+        return;
+
+    // NOTE(arle): Levels alternate between two float buffers, one the size of level 1 and
+    // one the size of level 2. Each level reads the buffer the previous one wrote
+    const size_t level1 = size_t(max(extent.width >> 1, 1u)) * max(extent.height >> 1, 1u);
+    const size_t level2 = size_t(max(extent.width >> 2, 1u)) * max(extent.height >> 2, 1u);
+    float *floats[2] = {new float[level1 * 4], levelCount > 2 ? new float[level2 * 4] : nullptr};
+
+    static const float boxWeights[2] = {0.5f, 0.5f};
+
+    MipLevelJob job = {};
+    job.source = pixels;
+    job.sourceType = type;
+    job.sourceWidth = extent.width;
+    job.sourceHeight = extent.height;
+    job.targetType = type;
+    job.weights = filter == mip_filter::box ? boxWeights : Tables().kaiser;
+    job.taps = filter == mip_filter::box ? 2 : KAISER_TAPS;
+
+    for (uint32_t level = 1; level < levelCount; level++)
+    {
+        job.width = max(extent.width >> level, 1u);
+        job.height = max(extent.height >> level, 1u);
+        job.target = target + levelOffsets[level];
+        job.floats = level + 1 < levelCount ? floats[(level - 1) % 2] : nullptr;
+
+        const uint32_t bands = (job.height + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK;
+        if(pool)
+        {
+            pool->parallelFor(bands, FilterBand, &job);
+        }
+        else
+        {
+            for (uint32_t band = 0; band < bands; band++)
+                FilterBand(&job, band);
+        }
+
+        job.source = reinterpret_cast<const uint8_t*>(job.floats);
+        job.sourceType = texel_type::float32;
+        job.sourceWidth = job.width;
+        job.sourceHeight = job.height;
+    }
+
+    delete[] floats[0];
+    delete[] floats[1];
+}
\ No newline at end of file
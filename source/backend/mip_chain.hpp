@@ -0,0 +1,31 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include <vulkan/vulkan.h>
+
+// CPU mip chains for images the device can not blit, written straight into staging memory.
+// Every level is filtered in linear space from a float copy of the level above it, 8-bit
+// formats only round once per level and sRGB texels are linearised through tables. Rows
+// of a level are spread across the thread pool in bands, levels follow one another.
+
+enum class mip_filter
+{
+    box,        // 2x2 average
+    kaiser      // 6x6 Kaiser windowed sinc, keeps more detail and aliases less than the box
+};
+
+namespace mipChain
+{
+    // Levels of the full chain, 0 when the format can not be filtered on the CPU. Those are
+    // 8-bit RGBA and BGRA, UNORM or sRGB, RGBA16F and RGBA32F
+    uint32_t LevelCount(VkFormat format, VkExtent2D extent);
+
+    // Kaiser for 8-bit formats, box for float ones where the negative lobes ring around
+    // bright HDR texels
+    mip_filter PreferredFilter(VkFormat format);
+
+    // Copies level 0 from pixels and filters the levels below it, level i is written to
+    // target + levelOffsets[i] with tightly packed rows. Without a pool the caller filters alone
+    void Generate(const uint8_t *pixels, VkFormat format, VkExtent2D extent, uint32_t levelCount,
+                  const VkDeviceSize *levelOffsets, uint8_t *target, mip_filter filter, ThreadPool *pool = nullptr);
+}
\ No newline at end of file
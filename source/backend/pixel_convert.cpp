@@ -0,0 +1,228 @@
+#include "pixel_convert.hpp"
+#include "../mv_utils/cpu_features.hpp"
+#include <immintrin.h>
+
+// Float bits to a small unsigned float with a 5-bit exponent, rounded to nearest even.
+// Inputs must already be clamped to [0, max of the format], there are no specials to handle
+template<int MANTISSA_BITS>
+static inline __m128i SmallFloatBits(__m128 value)
+{
+    constexpr int SHIFT = 23 - MANTISSA_BITS;
+    const __m128i bits = _mm_castps_si128(value);
+
+    // Denormal results, adding a power of two lines the target mantissa up with the float's low bits
+    const __m128i magic = _mm_set1_epi32((127 - 15 + SHIFT + 1) << 23);
+    const __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(value, _mm_castsi128_ps(magic))), magic);
+
+    // Rebias the exponent from 127 to 15 and round on the dropped mantissa bits, odd rounds up on ties
+    const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, SHIFT), _mm_set1_epi32(1));
+    const __m128i bias = _mm_set1_epi32(int32_t((1u << (SHIFT - 1)) - 1 - (uint32_t(127 - 15) << 23)));
+    const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, bias), odd), SHIFT);
+
+    const __m128i isDenormal = _mm_cmplt_epi32(bits, _mm_set1_epi32((127 - 14) << 23));
+    return _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+}
+
+// Floats to halves in the low 16 bits of each lane, sign extended so packs_epi32 keeps them.
+// Same rounding and specials as FloatToHalf
+static inline __m128i HalfBitsSSE2(__m128 value)
+{
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(int32_t(0x80000000)));
+    const __m128 sign = _mm_and_ps(value, signMask);
+    const __m128 magnitude = _mm_xor_ps(value, sign);
+    const __m128i bits = _mm_castps_si128(magnitude);
+
+    // Past 65520 rounds to infinity, NaN keeps a quiet bit
+    const __m128i isFinite = _mm_cmplt_epi32(bits, _mm_set1_epi32(0x477FF000));
+    const __m128i nanBit = _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(magnitude, magnitude)),
+                                         _mm_set1_epi32(0x200));
+    const __m128i special = _mm_or_si128(nanBit, _mm_set1_epi32(0x7C00));
+
+    const __m128i finite = SmallFloatBits<10>(magnitude);
+    const __m128i half = _mm_or_si128(_mm_and_si128(isFinite, finite), _mm_andnot_si128(isFinite, special));
+    return _mm_or_si128(half, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+static inline __m128 FloatsFromHalvesSSE2(__m128i halves)
+{
+    // Same as HalfToFloat, shifted into place and scaled by 2^112 to rebias the exponent
+    const __m128i magnitude = _mm_and_si128(halves, _mm_set1_epi32(0x7FFF));
+    const __m128i sign = _mm_slli_epi32(_mm_xor_si128(halves, magnitude), 16);
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)),
+                                     _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    const __m128i wasSpecial = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7BFF));
+    const __m128i specialExponent = _mm_and_si128(wasSpecial, _mm_set1_epi32(255 << 23));
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, specialExponent)));
+}
+
+// RGB sources overread by one float on the last texel, callers stop a texel early
+static inline __m128 LoadTexel(const float *source, uint32_t channels)
+{
+    const __m128 value = _mm_loadu_ps(source);
+    if(channels == 4)
+        return value;
+
+    const __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    return _mm_or_ps(_mm_and_ps(value, rgb), _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static inline __m128 LoadLastTexel(const float *source, uint32_t channels)
+{
+    return _mm_setr_ps(source[0], source[1], source[2], channels == 4 ? source[3] : 1.0f);
+}
+
+// Texels the vector loops may take, RGB leaves the last one to the scalar tail
+static inline size_t VectorTexels(size_t texelCount, uint32_t channels, size_t step)
+{
+    const size_t safe = channels == 4 || texelCount == 0 ? texelCount : texelCount - 1;
+    return safe - safe % step;
+}
+
+TARGET_F16C static void ToHalfF16C(const float *source, uint32_t channels, size_t texelCount, uint16_t *target)
+{
+    const size_t vectorCount = VectorTexels(texelCount, channels, 2);
+    size_t i = 0;
+    for (; i < vectorCount; i += 2)
+    {
+        const __m128i a = _mm_cvtps_ph(LoadTexel(source + i * channels, channels), _MM_FROUND_TO_NEAREST_INT);
+        const __m128i b = _mm_cvtps_ph(LoadTexel(source + (i + 1) * channels, channels), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i * 4), _mm_unpacklo_epi64(a, b));
+    }
+    for (; i < texelCount; i++)
+    {
+        const __m128i a = _mm_cvtps_ph(LoadLastTexel(source + i * channels, channels), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(target + i * 4), a);
+    }
+}
+
+static void ToHalfSSE2(const float *source, uint32_t channels, size_t texelCount, uint16_t *target)
+{
+    const size_t vectorCount = VectorTexels(texelCount, channels, 2);
+    size_t i = 0;
+    for (; i < vectorCount; i += 2)
+    {
+        const __m128i a = HalfBitsSSE2(LoadTexel(source + i * channels, channels));
+        const __m128i b = HalfBitsSSE2(LoadTexel(source + (i + 1) * channels, channels));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i * 4), _mm_packs_epi32(a, b));
+    }
+    for (; i < texelCount; i++)
+    {
+        const __m128i a = HalfBitsSSE2(LoadLastTexel(source + i * channels, channels));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(target + i * 4), _mm_packs_epi32(a, a));
+    }
+}
+
+// The F16C instructions stand for simd_path::avx, processors without them take SSE2
+static simd_path Resolve(simd_path path)
+{
+    if(path == simd_path::best || path == simd_path::avx)
+        return cpu::Features().f16c ? simd_path::avx : simd_path::sse;
+    return path;
+}
+
+static void ToHalfScalar(const float *source, uint32_t channels, size_t texelCount, uint16_t *target)
+{
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+            target[i * 4 + c] = FloatToHalf(source[i * channels + c]);
+        target[i * 4 + 3] = FloatToHalf(channels == 4 ? source[i * channels + 3] : 1.0f);
+    }
+}
+
+void pixelConvert::ToHalf(const float *source, uint32_t channels, size_t texelCount, uint16_t *target,
+                          simd_path path)
+{
+    switch (Resolve(path))
+    {
+        case simd_path::scalar:
+            ToHalfScalar(source, channels, texelCount, target);
+            break;
+        case simd_path::avx:
+            ToHalfF16C(source, channels, texelCount, target);
+            break;
+        default:
+            ToHalfSSE2(source, channels, texelCount, target);
+            break;
+    }
+}
+
+TARGET_F16C static void FromHalfF16C(const uint16_t *source, size_t count, float *target)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i halves = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i));
+        _mm_storeu_ps(target + i, _mm_cvtph_ps(halves));
+    }
+    for (; i < count; i++)
+        target[i] = HalfToFloat(source[i]);
+}
+
+static void FromHalfSSE2(const uint16_t *source, size_t count, float *target)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i halves = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i));
+        _mm_storeu_ps(target + i, FloatsFromHalvesSSE2(_mm_unpacklo_epi16(halves, zero)));
+    }
+    for (; i < count; i++)
+        target[i] = HalfToFloat(source[i]);
+}
+
+void pixelConvert::FromHalf(const uint16_t *source, size_t count, float *target, simd_path path)
+{
+    switch (Resolve(path))
+    {
+        case simd_path::scalar:
+            for (size_t i = 0; i < count; i++)
+                target[i] = HalfToFloat(source[i]);
+            break;
+        case simd_path::avx:
+            FromHalfF16C(source, count, target);
+            break;
+        default:
+            FromHalfSSE2(source, count, target);
+            break;
+    }
+}
+
+void pixelConvert::ToB10G11R11(const float *source, uint32_t channels, size_t texelCount, uint32_t *target)
+{
+    // NOTE(arle): max_ps returns its second operand when either is NaN, zero in that order
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 redGreenMax = _mm_set1_ps(65024.0f);
+    const __m128 blueMax = _mm_set1_ps(64512.0f);
+
+    // Four texels transposed to a register per channel, packed with exact rounding to 6 and
+    // 5 mantissa bits. Going through halves would round twice
+    const size_t vectorCount = VectorTexels(texelCount, channels, 4);
+    size_t i = 0;
+    for (; i < vectorCount; i += 4)
+    {
+        __m128 r = LoadTexel(source + i * channels, channels);
+        __m128 g = LoadTexel(source + (i + 1) * channels, channels);
+        __m128 b = LoadTexel(source + (i + 2) * channels, channels);
+        __m128 a = LoadTexel(source + (i + 3) * channels, channels);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        const __m128i red = SmallFloatBits<6>(_mm_min_ps(_mm_max_ps(r, zero), redGreenMax));
+        const __m128i green = SmallFloatBits<6>(_mm_min_ps(_mm_max_ps(g, zero), redGreenMax));
+        const __m128i blue = SmallFloatBits<5>(_mm_min_ps(_mm_max_ps(b, zero), blueMax));
+
+        const __m128i packed = _mm_or_si128(red, _mm_or_si128(_mm_slli_epi32(green, 11), _mm_slli_epi32(blue, 22)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), packed);
+    }
+    for (; i < texelCount; i++)
+    {
+        const __m128 texel = LoadLastTexel(source + i * channels, channels);
+        const __m128 clamped = _mm_min_ps(_mm_max_ps(texel, zero), _mm_setr_ps(65024.0f, 65024.0f, 64512.0f, 0.0f));
+
+        alignas(16) uint32_t elevenBits[4], tenBits[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(elevenBits), SmallFloatBits<6>(clamped));
+        _mm_store_si128(reinterpret_cast<__m128i*>(tenBits), SmallFloatBits<5>(clamped));
+        target[i] = elevenBits[0] | (elevenBits[1] << 11) | (tenBits[2] << 22);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../base.hpp"
+
+// Float texels to the packed HDR formats and back, four channels at a time in SSE registers.
+// Processors with F16C convert in hardware (simd_path::avx), older ones take an SSE2 bit
+// manipulation path that rounds the same way, to nearest even. Both match FloatToHalf and
+// HalfToFloat bit for bit except for the payload of NaNs other than the default one, see
+// bench/pixel_bench.cpp.
+
+namespace pixelConvert
+{
+    // RGB or RGBA floats to RGBA16F, alpha is 1 when the source has 3 channels. Values past
+    // 65504 become infinity
+    void ToHalf(const float *source, uint32_t channels, size_t texelCount, uint16_t *target,
+                simd_path path = simd_path::best);
+
+    // Any number of halves to floats
+    void FromHalf(const uint16_t *source, size_t count, float *target, simd_path path = simd_path::best);
+
+    // RGB or RGBA floats to B10G11R11_UFLOAT_PACK32, alpha is dropped. The format has no
+    // sign, negative values and NaN become 0 and large values clamp to its maximum of 65024
+    // for red and green and 64512 for blue
+    void ToB10G11R11(const float *source, uint32_t channels, size_t texelCount, uint32_t *target);
+}
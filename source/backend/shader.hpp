@@ -25,7 +25,8 @@ protected:
         if(io::IsValid(file) == false)
             return false;
 
-        auto map = io::Map(file);
+        // Consumed whole right away, read ahead of vkCreateShaderModule touching it
+        auto map = io::Map(file, io::access::sequential, true);
 
         const auto loadInfo = vkInits::shaderModuleCreateInfo(map.data, map.size);
         vkCreateShaderModule(device, &loadInfo, nullptr, &m_module);
@@ -62,4 +63,16 @@ public:
         m_path = path;
         Shader::load(device);
     }
+};
+
+class ComputeShader : public Shader
+{
+public:
+    void load(VkDevice device, const char *path)
+    {
+        m_module = VK_NULL_HANDLE;
+        m_stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        m_path = path;
+        Shader::load(device);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "staging_ring.hpp"
+
+bool stagingRing::Reserve(StagingRing &ring, uint64_t size, uint64_t alignment, uint64_t &start)
+{
+    // Offset 0 suits every alignment
+    uint64_t position = ring.head;
+    const auto offset = position % ring.capacity;
+    const auto aligned = (offset + alignment - 1) / alignment * alignment;
+    if(aligned + size > ring.capacity)
+        position += ring.capacity - offset;
+    else
+        position += aligned - offset;
+
+    // NOTE(arle): With nothing in use the skipped padding is free as well. Counted as used, an
+    // allocation larger than the offset would wait for releases that never come
+    if(ring.tail == ring.head)
+        ring.tail = position;
+
+    if(position + size - ring.tail > ring.capacity)
+        return false;
+
+    start = position;
+    ring.head = position + size;
+    return true;
+}
+
+void stagingRing::Release(StagingRing &ring, uint64_t end)
+{
+    ring.tail = end;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../base.hpp"
+
+// Byte positions in a ring of capacity bytes that only grow, the offset in the buffer is the
+// position modulo capacity. Allocations never wrap, one that would is moved to the start of
+// the next lap and the skipped end counts as used until the allocations before it are
+// released. AssetLoader stages its textures with one, under its ring lock.
+
+struct StagingRing
+{
+    uint64_t    head;       // Past the last allocation
+    uint64_t    tail;       // Start of the oldest allocation still in use
+    uint64_t    capacity;
+};
+
+namespace stagingRing
+{
+    // Position of size bytes whose offset is a multiple of alignment, false and start untouched
+    // while allocations in use are in the way. size must not exceed capacity
+    bool Reserve(StagingRing &ring, uint64_t size, uint64_t alignment, uint64_t &start);
+
+    // Everything up to end is free again, allocations are released in order
+    void Release(StagingRing &ring, uint64_t end);
+}
@@ -0,0 +1,82 @@
+#include "thread_pool.hpp"
+
+void ThreadPool::init(uint32_t threadCount)
+{
+    if(threadCount == 0)
+        threadCount = pltf::ProcessorCount();
+
+    proc = nullptr;
+    data = nullptr;
+    count = 0;
+    next = 0;
+    quit = false;
+
+    wake = pltf::SemaphoreCreate(0);
+    done = pltf::SemaphoreCreate(0);
+
+    workerCount = 0;
+    workers = new pltf::thread[max(threadCount, 1u) - 1];
+    for (uint32_t i = 0; i + 1 < threadCount; i++)
+    {
+        workers[workerCount] = pltf::ThreadCreate(workerMain, this);
+        if(workers[workerCount] != nullptr)
+            workerCount++;
+    }
+}
+
+void ThreadPool::destroy()
+{
+    quit = true;
+    pltf::SemaphoreSignal(wake, workerCount);
+
+    for (uint32_t i = 0; i < workerCount; i++)
+        pltf::ThreadJoin(workers[i]);
+
+    delete[] workers;
+    workers = nullptr;
+    workerCount = 0;
+
+    pltf::SemaphoreDestroy(wake);
+    pltf::SemaphoreDestroy(done);
+}
+
+void ThreadPool::parallelFor(uint32_t taskCount, task_proc taskProc, void *taskData)
+{
+    proc = taskProc;
+    data = taskData;
+    count = taskCount;
+    next.store(0, std::memory_order_relaxed);
+
+    // NOTE(arle): The semaphores order the job fields and the task results, the
+    // counter only has to hand out unique indices
+    const uint32_t helpers = min(workerCount, taskCount > 0 ? taskCount - 1 : 0u);
+    pltf::SemaphoreSignal(wake, helpers);
+
+    runTasks();
+
+    for (uint32_t i = 0; i < helpers; i++)
+        pltf::SemaphoreWait(done);
+}
+
+void ThreadPool::workerMain(void *param)
+{
+    auto pool = static_cast<ThreadPool*>(param);
+    for (;;)
+    {
+        pltf::SemaphoreWait(pool->wake);
+        if(pool->quit)
+            return;
+
+        pool->runTasks();
+        pltf::SemaphoreSignal(pool->done);
+    }
+}
+
+void ThreadPool::runTasks()
+{
+    for (uint32_t i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+         i = next.fetch_add(1, std::memory_order_relaxed))
+    {
+        proc(data, i);
+    }
+}
\ No newline at end of file
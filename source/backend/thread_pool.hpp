@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../base.hpp"
+#include <atomic>
+
+// Fixed set of worker threads for data parallel loops. The calling thread takes part in
+// every loop, so a pool of N threads runs N - 1 workers. Tasks are handed out one index
+// at a time, uneven task costs balance out without any up front partitioning.
+
+class ThreadPool
+{
+public:
+    using task_proc = void(*)(void *data, uint32_t index);
+
+    // 0 uses every processor the process may run on
+    void init(uint32_t threadCount = 0);
+    void destroy();
+
+    // Calls proc for every index in [0, count), returns once all of them have finished.
+    // Not reentrant, proc must not call back into the pool
+    void parallelFor(uint32_t count, task_proc proc, void *data);
+
+    uint32_t threadCount() const {return workerCount + 1;}
+
+private:
+    static void workerMain(void *param);
+    void runTasks();
+
+    pltf::thread*           workers;
+    uint32_t                workerCount;
+    pltf::semaphore         wake;
+    pltf::semaphore         done;
+
+    task_proc               proc;
+    void*                   data;
+    uint32_t                count;
+    std::atomic<uint32_t>   next;
+    bool                    quit;
+};
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "transform_store.hpp"
+#include "../mv_utils/cpu_features.hpp"
+#include <immintrin.h>
+#include <string.h>
+
+enum Component
+{
+    POSITION_X, POSITION_Y, POSITION_Z,
+    ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+    SCALE_X, SCALE_Y, SCALE_Z,
+    COMPONENT_COUNT
+};
+
+// Objects per thread pool task, a multiple of 8 so only the last block has a scalar tail
+constexpr uint32_t BLOCK_SIZE = 4096;
+
+struct WorldJob
+{
+    const float*    components;
+    uint32_t        stride;
+    uint32_t        count;
+    simd_path       path;
+    mat4x4          viewProjection;
+    mat4x4*         world;
+    mat4x4*         worldViewProjection;
+};
+
+void TransformStore::init(uint32_t capacity)
+{
+    m_components = nullptr;
+    m_count = 0;
+    m_capacity = 0;
+    m_lastBlocks = 0;
+    grow(max(capacity, 8u));
+}
+
+void TransformStore::destroy()
+{
+    delete[] m_components;
+    m_components = nullptr;
+    m_count = 0;
+    m_capacity = 0;
+}
+
+void TransformStore::grow(uint32_t capacity)
+{
+    capacity = (capacity + 7) & ~7u;
+    auto components = new float[size_t(capacity) * COMPONENT_COUNT];
+    for (uint32_t c = 0; c < COMPONENT_COUNT && m_count > 0; c++)
+        memcpy(components + size_t(c) * capacity, m_components + size_t(c) * m_capacity, sizeof(float) * m_count);
+
+    delete[] m_components;
+    m_components = components;
+    m_capacity = capacity;
+}
+
+uint32_t TransformStore::add(vec3<float> position, vec4<float> rotation, vec3<float> scale)
+{
+    if(m_count == m_capacity)
+        grow(m_capacity * 2);
+
+    const uint32_t index = m_count++;
+    setPosition(index, position);
+    setRotation(index, rotation);
+    setScale(index, scale);
+    return index;
+}
+
+void TransformStore::remove(uint32_t index)
+{
+    const uint32_t last = --m_count;
+    for (uint32_t c = 0; c < COMPONENT_COUNT; c++)
+        m_components[size_t(c) * m_capacity + index] = m_components[size_t(c) * m_capacity + last];
+}
+
+void TransformStore::setPosition(uint32_t index, vec3<float> position)
+{
+    m_components[POSITION_X * m_capacity + index] = position.x;
+    m_components[POSITION_Y * m_capacity + index] = position.y;
+    m_components[POSITION_Z * m_capacity + index] = position.z;
+}
+
+void TransformStore::setRotation(uint32_t index, vec4<float> rotation)
+{
+    const float len = length(rotation);
+    const auto q = len > 0.0f ? rotation * (1.0f / len) : vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    m_components[ROTATION_X * m_capacity + index] = q.x;
+    m_components[ROTATION_Y * m_capacity + index] = q.y;
+    m_components[ROTATION_Z * m_capacity + index] = q.z;
+    m_components[ROTATION_W * m_capacity + index] = q.w;
+}
+
+void TransformStore::setScale(uint32_t index, vec3<float> scale)
+{
+    m_components[SCALE_X * m_capacity + index] = scale.x;
+    m_components[SCALE_Y * m_capacity + index] = scale.y;
+    m_components[SCALE_Z * m_capacity + index] = scale.z;
+}
+
+vec3<float> TransformStore::position(uint32_t index) const
+{
+    return vec3(m_components[POSITION_X * m_capacity + index], m_components[POSITION_Y * m_capacity + index],
+                m_components[POSITION_Z * m_capacity + index]);
+}
+
+vec4<float> TransformStore::rotation(uint32_t index) const
+{
+    return vec4(m_components[ROTATION_X * m_capacity + index], m_components[ROTATION_Y * m_capacity + index],
+                m_components[ROTATION_Z * m_capacity + index], m_components[ROTATION_W * m_capacity + index]);
+}
+
+vec3<float> TransformStore::scale(uint32_t index) const
+{
+    return vec3(m_components[SCALE_X * m_capacity + index], m_components[SCALE_Y * m_capacity + index],
+                m_components[SCALE_Z * m_capacity + index]);
+}
+
+vec4<float> TransformStore::AxisAngle(vec3<float> axis, float radians)
+{
+    const auto n = normalise(axis);
+    const float s = std::sin(radians * 0.5f);
+    return vec4(n.x * s, n.y * s, n.z * s, std::cos(radians * 0.5f));
+}
+
+// NOTE(arle): Every path evaluates the same expressions in the same order, the same as the
+// glTF node matrices in mesh_import, so SSE and AVX match the scalar code bit for bit
+
+static void WorldScalar(const WorldJob &job, uint32_t first, uint32_t end)
+{
+    const float *c = job.components;
+    const size_t stride = job.stride;
+    for (uint32_t i = first; i < end; i++)
+    {
+        const float x = c[ROTATION_X * stride + i], y = c[ROTATION_Y * stride + i];
+        const float z = c[ROTATION_Z * stride + i], w = c[ROTATION_W * stride + i];
+        const float sx = c[SCALE_X * stride + i], sy = c[SCALE_Y * stride + i], sz = c[SCALE_Z * stride + i];
+
+        mat4x4 m;
+        m(0, 0) = (1.0f - 2.0f * (y * y + z * z)) * sx;
+        m(0, 1) = (2.0f * (x * y + z * w)) * sx;
+        m(0, 2) = (2.0f * (x * z - y * w)) * sx;
+        m(0, 3) = 0.0f;
+        m(1, 0) = (2.0f * (x * y - z * w)) * sy;
+        m(1, 1) = (1.0f - 2.0f * (x * x + z * z)) * sy;
+        m(1, 2) = (2.0f * (y * z + x * w)) * sy;
+        m(1, 3) = 0.0f;
+        m(2, 0) = (2.0f * (x * z + y * w)) * sz;
+        m(2, 1) = (2.0f * (y * z - x * w)) * sz;
+        m(2, 2) = (1.0f - 2.0f * (x * x + y * y)) * sz;
+        m(2, 3) = 0.0f;
+        m(3, 0) = c[POSITION_X * stride + i];
+        m(3, 1) = c[POSITION_Y * stride + i];
+        m(3, 2) = c[POSITION_Z * stride + i];
+        m(3, 3) = 1.0f;
+
+        if(job.world != nullptr)
+            job.world[i] = m;
+        if(job.worldViewProjection != nullptr)
+            job.worldViewProjection[i] = mat4Scalar::multiply(m, job.viewProjection);
+    }
+}
+
+static inline void StoreRows(mat4x4 *target, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+{
+    _mm_storeu_ps(target->row(0), r0);
+    _mm_storeu_ps(target->row(1), r1);
+    _mm_storeu_ps(target->row(2), r2);
+    _mm_storeu_ps(target->row(3), r3);
+}
+
+// Rows of four objects, one object per lane on the way in and one per register on the way out
+static inline void StoreObjectsSSE(const WorldJob &job, uint32_t i, const __m128 (&vp)[4],
+                                   __m128 (&rows)[4][4])
+{
+    for (uint32_t r = 0; r < 4; r++)
+        _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+
+    for (uint32_t k = 0; k < 4; k++)
+    {
+        if(job.world != nullptr)
+            StoreRows(job.world + i + k, rows[0][k], rows[1][k], rows[2][k], rows[3][k]);
+        if(job.worldViewProjection != nullptr)
+        {
+            StoreRows(job.worldViewProjection + i + k,
+                      mat4Simd::Combine(rows[0][k], vp[0], vp[1], vp[2], vp[3]),
+                      mat4Simd::Combine(rows[1][k], vp[0], vp[1], vp[2], vp[3]),
+                      mat4Simd::Combine(rows[2][k], vp[0], vp[1], vp[2], vp[3]),
+                      mat4Simd::Combine(rows[3][k], vp[0], vp[1], vp[2], vp[3]));
+        }
+    }
+}
+
+static void WorldSSE(const WorldJob &job, uint32_t first, uint32_t end)
+{
+    const float *c = job.components;
+    const size_t stride = job.stride;
+    const __m128 vp[4] = {_mm_load_ps(job.viewProjection.row(0)), _mm_load_ps(job.viewProjection.row(1)),
+                          _mm_load_ps(job.viewProjection.row(2)), _mm_load_ps(job.viewProjection.row(3))};
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+
+    uint32_t i = first;
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(c + ROTATION_X * stride + i), y = _mm_loadu_ps(c + ROTATION_Y * stride + i);
+        const __m128 z = _mm_loadu_ps(c + ROTATION_Z * stride + i), w = _mm_loadu_ps(c + ROTATION_W * stride + i);
+        const __m128 sx = _mm_loadu_ps(c + SCALE_X * stride + i);
+        const __m128 sy = _mm_loadu_ps(c + SCALE_Y * stride + i);
+        const __m128 sz = _mm_loadu_ps(c + SCALE_Z * stride + i);
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+        __m128 rows[4][4] = {
+            {_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+             _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, zw)), sx),
+             _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, yw)), sx), zero},
+            {_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, zw)), sy),
+             _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+             _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, xw)), sy), zero},
+            {_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, yw)), sz),
+             _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, xw)), sz),
+             _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz), zero},
+            {_mm_loadu_ps(c + POSITION_X * stride + i), _mm_loadu_ps(c + POSITION_Y * stride + i),
+             _mm_loadu_ps(c + POSITION_Z * stride + i), one}
+        };
+        StoreObjectsSSE(job, i, vp, rows);
+    }
+
+    WorldScalar(job, i, end);
+}
+
+// The 4x4 transpose within each 128 bit half, objects i to i + 3 come out in the low halves
+// and i + 4 to i + 7 in the high ones
+TARGET_AVX static inline void TransposeLanes(__m256 &a, __m256 &b, __m256 &c, __m256 &d)
+{
+    const __m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b);
+    const __m256 t2 = _mm256_unpacklo_ps(c, d), t3 = _mm256_unpackhi_ps(c, d);
+    a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    b = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    c = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    d = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// mat4Simd::Combine on two objects at once, one per half
+TARGET_AVX static inline __m256 Combine2(__m256 v, const __m256 (&vp)[4])
+{
+    __m256 sum = _mm256_mul_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), vp[0]);
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), vp[1]));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), vp[2]));
+    return _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), vp[3]));
+}
+
+TARGET_AVX static inline void StoreHalves(mat4x4 *target, const __m256 (&rows)[4], int half)
+{
+    for (uint32_t r = 0; r < 4; r++)
+    {
+        const __m128 row = half == 0 ? _mm256_castps256_ps128(rows[r]) : _mm256_extractf128_ps(rows[r], 1);
+        _mm_storeu_ps(target->row(r), row);
+    }
+}
+
+TARGET_AVX static void WorldAVX(const WorldJob &job, uint32_t first, uint32_t end)
+{
+    const float *c = job.components;
+    const size_t stride = job.stride;
+    const __m256 vp[4] = {_mm256_broadcast_ps(reinterpret_cast<const __m128*>(job.viewProjection.row(0))),
+                          _mm256_broadcast_ps(reinterpret_cast<const __m128*>(job.viewProjection.row(1))),
+                          _mm256_broadcast_ps(reinterpret_cast<const __m128*>(job.viewProjection.row(2))),
+                          _mm256_broadcast_ps(reinterpret_cast<const __m128*>(job.viewProjection.row(3)))};
+    const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+
+    uint32_t i = first;
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(c + ROTATION_X * stride + i);
+        const __m256 y = _mm256_loadu_ps(c + ROTATION_Y * stride + i);
+        const __m256 z = _mm256_loadu_ps(c + ROTATION_Z * stride + i);
+        const __m256 w = _mm256_loadu_ps(c + ROTATION_W * stride + i);
+        const __m256 sx = _mm256_loadu_ps(c + SCALE_X * stride + i);
+        const __m256 sy = _mm256_loadu_ps(c + SCALE_Y * stride + i);
+        const __m256 sz = _mm256_loadu_ps(c + SCALE_Z * stride + i);
+        const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        const __m256 xw = _mm256_mul_ps(x, w), yw = _mm256_mul_ps(y, w), zw = _mm256_mul_ps(z, w);
+
+        __m256 rows[4][4] = {
+            {_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+             _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, zw)), sx),
+             _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, yw)), sx), zero},
+            {_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, zw)), sy),
+             _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+             _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, xw)), sy), zero},
+            {_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, yw)), sz),
+             _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, xw)), sz),
+             _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz), zero},
+            {_mm256_loadu_ps(c + POSITION_X * stride + i), _mm256_loadu_ps(c + POSITION_Y * stride + i),
+             _mm256_loadu_ps(c + POSITION_Z * stride + i), one}
+        };
+        for (uint32_t r = 0; r < 4; r++)
+            TransposeLanes(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+
+        // Rows of objects i + k and i + k + 4, the pair shares the projection products
+        for (uint32_t k = 0; k < 4; k++)
+        {
+            const __m256 object[4] = {rows[0][k], rows[1][k], rows[2][k], rows[3][k]};
+            if(job.world != nullptr)
+            {
+                StoreHalves(job.world + i + k, object, 0);
+                StoreHalves(job.world + i + k + 4, object, 1);
+            }
+            if(job.worldViewProjection != nullptr)
+            {
+                const __m256 projected[4] = {Combine2(object[0], vp), Combine2(object[1], vp),
+                                             Combine2(object[2], vp), Combine2(object[3], vp)};
+                StoreHalves(job.worldViewProjection + i + k, projected, 0);
+                StoreHalves(job.worldViewProjection + i + k + 4, projected, 1);
+            }
+        }
+    }
+
+    WorldSSE(job, i, end);
+}
+
+static void ComputeBlock(const WorldJob &job, uint32_t first, uint32_t end)
+{
+    switch (job.path)
+    {
+        case simd_path::scalar:
+            WorldScalar(job, first, end);
+            break;
+        case simd_path::avx:
+            WorldAVX(job, first, end);
+            break;
+        default:
+            WorldSSE(job, first, end);
+            break;
+    }
+}
+
+static void ComputeBlockTask(void *data, uint32_t index)
+{
+    const auto &job = *static_cast<const WorldJob*>(data);
+    const uint32_t first = index * BLOCK_SIZE;
+    ComputeBlock(job, first, min(first + BLOCK_SIZE, job.count));
+}
+
+void TransformStore::computeWorldMatrices(ThreadPool &pool, mat4x4 *world, simd_path path)
+{
+    computeWorldMatrices(pool, mat4x4::identity(), world, nullptr, path);
+}
+
+void TransformStore::computeWorldMatrices(ThreadPool &pool, mat4x4 viewProjection, mat4x4 *world,
+                                          mat4x4 *worldViewProjection, simd_path path)
+{
+    if(path == simd_path::best || (path == simd_path::avx && !cpu::Features().avx))
+        path = cpu::Features().avx ? simd_path::avx : simd_path::sse;
+
+    WorldJob job = {m_components, m_capacity, m_count, path, viewProjection, world, worldViewProjection};
+
+    // NOTE(arle): Waking the workers costs more than a block takes on one thread
+    m_lastBlocks = (m_count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if(m_lastBlocks <= 1 || pool.threadCount() == 1)
+    {
+        ComputeBlock(job, 0, m_count);
+        m_lastBlocks = m_count > 0 ? 1 : 0;
+        return;
+    }
+
+    pool.parallelFor(m_lastBlocks, ComputeBlockTask, &job);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+// Positions, rotations and scales of many objects kept as structure of arrays, one array per
+// component. World matrices are built from them four (SSE) or eight (AVX) objects at a time
+// with every object in its own lane, and written out contiguously so they can go straight
+// into a mapped instance buffer. Large stores are split into blocks across the thread pool.
+//
+// Rotations are unit quaternions stored x, y, z, w. World matrices are T * R * S, the same
+// as glTF nodes, in the row vector layout of mat4x4: scale(s) * rotation * translate(t).
+
+struct transform_store_stats
+{
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t blocks;        // Tasks the last computeWorldMatrices was split into, 1 when inline
+};
+
+class TransformStore
+{
+public:
+    void init(uint32_t capacity);
+    void destroy();
+
+    // Returns the index of the new transform, the store grows as needed
+    uint32_t add(vec3<float> position, vec4<float> rotation = vec4(0.0f, 0.0f, 0.0f, 1.0f),
+                 vec3<float> scale = vec3(1.0f));
+
+    // Moves the last transform into index, whoever held the last index now holds this one
+    void remove(uint32_t index);
+    void clear() {m_count = 0;}
+
+    void setPosition(uint32_t index, vec3<float> position);
+    void setRotation(uint32_t index, vec4<float> rotation);    // Normalised on the way in
+    void setScale(uint32_t index, vec3<float> scale);
+
+    vec3<float> position(uint32_t index) const;
+    vec4<float> rotation(uint32_t index) const;
+    vec3<float> scale(uint32_t index) const;
+
+    uint32_t count() const {return m_count;}
+    transform_store_stats stats() const {return {m_count, m_capacity, m_lastBlocks};}
+
+    // One world matrix per transform, in index order. Output is only written, never read, and
+    // in sequential 16 byte stores, which suits write-combined memory
+    void computeWorldMatrices(ThreadPool &pool, mat4x4 *world, simd_path path = simd_path::best);
+
+    // Also world * viewProjection, viewProjection being view * projection in mat4x4 order.
+    // Either output may be null
+    void computeWorldMatrices(ThreadPool &pool, mat4x4 viewProjection, mat4x4 *world,
+                              mat4x4 *worldViewProjection, simd_path path = simd_path::best);
+
+    // Quaternion turning radians about axis, which does not need to be normalised
+    static vec4<float> AxisAngle(vec3<float> axis, float radians);
+
+private:
+    void grow(uint32_t capacity);
+
+    float*      m_components;   // COMPONENT_COUNT arrays of m_capacity floats each
+    uint32_t    m_count;
+    uint32_t    m_capacity;
+    uint32_t    m_lastBlocks;
+};
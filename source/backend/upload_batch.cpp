@@ -0,0 +1,176 @@
+#include "upload_batch.hpp"
+#include <string.h>
+
+void UploadBatch::begin(const VulkanDevice *vulkanDevice, VkQueue submitQueue, VkDeviceSize stagingSize)
+{
+    device = vulkanDevice;
+    queue = submitQueue;
+    stats = {};
+    pending = false;
+
+    alignment = max(VkDeviceSize(16), device->gpuProperties.limits.optimalBufferCopyOffsetAlignment);
+    createArena(stagingSize);
+
+    auto fenceInfo = vkInits::fenceCreateInfo(0);
+    vkCreateFence(device->device, &fenceInfo, nullptr, &fence);
+
+    command = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+}
+
+UploadStats UploadBatch::end()
+{
+    flush();
+
+    vkEndCommandBuffer(command);
+    vkFreeCommandBuffers(device->device, device->commandPool, 1, &command);
+    vkDestroyFence(device->device, fence, nullptr);
+    arena.destroy(device->device);
+    return stats;
+}
+
+void UploadBatch::createArena(VkDeviceSize size)
+{
+    device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEM_FLAG_HOST_VISIBLE, size, arena);
+    arena.map(device->device);
+    offset = 0;
+}
+
+double UploadBatch::flush()
+{
+    if(!pending)
+        return 0.0;
+
+    // NOTE(arle): Later submissions on the queue read the copies as vertices, indices,
+    // uniforms or textures, one barrier covers all of them
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                            VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+    vkEndCommandBuffer(command);
+
+    // NOTE(arle): Only the GPU side is timed, staging writes and recording happen between
+    // flushes and belong to whoever made them
+    const auto submitInfo = vkInits::submitInfo(&command, 1);
+    const auto submitTime = pltf::GetTime();
+    vkQueueSubmit(queue, 1, &submitInfo, fence);
+    vkWaitForFences(device->device, 1, &fence, VK_TRUE, UINT64_MAX);
+    const auto seconds = pltf::GetTime() - submitTime;
+    vkResetFences(device->device, 1, &fence);
+
+    vkResetCommandBuffer(command, 0);
+    const auto beginInfo = vkInits::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    vkBeginCommandBuffer(command, &beginInfo);
+
+    stats.submits++;
+    stats.seconds += seconds;
+    offset = 0;
+    pending = false;
+    return seconds;
+}
+
+void UploadBatch::reserve(VkDeviceSize size, uint32_t count)
+{
+    const auto required = size + VkDeviceSize(count) * alignment;
+    if(offset + required <= arena.size)
+        return;
+
+    flush();
+    if(required > arena.size)
+    {
+        arena.destroy(device->device);
+        createArena(required);
+    }
+}
+
+VkDeviceSize UploadBatch::allocate(VkDeviceSize size, VkDeviceSize allocationAlignment)
+{
+    // Not a power of two for 3, 6 and 12 byte texels
+    offset = (offset + allocationAlignment - 1) / allocationAlignment * allocationAlignment;
+    if(offset + size > arena.size)
+    {
+        reserve(size);
+        offset = 0;
+    }
+
+    const auto allocation = offset;
+    offset += size;
+    pending = true;
+    stats.copies++;
+    stats.bytes += size;
+    return allocation;
+}
+
+void *UploadBatch::stageBuffer(VkBuffer dst, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    const auto srcOffset = allocate(size, alignment);
+
+    VkBufferCopy region{};
+    region.srcOffset = srcOffset;
+    region.dstOffset = dstOffset;
+    region.size = size;
+    vkCmdCopyBuffer(command, arena.data, dst, 1, &region);
+
+    return static_cast<uint8_t*>(arena.mapped) + srcOffset;
+}
+
+void UploadBatch::uploadBuffer(VkBuffer dst, const void *data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    memcpy(stageBuffer(dst, size, dstOffset), data, size);
+}
+
+void *UploadBatch::stageImage(VkImage image, VkFormat format, VkExtent2D extent, VkDeviceSize size,
+                              VkImageLayout finalLayout)
+{
+    const auto region = vkInits::bufferImageCopy(extent);
+    return stageImage(image, format, &region, 1, size, finalLayout);
+}
+
+void *UploadBatch::stageImage(VkImage image, VkFormat format, const VkBufferImageCopy *regions, uint32_t regionCount,
+                              VkDeviceSize size, VkImageLayout finalLayout)
+{
+    // The least common multiple of the arena's power of two and the format's copy alignment
+    const VkDeviceSize copyAlignment = vkTools::CopyAlignment(format);
+    VkDeviceSize imageAlignment = alignment;
+    while (imageAlignment % copyAlignment != 0)
+        imageAlignment += alignment;
+    const auto srcOffset = allocate(size, imageAlignment);
+
+    auto range = vkInits::imageSubresourceRange();
+    range.levelCount = regionCount;
+    vkTools::SetImageLayout(command,
+                            VK_IMAGE_LAYOUT_UNDEFINED,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            image,
+                            range);
+
+    VkBufferImageCopy copies[16];
+    for (uint32_t i = 0; i < regionCount;)
+    {
+        const auto count = min(regionCount - i, uint32_t(arraysize(copies)));
+        for (uint32_t j = 0; j < count; j++)
+        {
+            copies[j] = regions[i + j];
+            copies[j].bufferOffset += srcOffset;
+        }
+        vkCmdCopyBufferToImage(command, arena.data, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, count, copies);
+        i += count;
+    }
+
+    const bool blitSource = finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    vkTools::InsertMemoryarrier(command,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                finalLayout,
+                                VK_ACCESS_TRANSFER_WRITE_BIT,
+                                blitSource ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                blitSource ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                range,
+                                image);
+
+    return static_cast<uint8_t*>(arena.mapped) + srcOffset;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "VulkanDevice.hpp"
+
+// Collects staging copies of many resources into one host visible arena and one command
+// buffer, submitted with a single fence. The batch only submits on its own when the arena
+// is full, or when flush or end is called. Loading a whole scene takes a handful of
+// submissions instead of one round trip per buffer or image.
+//
+// Destinations are only written once the batch is submitted, nothing may read them on the
+// GPU before flush or end returns.
+
+constexpr VkDeviceSize UPLOAD_STAGING_SIZE = MegaBytes(64);
+
+struct UploadStats
+{
+    uint32_t        submits;
+    uint32_t        copies;
+    VkDeviceSize    bytes;
+    double          seconds;    // Submit to fence, summed over the submits
+
+    double bytesPerSecond() const
+    {
+        return seconds > 0.0 ? double(bytes) / seconds : 0.0;
+    }
+};
+
+class UploadBatch
+{
+public:
+    // The arena grows past stagingSize when a single reservation needs more
+    void begin(const VulkanDevice *device, VkQueue queue, VkDeviceSize stagingSize = UPLOAD_STAGING_SIZE);
+
+    // Submits what is left, waits and frees the arena
+    UploadStats end();
+
+    // Submits everything recorded so far and waits for it, returns the seconds from submit
+    // to fence or 0 when nothing was pending
+    double flush();
+
+    // Flushes when the arena can not take size more bytes in count allocations. Pointers of
+    // stage calls within the reservation stay valid together until the next flush
+    void reserve(VkDeviceSize size, uint32_t count = 1);
+
+    // Staging memory for size bytes that are copied to dst at dstOffset, write it before the
+    // next call that may flush
+    void *stageBuffer(VkBuffer dst, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+    void uploadBuffer(VkBuffer dst, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+    // Level 0 of a single layer image, left in finalLayout for the fragment shader or, when
+    // it is TRANSFER_SRC_OPTIMAL, ready for blits recorded into commandBuffer() after it. The
+    // returned memory is aligned for copies of format
+    void *stageImage(VkImage image, VkFormat format, VkExtent2D extent, VkDeviceSize size,
+                     VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // Region i copies level i from its offset into the returned memory, levels up to
+    // regionCount end up in finalLayout
+    void *stageImage(VkImage image, VkFormat format, const VkBufferImageCopy *regions, uint32_t regionCount,
+                     VkDeviceSize size, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // Command buffer of the pending submission, for work that has to follow the copies
+    VkCommandBuffer commandBuffer() const {return command;}
+
+private:
+    VkDeviceSize allocate(VkDeviceSize size, VkDeviceSize allocationAlignment);
+    void createArena(VkDeviceSize size);
+
+    const VulkanDevice*     device;
+    VkQueue                 queue;
+    VkCommandBuffer         command;
+    VkFence                 fence;
+    VulkanBuffer            arena;
+    VkDeviceSize            offset;
+    VkDeviceSize            alignment;  // Of every allocation, images raise it for their format
+    bool                    pending;
+    UploadStats             stats;
+};
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "vertex_quantize.hpp"
+#include <cmath>
+
+constexpr float POSITION_STEPS = 65535.0f;
+constexpr float NORMAL_STEPS = 127.0f;
+
+template<typename T>
+static const T &Strided(const T *base, size_t stride, uint32_t index)
+{
+    return *reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(base) + index * stride);
+}
+
+// Signed normalized decode, -128 clamps to -1 like the fixed function conversion
+static float Snorm8(int8_t value)
+{
+    return max(float(value) / NORMAL_STEPS, -1.0f);
+}
+
+PositionDequantization vertexQuantize::Dequantization(const BoundingBox &box)
+{
+    PositionDequantization dequantization;
+    dequantization.offset = vec4(box.min, 0.0f);
+    dequantization.scale = vec4(box.max - box.min, 0.0f);
+    return dequantization;
+}
+
+// The code's point on the octahedron, the lower half is folded out over the square's corners
+static vec3<float> Unfold(float x, float y)
+{
+    auto n = vec3(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+    const float fold = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -fold : fold;
+    n.y += n.y >= 0.0f ? -fold : fold;
+    return n;
+}
+
+vec3<float> vertexQuantize::DecodeNormal(const int8_t code[2])
+{
+    return normalise(Unfold(Snorm8(code[0]), Snorm8(code[1])));
+}
+
+void vertexQuantize::EncodeNormal(vec3<float> normal, int8_t code[2])
+{
+    code[0] = 0;
+    code[1] = 0;
+
+    const float l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if(l1 <= 0.0f)
+        return;
+
+    float x = normal.x / l1, y = normal.y / l1;
+    if(normal.z < 0.0f)
+    {
+        const float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    // NOTE(arle): At 8 bits rounding each axis on its own often misses the closest code,
+    // the four codes around the projection are decoded and the best one is kept
+    const float baseX = std::floor(x * NORMAL_STEPS), baseY = std::floor(y * NORMAL_STEPS);
+    float bestCosine = -2.0f;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        const float codeX = clamp(baseX + float(i & 1), -NORMAL_STEPS, NORMAL_STEPS);
+        const float codeY = clamp(baseY + float(i >> 1), -NORMAL_STEPS, NORMAL_STEPS);
+
+        // Cosine up to the length of normal, the same for every candidate
+        const auto candidate = Unfold(codeX / NORMAL_STEPS, codeY / NORMAL_STEPS);
+        const float cosine = dot(candidate, normal) / std::sqrt(dot(candidate, candidate));
+        if(cosine > bestCosine)
+        {
+            bestCosine = cosine;
+            code[0] = int8_t(codeX);
+            code[1] = int8_t(codeY);
+        }
+    }
+}
+
+vec3<float> vertexQuantize::DecodePosition(const uint16_t position[3], const PositionDequantization &dequantization)
+{
+    return vec3(dequantization.offset.x + float(position[0]) / POSITION_STEPS * dequantization.scale.x,
+                dequantization.offset.y + float(position[1]) / POSITION_STEPS * dequantization.scale.y,
+                dequantization.offset.z + float(position[2]) / POSITION_STEPS * dequantization.scale.z);
+}
+
+// NOTE(arle): In double, float rounding of the subtraction and division picks the farther code
+// near ties and misses half a step by a few thousandths
+static uint16_t QuantizeAxis(float value, float offset, float scale)
+{
+    if(scale <= 0.0f)
+        return 0;
+    const double t = clamp((double(value) - double(offset)) / double(scale), 0.0, 1.0);
+    return uint16_t(t * double(POSITION_STEPS) + 0.5);
+}
+
+QuantizationError vertexQuantize::Pack(const vec3<float> *positions, const vec3<float> *normals, const vec2<float> *uvs,
+                                       size_t stride, uint32_t count, const PositionDequantization &dequantization,
+                                       PackedVertex *target)
+{
+    QuantizationError error{};
+    float normalCosine = 1.0f;     // The angle is taken once at the end
+    const auto &offset = dequantization.offset;
+    const auto &scale = dequantization.scale;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto &position = Strided(positions, stride, i);
+        const auto &normal = Strided(normals, stride, i);
+        const auto &uv = Strided(uvs, stride, i);
+
+        // Built on the stack, target is usually write combined staging memory
+        PackedVertex packed;
+        packed.position[0] = QuantizeAxis(position.x, offset.x, scale.x);
+        packed.position[1] = QuantizeAxis(position.y, offset.y, scale.y);
+        packed.position[2] = QuantizeAxis(position.z, offset.z, scale.z);
+        EncodeNormal(normal, packed.normal);
+        packed.uv[0] = FloatToHalf(uv.x);
+        packed.uv[1] = FloatToHalf(uv.y);
+        target[i] = packed;
+
+        const auto decoded = DecodePosition(packed.position, dequantization);
+        error.position = max(error.position, std::fabs(decoded.x - position.x));
+        error.position = max(error.position, std::fabs(decoded.y - position.y));
+        error.position = max(error.position, std::fabs(decoded.z - position.z));
+
+        const float normalLength = length(normal);
+        if(normalLength > 0.0f)
+        {
+            normalCosine = min(normalCosine, dot(DecodeNormal(packed.normal), normal) / normalLength);
+        }
+
+        error.uv = max(error.uv, std::fabs(HalfToFloat(packed.uv[0]) - uv.x));
+        error.uv = max(error.uv, std::fabs(HalfToFloat(packed.uv[1]) - uv.y));
+    }
+
+    error.normal = GetAngle(std::acos(clamp(normalCosine, -1.0f, 1.0f)));
+    return error;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "culling.hpp"
+
+// Compact vertices for Model3D, 12 bytes against the 32 of float position, normal and uv:
+//
+//  - Position: 16 bit unsigned normalized steps across the mesh box, the vertex shader scales
+//    and offsets them back with PositionDequantization
+//  - Normal: octahedral, the unit sphere folded onto a square (Cigolle et al. 2014), in two 8
+//    bit signed normalized values. Each normal takes the closest of its four neighbouring
+//    codes rather than the rounded one
+//  - UV: half floats, within 2^-12 across the 0 to 1 range
+//
+// The formats are VK_FORMAT_R16G16B16A16_UNORM (its fourth lane overlaps the normal and is
+// not read), R8G8_SNORM and R16G16_SFLOAT, all with mandatory vertex buffer support.
+
+struct PackedVertex
+{
+    uint16_t    position[3];
+    int8_t      normal[2];
+    uint16_t    uv[2];
+};
+
+static_assert(sizeof(PackedVertex) == 12);
+
+// position = offset + packed / 65535 * scale, scale is the size of the box
+struct alignas(16) PositionDequantization
+{
+    vec4<float> offset;
+    vec4<float> scale;
+};
+
+// Largest differences between the packed vertices and their float source
+struct QuantizationError
+{
+    float       position;   // Model space units, on any axis
+    float       normal;     // Degrees
+    float       uv;
+};
+
+namespace vertexQuantize
+{
+    PositionDequantization Dequantization(const BoundingBox &box);
+
+    // Unit length normal to its octahedral code and back, the decode matches pbr.vert
+    void EncodeNormal(vec3<float> normal, int8_t code[2]);
+    vec3<float> DecodeNormal(const int8_t code[2]);
+
+    vec3<float> DecodePosition(const uint16_t position[3], const PositionDequantization &dequantization);
+
+    // Reads count vertices spaced stride bytes apart from the three attribute pointers, so
+    // it packs straight out of an array of Model3D::Vertex. Positions outside the box are
+    // clamped to it
+    QuantizationError Pack(const vec3<float> *positions, const vec3<float> *normals, const vec2<float> *uvs,
+                           size_t stride, uint32_t count, const PositionDequantization &dequantization,
+                           PackedVertex *target);
+}
@@ -7,7 +7,7 @@
 
 namespace vkInits
 {
-    INIT_API applicationInfo(const char *appName)
+    INIT_API applicationInfo(const char *appName, uint32_t apiVersion = VK_API_VERSION_1_0)
     {
         VkApplicationInfo appInfo{};
         appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -15,7 +15,7 @@ namespace vkInits
         appInfo.pEngineName = appName;
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = apiVersion;
         return appInfo;
     }
 
@@ -1,4 +1,6 @@
 #include "model_viewer.hpp"
+#include <stdio.h>
+#include <string.h>
 
 #if defined(DEBUG)
 static const bool ENABLE_VALIDATION = true;
@@ -6,10 +8,75 @@ static const bool ENABLE_VALIDATION = true;
 static const bool ENABLE_VALIDATION = false;
 #endif
 
+// Irradiance and prefiltered maps are baked with compute, the render pass path is kept for comparison
+static const bool IBL_COMPUTE = true;
+
+// Times both bake paths at startup, uncached
+#if defined(BENCHMARK_IBL)
+static const bool BENCHMARK_IBL_BAKE = true;
+#else
+static const bool BENCHMARK_IBL_BAKE = false;
+#endif
+
+// Times the CPU mip generator against the blit path at startup
+#if defined(BENCHMARK_MIPS)
+static const bool BENCHMARK_MIP_GENERATION = true;
+#else
+static const bool BENCHMARK_MIP_GENERATION = false;
+#endif
+
+constexpr uint32_t IBL_GROUP_SIZE = 8; // local_size of the cubemap compute filters
+
+// Bakes the IBL maps on the CPU thread pool, no GPU work besides the uploads. Meant for
+// headless machines and as the reference the GPU bakes are checked against
+static const bool IBL_CPU_BAKE = false;
+
+// Diffuse IBL from spherical harmonics in the light uniforms instead of the irradiance cubemap,
+// needs pbr_sh_frag.spv (pbr.frag compiled with -DIRRADIANCE_SH)
+static const bool IBL_SPHERICAL_HARMONICS = true;
+
+constexpr uint32_t SH_PROJECTION_SIZE = 64; // Environment face size the projection reads
+
+// Storage of the equirectangular HDR the environment cubemap is rendered from. Radiance files
+// have 8-bit mantissas under a shared exponent. B10G11R11 is a quarter of RGBA32F in staging
+// and VRAM but keeps only 6 bits for red and green and 5 for blue, and clamps at 65024 where
+// RGBE goes far past it. R16G16B16A16_SFLOAT halves RGBA32F, its 10 bits cover RGBE's 8 and
+// its range ends at 65504. Part of the environment's cache key
+static const VkFormat HDR_SOURCE_FORMAT = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+
+// Mesh in the viewer relative to ASSETS_PATH, .gltf, .glb or .obj. The sphere primitive is
+// shown when this is null or the file fails to load
+static const char *OBJECT_MODEL = nullptr;
+
+// Reorders the object's triangles for the post-transform cache and overdraw and its vertices
+// for fetch locality before they are staged, see mesh_optimize.hpp
+static const bool OPTIMIZE_MESHES = true;
+
+// The object in 12 byte PackedVertex instead of the 32 byte Model3D::Vertex, see
+// vertex_quantize.hpp. Needs pbr_packed_vert.spv (pbr.vert compiled with -DPACKED_VERTICES)
+static const bool PACK_VERTICES = true;
+static const vertex_format OBJECT_VERTEX_FORMAT = PACK_VERTICES ? vertex_format::packed : vertex_format::full;
+
+// Copies of the object per side of a material comparison grid, roughness rising along x and
+// metallic along z. 0 shows the object once with its textures as they are
+static const uint32_t MATERIAL_GRID_SIZE = 0;
+
+// Instances are culled by instance_cull.comp and drawn from the draw commands it writes, the
+// CPU only computes world matrices and records the same few commands whatever the count.
+// Off culls on the CPU and writes out the visible instances
+static const bool GPU_CULLING = true;
+
+// Starting size of the Model3D mesh registry, it doubles when a mesh does not fit
+constexpr uint32_t MESH_VERTEX_CAPACITY = 1u << 18;
+constexpr uint32_t MESH_INDEX_CAPACITY = 1u << 20;
+
+constexpr uint32_t CULL_GROUP_SIZE = 64; // local_size of instance_cull.comp
+
 void CoreMessageCallback(log_level level, const char *string)
 {
     pltf::DebugString(string);
-    pltf::DebugBreak();
+    if(level == log_level::error)
+        pltf::DebugBreak();
 }
 
 ModelViewer::ModelViewer() : VulkanInstance(MegaBytes(64)),
@@ -18,6 +85,8 @@ ModelViewer::ModelViewer() : VulkanInstance(MegaBytes(64)),
     settings.title = "PBR Demo";
     settings.syncMode = VSyncMode::Off;
     settings.enValidation = ENABLE_VALIDATION;
+    settings.headless = false;
+    settings.framesInFlight = 2;
 
     VulkanInstance::coreMessage = CoreMessageCallback;
     VulkanInstance::prepare();
@@ -25,45 +94,92 @@ ModelViewer::ModelViewer() : VulkanInstance(MegaBytes(64)),
     auto dispatcher = EventDispatcher<ModelViewer>(platformDevice, this);
 
     loadResources();
-    generateBrdfLUT();
 
-    stringBuffer.flush() << SHADERS_PATH << view("pbr_vert.spv");
+    if(PACK_VERTICES)
+        stringBuffer.flush() << SHADERS_PATH << view("pbr_packed_vert.spv");
+    else
+        stringBuffer.flush() << SHADERS_PATH << view("pbr_vert.spv");
     scene.vertexShader.load(device, stringBuffer.c_str());
-    stringBuffer.flush() << SHADERS_PATH << view("pbr_frag.spv");
+    if(IBL_SPHERICAL_HARMONICS)
+        stringBuffer.flush() << SHADERS_PATH << view("pbr_sh_frag.spv");
+    else
+        stringBuffer.flush() << SHADERS_PATH << view("pbr_frag.spv");
     scene.fragmentShader.load(device, stringBuffer.c_str());
     stringBuffer.flush() << SHADERS_PATH << view("skybox_vert.spv");
     skybox.vertexShader.load(device, stringBuffer.c_str());
     stringBuffer.flush() << SHADERS_PATH << view("skybox_frag.spv");
     skybox.fragmentShader.load(device, stringBuffer.c_str());
 
+    threadPool.init();
+
+    const auto iblBegin = pltf::GetTime();
+    uint32_t cachedMaps = 0;
+
+    cachedMaps += generateBrdfLUT() ? 1 : 0;
+
+    // Baked maps are cached per source image and the format it is staged in, switching
+    // environments only bakes new ones once
     stringBuffer.flush() << ASSETS_PATH << view("skybox/Newport_Loft_Ref.hdr");
-    loadHDRSkybox(stringBuffer.c_str());
+    environmentKey = imageCache::HashFile(stringBuffer.c_str());
+    if(environmentKey != 0)
+        environmentKey = Fnv1a(&HDR_SOURCE_FORMAT, sizeof(HDR_SOURCE_FORMAT), environmentKey);
+
+    cachedMaps += loadHDRSkybox(stringBuffer.c_str()) ? 1 : 0;
+    if(IBL_SPHERICAL_HARMONICS)
+    {
+        m_lights.irradianceSH = projectIrradianceSH();
+    }
+    else
+    {
+        m_lights.irradianceSH = {};
+        cachedMaps += generateIrradianceMap() ? 1 : 0;
+    }
+    cachedMaps += generatePrefilteredMap() ? 1 : 0;
 
-    generateIrradianceMap();
-    generatePrefilteredMap();
+    char line[128];
+    snprintf(line, sizeof(line), "Image based lighting ready in %.1f ms, %u/%u maps from the image cache",
+             (pltf::GetTime() - iblBegin) * 1000.0, cachedMaps, IBL_SPHERICAL_HARMONICS ? 3u : 4u);
+    coreMessage(log_level::info, line);
+
+    if(BENCHMARK_IBL_BAKE)
+    {
+        benchmarkIblBake();
+        benchmarkCpuBake();
+        compareIrradianceSH(IBL_SPHERICAL_HARMONICS ? m_lights.irradianceSH : projectIrradianceSH());
+    }
+
+    if(BENCHMARK_MIP_GENERATION)
+        benchmarkMipGeneration();
 
     m_lights.exposure = 1.2f;
     m_lights.gamma = 0.9f;
 
     m_mainCamera.init();
-    m_lights.init(&device);
+    m_lights.init();
 
-    buildUniformBuffers();
     buildDescriptors();
+    if(GPU_CULLING)
+        buildGpuCulling();
 
     buildPipelines();
 
     // Prepare imgui
 
     imgui.device = &device;
+    imgui.frameData = &frameData;
     imgui.extent = extent;// TODO(arle): use pointer
     VulkanImgui::CreateInfo guiInfo;
     guiInfo.depthFormat = depthFormat;
     guiInfo.sampleCount = sampleCount;
     guiInfo.surfaceFormat = surfaceFormat;
+    guiInfo.finalLayout = presentLayout;
+    guiInfo.pipelineCache = pipelineCache;
     imgui.init(guiInfo, graphicsQueue);
 
     imgui.settings.tint = vec4(1.0f);
+
+    device.allocator.dumpStats(coreMessage);
+    VulkanInstance::reportPipelineStats();
 }
 
 ModelViewer::~ModelViewer()
@@ -73,14 +189,18 @@ ModelViewer::~ModelViewer()
     vkDestroySampler(device, brdf.sampler, nullptr);
     vkDestroyImageView(device, brdf.view, nullptr);
     vkDestroyImage(device, brdf.image, nullptr);
-    vkFreeMemory(device, brdf.memory, nullptr);
+    brdf.memory.release();
 
     textures.environment.destroy(device);
-    irradiance.destroy(device);
+    if(!IBL_SPHERICAL_HARMONICS)
+        irradiance.destroy(device);
     prefiltered.destroy(device);
 
     VulkanImgui::Instance().destroy();
 
+    threadPool.destroy();
+    assetLoader.destroy();
+
     vkDestroyPipeline(device, skybox.pipeline, nullptr);
     vkDestroyPipelineLayout(device, skybox.pipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(device, skybox.setLayout, nullptr);
@@ -95,16 +215,29 @@ ModelViewer::~ModelViewer()
 
     textures.albedo.destroy(device);
     textures.normal.destroy(device);
-    textures.roughness.destroy(device);
-    textures.metallic.destroy(device);
-    textures.ao.destroy(device);
-    models.skybox.destroy(device);
-    models.object.destroy(device);
-
-    for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
-        scene.cameraBuffers[i].destroy(device);
+    textures.orm.destroy(device);
+    textures.placeholder.destroy(device);
+    models.skybox.destroy();
+    models.object.destroy();
+    models.meshes.destroy();
+    models.skyboxMeshes.destroy();
+
+    if(GPU_CULLING)
+    {
+        vkDestroyPipeline(device, gpuCull.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, gpuCull.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, gpuCull.setLayout, nullptr);
+        gpuCull.shader.destroy(device);
+        for (auto &output : gpuCull.output)
+            output.destroy(device);
+    }
 
-    m_lights.destroy(device);
+    instances.transforms.destroy();
+    materialTable.destroy(device);
+    delete[] instances.materials;
+    delete[] instances.world;
+    delete[] instances.bounds;
+    delete[] instances.visible;
 
     vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
 
@@ -122,11 +255,19 @@ void ModelViewer::run()
         if(extent.width == 0 || extent.height == 0)
             continue;
 
+        // NOTE(arle): Per-frame buffers are only safe to write once prepareFrame
+        // has waited on the fence of the slot they belong to
+        VulkanInstance::prepareFrame();
+
+        updateAssets();
         updateCamera(pltf::GetTimestep(platformDevice));
+        uniformOffsets.lights = m_lights.update(frameData);
+        if(GPU_CULLING)
+            updateGpuCulling();
+        else
+            updateInstances();
         updateGui();
 
-        VulkanInstance::prepareFrame();
-
         recordFrame(commandBuffers[currentFrame]);
         imgui.recordFrame(currentFrame, framebuffers[imageIndex]);
 
@@ -197,7 +338,7 @@ void ModelViewer::onScrollWheelEvent(double x, double y)
     m_mainCamera.fov = clamp(m_mainCamera.fov, Camera::FOV_LIMITS_LOW, Camera::FOV_LIMITS_HIGH);
 }
 
-void ModelViewer::generateBrdfLUT()
+bool ModelViewer::generateBrdfLUT()
 {
     constexpr auto format = VK_FORMAT_R16G16_SFLOAT;
     constexpr uint32_t dimension = 512;
@@ -206,17 +347,13 @@ void ModelViewer::generateBrdfLUT()
 
     auto imageInfo = vkInits::imageCreateInfo();
     imageInfo.format = format;
-    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.extent = {dimension, dimension, 1};
     vkCreateImage(device, &imageInfo, nullptr, &brdf.image);
 
-    VkMemoryRequirements memReqs{};
-    vkGetImageMemoryRequirements(device, brdf.image, &memReqs);
-
-    auto allocInfo = device.getMemoryAllocInfo(memReqs, MEM_FLAG_GPU_LOCAL);
-    vkAllocateMemory(device, &allocInfo, nullptr, &brdf.memory);
-    vkBindImageMemory(device, brdf.image, brdf.memory, 0);
+    brdf.memory = device.allocateImageMemory(brdf.image, MEM_FLAG_GPU_LOCAL);
 
     auto samplerInfo = vkInits::samplerCreateInfo();
     samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
@@ -233,6 +370,25 @@ void ModelViewer::generateBrdfLUT()
     brdf.descriptor.imageView = brdf.view;
     brdf.descriptor.sampler = brdf.sampler;
 
+    // The LUT does not depend on the environment, one entry serves all of them
+    const ImageCacheDesc cacheDesc = {format, {dimension, dimension}, 1, 1};
+    const auto cacheKey = imageCache::Key(IBL_CPU_BAKE ? "brdf_lut_cpu" : "brdf_lut", cacheDesc);
+    if(imageCache::Load(&device, graphicsQueue, cacheKey, cacheDesc, brdf.image))
+        return true;
+
+    if(IBL_CPU_BAKE)
+    {
+        auto texels = new uint16_t[dimension * dimension * 2];
+        iblBake::BrdfLUT(threadPool, dimension, texels);
+        imageCache::Upload(&device, graphicsQueue, cacheDesc, brdf.image, texels);
+        delete[] texels;
+
+        if(!imageCache::Store(&device, graphicsQueue, cacheKey, cacheDesc, brdf.image))
+            coreMessage(log_level::warning, "Failed to write the BRDF lookup table to the image cache");
+
+        return false;
+    }
+
     // Render pass
 
     auto colourAttachment = vkInits::attachmentDescription(format);
@@ -351,7 +507,7 @@ void ModelViewer::generateBrdfLUT()
     pipelineInfo.renderPass = brdfRenderPass;
 
     VkPipeline brdfPipeline = VK_NULL_HANDLE;
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &brdfPipeline);
+    device.createGraphicsPipeline(pipelineCache, pipelineInfo, &brdfPipeline);
 
     // Render
 
@@ -378,18 +534,233 @@ void ModelViewer::generateBrdfLUT()
     brdfFragmentShader.destroy(device);
     vkDestroyFramebuffer(device, brdfFramebuffer, nullptr);
     vkDestroyRenderPass(device, brdfRenderPass, nullptr);
+
+    if(!imageCache::Store(&device, graphicsQueue, cacheKey, cacheDesc, brdf.image))
+        coreMessage(log_level::warning, "Failed to write the BRDF lookup table to the image cache");
+
+    return false;
 }
 
-void ModelViewer::generateIrradianceMap()
+bool ModelViewer::generateIrradianceMap()
 {
     constexpr uint32_t dimension = 32;
 
     irradiance.extent = {dimension, dimension};
     irradiance.format = VK_FORMAT_R16G16B16A16_SFLOAT;
     irradiance.mipLevels = static_cast<uint32_t>(std::floor(std::log2(dimension))) + 1;
-    irradiance.prepare(&device);
+    irradiance.prepare(&device, VK_IMAGE_USAGE_STORAGE_BIT);
+
+    const auto cacheName = IBL_CPU_BAKE ? "irradiance_cpu" : IBL_COMPUTE ? "irradiance_compute" : "irradiance";
+    const auto cacheKey = imageCache::Key(cacheName, irradiance.cacheDesc(), environmentKey);
+    if(imageCache::Load(&device, graphicsQueue, cacheKey, irradiance.cacheDesc(), irradiance.image))
+        return true;
+
+    if(IBL_CPU_BAKE)
+        bakeCubemapCpu(irradiance, iblBake::IrradianceMap);
+    else if(IBL_COMPUTE)
+        filterCubemap(irradiance, "irradiance_comp.spv");
+    else
+        renderIrradianceMap(irradiance);
+
+    if(!imageCache::Store(&device, graphicsQueue, cacheKey, irradiance.cacheDesc(), irradiance.image))
+        coreMessage(log_level::warning, "Failed to write the irradiance map to the image cache");
+
+    return false;
+}
+
+SH9 ModelViewer::projectIrradianceSH()
+{
+    const auto &environment = textures.environment;
+
+    // NOTE(arle): L2 harmonics only keep the lowest frequencies, box filtering the environment
+    // down on the GPU first changes the coefficients by well under a percent and the CPU
+    // reads 64x64 faces instead of 512x512. Each blit halves, so the filter stays a 2x2 box
+    uint32_t levels = 0;
+    while((environment.extent.width >> (levels + 1)) >= SH_PROJECTION_SIZE)
+        levels++;
+
+    TextureCubeMap reduced;
+    if(levels > 0)
+    {
+        reduced.extent = {environment.extent.width >> 1, environment.extent.height >> 1};
+        reduced.format = environment.format;
+        reduced.mipLevels = levels;
+        reduced.prepare(&device);
+
+        const auto filter = device.linearFilterSupport(environment.format, VK_IMAGE_TILING_OPTIMAL) ?
+                            VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+        VkImageSubresourceRange sourceRange{};
+        sourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        sourceRange.levelCount = 1;
+        sourceRange.layerCount = 6;
+
+        VkImageSubresourceRange reducedRange = sourceRange;
+        reducedRange.levelCount = levels;
+
+        auto cmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        vkTools::SetImageLayout(cmd,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                environment.image, sourceRange);
+
+        vkTools::SetImageLayout(cmd,
+                                VK_IMAGE_LAYOUT_UNDEFINED,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                reduced.image, reducedRange);
+
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            VkImageBlit blit{};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level == 0 ? 0 : level - 1;
+            blit.srcSubresource.layerCount = 6;
+            blit.srcOffsets[1].x = int32_t(environment.extent.width >> level);
+            blit.srcOffsets[1].y = int32_t(environment.extent.height >> level);
+            blit.srcOffsets[1].z = 1;
+
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.layerCount = 6;
+            blit.dstOffsets[1].x = int32_t(environment.extent.width >> (level + 1));
+            blit.dstOffsets[1].y = int32_t(environment.extent.height >> (level + 1));
+            blit.dstOffsets[1].z = 1;
+
+            vkCmdBlitImage(cmd,
+                           level == 0 ? environment.image : reduced.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           reduced.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &blit, filter);
+
+            VkImageSubresourceRange levelRange = sourceRange;
+            levelRange.baseMipLevel = level;
+
+            vkTools::SetImageLayout(cmd,
+                                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                    reduced.image, levelRange);
+        }
+
+        vkTools::SetImageLayout(cmd,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                environment.image, sourceRange);
+
+        vkTools::SetImageLayout(cmd,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                reduced.image, reducedRange);
+
+        device.flushCommandBuffer(cmd, graphicsQueue);
+    }
+
+    const auto &source = levels > 0 ? reduced : environment;
+    const uint32_t faceSize = source.extent.width >> (source.mipLevels - 1);
+
+    VulkanBuffer readback;
+    if(!imageCache::Readback(&device, graphicsQueue, source.cacheDesc(), source.image, readback))
+    {
+        coreMessage(log_level::error, "Failed to read back the environment for the spherical harmonics projection");
+        if(levels > 0)
+            reduced.destroy(device);
+        return {};
+    }
+
+    // Only the smallest level is projected, it is packed last
+    const VkDeviceSize faceBytes = VkDeviceSize(faceSize) * faceSize * 4 * sizeof(float);
+    const auto texels = reinterpret_cast<const float*>(static_cast<uint8_t*>(readback.memory.mapped) +
+                                                       readback.size - faceBytes * 6);
+
+    const auto begin = pltf::GetTime();
+    const auto radiance = ProjectCubemapSH9(texels, faceSize);
+    const auto elapsed = pltf::GetTime() - begin;
+
+    char line[128];
+    snprintf(line, sizeof(line), "Spherical harmonics projected from %ux%u faces in %.3f ms",
+             faceSize, faceSize, elapsed * 1000.0);
+    coreMessage(log_level::info, line);
+
+    readback.destroy(device);
+    if(levels > 0)
+        reduced.destroy(device);
+
+    return IrradianceSH9(radiance);
+}
+
+void ModelViewer::compareIrradianceSH(const SH9 &irradianceSH)
+{
+    // Reference is the compute irradiance bake at its base resolution, uncached
+    constexpr uint32_t dimension = 32;
+
+    TextureCubeMap reference;
+    reference.extent = {dimension, dimension};
+    reference.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    reference.mipLevels = 1;
+    reference.prepare(&device, VK_IMAGE_USAGE_STORAGE_BIT);
 
-    auto colourAttachment = vkInits::attachmentDescription(irradiance.format);
+    filterCubemap(reference, "irradiance_comp.spv");
+
+    VulkanBuffer readback;
+    if(!imageCache::Readback(&device, graphicsQueue, reference.cacheDesc(), reference.image, readback))
+    {
+        coreMessage(log_level::warning, "Failed to read back the irradiance reference");
+        reference.destroy(device);
+        return;
+    }
+
+    const auto texels = static_cast<const uint16_t*>(readback.memory.mapped);
+
+    double errorSum = 0.0;
+    double errorMax = 0.0;
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        for (uint32_t y = 0; y < dimension; y++)
+        {
+            for (uint32_t x = 0; x < dimension; x++)
+            {
+                const float u = (float(x) + 0.5f) / float(dimension) * 2.0f - 1.0f;
+                const float v = (float(y) + 0.5f) / float(dimension) * 2.0f - 1.0f;
+
+                const auto texel = texels + ((face * dimension + y) * dimension + x) * 4;
+                const auto expected = vec3(HalfToFloat(texel[0]), HalfToFloat(texel[1]), HalfToFloat(texel[2]));
+
+                // Shader clamps negative ringing the same way
+                auto evaluated = EvaluateSH9(irradianceSH, CubeFaceDirection(face, u, v));
+                evaluated = vec3(max(evaluated.x, 0.0f), max(evaluated.y, 0.0f), max(evaluated.z, 0.0f));
+
+                const double error = length(evaluated - expected) / max(length(expected), 1e-4f);
+                errorSum += error;
+                errorMax = max(errorMax, error);
+            }
+        }
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "Spherical harmonics vs irradiance cubemap %ux%u: mean relative error %.2f%%, max %.2f%%",
+             dimension, dimension, errorSum * 100.0 / (6.0 * dimension * dimension), errorMax * 100.0);
+    coreMessage(log_level::info, line);
+
+    readback.destroy(device);
+    reference.destroy(device);
+}
+
+void ModelViewer::renderIrradianceMap(TextureCubeMap &target)
+{
+    const uint32_t dimension = target.extent.width;
+
+    auto colourAttachment = vkInits::attachmentDescription(target.format);
     colourAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     auto colourAttachmentRef = vkInits::attachmentReference(0);
@@ -430,7 +801,7 @@ void ModelViewer::generateIrradianceMap()
     vkCreateRenderPass(device, &renderPassInfo, nullptr, &irradianceRenderPass);
 
     OffscreenBuffer offscreen;
-    device.createOffscreenBuffer(irradiance.format, irradiance.extent,
+    device.createOffscreenBuffer(target.format, target.extent,
                                  irradianceRenderPass,
                                  graphicsQueue, offscreen);
 
@@ -534,14 +905,14 @@ void ModelViewer::generateIrradianceMap()
     pipelineInfo.renderPass = irradianceRenderPass;
 
     VkPipeline irradiancePipeline = VK_NULL_HANDLE;
-    vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &irradiancePipeline);
+    device.createGraphicsPipeline(pipelineCache, pipelineInfo, &irradiancePipeline);
 
     // Render
 
     VkClearValue clearValue;
     clearValue.color = {{0.0f, 0.0f, 0.2f, 1.0f}};
 
-    auto renderBeginInfo = vkInits::renderPassBeginInfo(irradianceRenderPass, irradiance.extent);
+    auto renderBeginInfo = vkInits::renderPassBeginInfo(irradianceRenderPass, target.extent);
     renderBeginInfo.framebuffer = offscreen.framebuffer;
     renderBeginInfo.clearValueCount = 1;
     renderBeginInfo.pClearValues = &clearValue;
@@ -557,15 +928,15 @@ void ModelViewer::generateIrradianceMap()
 
     auto cmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
-    auto viewport = vkInits::viewportInfo(irradiance.extent);
-    auto scissor = vkInits::scissorInfo(irradiance.extent);
+    auto viewport = vkInits::viewportInfo(target.extent);
+    auto scissor = vkInits::scissorInfo(target.extent);
 
     vkCmdSetViewport(cmd, 0, 1, &viewport);
     vkCmdSetScissor(cmd, 0, 1, &scissor);
 
     VkImageSubresourceRange subresourceRange{};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresourceRange.levelCount = irradiance.mipLevels;
+    subresourceRange.levelCount = target.mipLevels;
     subresourceRange.layerCount = 6;
 
     vkTools::SetImageLayout(cmd,
@@ -573,13 +944,13 @@ void ModelViewer::generateIrradianceMap()
                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                            irradiance.image,
+                            target.image,
                             subresourceRange);
 
     alignas(16) mat4x4 pushBlock[2] = {};
     pushBlock[1] = mat4x4::perspective(PI32 / 2, 1.0f, Camera::DEFAULT_ZNEAR, Camera::DEFAULT_ZFAR);
 
-    for (uint32_t level = 0; level < irradiance.mipLevels; level++)
+    for (uint32_t level = 0; level < target.mipLevels; level++)
     {
         for (uint32_t i = 0; i < 6; i++)
         {
@@ -602,6 +973,7 @@ void ModelViewer::generateIrradianceMap()
                                pushConstant.size,
                                &pushBlock);
 
+            models.skyboxMeshes.bind(cmd);
             models.skybox.draw(cmd);
 
             vkCmdEndRenderPass(cmd);
@@ -632,7 +1004,7 @@ void ModelViewer::generateIrradianceMap()
 
             vkCmdCopyImage(cmd, offscreen.image,
                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                           irradiance.image,
+                           target.image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                            1, &copyRegion);
 
@@ -650,13 +1022,13 @@ void ModelViewer::generateIrradianceMap()
                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                            irradiance.image, subresourceRange);
+                            target.image, subresourceRange);
 
     device.flushCommandBuffer(cmd, graphicsQueue);
 
     vkDestroyRenderPass(device, irradianceRenderPass, nullptr);
     vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-    vkFreeMemory(device, offscreen.memory, nullptr);
+    offscreen.memory.release();
     vkDestroyImageView(device, offscreen.view, nullptr);
     vkDestroyImage(device, offscreen.image, nullptr);
     vkDestroyDescriptorPool(device, irradianceDescriptorPool, nullptr);
@@ -666,16 +1038,42 @@ void ModelViewer::generateIrradianceMap()
     irradianceFragmentShader.destroy(device);
 }
 
-void ModelViewer::generatePrefilteredMap()
+bool ModelViewer::generatePrefilteredMap()
 {
     constexpr uint32_t dimension = 512;
 
     prefiltered.extent = {dimension, dimension};
     prefiltered.format = VK_FORMAT_R16G16B16A16_SFLOAT;
     prefiltered.mipLevels = static_cast<uint32_t>(std::floor(std::log2(dimension))) + 1;
-    prefiltered.prepare(&device);
+    prefiltered.prepare(&device, VK_IMAGE_USAGE_STORAGE_BIT);
+
+    // A different sample count bakes a different map from the same environment
+    const auto cacheName = IBL_CPU_BAKE ? "prefiltered_cpu" : IBL_COMPUTE ? "prefiltered_compute" : "prefiltered";
+    auto sourceKey = environmentKey;
+    if(sourceKey != 0)
+        sourceKey = Fnv1a(&PREFILTER_SAMPLE_COUNT, sizeof(PREFILTER_SAMPLE_COUNT), sourceKey);
+    const auto cacheKey = imageCache::Key(cacheName, prefiltered.cacheDesc(), sourceKey);
+    if(imageCache::Load(&device, graphicsQueue, cacheKey, prefiltered.cacheDesc(), prefiltered.image))
+        return true;
+
+    if(IBL_CPU_BAKE)
+        bakeCubemapCpu(prefiltered, iblBake::PrefilteredMap);
+    else if(IBL_COMPUTE)
+        filterCubemap(prefiltered, "prefiltered_comp.spv");
+    else
+        renderPrefilteredMap(prefiltered);
+
+    if(!imageCache::Store(&device, graphicsQueue, cacheKey, prefiltered.cacheDesc(), prefiltered.image))
+        coreMessage(log_level::warning, "Failed to write the prefiltered map to the image cache");
+
+    return false;
+}
 
-    auto colourAttachment = vkInits::attachmentDescription(prefiltered.format);
+void ModelViewer::renderPrefilteredMap(TextureCubeMap &target)
+{
+    const uint32_t dimension = target.extent.width;
+
+    auto colourAttachment = vkInits::attachmentDescription(target.format);
     colourAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     auto colourAttachmentRef = vkInits::attachmentReference(0);
@@ -716,7 +1114,7 @@ void ModelViewer::generatePrefilteredMap()
     vkCreateRenderPass(device, &renderPassInfo, nullptr, &prefilteredRenderPass);
 
     OffscreenBuffer offscreen;
-    device.createOffscreenBuffer(prefiltered.format, prefiltered.extent,
+    device.createOffscreenBuffer(target.format, target.extent,
                                  prefilteredRenderPass,
                                  graphicsQueue, offscreen);
 
@@ -823,14 +1221,14 @@ void ModelViewer::generatePrefilteredMap()
     pipelineInfo.renderPass = prefilteredRenderPass;
 
     VkPipeline prefilteredPipeline = VK_NULL_HANDLE;
-    vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &prefilteredPipeline);
+    device.createGraphicsPipeline(pipelineCache, pipelineInfo, &prefilteredPipeline);
 
     // Render
 
     VkClearValue clearValue;
     clearValue.color = {{0.2f, 0.0f, 0.0f, 1.0f}};
 
-    auto renderBeginInfo = vkInits::renderPassBeginInfo(prefilteredRenderPass, prefiltered.extent);
+    auto renderBeginInfo = vkInits::renderPassBeginInfo(prefilteredRenderPass, target.extent);
     renderBeginInfo.framebuffer = offscreen.framebuffer;
     renderBeginInfo.clearValueCount = 1;
     renderBeginInfo.pClearValues = &clearValue;
@@ -846,15 +1244,15 @@ void ModelViewer::generatePrefilteredMap()
 
     auto cmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
-    auto viewport = vkInits::viewportInfo(prefiltered.extent);
-    auto scissor = vkInits::scissorInfo(prefiltered.extent);
+    auto viewport = vkInits::viewportInfo(target.extent);
+    auto scissor = vkInits::scissorInfo(target.extent);
 
     vkCmdSetViewport(cmd, 0, 1, &viewport);
     vkCmdSetScissor(cmd, 0, 1, &scissor);
 
     VkImageSubresourceRange subresourceRange{};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresourceRange.levelCount = prefiltered.mipLevels;
+    subresourceRange.levelCount = target.mipLevels;
     subresourceRange.layerCount = 6;
 
     vkTools::SetImageLayout(cmd,
@@ -862,15 +1260,15 @@ void ModelViewer::generatePrefilteredMap()
                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                            prefiltered.image,
+                            target.image,
                             subresourceRange);
 
     alignas(16) mat4x4 pushBlock[2] = {};
     pushBlock[1] = mat4x4::perspective(PI32 / 2, 1.0f, Camera::DEFAULT_ZNEAR, Camera::DEFAULT_ZFAR);
 
-    for (uint32_t level = 0; level < prefiltered.mipLevels; level++)
+    for (uint32_t level = 0; level < target.mipLevels; level++)
     {
-        const float roughness = float(level) / float(prefiltered.mipLevels - 1);
+        const float roughness = float(level) / float(target.mipLevels - 1);
         vkCmdPushConstants(cmd, prefilteredPipelineLayout,
                             pushConstants[1].stageFlags,
                             pushConstants[1].offset,
@@ -897,6 +1295,7 @@ void ModelViewer::generatePrefilteredMap()
                                pushConstants[0].size,
                                &pushBlock);
 
+            models.skyboxMeshes.bind(cmd);
             models.skybox.draw(cmd);
 
             vkCmdEndRenderPass(cmd);
@@ -927,7 +1326,7 @@ void ModelViewer::generatePrefilteredMap()
 
             vkCmdCopyImage(cmd, offscreen.image,
                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                           prefiltered.image,
+                           target.image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                            1, &copyRegion);
 
@@ -945,13 +1344,13 @@ void ModelViewer::generatePrefilteredMap()
                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                            prefiltered.image, subresourceRange);
+                            target.image, subresourceRange);
 
     device.flushCommandBuffer(cmd, graphicsQueue);
 
     vkDestroyRenderPass(device, prefilteredRenderPass, nullptr);
     vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-    vkFreeMemory(device, offscreen.memory, nullptr);
+    offscreen.memory.release();
     vkDestroyImageView(device, offscreen.view, nullptr);
     vkDestroyImage(device, offscreen.image, nullptr);
     vkDestroyDescriptorPool(device, prefilteredDescriptorPool, nullptr);
@@ -961,21 +1360,444 @@ void ModelViewer::generatePrefilteredMap()
     prefilteredFragmentShader.destroy(device);
 }
 
-void ModelViewer::loadHDRSkybox(const char *filename)
+void ModelViewer::filterCubemap(TextureCubeMap &target, const char *shaderName)
 {
-    HDRImage hdr;
-    auto result = hdr.load(&device, graphicsQueue, filename);
+    // NOTE(arle): Every mip level gets its own storage view and descriptor set, a level
+    // is then a single dispatch covering all six faces, no render passes or copies needed
+    const uint32_t levelCount = target.mipLevels;
 
-    if(result == CoreResult::Success)
+    auto levelViews = new VkImageView[levelCount];
+    auto levelImages = new VkDescriptorImageInfo[levelCount];
+    auto descriptorSets = new VkDescriptorSet[levelCount];
+
+    for (uint32_t level = 0; level < levelCount; level++)
     {
-        constexpr uint32_t dimension = 512;
+        auto viewInfo = vkInits::imageViewCreateInfo();
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.image = target.image;
+        viewInfo.format = target.format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.layerCount = 6;
+        vkCreateImageView(device, &viewInfo, nullptr, &levelViews[level]);
+
+        levelImages[level].sampler = VK_NULL_HANDLE;
+        levelImages[level].imageView = levelViews[level];
+        levelImages[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    // Descriptors
 
-        textures.environment.extent = {dimension, dimension};
-        textures.environment.format = hdr.format;
-        textures.environment.mipLevels = 1;
-        textures.environment.prepare(&device);
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
 
-        auto colourAttachment = vkInits::attachmentDescription(hdr.format);
+    const VkDescriptorPoolSize poolSizes[] = {
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount),
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount)
+    };
+
+    const auto descriptorPoolInfo = vkInits::descriptorPoolCreateInfo(poolSizes, levelCount);
+    vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool);
+
+    const VkDescriptorSetLayoutBinding bindings[] = {
+        vkInits::descriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                            VK_SHADER_STAGE_COMPUTE_BIT),
+        vkInits::descriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                            VK_SHADER_STAGE_COMPUTE_BIT)
+    };
+
+    auto setLayoutInfo = vkInits::descriptorSetLayoutCreateInfo(bindings);
+    vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout);
+
+    VkDescriptorSetLayout setLayouts[] = {setLayout};
+
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        auto setAllocInfo = vkInits::descriptorSetAllocateInfo(descriptorPool, setLayouts);
+        vkAllocateDescriptorSets(device, &setAllocInfo, &descriptorSets[level]);
+
+        const VkWriteDescriptorSet writes[] = {
+            vkInits::writeDescriptorSet(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                        descriptorSets[level], &textures.environment.descriptor),
+            vkInits::writeDescriptorSet(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                        descriptorSets[level], &levelImages[level])
+        };
+
+        vkUpdateDescriptorSets(device, uint32_t(arraysize(writes)), writes, 0, nullptr);
+    }
+
+    // Pipeline
+
+    ComputeShader computeShader;
+    stringBuffer.flush() << SHADERS_PATH << shaderName;
+    computeShader.load(device, stringBuffer.c_str());
+
+    VkPushConstantRange pushConstant{};
+    pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstant.offset = 0;
+    pushConstant.size = sizeof(float);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+
+    // Filters without the constant ignore it
+    const VkSpecializationMapEntry sampleCountEntry = {0, 0, sizeof(uint32_t)};
+    VkSpecializationInfo specialization{};
+    specialization.mapEntryCount = 1;
+    specialization.pMapEntries = &sampleCountEntry;
+    specialization.dataSize = sizeof(PREFILTER_SAMPLE_COUNT);
+    specialization.pData = &PREFILTER_SAMPLE_COUNT;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShader.shaderStage();
+    pipelineInfo.stage.pSpecializationInfo = &specialization;
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    device.createComputePipeline(pipelineCache, pipelineInfo, &pipeline);
+
+    // Dispatch
+
+    VkImageSubresourceRange subresourceRange{};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.levelCount = levelCount;
+    subresourceRange.layerCount = 6;
+
+    auto cmd = device.createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    vkTools::InsertMemoryarrier(cmd,
+                                VK_IMAGE_LAYOUT_UNDEFINED,
+                                VK_IMAGE_LAYOUT_GENERAL,
+                                VK_ACCESS_NONE,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                subresourceRange, target.image);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        const float roughness = levelCount > 1 ? float(level) / float(levelCount - 1) : 0.0f;
+        vkCmdPushConstants(cmd, pipelineLayout, pushConstant.stageFlags,
+                           pushConstant.offset, pushConstant.size, &roughness);
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+                                0, 1, &descriptorSets[level], 0, nullptr);
+
+        const auto width = max(target.extent.width >> level, 1u);
+        const auto height = max(target.extent.height >> level, 1u);
+        vkCmdDispatch(cmd, (width + IBL_GROUP_SIZE - 1) / IBL_GROUP_SIZE,
+                      (height + IBL_GROUP_SIZE - 1) / IBL_GROUP_SIZE, 6);
+    }
+
+    vkTools::InsertMemoryarrier(cmd,
+                                VK_IMAGE_LAYOUT_GENERAL,
+                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_ACCESS_SHADER_READ_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                subresourceRange, target.image);
+
+    device.flushCommandBuffer(cmd, graphicsQueue);
+
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    computeShader.destroy(device);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+
+    for (uint32_t level = 0; level < levelCount; level++)
+        vkDestroyImageView(device, levelViews[level], nullptr);
+
+    delete[] levelViews;
+    delete[] levelImages;
+    delete[] descriptorSets;
+}
+
+void ModelViewer::benchmarkIblBake()
+{
+    constexpr uint32_t RUNS = 4;
+
+    const struct
+    {
+        const char*     name;
+        uint32_t        dimension;
+        const char*     shaderName;
+        void            (ModelViewer::*render)(TextureCubeMap&);
+    } maps[] = {
+        {"irradiance", 32, "irradiance_comp.spv", &ModelViewer::renderIrradianceMap},
+        {"prefiltered", 512, "prefiltered_comp.spv", &ModelViewer::renderPrefilteredMap}
+    };
+
+    // Wall time of the whole bake including pipeline setup, the first run warms the pipeline cache
+    for (const auto &map : maps)
+    {
+        double seconds[2] = {};
+        for (uint32_t path = 0; path < 2; path++)
+        {
+            for (uint32_t run = 0; run < RUNS; run++)
+            {
+                TextureCubeMap target;
+                target.extent = {map.dimension, map.dimension};
+                target.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+                target.mipLevels = static_cast<uint32_t>(std::floor(std::log2(map.dimension))) + 1;
+                target.prepare(&device, VK_IMAGE_USAGE_STORAGE_BIT);
+
+                const auto begin = pltf::GetTime();
+                if(path == 0)
+                    (this->*map.render)(target);
+                else
+                    filterCubemap(target, map.shaderName);
+                seconds[path] += pltf::GetTime() - begin;
+
+                target.destroy(device);
+            }
+        }
+
+        char line[160];
+        snprintf(line, sizeof(line), "IBL bake %s %ux%u: render passes %.2f ms, compute %.2f ms (%.1fx), %u runs",
+                 map.name, map.dimension, map.dimension, seconds[0] * 1000.0 / RUNS, seconds[1] * 1000.0 / RUNS,
+                 seconds[1] > 0.0 ? seconds[0] / seconds[1] : 0.0, RUNS);
+        coreMessage(log_level::info, line);
+    }
+}
+
+float *ModelViewer::readbackEnvironment()
+{
+    const auto &environment = textures.environment;
+
+    VulkanBuffer readback;
+    if(!imageCache::Readback(&device, graphicsQueue, environment.cacheDesc(), environment.image, readback))
+        return nullptr;
+
+    // NOTE(arle): Readback memory is not necessarily host cached, the CPU bake reads every
+    // texel many times over so it works on a copy
+    auto texels = new float[readback.size / sizeof(float)];
+    memcpy(texels, readback.memory.mapped, size_t(readback.size));
+    readback.destroy(device);
+
+    return texels;
+}
+
+void ModelViewer::bakeCubemapCpu(TextureCubeMap &target, iblBake::cubemap_bake bake)
+{
+    auto texels = readbackEnvironment();
+    if(texels == nullptr)
+    {
+        coreMessage(log_level::error, "Failed to read back the environment for the CPU bake");
+        return;
+    }
+
+    const CubemapSource source = {texels, textures.environment.extent.width};
+    auto output = new uint16_t[imageCache::PackedSize(target.cacheDesc()) / sizeof(uint16_t)];
+
+    bake(threadPool, source, target.extent.width, target.mipLevels, output);
+    imageCache::Upload(&device, graphicsQueue, target.cacheDesc(), target.image, output);
+
+    delete[] output;
+    delete[] texels;
+}
+
+void ModelViewer::benchmarkCpuBake()
+{
+    auto texels = readbackEnvironment();
+    if(texels == nullptr)
+        return;
+
+    const CubemapSource source = {texels, textures.environment.extent.width};
+
+    const struct
+    {
+        const char*             name;
+        uint32_t                dimension;
+        const char*             shaderName;
+        iblBake::cubemap_bake   bake;
+    } maps[] = {
+        {"irradiance", 32, "irradiance_comp.spv", iblBake::IrradianceMap},
+        {"prefiltered", 512, "prefiltered_comp.spv", iblBake::PrefilteredMap}
+    };
+
+    ThreadPool serialPool;
+    serialPool.init(1);
+
+    // Scaling from one thread to the whole pool, and the compute bake measured against the
+    // CPU result as the reference
+    for (const auto &map : maps)
+    {
+        TextureCubeMap target;
+        target.extent = {map.dimension, map.dimension};
+        target.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+        target.mipLevels = static_cast<uint32_t>(std::floor(std::log2(map.dimension))) + 1;
+        target.prepare(&device, VK_IMAGE_USAGE_STORAGE_BIT);
+
+        const auto texelCount = imageCache::PackedSize(target.cacheDesc()) / sizeof(uint16_t);
+        auto reference = new uint16_t[texelCount];
+
+        auto begin = pltf::GetTime();
+        map.bake(serialPool, source, map.dimension, target.mipLevels, reference);
+        const auto serialSeconds = pltf::GetTime() - begin;
+
+        begin = pltf::GetTime();
+        map.bake(threadPool, source, map.dimension, target.mipLevels, reference);
+        const auto pooledSeconds = pltf::GetTime() - begin;
+
+        filterCubemap(target, map.shaderName);
+
+        double errorSum = 0.0;
+        double errorMax = 0.0;
+        VulkanBuffer baked;
+        if(imageCache::Readback(&device, graphicsQueue, target.cacheDesc(), target.image, baked))
+        {
+            const auto gpuTexels = static_cast<const uint16_t*>(baked.memory.mapped);
+            for (size_t i = 0; i < texelCount; i += 4)
+            {
+                const auto expected = vec3(HalfToFloat(reference[i]), HalfToFloat(reference[i + 1]), HalfToFloat(reference[i + 2]));
+                const auto actual = vec3(HalfToFloat(gpuTexels[i]), HalfToFloat(gpuTexels[i + 1]), HalfToFloat(gpuTexels[i + 2]));
+
+                const double error = length(actual - expected) / max(length(expected), 1e-4f);
+                errorSum += error;
+                errorMax = max(errorMax, error);
+            }
+            baked.destroy(device);
+        }
+
+        const double speedup = pooledSeconds > 0.0 ? serialSeconds / pooledSeconds : 0.0;
+
+        char line[256];
+        snprintf(line, sizeof(line), "CPU bake %s %ux%u: 1 thread %.0f ms, %u threads %.0f ms (%.1fx, %.0f%% efficiency), "
+                 "compute vs CPU mean relative error %.3f%%, max %.3f%%",
+                 map.name, map.dimension, map.dimension, serialSeconds * 1000.0, threadPool.threadCount(),
+                 pooledSeconds * 1000.0, speedup, speedup * 100.0 / threadPool.threadCount(),
+                 errorSum * 100.0 / double(texelCount / 4), errorMax * 100.0);
+        coreMessage(log_level::info, line);
+
+        delete[] reference;
+        target.destroy(device);
+    }
+
+    serialPool.destroy();
+    delete[] texels;
+}
+
+void ModelViewer::benchmarkMipGeneration()
+{
+    constexpr uint32_t RUNS = 4;
+    constexpr uint32_t SIZE = 2048;
+
+    // The cost does not depend on the content, gradients with some high frequencies will do
+    auto pixels = new uint8_t[size_t(SIZE) * SIZE * 4];
+    for (uint32_t y = 0; y < SIZE; y++)
+    {
+        for (uint32_t x = 0; x < SIZE; x++)
+        {
+            auto texel = pixels + (size_t(y) * SIZE + x) * 4;
+            texel[0] = uint8_t(x);
+            texel[1] = uint8_t(y);
+            texel[2] = uint8_t(x ^ y);
+            texel[3] = 255;
+        }
+    }
+
+    ThreadPool serialPool;
+    serialPool.init(1);
+
+    const struct
+    {
+        const char*     name;
+        bool            blit;
+        mip_filter      filter;
+        ThreadPool*     pool;
+    } paths[] = {
+        {"blit", true, mip_filter::box, nullptr},
+        {"CPU box", false, mip_filter::box, &serialPool},
+        {"CPU box", false, mip_filter::box, &threadPool},
+        {"CPU kaiser", false, mip_filter::kaiser, &serialPool},
+        {"CPU kaiser", false, mip_filter::kaiser, &threadPool}
+    };
+
+    const VkFormat formats[] = {VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB};
+    for (auto format : formats)
+    {
+        const auto file = Texture2D::wrapPixels(pixels, {SIZE, SIZE}, format, 4);
+        for (const auto &path : paths)
+        {
+            // NOTE(arle): Wall time from recording to the fence, both paths upload level 0 and
+            // the CPU path also moves the rest of the chain through staging
+            double seconds = 0.0;
+            for (uint32_t run = 0; run < RUNS; run++)
+            {
+                UploadBatch upload;
+                Texture2D texture;
+                const auto begin = pltf::GetTime();
+                upload.begin(&device, graphicsQueue);
+                if(path.blit)
+                    texture.create(&device, upload, file, true);
+                else
+                    texture.createMipChain(&device, upload, file, path.filter, path.pool);
+                upload.end();
+                seconds += pltf::GetTime() - begin;
+                texture.destroy(device);
+            }
+
+            char threads[32] = "";
+            if(path.pool)
+                snprintf(threads, sizeof(threads), " on %u threads", path.pool->threadCount());
+
+            char line[160];
+            snprintf(line, sizeof(line), "Mip chain %ux%u %s, %s%s: %.2f ms, %u runs", SIZE, SIZE,
+                     format == VK_FORMAT_R8G8B8A8_SRGB ? "sRGB" : "UNORM", path.name, threads,
+                     seconds * 1000.0 / RUNS, RUNS);
+            coreMessage(log_level::info, line);
+        }
+    }
+
+    serialPool.destroy();
+    delete[] pixels;
+}
+
+bool ModelViewer::loadHDRSkybox(const char *filename)
+{
+    constexpr uint32_t dimension = 512;
+
+    textures.environment.extent = {dimension, dimension};
+    textures.environment.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    textures.environment.mipLevels = 1;
+    textures.environment.prepare(&device);
+
+    // A hit skips decoding the HDR and the equirectangular conversion altogether
+    const auto cacheKey = imageCache::Key("environment", textures.environment.cacheDesc(), environmentKey);
+    if(imageCache::Load(&device, graphicsQueue, cacheKey, textures.environment.cacheDesc(),
+                        textures.environment.image))
+        return true;
+
+    HDRImage hdr;
+    UploadBatch upload;
+    upload.begin(&device, graphicsQueue);
+    const auto loadBegin = pltf::GetTime();
+    auto result = hdr.load(&device, upload, filename, HDR_SOURCE_FORMAT);
+    upload.end();
+    const auto loadElapsed = pltf::GetTime() - loadBegin;
+
+    if(result == CoreResult::Success)
+    {
+        const double texels = double(hdr.extent.width) * hdr.extent.height;
+        char line[160];
+        snprintf(line, sizeof(line), "Environment source %ux%u loaded in %.1f ms, %.1f MiB staged instead of %.1f MiB",
+                 hdr.extent.width, hdr.extent.height, loadElapsed * 1000.0,
+                 texels * vkTools::FormatSize(hdr.format) / (1024.0 * 1024.0), texels * 16.0 / (1024.0 * 1024.0));
+        coreMessage(log_level::info, line);
+
+        auto colourAttachment = vkInits::attachmentDescription(textures.environment.format);
         colourAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
         auto colourAttachmentRef = vkInits::attachmentReference(0);
@@ -1016,7 +1838,7 @@ void ModelViewer::loadHDRSkybox(const char *filename)
         vkCreateRenderPass(device, &renderPassInfo, nullptr, &skyboxRenderPass);
 
         OffscreenBuffer offscreen;
-        device.createOffscreenBuffer(hdr.format, textures.environment.extent,
+        device.createOffscreenBuffer(textures.environment.format, textures.environment.extent,
                                      skyboxRenderPass,
                                      graphicsQueue, offscreen);
 
@@ -1122,7 +1944,7 @@ void ModelViewer::loadHDRSkybox(const char *filename)
         pipelineInfo.renderPass = skyboxRenderPass;
 
         VkPipeline pipeline = VK_NULL_HANDLE;
-        vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+        device.createGraphicsPipeline(pipelineCache, pipelineInfo, &pipeline);
 
         // Render
 
@@ -1183,6 +2005,7 @@ void ModelViewer::loadHDRSkybox(const char *filename)
                                pushConstants[0].size,
                                &pushBlock);
 
+            models.skyboxMeshes.bind(cmd);
             models.skybox.draw(cmd);
 
             vkCmdEndRenderPass(cmd);
@@ -1236,7 +2059,7 @@ void ModelViewer::loadHDRSkybox(const char *filename)
 
         vkDestroyRenderPass(device, skyboxRenderPass, nullptr);
         vkDestroyFramebuffer(device, offscreen.framebuffer, nullptr);
-        vkFreeMemory(device, offscreen.memory, nullptr);
+        offscreen.memory.release();
         vkDestroyImageView(device, offscreen.view, nullptr);
         vkDestroyImage(device, offscreen.image, nullptr);
         vkDestroyDescriptorPool(device, descriptorPool, nullptr);
@@ -1245,63 +2068,177 @@ void ModelViewer::loadHDRSkybox(const char *filename)
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
         fragmentShader.destroy(device);
         hdr.destroy(device);
+
+        if(!imageCache::Store(&device, graphicsQueue, cacheKey, textures.environment.cacheDesc(),
+                              textures.environment.image))
+            coreMessage(log_level::warning, "Failed to write the environment map to the image cache");
     }
+
+    return false;
 }
 
 void ModelViewer::loadResources()
 {
+    // Meshes and the placeholder share one upload batch
+    UploadBatch upload;
+    upload.begin(&device, graphicsQueue);
+
+    // One registry per vertex layout, the skybox cube is all its registry holds
+    models.meshes.create(&device, graphicsQueue, Model3D::vertexSize(OBJECT_VERTEX_FORMAT),
+                         MESH_VERTEX_CAPACITY, MESH_INDEX_CAPACITY);
+    models.skyboxMeshes.create(&device, graphicsQueue, sizeof(CubemapModel::Vertex), 8, 36);
+
     // Object
     {
-        models.object.loadSpherePrimitive(&device, graphicsQueue);
-        models.object.transform = mat4x4::identity();
+        const auto logMeshOptimization = [this](const char *name, const ModelLoadStats &stats)
+        {
+            if(!OPTIMIZE_MESHES)
+                return;
+
+            char line[256];
+            snprintf(line, sizeof(line), "Optimized %s in %.2f ms: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+                     name, stats.optimizeSeconds * 1000.0,
+                     stats.cacheBefore.acmr(), stats.cacheAfter.acmr(),
+                     stats.cacheBefore.atvr(), stats.cacheAfter.atvr());
+            coreMessage(log_level::info, line);
+        };
+
+        // Position error against the size of the box, the step of 16 bits is 1/65535 of it
+        const auto logQuantization = [this](const char *name, const ModelLoadStats &stats, const BoundingBox &box)
+        {
+            if(!PACK_VERTICES)
+                return;
+
+            const auto size = box.max - box.min;
+            const float largest = max(size.x, max(size.y, size.z));
+            char line[256];
+            snprintf(line, sizeof(line), "Packed %s vertices %u -> %u bytes: max error position %.3g (%.3g of the box), "
+                     "normal %.2f deg, uv %.3g",
+                     name, uint32_t(sizeof(Model3D::Vertex)), Model3D::vertexSize(OBJECT_VERTEX_FORMAT),
+                     stats.quantization.position, largest > 0.0f ? stats.quantization.position / largest : 0.0f,
+                     stats.quantization.normal, stats.quantization.uv);
+            coreMessage(log_level::info, line);
+        };
+
+        const MeshLoadOptions meshOptions = {OBJECT_VERTEX_FORMAT, OPTIMIZE_MESHES};
+
+        bool modelLoaded = false;
+        if(OBJECT_MODEL)
+        {
+            stringBuffer.flush() << ASSETS_PATH << OBJECT_MODEL;
+
+            ModelLoadStats stats;
+            const char *error = nullptr;
+            modelLoaded = models.object.loadFile(models.meshes, upload, stringBuffer.c_str(), meshOptions,
+                                                 stats, error);
+
+            char line[256];
+            if(modelLoaded)
+            {
+                snprintf(line, sizeof(line), "Loaded %s: %u vertices, %u indices, %u materials, "
+                         "parse %.2f ms, upload %.2f ms (%.0f MB/s)",
+                         OBJECT_MODEL, stats.vertexCount, stats.indexCount, stats.materialCount,
+                         stats.parseSeconds * 1000.0, stats.uploadSeconds * 1000.0,
+                         stats.uploadSeconds > 0.0 ? double(stats.bytes) / (stats.uploadSeconds * 1024.0 * 1024.0) : 0.0);
+                coreMessage(log_level::info, line);
+                logMeshOptimization(OBJECT_MODEL, stats);
+                logQuantization(OBJECT_MODEL, stats, models.object.bounds.box);
+            }
+            else
+            {
+                snprintf(line, sizeof(line), "Failed to load %s: %s", OBJECT_MODEL, error);
+                coreMessage(log_level::warning, line);
+            }
+        }
+
+        if(!modelLoaded)
+        {
+            ModelLoadStats stats;
+            models.object.loadSpherePrimitive(models.meshes, upload, meshOptions, stats);
+            logMeshOptimization("sphere", stats);
+            logQuantization("sphere", stats, models.object.bounds.box);
+        }
+        buildInstances(upload);
+
+        // NOTE(arle): Material textures stream in on the asset loader, until they are
+        // ready the scene samples a 1x1 placeholder
+        const auto placeholderFile = Texture2D::wrapPixels(TEX2D_DEFAULT, {1, 1}, VK_FORMAT_R8G8B8A8_SRGB, 4);
+        textures.placeholder.create(&device, upload, placeholderFile);
 
+        // Only the albedo map holds colour, the others are linear data
         constexpr auto materialPath = view("materials/warped-sheet-metal/");
+        constexpr const char *materialFiles[] = {"albedo", "normal", "orm"};
+        constexpr VkFormat materialFormats[] = {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM,
+                                                VK_FORMAT_R8G8B8A8_UNORM};
+        Texture2D *materialTextures[] = {&textures.albedo, &textures.normal, &textures.orm};
 
-        stringBuffer.flush() << ASSETS_PATH << materialPath << view("albedo.png");
-        auto imageFile = Texture2D::loadFile(stringBuffer.c_str(), VK_FORMAT_R8G8B8A8_SRGB);
-        textures.albedo.create(&device, graphicsQueue, imageFile, true);
-        Texture2D::freeFile(imageFile);
-
-        stringBuffer.flush() << ASSETS_PATH << materialPath << view("normal.png");
-        imageFile = Texture2D::loadFile(stringBuffer.c_str(), VK_FORMAT_R8G8B8A8_SRGB);
-        textures.normal.create(&device, graphicsQueue, imageFile, true);
-        Texture2D::freeFile(imageFile);
-
-        stringBuffer.flush() << ASSETS_PATH << materialPath << view("roughness.png");
-        imageFile = Texture2D::loadFile(stringBuffer.c_str(), VK_FORMAT_R8G8B8A8_SRGB);
-        textures.roughness.create(&device, graphicsQueue, imageFile, true);
-        Texture2D::freeFile(imageFile);
-
-        stringBuffer.flush() << ASSETS_PATH << materialPath << view("metallic.png");
-        imageFile = Texture2D::loadFile(stringBuffer.c_str(), VK_FORMAT_R8G8B8A8_SRGB);
-        textures.metallic.create(&device, graphicsQueue, imageFile, true);
-        Texture2D::freeFile(imageFile);
-
-        stringBuffer.flush() << ASSETS_PATH << materialPath << view("ao.png");
-        imageFile = Texture2D::loadFile(stringBuffer.c_str(), VK_FORMAT_R8G8B8A8_SRGB);
-        textures.ao.create(&device, graphicsQueue, imageFile, true);
-        Texture2D::freeFile(imageFile);
+        // Sources of the orm channels when there is no packed file
+        constexpr const char *ormChannelFiles[] = {"ao", "roughness", "metallic"};
+        constexpr size_t ORM = 2;
+
+        assetLoader.init(&device, graphicsQueue, transferQueue);
+        for (size_t i = 0; i < arraysize(materialFiles); i++)
+        {
+            // NOTE(arle): BC compressed KTX2 files written by tools/texture_compress take the
+            // place of the PNGs when the device can sample them
+            bool compressed = false;
+            if(device.textureCompressionBC)
+            {
+                stringBuffer.flush() << ASSETS_PATH << materialPath << materialFiles[i] << view(".ktx2");
+                auto file = io::Open<io::cmd::read>(stringBuffer.c_str());
+                compressed = io::IsValid(file);
+                io::Close(file);
+            }
+            *materialTextures[i] = Texture2D{};
+            if(!compressed && i == ORM)
+            {
+                // NOTE(arle): Without an orm.ktx2 from texture_compress -orm the separate maps
+                // are packed as they are decoded
+                char channelPaths[arraysize(ormChannelFiles)][256];
+                const char *channelFiles[arraysize(ormChannelFiles)];
+                for (size_t c = 0; c < arraysize(ormChannelFiles); c++)
+                {
+                    stringBuffer.flush() << ASSETS_PATH << materialPath << ormChannelFiles[c] << view(".png");
+                    snprintf(channelPaths[c], sizeof(channelPaths[c]), "%s", stringBuffer.c_str());
+                    channelFiles[c] = channelPaths[c];
+                }
+                materialLoads[i] = assetLoader.loadPacked(channelFiles, uint32_t(arraysize(channelFiles)),
+                                                          materialFormats[i], *materialTextures[i], true);
+                continue;
+            }
+
+            if(!compressed)
+                stringBuffer.flush() << ASSETS_PATH << materialPath << materialFiles[i] << view(".png");
+            materialLoads[i] = assetLoader.loadTexture(stringBuffer.c_str(), materialFormats[i],
+                                                       *materialTextures[i], true);
+        }
+        assetLoader.flush();
     }
 
-    models.skybox.load(&device, graphicsQueue);
-}
+    models.skybox.load(models.skyboxMeshes, upload);
 
-void ModelViewer::buildUniformBuffers()
-{
-    for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
-    {
-        device.createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MEM_FLAG_HOST_VISIBLE,
-                            sizeof(MvpMatrix), scene.cameraBuffers[i]);
-    }
+    const auto uploadStats = upload.end();
+    char line[160];
+    snprintf(line, sizeof(line), "Uploaded %.2f MB in %u copies and %u submits, %.2f ms on the GPU (%.0f MB/s)",
+             double(uploadStats.bytes) / (1024.0 * 1024.0), uploadStats.copies, uploadStats.submits,
+             uploadStats.seconds * 1000.0, uploadStats.bytesPerSecond() / (1024.0 * 1024.0));
+    coreMessage(log_level::info, line);
 
-    updateCamera(0.0f);
+    const auto meshStats = models.meshes.stats();
+    snprintf(line, sizeof(line), "Mesh registry: %u meshes, %u of %u vertices, %u of %u indices",
+             meshStats.meshes, meshStats.vertices, meshStats.vertexCapacity, meshStats.indices,
+             meshStats.indexCapacity);
+    coreMessage(log_level::info, line);
 }
 
 void ModelViewer::buildDescriptors()
 {
     const VkDescriptorPoolSize poolSizes[] = {
-        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 * MAX_IMAGES_IN_FLIGHT),
-        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9 * MAX_IMAGES_IN_FLIGHT)
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 4 * MAX_IMAGES_IN_FLIGHT),
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MAX_IMAGES_IN_FLIGHT),
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (IBL_SPHERICAL_HARMONICS ? 6 : 7) * MAX_IMAGES_IN_FLIGHT),
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2 * MAX_IMAGES_IN_FLIGHT),
+        vkInits::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * MAX_IMAGES_IN_FLIGHT)
     };
 
     auto maxSets = vkTools::descriptorPoolMaxSets(poolSizes);
@@ -1312,20 +2249,24 @@ void ModelViewer::buildDescriptors()
     // Scene
 
     constexpr auto combinedStage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    const VkDescriptorSetLayoutBinding bindings[] = {
-        vkInits::descriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, combinedStage),
-        vkInits::descriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT),
+    VkDescriptorSetLayoutBinding bindings[] = {
+        vkInits::descriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, combinedStage),
+        vkInits::descriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_FRAGMENT_BIT),
         vkInits::descriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
         vkInits::descriptorSetLayoutBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
         vkInits::descriptorSetLayoutBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
         vkInits::descriptorSetLayoutBinding(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
         vkInits::descriptorSetLayoutBinding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
         vkInits::descriptorSetLayoutBinding(7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
-        vkInits::descriptorSetLayoutBinding(8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
-        vkInits::descriptorSetLayoutBinding(9, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        vkInits::descriptorSetLayoutBinding(8, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
     };
 
-    auto setLayoutInfo = vkInits::descriptorSetLayoutCreateInfo(bindings);
+    // Irradiance comes from the light uniforms, binding 3 is left out of the layout
+    uint32_t bindingCount = uint32_t(arraysize(bindings));
+    if(IBL_SPHERICAL_HARMONICS)
+        bindings[3] = bindings[--bindingCount];
+
+    auto setLayoutInfo = vkInits::descriptorSetLayoutCreateInfo({bindings, bindingCount});
     vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &scene.setLayout);
 
     VkDescriptorSetLayout layouts[MAX_IMAGES_IN_FLIGHT] = {};
@@ -1334,30 +2275,38 @@ void ModelViewer::buildDescriptors()
     auto allocInfo = vkInits::descriptorSetAllocateInfo(m_descriptorPool, layouts);
     vkAllocateDescriptorSets(device, &allocInfo, scene.descriptorSets);
 
+    // Uniforms live in the frame ring buffer, the offset is supplied at bind time. Materials
+    // never change after buildInstances and stay in their own buffer
+    const auto cameraDescriptor = frameData.descriptor<MvpMatrix>();
+    const auto lightsDescriptor = frameData.descriptor<LightData>();
+    const VkDescriptorBufferInfo materialsDescriptor = {materialTable.data, 0, sizeof(MaterialTable)};
+
     for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
     {
         auto &setRef = scene.descriptorSets[i];
-        const VkWriteDescriptorSet writes[] = {
-            vkInits::writeDescriptorSet(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setRef, &scene.cameraBuffers[i].descriptor),
-            vkInits::writeDescriptorSet(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setRef, &m_lights.buffers[i].descriptor),
+        VkWriteDescriptorSet writes[] = {
+            vkInits::writeDescriptorSet(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, setRef, &cameraDescriptor),
+            vkInits::writeDescriptorSet(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, setRef, &lightsDescriptor),
             vkInits::writeDescriptorSet(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &brdf.descriptor),
             vkInits::writeDescriptorSet(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &irradiance.descriptor),
             vkInits::writeDescriptorSet(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &prefiltered.descriptor),
-            vkInits::writeDescriptorSet(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &textures.albedo.descriptor),
-            vkInits::writeDescriptorSet(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &textures.normal.descriptor),
-            vkInits::writeDescriptorSet(7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &textures.roughness.descriptor),
-            vkInits::writeDescriptorSet(8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &textures.metallic.descriptor),
-            vkInits::writeDescriptorSet(9, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &textures.ao.descriptor)
+            vkInits::writeDescriptorSet(8, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setRef, &materialsDescriptor)
         };
 
-        vkUpdateDescriptorSets(device, uint32_t(arraysize(writes)), writes, 0, nullptr);
+        uint32_t writeCount = uint32_t(arraysize(writes));
+        if(IBL_SPHERICAL_HARMONICS)
+            writes[3] = writes[--writeCount];
+
+        vkUpdateDescriptorSets(device, writeCount, writes, 0, nullptr);
+        writeMaterialDescriptors(setRef);
     }
+    staleMaterialSets = 0;
 
     // Skybox
 
     const VkDescriptorSetLayoutBinding skyboxBindings[] = {
         vkInits::descriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT),
-        vkInits::descriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        vkInits::descriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_FRAGMENT_BIT)
     };
 
     setLayoutInfo = vkInits::descriptorSetLayoutCreateInfo(skyboxBindings);
@@ -1373,27 +2322,72 @@ void ModelViewer::buildDescriptors()
         auto &setRef = skybox.descriptorSets[i];
         const VkWriteDescriptorSet writes[] = {
             vkInits::writeDescriptorSet(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setRef, &textures.environment.descriptor),
-            vkInits::writeDescriptorSet(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setRef, &m_lights.buffers[i].descriptor)
+            vkInits::writeDescriptorSet(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, setRef, &lightsDescriptor)
         };
 
         vkUpdateDescriptorSets(device, uint32_t(arraysize(writes)), writes, 0, nullptr);
     }
 }
 
+void ModelViewer::writeMaterialDescriptors(VkDescriptorSet set)
+{
+    const Texture2D *materialTextures[] = {&textures.albedo, &textures.normal, &textures.orm};
+
+    VkWriteDescriptorSet writes[arraysize(materialTextures)];
+    for (uint32_t i = 0; i < arraysize(materialTextures); i++)
+    {
+        const auto &texture = assetLoader.ready(materialLoads[i]) ? *materialTextures[i] : textures.placeholder;
+        writes[i] = vkInits::writeDescriptorSet(5 + i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, set, &texture.descriptor);
+    }
+    vkUpdateDescriptorSets(device, uint32_t(arraysize(writes)), writes, 0, nullptr);
+}
+
+void ModelViewer::updateAssets()
+{
+    // NOTE(arle): Sets can only be rewritten once the GPU is done with them, each one is
+    // patched when its frame slot comes around again after prepareFrame
+    if(assetLoader.update() > 0)
+    {
+        staleMaterialSets = BIT(MAX_IMAGES_IN_FLIGHT) - 1;
+
+        if(assetLoader.idle())
+        {
+            const auto &stats = assetLoader.stats();
+            char line[192];
+            snprintf(line, sizeof(line), "Streamed %u textures (%u failed) in %.1f ms, decode %.1f ms summed, "
+                     "%.1f MB uploaded, %.1f MB of images", stats.textures, stats.failed, stats.seconds * 1000.0,
+                     stats.decodeSeconds * 1000.0, double(stats.bytes) / (1024.0 * 1024.0),
+                     double(stats.imageBytes) / (1024.0 * 1024.0));
+            coreMessage(stats.failed > 0 ? log_level::warning : log_level::info, line);
+        }
+    }
+
+    if(staleMaterialSets & BIT(currentFrame))
+    {
+        writeMaterialDescriptors(scene.descriptorSets[currentFrame]);
+        staleMaterialSets &= ~uint32_t(BIT(currentFrame));
+    }
+}
+
 void ModelViewer::buildPipelines()
 {
     VkPipelineShaderStageCreateInfo shaderStages[] = {
         scene.vertexShader.shaderStage(), scene.fragmentShader.shaderStage()
     };
 
-    auto bindingDescription = vkInits::vertexBindingDescription(sizeof(Model3D::Vertex));
+    // Vertices in binding 0, the instance streams after them
+    static_assert(arraysize(Model3D::Attributes) == arraysize(Model3D::PackedAttributes));
+    constexpr auto vertexAttributeCount = arraysize(Model3D::Attributes);
+    VkVertexInputAttributeDescription attributes[vertexAttributeCount + arraysize(Model3D::InstanceAttributes)];
+    memcpy(attributes, PACK_VERTICES ? Model3D::PackedAttributes : Model3D::Attributes, sizeof(Model3D::Attributes));
+    memcpy(attributes + vertexAttributeCount, Model3D::InstanceAttributes, sizeof(Model3D::InstanceAttributes));
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = uint32_t(arraysize(Model3D::Attributes));
-    vertexInputInfo.pVertexAttributeDescriptions = Model3D::Attributes;
+    vertexInputInfo.vertexBindingDescriptionCount = uint32_t(arraysize(Model3D::Bindings));
+    vertexInputInfo.pVertexBindingDescriptions = PACK_VERTICES ? Model3D::PackedBindings : Model3D::Bindings;
+    vertexInputInfo.vertexAttributeDescriptionCount = uint32_t(arraysize(attributes));
+    vertexInputInfo.pVertexAttributeDescriptions = attributes;
 
     auto inputAssembly = vkInits::inputAssemblyInfo();
     auto viewport = vkInits::viewportInfo(extent);
@@ -1415,14 +2409,15 @@ void ModelViewer::buildPipelines()
     colourBlend.attachmentCount = 1;
     colourBlend.pAttachments = &colorBlendAttachment;
 
-    const VkPushConstantRange pushConstants[] = {Model3D::pushConstant()};
-
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.pSetLayouts = &scene.setLayout;
     pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = pushConstants;
-    pipelineLayoutInfo.pushConstantRangeCount = uint32_t(arraysize(pushConstants));
+    if(PACK_VERTICES)
+    {
+        pipelineLayoutInfo.pPushConstantRanges = &Model3D::PackedPushConstant;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+    }
     vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &scene.pipelineLayout);
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
@@ -1438,15 +2433,17 @@ void ModelViewer::buildPipelines()
     pipelineInfo.pColorBlendState = &colourBlend;
     pipelineInfo.layout = scene.pipelineLayout;
     pipelineInfo.renderPass = renderPass;
-    vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &scene.pipeline);
+    device.createGraphicsPipeline(pipelineCache, pipelineInfo, &scene.pipeline);
 
     // Skybox
 
     shaderStages[0] = skybox.vertexShader.shaderStage();
     shaderStages[1] = skybox.fragmentShader.shaderStage();
 
-    bindingDescription.stride = sizeof(CubemapModel::Vertex);
+    const auto skyboxBinding = vkInits::vertexBindingDescription(sizeof(CubemapModel::Vertex));
 
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &skyboxBinding;
     vertexInputInfo.vertexAttributeDescriptionCount = uint32_t(arraysize(CubemapModel::Attributes));
     vertexInputInfo.pVertexAttributeDescriptions = CubemapModel::Attributes;
 
@@ -1462,7 +2459,155 @@ void ModelViewer::buildPipelines()
     vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &skybox.pipelineLayout);
 
     pipelineInfo.layout = skybox.pipelineLayout;
-    vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &skybox.pipeline);
+    device.createGraphicsPipeline(pipelineCache, pipelineInfo, &skybox.pipeline);
+}
+
+void ModelViewer::buildInstances(UploadBatch &upload)
+{
+    device.createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MEM_FLAG_GPU_LOCAL,
+                        sizeof(MaterialTable), materialTable);
+
+    // Material 0 leaves the textures as they are. Written straight into staging, every
+    // factor is set so unused entries go up as zeros
+    auto &table = *static_cast<MaterialTable*>(upload.stageBuffer(materialTable.data, sizeof(MaterialTable)));
+    table = {};
+    table.factors[0] = {vec4(1.0f), 1.0f, 1.0f, vec2(0.0f)};
+
+    const uint32_t side = max(MATERIAL_GRID_SIZE, 1u);
+    const uint32_t count = side * side;
+    instances.transforms.init(count);
+    instances.materials = new uint32_t[count];
+    instances.world = new mat4x4[count];
+    instances.bounds = new float[size_t(count) * 6];
+    instances.visible = new uint32_t[count];
+    instances.streams = {};
+
+    if(MATERIAL_GRID_SIZE == 0)
+    {
+        instances.transforms.add(vec3(0.0f));
+        instances.materials[0] = 0;
+        return;
+    }
+
+    // Levels of roughness by levels of metallic after material 0, the first and last copies
+    // along each axis take both ends and larger grids repeat steps over neighbouring copies.
+    // Fully smooth surfaces alias, roughness starts above 0
+    constexpr uint32_t LEVELS = 15;
+    static_assert(1 + LEVELS * LEVELS <= MAX_MATERIALS);
+    for (uint32_t z = 0; z < LEVELS; z++)
+    {
+        for (uint32_t x = 0; x < LEVELS; x++)
+        {
+            auto &factors = table.factors[1 + z * LEVELS + x];
+            factors.albedo = vec4(1.0f);
+            factors.roughness = max(float(x) / float(LEVELS - 1), 0.05f);
+            factors.metallic = float(z) / float(LEVELS - 1);
+        }
+    }
+
+    const uint32_t last = max(side - 1, 1u);
+    const auto &sphere = models.object.bounds.sphere;
+    const float spacing = 2.5f * max(sphere.radius, 0.01f);
+    const float origin = -0.5f * spacing * float(side - 1);
+    for (uint32_t z = 0; z < side; z++)
+    {
+        for (uint32_t x = 0; x < side; x++)
+        {
+            const auto position = vec3(origin + float(x) * spacing, 0.0f, origin + float(z) * spacing);
+            const uint32_t index = instances.transforms.add(position - sphere.centre);
+            const uint32_t metallic = (z * (LEVELS - 1) + last / 2) / last;
+            const uint32_t roughness = (x * (LEVELS - 1) + last / 2) / last;
+            instances.materials[index] = 1 + metallic * LEVELS + roughness;
+        }
+    }
+}
+
+void ModelViewer::buildGpuCulling()
+{
+    constexpr auto stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    const VkDescriptorSetLayoutBinding bindings[] = {
+        vkInits::descriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, stage),
+        vkInits::descriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, stage),
+        vkInits::descriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, stage),
+        vkInits::descriptorSetLayoutBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage),
+        vkInits::descriptorSetLayoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage),
+        vkInits::descriptorSetLayoutBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage)
+    };
+
+    const auto setLayoutInfo = vkInits::descriptorSetLayoutCreateInfo(bindings);
+    vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &gpuCull.setLayout);
+
+    VkDescriptorSetLayout layouts[MAX_IMAGES_IN_FLIGHT] = {};
+    arrayfill(layouts, gpuCull.setLayout);
+
+    const auto allocInfo = vkInits::descriptorSetAllocateInfo(m_descriptorPool, layouts);
+    vkAllocateDescriptorSets(device, &allocInfo, gpuCull.descriptorSets);
+
+    // NOTE(arle): The inputs are allocated from frameData at full capacity every frame so the
+    // descriptor ranges written here stay inside the ring whatever the dynamic offset
+    gpuCull.capacity = max(instances.transforms.count(), 1u);
+    const VkDeviceSize alignment = frameData.storageAlignment;
+    const auto alignUp = [alignment](VkDeviceSize size) { return (size + alignment - 1) & ~(alignment - 1); };
+
+    const VkDeviceSize transformBytes = gpuCull.capacity * sizeof(mat4x4);
+    const VkDeviceSize materialBytes = gpuCull.capacity * sizeof(uint32_t);
+    gpuCull.drawsSize = sizeof(CullDrawHeader) + models.object.drawCommandCount() * sizeof(VkDrawIndexedIndirectCommand);
+    gpuCull.transforms = alignUp(gpuCull.drawsSize);
+    gpuCull.materials = gpuCull.transforms + alignUp(transformBytes);
+    gpuCull.ready = false;
+
+    constexpr auto outputUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    const auto uniformDescriptor = frameData.descriptor<CullUniforms>();
+    const VkDescriptorBufferInfo transformInput = {frameData.buffer.data, 0, transformBytes};
+    const VkDescriptorBufferInfo materialInput = {frameData.buffer.data, 0, materialBytes};
+
+    for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
+    {
+        auto &output = gpuCull.output[i];
+        device.createBuffer(outputUsage, MEM_FLAG_GPU_LOCAL, gpuCull.materials + materialBytes, output);
+
+        const VkDescriptorBufferInfo draws = {output.data, 0, gpuCull.drawsSize};
+        const VkDescriptorBufferInfo transformOutput = {output.data, gpuCull.transforms, transformBytes};
+        const VkDescriptorBufferInfo materialOutput = {output.data, gpuCull.materials, materialBytes};
+
+        auto &setRef = gpuCull.descriptorSets[i];
+        const VkWriteDescriptorSet writes[] = {
+            vkInits::writeDescriptorSet(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, setRef, &uniformDescriptor),
+            vkInits::writeDescriptorSet(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, setRef, &transformInput),
+            vkInits::writeDescriptorSet(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, setRef, &materialInput),
+            vkInits::writeDescriptorSet(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setRef, &draws),
+            vkInits::writeDescriptorSet(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setRef, &transformOutput),
+            vkInits::writeDescriptorSet(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setRef, &materialOutput)
+        };
+
+        vkUpdateDescriptorSets(device, uint32_t(arraysize(writes)), writes, 0, nullptr);
+    }
+
+    // Pipeline, the pass index is the only push constant
+
+    stringBuffer.flush() << SHADERS_PATH << view("instance_cull_comp.spv");
+    gpuCull.shader.load(device, stringBuffer.c_str());
+
+    VkPushConstantRange pushConstant{};
+    pushConstant.stageFlags = stage;
+    pushConstant.offset = 0;
+    pushConstant.size = sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pSetLayouts = &gpuCull.setLayout;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &gpuCull.pipelineLayout);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = gpuCull.shader.shaderStage();
+    pipelineInfo.layout = gpuCull.pipelineLayout;
+    device.createComputePipeline(pipelineCache, pipelineInfo, &gpuCull.pipeline);
 }
 
 void ModelViewer::updateCamera(float dt)
@@ -1477,13 +2622,88 @@ void ModelViewer::updateCamera(float dt)
     m_mainCamera.controls.moveRight = pltf::IsKeyDown(pltf::key_code::Right);
     m_mainCamera.update(dt, aspectRatio);
 
-    const auto ubo = m_mainCamera.getModelViewProjection();
-    for (size_t i = 0; i < MAX_IMAGES_IN_FLIGHT; i++)
+    uniformOffsets.camera = frameData.push(m_mainCamera.getModelViewProjection());
+}
+
+void ModelViewer::updateInstances()
+{
+    const uint32_t count = instances.transforms.count();
+    instances.transforms.computeWorldMatrices(threadPool, instances.world);
+
+    // World boxes of every copy, culled against the frustum in one batch
+    float *centres = instances.bounds, *extents = instances.bounds + size_t(count) * 3;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto box = culling::TransformBox(models.object.bounds.box, instances.world[i]);
+        const auto centre = (box.min + box.max) * 0.5f;
+        const auto extent = (box.max - box.min) * 0.5f;
+        centres[i] = centre.x;
+        centres[count + i] = centre.y;
+        centres[2 * count + i] = centre.z;
+        extents[i] = extent.x;
+        extents[count + i] = extent.y;
+        extents[2 * count + i] = extent.z;
+    }
+
+    const BoxBatch batch = {centres, centres + count, centres + 2 * count,
+                            extents, extents + count, extents + 2 * count, count};
+    const uint32_t visibleCount = culling::CullBoxes(m_mainCamera.frustum(), batch, instances.visible);
+
+    // Only the survivors are written out, packed for the instanced draw
+    instances.streams = {};
+    if(visibleCount == 0)
+        return;
+
+    auto transforms = frameData.allocate(visibleCount * sizeof(mat4x4), alignof(mat4x4));
+    auto materials = frameData.allocate(visibleCount * sizeof(uint32_t), sizeof(uint32_t));
+    if(transforms.mapped == nullptr || materials.mapped == nullptr)
+        return;
+
+    auto worldOut = static_cast<mat4x4*>(transforms.mapped);
+    auto materialsOut = static_cast<uint32_t*>(materials.mapped);
+    for (uint32_t i = 0; i < visibleCount; i++)
     {
-        scene.cameraBuffers[i].map(device);
-        *static_cast<MvpMatrix*>(scene.cameraBuffers[i].mapped) = ubo;
-        scene.cameraBuffers[i].unmap(device);
+        const uint32_t index = instances.visible[i];
+        worldOut[i] = instances.world[index];
+        materialsOut[i] = instances.materials[index];
     }
+
+    instances.streams = {frameData.buffer.data, transforms.offset, materials.offset, visibleCount};
+}
+
+void ModelViewer::updateGpuCulling()
+{
+    gpuCull.ready = false;
+
+    const uint32_t count = instances.transforms.count();
+    auto transforms = frameData.allocate(gpuCull.capacity * sizeof(mat4x4), frameData.storageAlignment);
+    auto materials = frameData.allocate(gpuCull.capacity * sizeof(uint32_t), frameData.storageAlignment);
+    auto draws = frameData.allocate(gpuCull.drawsSize, sizeof(uint32_t));
+    if(transforms.mapped == nullptr || materials.mapped == nullptr || draws.mapped == nullptr)
+        return;
+
+    // The matrices go straight to the shader, no copy through instances.world
+    instances.transforms.computeWorldMatrices(threadPool, static_cast<mat4x4*>(transforms.mapped));
+    memcpy(materials.mapped, instances.materials, count * sizeof(uint32_t));
+
+    // Copied over the output draws before culling, counts at 0 and the commands of the model
+    auto header = static_cast<CullDrawHeader*>(draws.mapped);
+    *header = {};
+    models.object.writeDrawCommands(reinterpret_cast<VkDrawIndexedIndirectCommand*>(header + 1), 0);
+
+    const auto &box = models.object.bounds.box;
+    CullUniforms uniforms{};
+    uniforms.frustum = m_mainCamera.frustum();
+    uniforms.boxCentre = vec4((box.min + box.max) * 0.5f, 0.0f);
+    uniforms.boxExtent = vec4((box.max - box.min) * 0.5f, 0.0f);
+    uniforms.instanceCount = count;
+    uniforms.commandCount = models.object.drawCommandCount();
+    uniformOffsets.cull = frameData.push(uniforms);
+
+    gpuCull.inputOffsets[0] = uint32_t(transforms.offset);
+    gpuCull.inputOffsets[1] = uint32_t(materials.offset);
+    gpuCull.drawTemplate = draws.offset;
+    gpuCull.ready = true;
 }
 
 void ModelViewer::updateGui()
@@ -1500,6 +2720,18 @@ void ModelViewer::updateGui()
     stringBuffer.flush() << view("Device: ") << device.gpuProperties.deviceName;
     imgui.text(stringBuffer.getView(), vec2(5.0f, 90.0f));
 
+    // Frame pacing, times in milliseconds
+    const auto statLine = [this](const char *label, double value, float y)
+    {
+        imgui.text(label, vec2(5.0f, y));
+        imgui.textFloat(float(value), vec2(20.0f, y));
+    };
+    statLine("Frame:", frameStats.frameTime * 1000.0, 60.0f);
+    statLine("CPU:", frameStats.cpuTime * 1000.0, 64.0f);
+    statLine("GPU:", frameStats.gpuTime * 1000.0, 68.0f);
+    statLine("Wait:", frameStats.waitTime * 1000.0, 72.0f);
+    statLine("Overlap %:", frameStats.overlap * 100.0, 76.0f);
+
     if(imgui.button(vec2(2.0f, 80.0f), vec2(6.0f, 84.0f)))
     {
         //
@@ -1508,6 +2740,52 @@ void ModelViewer::updateGui()
     imgui.end();
 }
 
+void ModelViewer::recordGpuCulling(VkCommandBuffer cmdBuffer)
+{
+    const auto memoryBarrier = [cmdBuffer](VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+                                           VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(cmdBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    };
+
+    const auto &output = gpuCull.output[currentFrame];
+    auto region = vkInits::bufferCopy(gpuCull.drawsSize);
+    region.srcOffset = gpuCull.drawTemplate;
+    vkCmdCopyBuffer(cmdBuffer, frameData.buffer.data, output.data, 1, &region);
+
+    memoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    // Dynamic offsets follow binding order, uniforms, matrices then materials
+    const uint32_t offsets[] = {uniformOffsets.cull, gpuCull.inputOffsets[0], gpuCull.inputOffsets[1]};
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuCull.pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuCull.pipelineLayout, 0, 1,
+                            &gpuCull.descriptorSets[currentFrame], uint32_t(arraysize(offsets)), offsets);
+
+    const uint32_t instanceCount = instances.transforms.count();
+    const uint32_t passes[] = {0, 1};
+    if(instanceCount > 0)
+    {
+        vkCmdPushConstants(cmdBuffer, gpuCull.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &passes[0]);
+        vkCmdDispatch(cmdBuffer, (instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        memoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+
+    const uint32_t commandCount = models.object.drawCommandCount();
+    vkCmdPushConstants(cmdBuffer, gpuCull.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &passes[1]);
+    vkCmdDispatch(cmdBuffer, (commandCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    memoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+}
+
 void ModelViewer::recordFrame(VkCommandBuffer cmdBuffer)
 {
     VkClearValue clearValues[2];
@@ -1521,6 +2799,11 @@ void ModelViewer::recordFrame(VkCommandBuffer cmdBuffer)
     renderBeginInfo.clearValueCount = uint32_t(arraysize(clearValues));
 
     vkBeginCommandBuffer(cmdBuffer, &cmdBeginInfo);
+    beginGpuTimer(cmdBuffer);
+
+    // Outside the render pass, the draws below read what it writes
+    if(GPU_CULLING && gpuCull.ready)
+        recordGpuCulling(cmdBuffer);
 
     renderBeginInfo.framebuffer = framebuffers[imageIndex];
     vkCmdBeginRenderPass(cmdBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
@@ -1533,17 +2816,24 @@ void ModelViewer::recordFrame(VkCommandBuffer cmdBuffer)
                                 0,
                                 1,
                                 &skybox.descriptorSets[currentFrame],
-                                0,
-                                nullptr);
+                                1,
+                                &uniformOffsets.lights);
 
         const auto [stage, offset, size] = ModelViewMatrix::pushConstant();
         auto modelView = m_mainCamera.getModelView();
         vkCmdPushConstants(cmdBuffer, skybox.pipelineLayout, stage, offset, size, &modelView);
 
+        models.skyboxMeshes.bind(cmdBuffer);
         models.skybox.draw(cmdBuffer);
     }
 
+    // Nothing to record when every instance is out of view, the GPU path always records
+    // and lets the draw count decide
+    const bool drawObject = GPU_CULLING ? gpuCull.ready : instances.streams.count > 0;
+    if(drawObject)
     {
+        // Dynamic offsets follow binding order, camera then lights
+        const uint32_t sceneOffsets[] = {uniformOffsets.camera, uniformOffsets.lights};
         vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipeline);
         vkCmdBindDescriptorSets(cmdBuffer,
                                 VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -1551,15 +2841,27 @@ void ModelViewer::recordFrame(VkCommandBuffer cmdBuffer)
                                 0,
                                 1,
                                 &scene.descriptorSets[currentFrame],
-                                0,
-                                nullptr);
-
-        const auto [stage, offset, size] = Model3D::pushConstant();
-        vkCmdPushConstants(cmdBuffer, scene.pipelineLayout, stage, offset, size, &models.object.transform);
+                                uint32_t(arraysize(sceneOffsets)),
+                                sceneOffsets);
 
-        models.object.draw(cmdBuffer);
+        // Every Model3D draws from the one registry, bound once
+        models.meshes.bind(cmdBuffer);
+        models.object.pushDequantization(cmdBuffer, scene.pipelineLayout);
+        if(GPU_CULLING)
+        {
+            const auto &output = gpuCull.output[currentFrame];
+            models.object.bindInstances(cmdBuffer, {output.data, gpuCull.transforms, gpuCull.materials, gpuCull.capacity});
+            models.object.drawIndirect(cmdBuffer, output.data, sizeof(CullDrawHeader),
+                                       device.drawIndirectCount ? output.data : VK_NULL_HANDLE, 0,
+                                       device.multiDrawIndirect);
+        }
+        else
+        {
+            models.object.drawInstances(cmdBuffer, instances.streams);
+        }
     }
 
     vkCmdEndRenderPass(cmdBuffer);
+    endGpuTimer(cmdBuffer);
     vkEndCommandBuffer(cmdBuffer);
 }
\ No newline at end of file
@@ -8,6 +8,9 @@
 #include "backend/shader.hpp"
 #include "backend/camera.hpp"
 #include "backend/lights.hpp"
+#include "backend/ibl_bake.hpp"
+#include "backend/asset_loader.hpp"
+#include "backend/transform_store.hpp"
 
 class ModelViewer : public VulkanInstance
 {
@@ -28,52 +31,121 @@ public:
     void onScrollWheelEvent(double x, double y);
 
 private:
-    void generateBrdfLUT();
-    void generateIrradianceMap();
-    void generatePrefilteredMap();
+    // IBL products, these return true when the result was taken from the image cache
+    bool generateBrdfLUT();
+    bool generateIrradianceMap();
+    bool generatePrefilteredMap();
+    bool loadHDRSkybox(const char *filename);
+
+    void renderIrradianceMap(TextureCubeMap &target);
+    void renderPrefilteredMap(TextureCubeMap &target);
+    void filterCubemap(TextureCubeMap &target, const char *shaderName);
+    void benchmarkIblBake();
+
+    // Diffuse irradiance as L2 spherical harmonics, projected from the environment on the CPU
+    SH9 projectIrradianceSH();
+    void compareIrradianceSH(const SH9 &irradianceSH);
+
+    // Bakes target from the environment on the thread pool and uploads it
+    float *readbackEnvironment(); // RGBA32F faces, delete[] when done
+    void bakeCubemapCpu(TextureCubeMap &target, iblBake::cubemap_bake bake);
+    void benchmarkCpuBake();
+
+    // CPU mip chains against vkCmdBlitImage, uploads included
+    void benchmarkMipGeneration();
 
-    void loadHDRSkybox(const char *filename);
     void loadResources();
-    void buildUniformBuffers();
     void buildDescriptors();
+    void writeMaterialDescriptors(VkDescriptorSet set); // Placeholder for textures still loading
+    void updateAssets();
     void buildPipelines(); // TODO(arle): split into pipeline & layout
     // pipelinelayout does not need to be recreated upon window resize event
 
+    void buildInstances(UploadBatch &upload); // Placement and material of every copy of the object
+    void buildGpuCulling(); // Pipeline, descriptors and output buffers of instance_cull.comp
     void updateCamera(float dt);
+    void updateInstances(); // World matrices, culling and this frame's instance streams
+    void updateGpuCulling(); // World matrices and draw templates for instance_cull.comp
     void updateGui();
+    void recordGpuCulling(VkCommandBuffer cmdBuffer);
     void recordFrame(VkCommandBuffer cmdBuffer);
     // TODO(arle): remove m_ prefix
     VkCommandBuffer         m_commands[2];
     Camera                  m_mainCamera;
     SceneLight              m_lights;
+    ThreadPool              threadPool;
+    AssetLoader             assetLoader;
+
+    struct
+    {
+        uint32_t                camera;
+        uint32_t                lights;
+        uint32_t                cull;
+    }uniformOffsets; // Dynamic offsets into frameData for the current frame
     VkDescriptorPool        m_descriptorPool;
     VulkanImgui&            imgui;
     StringBuilder           stringBuffer;
 
     struct ModelAssets
     {
+        MeshRegistry            meshes;         // OBJECT_VERTEX_FORMAT layout
+        MeshRegistry            skyboxMeshes;   // CubemapModel::Vertex layout
         Model3D                 object;
         CubemapModel            skybox;
     }models;
 
+    // Copies of models.object, all drawn with one instanced draw per primitive
+    struct
+    {
+        TransformStore              transforms;
+        uint32_t*                   materials;  // Index into the MaterialTable per instance
+        mat4x4*                     world;      // This frame's world matrices
+        float*                      bounds;     // World boxes, centre then half size arrays
+        uint32_t*                   visible;
+        Model3D::InstanceStreams    streams;    // The visible instances, in frameData
+    }instances;
+    VulkanBuffer                materialTable;  // MaterialTable, written once by buildInstances
+
+    // Culling on the GPU, the visible instances and their draw commands are written to a
+    // device local buffer per frame in flight: the draws, then the matrices, then materials
+    struct GpuCulling
+    {
+        VkPipeline              pipeline;
+        VkPipelineLayout        pipelineLayout;
+        ComputeShader           shader;
+        VkDescriptorSetLayout   setLayout;
+        VkDescriptorSet         descriptorSets[MAX_IMAGES_IN_FLIGHT];
+        VulkanBuffer            output[MAX_IMAGES_IN_FLIGHT];
+        VkDeviceSize            drawsSize;      // Header and commands
+        VkDeviceSize            transforms;     // Offsets of the streams in output
+        VkDeviceSize            materials;
+        uint32_t                capacity;       // Instances the inputs and outputs have room for
+        uint32_t                inputOffsets[2]; // This frame's matrices and materials in frameData
+        VkDeviceSize            drawTemplate;   // This frame's zeroed draws in frameData
+        bool                    ready;          // Inputs were written this frame
+    }gpuCull;
+
     struct TextureAssets
     {
         Texture2D               albedo;
         Texture2D               normal;
-        Texture2D               roughness;
-        Texture2D               metallic;
-        Texture2D               ao;
+        Texture2D               orm;            // Occlusion, roughness, metallic
+        Texture2D               placeholder;
         TextureCubeMap          environment;
     }textures;
 
+    asset_handle                materialLoads[3];   // Albedo, normal, orm
+    uint32_t                    staleMaterialSets;  // Scene sets still pointing at placeholders
+
     TextureCubeMap              irradiance;
     TextureCubeMap              prefiltered;
+    uint64_t                    environmentKey; // Content hash of the source HDR and HDR_SOURCE_FORMAT
 
     struct
     {
         VkImage                 image;
         VkImageView             view;
-        VkDeviceMemory          memory;
+        MemoryAllocation        memory;
         VkSampler               sampler;
         VkDescriptorImageInfo   descriptor;
     }brdf;
@@ -86,7 +158,6 @@ private:
         FragmentShader          fragmentShader;
         VkDescriptorSetLayout   setLayout;
         VkDescriptorSet         descriptorSets[MAX_IMAGES_IN_FLIGHT];
-        VulkanBuffer            cameraBuffers[MAX_IMAGES_IN_FLIGHT];
     }scene;
 
     struct Skybox
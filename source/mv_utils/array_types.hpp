@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 template<typename T, int N>
 constexpr size_t arraysize(T (&array)[N]) { return N; }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Instruction sets past the SSE2 every x86-64 processor has, checked once at runtime. Code
+// for them lives in functions marked with the TARGET_ macros, which MSVC does not need
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX
+#define TARGET_F16C
+#else
+#define TARGET_AVX __attribute__((target("avx")))
+#define TARGET_F16C __attribute__((target("f16c")))
+#endif
+
+struct cpu_features
+{
+    bool avx;
+    bool f16c;
+};
+
+namespace cpu
+{
+    inline cpu_features Detect()
+    {
+        uint32_t ecx = 0;
+        uint64_t xcr0 = 0;
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        ecx = uint32_t(info[2]);
+        if(ecx & (1u << 27))
+            xcr0 = _xgetbv(0);
+#else
+        uint32_t eax, ebx, edx;
+        if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            return {};
+        if(ecx & (1u << 27))
+        {
+            uint32_t low, high;
+            __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+            xcr0 = (uint64_t(high) << 32) | low;
+        }
+#endif
+
+        // NOTE(arle): AVX and F16C instructions are VEX encoded, they fault unless the OS
+        // saves the YMM state (OSXSAVE, then XMM and YMM enabled in XCR0)
+        const bool vex = (xcr0 & 6) == 6;
+
+        cpu_features features;
+        features.avx = vex && (ecx & (1u << 28)) != 0;
+        features.f16c = features.avx && (ecx & (1u << 29)) != 0;
+        return features;
+    }
+
+    inline const cpu_features &Features()
+    {
+        static const cpu_features features = Detect();
+        return features;
+    }
+}
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "utilities.hpp"
+
+// Minimal JSON reader for asset manifests (glTF). The text is tokenised in place: tokens
+// reference byte ranges of the source, nothing is copied or unescaped, so the source has
+// to outlive the document. Tokens are stored depth first, a container's children follow it
+// directly and next points past its whole subtree.
+
+namespace json
+{
+    enum class type : uint8_t
+    {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object
+    };
+
+    struct token
+    {
+        type        kind;
+        uint32_t    start;      // Strings exclude the quotes
+        uint32_t    end;
+        uint32_t    children;   // Elements of an array, key/value pairs of an object
+        uint32_t    next;       // Index of the first token after this subtree
+    };
+
+    struct document
+    {
+        const char  *text;
+        token       *tokens;
+        uint32_t    count;
+    };
+
+    constexpr int32_t INVALID = -1;
+    constexpr uint32_t MAX_DEPTH = 64;
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool Parse(const char *text, size_t length, document &doc)
+    {
+        doc = {};
+        doc.text = text;
+        if(length >= UINT32_MAX)
+            return false;
+
+        uint32_t capacity = 256;
+        doc.tokens = new token[capacity];
+
+        auto push = [&](type kind, uint32_t start) -> uint32_t
+        {
+            if(doc.count == capacity)
+            {
+                auto grown = new token[capacity * 2];
+                memcpy(grown, doc.tokens, sizeof(token) * capacity);
+                delete[] doc.tokens;
+                doc.tokens = grown;
+                capacity *= 2;
+            }
+            doc.tokens[doc.count] = {kind, start, start, 0, 0};
+            return doc.count++;
+        };
+
+        enum class expect {value, key, colon, separator};
+
+        uint32_t stack[MAX_DEPTH];
+        uint32_t depth = 0;
+        auto state = expect::value;
+        bool done = false;
+
+        // A finished value closes the document at depth 0 and counts towards an enclosing array
+        auto valueDone = [&]()
+        {
+            if(depth > 0 && doc.tokens[stack[depth - 1]].kind == type::array)
+                doc.tokens[stack[depth - 1]].children++;
+            state = expect::separator;
+            done = depth == 0;
+        };
+
+        size_t i = 0;
+        while (i < length)
+        {
+            const char c = text[i];
+            if(IsSpace(c))
+            {
+                i++;
+                continue;
+            }
+            if(done)
+                break;
+
+            if(c == '{' || c == '[')
+            {
+                if(state != expect::value || depth == MAX_DEPTH)
+                    break;
+
+                stack[depth++] = push(c == '{' ? type::object : type::array, uint32_t(i));
+                state = c == '{' ? expect::key : expect::value;
+                i++;
+            }
+            else if(c == '}' || c == ']')
+            {
+                if(depth == 0)
+                    break;
+
+                auto &container = doc.tokens[stack[depth - 1]];
+                if(container.kind != (c == '}' ? type::object : type::array))
+                    break;
+                // Empty containers close right after opening, otherwise only after a value
+                const bool empty = container.children == 0 && uint32_t(doc.count - 1) == stack[depth - 1];
+                if(state != expect::separator && !empty)
+                    break;
+
+                container.end = uint32_t(i + 1);
+                container.next = doc.count;
+                depth--;
+                i++;
+                valueDone();
+            }
+            else if(c == ',')
+            {
+                if(depth == 0 || state != expect::separator)
+                    break;
+
+                state = doc.tokens[stack[depth - 1]].kind == type::object ? expect::key : expect::value;
+                i++;
+            }
+            else if(c == ':')
+            {
+                if(state != expect::colon)
+                    break;
+
+                state = expect::value;
+                i++;
+            }
+            else if(c == '"')
+            {
+                if(state != expect::key && state != expect::value)
+                    break;
+
+                size_t end = i + 1;
+                while (end < length && text[end] != '"')
+                    end += text[end] == '\\' ? 2 : 1;
+                if(end >= length)
+                    break;
+
+                const auto t = push(type::string, uint32_t(i + 1));
+                doc.tokens[t].end = uint32_t(end);
+                doc.tokens[t].next = t + 1;
+                i = end + 1;
+
+                // Keys count towards the object's pairs, the value that follows does not
+                if(state == expect::key)
+                {
+                    doc.tokens[stack[depth - 1]].children++;
+                    state = expect::colon;
+                }
+                else
+                {
+                    valueDone();
+                }
+            }
+            else
+            {
+                if(state != expect::value)
+                    break;
+
+                size_t end = i;
+                type kind;
+                if(c == '-' || IsDigit(c))
+                {
+                    kind = type::number;
+                    while (end < length && (IsDigit(text[end]) || text[end] == '-' || text[end] == '+' ||
+                                            text[end] == '.' || text[end] == 'e' || text[end] == 'E'))
+                        end++;
+                }
+                else if(length - i >= 4 && memcmp(text + i, "true", 4) == 0)
+                {
+                    kind = type::boolean;
+                    end += 4;
+                }
+                else if(length - i >= 5 && memcmp(text + i, "false", 5) == 0)
+                {
+                    kind = type::boolean;
+                    end += 5;
+                }
+                else if(length - i >= 4 && memcmp(text + i, "null", 4) == 0)
+                {
+                    kind = type::null;
+                    end += 4;
+                }
+                else
+                {
+                    break;
+                }
+
+                const auto t = push(kind, uint32_t(i));
+                doc.tokens[t].end = uint32_t(end);
+                doc.tokens[t].next = t + 1;
+                i = end;
+                valueDone();
+            }
+        }
+
+        if(!done)
+        {
+            delete[] doc.tokens;
+            doc.tokens = nullptr;
+            doc.count = 0;
+        }
+        return done;
+    }
+
+    inline void Free(document &doc)
+    {
+        delete[] doc.tokens;
+        doc = {};
+    }
+
+    inline bool Equals(const document &doc, int32_t t, const char *string)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::string)
+            return false;
+
+        const auto &tok = doc.tokens[t];
+        const size_t length = strlen(string);
+        return tok.end - tok.start == length && memcmp(doc.text + tok.start, string, length) == 0;
+    }
+
+    // Value of key in an object, INVALID if t is not an object or has no such key
+    inline int32_t Find(const document &doc, int32_t t, const char *key)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::object)
+            return INVALID;
+
+        uint32_t child = uint32_t(t) + 1;
+        for (uint32_t i = 0; i < doc.tokens[t].children; i++)
+        {
+            const auto value = child + 1;
+            if(Equals(doc, int32_t(child), key))
+                return int32_t(value);
+            child = doc.tokens[value].next;
+        }
+        return INVALID;
+    }
+
+    // Element of an array, INVALID if t is not an array or index is out of range
+    inline int32_t At(const document &doc, int32_t t, uint32_t index)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::array || index >= doc.tokens[t].children)
+            return INVALID;
+
+        uint32_t child = uint32_t(t) + 1;
+        for (uint32_t i = 0; i < index; i++)
+            child = doc.tokens[child].next;
+        return int32_t(child);
+    }
+
+    // Elements of an array, pairs of an object, 0 otherwise
+    inline uint32_t Count(const document &doc, int32_t t)
+    {
+        if(t == INVALID || (doc.tokens[t].kind != type::array && doc.tokens[t].kind != type::object))
+            return 0;
+        return doc.tokens[t].children;
+    }
+
+    // First element of an array and the one after element, used to walk arrays without
+    // At's linear search
+    inline int32_t First(const document &doc, int32_t t)
+    {
+        return Count(doc, t) > 0 ? t + 1 : INVALID;
+    }
+
+    inline int32_t Next(const document &doc, int32_t t)
+    {
+        return int32_t(doc.tokens[t].next);
+    }
+
+    inline double Number(const document &doc, int32_t t, double fallback = 0.0)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::number)
+            return fallback;
+
+        const char *c = doc.text + doc.tokens[t].start;
+        const char *end = doc.text + doc.tokens[t].end;
+
+        double sign = 1.0;
+        if(*c == '-')
+        {
+            sign = -1.0;
+            c++;
+        }
+
+        double value = 0.0;
+        while (c < end && IsDigit(*c))
+            value = value * 10.0 + double(*c++ - '0');
+
+        if(c < end && *c == '.')
+        {
+            c++;
+            double scale = 0.1;
+            while (c < end && IsDigit(*c))
+            {
+                value += double(*c++ - '0') * scale;
+                scale *= 0.1;
+            }
+        }
+
+        if(c < end && (*c == 'e' || *c == 'E'))
+        {
+            c++;
+            int32_t exponentSign = 1;
+            if(c < end && (*c == '-' || *c == '+'))
+                exponentSign = *c++ == '-' ? -1 : 1;
+
+            int32_t exponent = 0;
+            while (c < end && IsDigit(*c))
+                exponent = min(exponent * 10 + (*c++ - '0'), 400);
+
+            const double base = exponentSign > 0 ? 10.0 : 0.1;
+            for (int32_t i = 0; i < exponent; i++)
+                value *= base;
+        }
+        return sign * value;
+    }
+
+    inline int64_t Integer(const document &doc, int32_t t, int64_t fallback = 0)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::number)
+            return fallback;
+        return int64_t(Number(doc, t));
+    }
+
+    inline bool Boolean(const document &doc, int32_t t, bool fallback = false)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::boolean)
+            return fallback;
+        return doc.text[doc.tokens[t].start] == 't';
+    }
+
+    // Raw string bytes, escapes are left as they are
+    inline view<const char> String(const document &doc, int32_t t)
+    {
+        if(t == INVALID || doc.tokens[t].kind != type::string)
+            return view<const char>(nullptr, 0);
+        return view(doc.text + doc.tokens[t].start, size_t(doc.tokens[t].end - doc.tokens[t].start));
+    }
+}
\ No newline at end of file
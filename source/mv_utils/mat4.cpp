@@ -0,0 +1,127 @@
+#include "mat4.hpp"
+#include "cpu_features.hpp"
+#include <immintrin.h>
+
+template<bool POINTS>
+static void TransformScalar(mat4x4 mat, const vec3<float> *input, size_t count, vec3<float> *out)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = POINTS ? mat4Scalar::transformPoint(input[i], mat) : mat4Scalar::transformDirection(input[i], mat);
+}
+
+template<bool POINTS>
+static void TransformSSE(mat4x4 mat, const vec3<float> *input, size_t count, vec3<float> *out)
+{
+    const __m128 r0 = _mm_load_ps(mat.row(0));
+    const __m128 r1 = _mm_load_ps(mat.row(1));
+    const __m128 r2 = _mm_load_ps(mat.row(2));
+    const __m128 r3 = POINTS ? _mm_load_ps(mat.row(3)) : _mm_setzero_ps();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const vec3<float> v = input[i];
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(v.x), r0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(v.y), r1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(v.z), r2));
+        if(POINTS)
+            sum = _mm_add_ps(sum, r3);
+
+        // x and y as a pair, z on its own, the fourth lane must not touch the next element
+        auto target = reinterpret_cast<float*>(out + i);
+        _mm_storel_pi(reinterpret_cast<__m64*>(target), sum);
+        _mm_store_ss(target + 2, _mm_movehl_ps(sum, sum));
+    }
+}
+
+// NOTE(arle): Eight packed vec3 are three registers of x0y0z0x1 y1z1x2y2 z2x3y3z3 with the
+// next four points in the high halves. Two rounds of in-lane shuffles sort them into one
+// register per axis and the same in reverse packs them again, after which each axis is a
+// plain multiply-add against broadcast matrix elements
+template<bool POINTS>
+TARGET_AVX static void TransformAVX(mat4x4 mat, const vec3<float> *input, size_t count, vec3<float> *out)
+{
+    const __m256 m00 = _mm256_set1_ps(mat(0, 0)), m01 = _mm256_set1_ps(mat(0, 1)), m02 = _mm256_set1_ps(mat(0, 2));
+    const __m256 m10 = _mm256_set1_ps(mat(1, 0)), m11 = _mm256_set1_ps(mat(1, 1)), m12 = _mm256_set1_ps(mat(1, 2));
+    const __m256 m20 = _mm256_set1_ps(mat(2, 0)), m21 = _mm256_set1_ps(mat(2, 1)), m22 = _mm256_set1_ps(mat(2, 2));
+    const __m256 m30 = _mm256_set1_ps(mat(3, 0)), m31 = _mm256_set1_ps(mat(3, 1)), m32 = _mm256_set1_ps(mat(3, 2));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const float *source = reinterpret_cast<const float*>(input + i);
+        __m256 m03 = _mm256_castps128_ps256(_mm_loadu_ps(source));
+        __m256 m14 = _mm256_castps128_ps256(_mm_loadu_ps(source + 4));
+        __m256 m25 = _mm256_castps128_ps256(_mm_loadu_ps(source + 8));
+        m03 = _mm256_insertf128_ps(m03, _mm_loadu_ps(source + 12), 1);
+        m14 = _mm256_insertf128_ps(m14, _mm_loadu_ps(source + 16), 1);
+        m25 = _mm256_insertf128_ps(m25, _mm_loadu_ps(source + 20), 1);
+
+        const __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+        const __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+        const __m256 x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+        const __m256 y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256 z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+
+        __m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m00), _mm256_mul_ps(y, m10)), _mm256_mul_ps(z, m20));
+        __m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m01), _mm256_mul_ps(y, m11)), _mm256_mul_ps(z, m21));
+        __m256 tz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m02), _mm256_mul_ps(y, m12)), _mm256_mul_ps(z, m22));
+        if(POINTS)
+        {
+            tx = _mm256_add_ps(tx, m30);
+            ty = _mm256_add_ps(ty, m31);
+            tz = _mm256_add_ps(tz, m32);
+        }
+
+        const __m256 rxy = _mm256_shuffle_ps(tx, ty, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 ryz = _mm256_shuffle_ps(ty, tz, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 rzx = _mm256_shuffle_ps(tz, tx, _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256 r03 = _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 r14 = _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256 r25 = _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1));
+
+        float *target = reinterpret_cast<float*>(out + i);
+        _mm_storeu_ps(target, _mm256_castps256_ps128(r03));
+        _mm_storeu_ps(target + 4, _mm256_castps256_ps128(r14));
+        _mm_storeu_ps(target + 8, _mm256_castps256_ps128(r25));
+        _mm_storeu_ps(target + 12, _mm256_extractf128_ps(r03, 1));
+        _mm_storeu_ps(target + 16, _mm256_extractf128_ps(r14, 1));
+        _mm_storeu_ps(target + 20, _mm256_extractf128_ps(r25, 1));
+    }
+
+    TransformSSE<POINTS>(mat, input + i, count - i, out + i);
+}
+
+static simd_path Resolve(simd_path path)
+{
+    if(path == simd_path::best || (path == simd_path::avx && !cpu::Features().avx))
+        return cpu::Features().avx ? simd_path::avx : simd_path::sse;
+    return path;
+}
+
+template<bool POINTS>
+static void Transform(mat4x4 mat, const vec3<float> *input, size_t count, vec3<float> *out, simd_path path)
+{
+    switch (Resolve(path))
+    {
+        case simd_path::scalar:
+            TransformScalar<POINTS>(mat, input, count, out);
+            break;
+        case simd_path::avx:
+            TransformAVX<POINTS>(mat, input, count, out);
+            break;
+        default:
+            TransformSSE<POINTS>(mat, input, count, out);
+            break;
+    }
+}
+
+void transformPoints(mat4x4 mat, const vec3<float> *points, size_t count, vec3<float> *out, simd_path path)
+{
+    Transform<true>(mat, points, count, out, path);
+}
+
+void transformDirections(mat4x4 mat, const vec3<float> *directions, size_t count, vec3<float> *out,
+                         simd_path path)
+{
+    Transform<false>(mat, directions, count, out, path);
+}
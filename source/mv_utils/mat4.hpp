@@ -1,14 +1,18 @@
 #pragma once
 
 #include "vec.hpp"
-#include <xmmintrin.h>
+#include <stddef.h>
+#include <emmintrin.h>
 
 // NOTE(arle): Translate - Rotate - Scale
+//
+// data[i] is row i of a matrix that row vectors are multiplied with, v * a * b applies a
+// and then b. In memory that is the column major layout GLSL reads, where the same product
+// is written b * a * v. Products, inverse, transpose and transforms run on SSE with a row
+// per register, mat4Scalar keeps the scalar versions as the reference and fallback. Defining
+// VECTOR_SCALAR makes the operators use them.
 
-struct mat4x4;
-constexpr mat4x4 VECTOR_API operator*(mat4x4 a, mat4x4 b);
-
-struct mat4x4
+struct alignas(16) mat4x4
 {
     mat4x4() = default;
 
@@ -39,6 +43,21 @@ struct mat4x4
         return data[x][y];
     }
 
+    constexpr float operator()(size_t x, size_t y) const
+    {
+        return data[x][y];
+    }
+
+    float *row(size_t i)
+    {
+        return data[i];
+    }
+
+    const float *row(size_t i) const
+    {
+        return data[i];
+    }
+
     static mat4x4 VECTOR_API translate(vec3<float> t)
     {
         auto result = identity();
@@ -168,29 +187,268 @@ private:
     float data[4][4];
 };
 
-constexpr mat4x4 VECTOR_API operator*(mat4x4 a, mat4x4 b)
+namespace mat4Scalar
 {
-    mat4x4 result;
-    result(0, 0) = a(0, 0) * b(0, 0) + a(0, 1) * b(1, 0) + a(0, 2) * b(2, 0) + a(0, 3) * b(3, 0);
-    result(1, 0) = a(1, 0) * b(0, 0) + a(1, 1) * b(1, 0) + a(1, 2) * b(2, 0) + a(1, 3) * b(3, 0);
-    result(2, 0) = a(2, 0) * b(0, 0) + a(2, 1) * b(1, 0) + a(2, 2) * b(2, 0) + a(3, 3) * b(3, 0);
-    result(3, 0) = a(3, 0) * b(0, 0) + a(3, 1) * b(1, 0) + a(3, 2) * b(2, 0) + a(3, 3) * b(3, 0);
-
-    result(0, 1) = a(0, 0) * b(0, 1) + a(0, 1) * b(1, 1) + a(0, 2) * b(2, 1) + a(0, 3) * b(3, 1);
-    result(1, 1) = a(1, 0) * b(0, 1) + a(1, 1) * b(1, 1) + a(1, 2) * b(2, 1) + a(1, 3) * b(3, 1);
-    result(2, 1) = a(2, 0) * b(0, 1) + a(2, 1) * b(1, 1) + a(2, 2) * b(2, 1) + a(3, 3) * b(3, 1);
-    result(3, 1) = a(3, 0) * b(0, 1) + a(3, 1) * b(1, 1) + a(3, 2) * b(2, 1) + a(3, 3) * b(3, 1);
-
-    result(0, 2) = a(0, 0) * b(0, 2) + a(0, 1) * b(1, 2) + a(0, 2) * b(2, 2) + a(0, 3) * b(3, 2);
-    result(1, 2) = a(1, 0) * b(0, 2) + a(1, 1) * b(1, 2) + a(1, 2) * b(2, 2) + a(1, 3) * b(3, 2);
-    result(2, 2) = a(2, 0) * b(0, 2) + a(2, 1) * b(1, 2) + a(2, 2) * b(2, 2) + a(3, 3) * b(3, 2);
-    result(3, 2) = a(3, 0) * b(0, 2) + a(3, 1) * b(1, 2) + a(3, 2) * b(2, 2) + a(3, 3) * b(3, 2);
-
-    result(0, 3) = a(0, 0) * b(0, 3) + a(0, 1) * b(1, 3) + a(0, 2) * b(2, 3) + a(0, 3) * b(3, 3);
-    result(1, 3) = a(1, 0) * b(0, 3) + a(1, 1) * b(1, 3) + a(1, 2) * b(2, 3) + a(1, 3) * b(3, 3);
-    result(2, 3) = a(2, 0) * b(0, 3) + a(2, 1) * b(1, 3) + a(2, 2) * b(2, 3) + a(2, 3) * b(3, 3);
-    result(3, 3) = a(3, 0) * b(0, 3) + a(3, 1) * b(1, 3) + a(3, 2) * b(2, 3) + a(3, 3) * b(3, 3);
-    return result;
+    inline mat4x4 VECTOR_API multiply(mat4x4 a, mat4x4 b)
+    {
+        mat4x4 result;
+        for (size_t i = 0; i < 4; i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+                result(i, j) = a(i, 0) * b(0, j) + a(i, 1) * b(1, j) + a(i, 2) * b(2, j) + a(i, 3) * b(3, j);
+        }
+        return result;
+    }
+
+    inline mat4x4 VECTOR_API transpose(mat4x4 m)
+    {
+        mat4x4 result;
+        for (size_t i = 0; i < 4; i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+                result(i, j) = m(j, i);
+        }
+        return result;
+    }
+
+    // Adjugate over the determinant, cofactors from 2x2 minors of the top and bottom rows.
+    // Singular matrices give non-finite results
+    inline mat4x4 VECTOR_API inverse(mat4x4 m)
+    {
+        const float s0 = m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1);
+        const float s1 = m(0, 0) * m(1, 2) - m(1, 0) * m(0, 2);
+        const float s2 = m(0, 0) * m(1, 3) - m(1, 0) * m(0, 3);
+        const float s3 = m(0, 1) * m(1, 2) - m(1, 1) * m(0, 2);
+        const float s4 = m(0, 1) * m(1, 3) - m(1, 1) * m(0, 3);
+        const float s5 = m(0, 2) * m(1, 3) - m(1, 2) * m(0, 3);
+
+        const float c5 = m(2, 2) * m(3, 3) - m(3, 2) * m(2, 3);
+        const float c4 = m(2, 1) * m(3, 3) - m(3, 1) * m(2, 3);
+        const float c3 = m(2, 1) * m(3, 2) - m(3, 1) * m(2, 2);
+        const float c2 = m(2, 0) * m(3, 3) - m(3, 0) * m(2, 3);
+        const float c1 = m(2, 0) * m(3, 2) - m(3, 0) * m(2, 2);
+        const float c0 = m(2, 0) * m(3, 1) - m(3, 0) * m(2, 1);
+
+        const float invDet = 1.0f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+        mat4x4 result;
+        result(0, 0) = ( m(1, 1) * c5 - m(1, 2) * c4 + m(1, 3) * c3) * invDet;
+        result(0, 1) = (-m(0, 1) * c5 + m(0, 2) * c4 - m(0, 3) * c3) * invDet;
+        result(0, 2) = ( m(3, 1) * s5 - m(3, 2) * s4 + m(3, 3) * s3) * invDet;
+        result(0, 3) = (-m(2, 1) * s5 + m(2, 2) * s4 - m(2, 3) * s3) * invDet;
+
+        result(1, 0) = (-m(1, 0) * c5 + m(1, 2) * c2 - m(1, 3) * c1) * invDet;
+        result(1, 1) = ( m(0, 0) * c5 - m(0, 2) * c2 + m(0, 3) * c1) * invDet;
+        result(1, 2) = (-m(3, 0) * s5 + m(3, 2) * s2 - m(3, 3) * s1) * invDet;
+        result(1, 3) = ( m(2, 0) * s5 - m(2, 2) * s2 + m(2, 3) * s1) * invDet;
+
+        result(2, 0) = ( m(1, 0) * c4 - m(1, 1) * c2 + m(1, 3) * c0) * invDet;
+        result(2, 1) = (-m(0, 0) * c4 + m(0, 1) * c2 - m(0, 3) * c0) * invDet;
+        result(2, 2) = ( m(3, 0) * s4 - m(3, 1) * s2 + m(3, 3) * s0) * invDet;
+        result(2, 3) = (-m(2, 0) * s4 + m(2, 1) * s2 - m(2, 3) * s0) * invDet;
+
+        result(3, 0) = (-m(1, 0) * c3 + m(1, 1) * c1 - m(1, 2) * c0) * invDet;
+        result(3, 1) = ( m(0, 0) * c3 - m(0, 1) * c1 + m(0, 2) * c0) * invDet;
+        result(3, 2) = (-m(3, 0) * s3 + m(3, 1) * s1 - m(3, 2) * s0) * invDet;
+        result(3, 3) = ( m(2, 0) * s3 - m(2, 1) * s1 + m(2, 2) * s0) * invDet;
+        return result;
+    }
+
+    inline vec4<float> VECTOR_API transform(vec4<float> v, mat4x4 m)
+    {
+        return vec4(v.x * m(0, 0) + v.y * m(1, 0) + v.z * m(2, 0) + v.w * m(3, 0),
+                    v.x * m(0, 1) + v.y * m(1, 1) + v.z * m(2, 1) + v.w * m(3, 1),
+                    v.x * m(0, 2) + v.y * m(1, 2) + v.z * m(2, 2) + v.w * m(3, 2),
+                    v.x * m(0, 3) + v.y * m(1, 3) + v.z * m(2, 3) + v.w * m(3, 3));
+    }
+
+    // w of 1, translated. Projections are not divided through
+    inline vec3<float> VECTOR_API transformPoint(vec3<float> p, mat4x4 m)
+    {
+        return vec3(p.x * m(0, 0) + p.y * m(1, 0) + p.z * m(2, 0) + m(3, 0),
+                    p.x * m(0, 1) + p.y * m(1, 1) + p.z * m(2, 1) + m(3, 1),
+                    p.x * m(0, 2) + p.y * m(1, 2) + p.z * m(2, 2) + m(3, 2));
+    }
+
+    // w of 0, not translated
+    inline vec3<float> VECTOR_API transformDirection(vec3<float> d, mat4x4 m)
+    {
+        return vec3(d.x * m(0, 0) + d.y * m(1, 0) + d.z * m(2, 0),
+                    d.x * m(0, 1) + d.y * m(1, 1) + d.z * m(2, 1),
+                    d.x * m(0, 2) + d.y * m(1, 2) + d.z * m(2, 2));
+    }
+}
+
+// Same functions and results on SSE2. Lanes add in the scalar order, products and transforms
+// match mat4Scalar bit for bit
+namespace mat4Simd
+{
+    inline __m128 VECTOR_API Splat(__m128 v, int lane)
+    {
+        switch (lane)
+        {
+            case 0: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+            case 1: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+            case 2: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+            default: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+    }
+
+    // Row vector times the rows of m, in the scalar order
+    inline __m128 VECTOR_API Combine(__m128 v, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+    {
+        __m128 sum = _mm_mul_ps(Splat(v, 0), r0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(Splat(v, 1), r1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(Splat(v, 2), r2));
+        return _mm_add_ps(sum, _mm_mul_ps(Splat(v, 3), r3));
+    }
+
+    inline mat4x4 VECTOR_API multiply(mat4x4 a, mat4x4 b)
+    {
+        const __m128 b0 = _mm_load_ps(b.row(0));
+        const __m128 b1 = _mm_load_ps(b.row(1));
+        const __m128 b2 = _mm_load_ps(b.row(2));
+        const __m128 b3 = _mm_load_ps(b.row(3));
+
+        mat4x4 result;
+        for (size_t i = 0; i < 4; i++)
+            _mm_store_ps(result.row(i), Combine(_mm_load_ps(a.row(i)), b0, b1, b2, b3));
+        return result;
+    }
+
+    inline mat4x4 VECTOR_API transpose(mat4x4 m)
+    {
+        __m128 r0 = _mm_load_ps(m.row(0));
+        __m128 r1 = _mm_load_ps(m.row(1));
+        __m128 r2 = _mm_load_ps(m.row(2));
+        __m128 r3 = _mm_load_ps(m.row(3));
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        mat4x4 result;
+        _mm_store_ps(result.row(0), r0);
+        _mm_store_ps(result.row(1), r1);
+        _mm_store_ps(result.row(2), r2);
+        _mm_store_ps(result.row(3), r3);
+        return result;
+    }
+
+    // 2x2 blocks held as (m00, m01, m10, m11). Product, adjugate times and times adjugate
+    inline __m128 VECTOR_API Mat2Mul(__m128 a, __m128 b)
+    {
+        return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+                                     _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+    }
+
+    inline __m128 VECTOR_API Mat2AdjMul(__m128 a, __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)),
+                                     _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    inline __m128 VECTOR_API Mat2MulAdj(__m128 a, __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+                                     _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+    }
+
+    // Blockwise inverse of [A B; C D] through the 2x2 adjugates, a handful of shuffles
+    // instead of 16 cofactors. Singular matrices give non-finite results
+    inline mat4x4 VECTOR_API inverse(mat4x4 m)
+    {
+        const __m128 r0 = _mm_load_ps(m.row(0));
+        const __m128 r1 = _mm_load_ps(m.row(1));
+        const __m128 r2 = _mm_load_ps(m.row(2));
+        const __m128 r3 = _mm_load_ps(m.row(3));
+
+        const __m128 A = _mm_movelh_ps(r0, r1);
+        const __m128 B = _mm_movehl_ps(r1, r0);
+        const __m128 C = _mm_movelh_ps(r2, r3);
+        const __m128 D = _mm_movehl_ps(r3, r2);
+
+        // Determinants of the blocks as (|A|, |B|, |C|, |D|)
+        const __m128 detSub = _mm_sub_ps(
+            _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+            _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+        const __m128 detA = Splat(detSub, 0);
+        const __m128 detB = Splat(detSub, 1);
+        const __m128 detC = Splat(detSub, 2);
+        const __m128 detD = Splat(detSub, 3);
+
+        const __m128 adjDC = Mat2AdjMul(D, C);
+        const __m128 adjAB = Mat2AdjMul(A, B);
+
+        // Adjugates of the result blocks, X = |D|A - B(D#C), Y = |B|C - D(A#B)#,
+        // Z = |C|B - A(D#C)#, W = |A|D - C(A#B)
+        __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, adjDC));
+        __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, adjAB));
+        __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, adjAB));
+        __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, adjDC));
+
+        // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+        __m128 trace = _mm_mul_ps(adjAB, _mm_shuffle_ps(adjDC, adjDC, _MM_SHUFFLE(3, 1, 2, 0)));
+        trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(2, 3, 0, 1)));
+        trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(1, 0, 3, 2)));
+        const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+
+        const __m128 invDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+        X = _mm_mul_ps(X, invDet);
+        Y = _mm_mul_ps(Y, invDet);
+        Z = _mm_mul_ps(Z, invDet);
+        W = _mm_mul_ps(W, invDet);
+
+        // The shuffles apply the adjugate and put the blocks back into rows
+        mat4x4 result;
+        _mm_store_ps(result.row(0), _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+        _mm_store_ps(result.row(1), _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+        _mm_store_ps(result.row(2), _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+        _mm_store_ps(result.row(3), _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+        return result;
+    }
+
+    inline vec4<float> VECTOR_API transform(vec4<float> v, mat4x4 m)
+    {
+        alignas(16) float out[4];
+        _mm_store_ps(out, Combine(_mm_setr_ps(v.x, v.y, v.z, v.w), _mm_load_ps(m.row(0)), _mm_load_ps(m.row(1)),
+                                  _mm_load_ps(m.row(2)), _mm_load_ps(m.row(3))));
+        return vec4(out[0], out[1], out[2], out[3]);
+    }
+
+    inline vec3<float> VECTOR_API transformPoint(vec3<float> p, mat4x4 m)
+    {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(p.x), _mm_load_ps(m.row(0)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(p.y), _mm_load_ps(m.row(1))));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(p.z), _mm_load_ps(m.row(2))));
+        sum = _mm_add_ps(sum, _mm_load_ps(m.row(3)));
+
+        alignas(16) float out[4];
+        _mm_store_ps(out, sum);
+        return vec3(out[0], out[1], out[2]);
+    }
+
+    inline vec3<float> VECTOR_API transformDirection(vec3<float> d, mat4x4 m)
+    {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(d.x), _mm_load_ps(m.row(0)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(d.y), _mm_load_ps(m.row(1))));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(d.z), _mm_load_ps(m.row(2))));
+
+        alignas(16) float out[4];
+        _mm_store_ps(out, sum);
+        return vec3(out[0], out[1], out[2]);
+    }
+}
+
+#if defined(VECTOR_SCALAR)
+namespace mat4Impl = mat4Scalar;
+#else
+namespace mat4Impl = mat4Simd;
+#endif
+
+inline mat4x4 VECTOR_API operator*(mat4x4 a, mat4x4 b)
+{
+    return mat4Impl::multiply(a, b);
 }
 
 inline mat4x4& VECTOR_API operator*=(mat4x4 &a, mat4x4 b)
@@ -199,12 +457,35 @@ inline mat4x4& VECTOR_API operator*=(mat4x4 &a, mat4x4 b)
     return a;
 }
 
+inline mat4x4 VECTOR_API transpose(mat4x4 m)
+{
+    return mat4Impl::transpose(m);
+}
+
+inline mat4x4 VECTOR_API inverse(mat4x4 m)
+{
+    return mat4Impl::inverse(m);
+}
+
+inline vec4<float> VECTOR_API operator*(vec4<float> vec, mat4x4 mat)
+{
+    return mat4Impl::transform(vec, mat);
+}
+
+inline vec3<float> VECTOR_API transformPoint(vec3<float> point, mat4x4 mat)
+{
+    return mat4Impl::transformPoint(point, mat);
+}
+
+inline vec3<float> VECTOR_API transformDirection(vec3<float> direction, mat4x4 mat)
+{
+    return mat4Impl::transformDirection(direction, mat);
+}
+
+// Transforms as a point
 inline vec3<float> VECTOR_API operator*(vec3<float> vec, mat4x4 mat)
 {
-    vec.x = vec.x * mat(0, 0) + vec.y * mat(0, 1) + vec.z * mat(0, 2) + mat(0, 3);
-    vec.y = vec.x * mat(1, 0) + vec.y * mat(1, 1) + vec.z * mat(1, 2) + mat(1, 3);
-    vec.z = vec.x * mat(2, 0) + vec.y * mat(2, 1) + vec.z * mat(2, 2) + mat(2, 3);
-    return vec;
+    return transformPoint(vec, mat);
 }
 
 inline vec3<float> VECTOR_API operator*(mat4x4 matrix, vec3<float> vec)
@@ -216,4 +497,19 @@ inline vec3<float>& VECTOR_API operator*=(vec3<float> &vec, mat4x4 matrix)
 {
     vec = vec * matrix;
     return vec;
-}
\ No newline at end of file
+}
+
+enum class simd_path
+{
+    scalar,
+    sse,
+    avx,
+    best    // AVX when the processor has it, SSE otherwise
+};
+
+// Whole arrays through one matrix, out may be the input. AVX deinterleaves eight points to
+// a register per axis, SSE and scalar go one point at a time
+void transformPoints(mat4x4 mat, const vec3<float> *points, size_t count, vec3<float> *out,
+                     simd_path path = simd_path::best);
+void transformDirections(mat4x4 mat, const vec3<float> *directions, size_t count, vec3<float> *out,
+                         simd_path path = simd_path::best);
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "vec.hpp"
+#include "utilities.hpp"
+#include <xmmintrin.h>
+
+// L2 spherical harmonics (9 coefficients) of RGB signals. Coefficients are vec4 so the
+// array copies straight into a std140 uniform block, w is unused.
+
+constexpr size_t SH9_COUNT = 9;
+
+struct SH9
+{
+    vec4<float> coeffs[SH9_COUNT];
+};
+
+// Real SH basis constants, bands 0 to 2
+constexpr float SH9_BASIS[SH9_COUNT] = {
+    0.282095f,
+    0.488603f, 0.488603f, 0.488603f,
+    1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f
+};
+
+// Cube face directions as origin + u * uAxis + v * vAxis with u, v in [-1, 1], faces in
+// Vulkan layer order +X, -X, +Y, -Y, +Z, -Z. Same mapping samplerCube lookups use
+constexpr float CUBE_FACE_AXES[6][3][3] = {
+    {{ 1.0f,  0.0f,  0.0f}, { 0.0f, 0.0f, -1.0f}, {0.0f, -1.0f,  0.0f}},
+    {{-1.0f,  0.0f,  0.0f}, { 0.0f, 0.0f,  1.0f}, {0.0f, -1.0f,  0.0f}},
+    {{ 0.0f,  1.0f,  0.0f}, { 1.0f, 0.0f,  0.0f}, {0.0f,  0.0f,  1.0f}},
+    {{ 0.0f, -1.0f,  0.0f}, { 1.0f, 0.0f,  0.0f}, {0.0f,  0.0f, -1.0f}},
+    {{ 0.0f,  0.0f,  1.0f}, { 1.0f, 0.0f,  0.0f}, {0.0f, -1.0f,  0.0f}},
+    {{ 0.0f,  0.0f, -1.0f}, {-1.0f, 0.0f,  0.0f}, {0.0f, -1.0f,  0.0f}}
+};
+
+inline vec3<float> CubeFaceDirection(uint32_t face, float u, float v)
+{
+    const auto &axes = CUBE_FACE_AXES[face];
+    return normalise(vec3(axes[0][0] + u * axes[1][0] + v * axes[2][0],
+                          axes[0][1] + u * axes[1][1] + v * axes[2][1],
+                          axes[0][2] + u * axes[1][2] + v * axes[2][2]));
+}
+
+inline float VECTOR_API HorizontalSum(__m128 value)
+{
+    __m128 shuffled = _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(value, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    sums = _mm_add_ss(sums, shuffled);
+    return _mm_cvtss_f32(sums);
+}
+
+// Projects radiance stored as tightly packed RGBA32F cube faces onto SH9. Four texels
+// are processed per step, faceSize has to be a multiple of 4
+inline SH9 ProjectCubemapSH9(const float *texels, uint32_t faceSize)
+{
+    double sums[SH9_COUNT][3] = {};
+    double weightSum = 0.0;
+
+    const float texelStep = 2.0f / float(faceSize);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+    const __m128 step = _mm_set1_ps(texelStep);
+    const __m128 laneCentres = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        const auto &axes = CUBE_FACE_AXES[face];
+        const __m128 uAxisX = _mm_set1_ps(axes[1][0]);
+        const __m128 uAxisY = _mm_set1_ps(axes[1][1]);
+        const __m128 uAxisZ = _mm_set1_ps(axes[1][2]);
+
+        for (uint32_t y = 0; y < faceSize; y++)
+        {
+            const float v = (float(y) + 0.5f) * texelStep - 1.0f;
+            const __m128 rowX = _mm_set1_ps(axes[0][0] + v * axes[2][0]);
+            const __m128 rowY = _mm_set1_ps(axes[0][1] + v * axes[2][1]);
+            const __m128 rowZ = _mm_set1_ps(axes[0][2] + v * axes[2][2]);
+
+            // NOTE(arle): Rows are summed in float and folded into doubles, a whole face
+            // in float loses too many bits on bright environments
+            __m128 acc[SH9_COUNT][3];
+            for (size_t k = 0; k < SH9_COUNT; k++)
+                acc[k][0] = acc[k][1] = acc[k][2] = _mm_setzero_ps();
+            __m128 accWeight = _mm_setzero_ps();
+
+            const float *row = texels + (size_t(face) * faceSize + y) * faceSize * 4;
+            for (uint32_t x = 0; x < faceSize; x += 4)
+            {
+                const __m128 u = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(x)), laneCentres), step), one);
+
+                __m128 dx = _mm_add_ps(rowX, _mm_mul_ps(u, uAxisX));
+                __m128 dy = _mm_add_ps(rowY, _mm_mul_ps(u, uAxisY));
+                __m128 dz = _mm_add_ps(rowZ, _mm_mul_ps(u, uAxisZ));
+
+                // Texel solid angle is proportional to 1 / |d|^3
+                const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+                const __m128 weight = _mm_mul_ps(_mm_mul_ps(invLength, invLength), invLength);
+
+                dx = _mm_mul_ps(dx, invLength);
+                dy = _mm_mul_ps(dy, invLength);
+                dz = _mm_mul_ps(dz, invLength);
+
+                __m128 r = _mm_loadu_ps(row + 4 * x);
+                __m128 g = _mm_loadu_ps(row + 4 * x + 4);
+                __m128 b = _mm_loadu_ps(row + 4 * x + 8);
+                __m128 a = _mm_loadu_ps(row + 4 * x + 12);
+                _MM_TRANSPOSE4_PS(r, g, b, a);
+
+                r = _mm_mul_ps(r, weight);
+                g = _mm_mul_ps(g, weight);
+                b = _mm_mul_ps(b, weight);
+
+                const __m128 basis[SH9_COUNT] = {
+                    one,
+                    dy,
+                    dz,
+                    dx,
+                    _mm_mul_ps(dx, dy),
+                    _mm_mul_ps(dy, dz),
+                    _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one),
+                    _mm_mul_ps(dx, dz),
+                    _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))
+                };
+
+                for (size_t k = 0; k < SH9_COUNT; k++)
+                {
+                    acc[k][0] = _mm_add_ps(acc[k][0], _mm_mul_ps(r, basis[k]));
+                    acc[k][1] = _mm_add_ps(acc[k][1], _mm_mul_ps(g, basis[k]));
+                    acc[k][2] = _mm_add_ps(acc[k][2], _mm_mul_ps(b, basis[k]));
+                }
+                accWeight = _mm_add_ps(accWeight, weight);
+            }
+
+            for (size_t k = 0; k < SH9_COUNT; k++)
+            {
+                sums[k][0] += HorizontalSum(acc[k][0]);
+                sums[k][1] += HorizontalSum(acc[k][1]);
+                sums[k][2] += HorizontalSum(acc[k][2]);
+            }
+            weightSum += HorizontalSum(accWeight);
+        }
+    }
+
+    // The weights only approximate the texel solid angles, normalising them to the
+    // full sphere keeps the DC term exact
+    const double scale = weightSum > 0.0 ? 4.0 * PI64 / weightSum : 0.0;
+
+    SH9 result;
+    for (size_t k = 0; k < SH9_COUNT; k++)
+    {
+        result.coeffs[k] = vec4(float(sums[k][0] * scale), float(sums[k][1] * scale),
+                                float(sums[k][2] * scale), 0.0f) * SH9_BASIS[k];
+    }
+    return result;
+}
+
+// Convolves radiance with the clamped cosine lobe (Ramamoorthi & Hanrahan) and folds in
+// the basis constants and 1 / PI. EvaluateSH9 on the result matches the irradiance
+// cubemap, which stores E / PI, and is what the IRRADIANCE_SH shader variant computes
+inline SH9 IrradianceSH9(const SH9 &radiance)
+{
+    constexpr float bandScale[SH9_COUNT] = {
+        1.0f,
+        2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+        0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+    };
+
+    SH9 result;
+    for (size_t k = 0; k < SH9_COUNT; k++)
+        result.coeffs[k] = radiance.coeffs[k] * (bandScale[k] * SH9_BASIS[k]);
+
+    return result;
+}
+
+inline vec3<float> EvaluateSH9(const SH9 &sh, vec3<float> n)
+{
+    const float basis[SH9_COUNT] = {
+        1.0f,
+        n.y, n.z, n.x,
+        n.x * n.y, n.y * n.z, 3.0f * n.z * n.z - 1.0f, n.x * n.z, n.x * n.x - n.y * n.y
+    };
+
+    auto result = vec4(0.0f);
+    for (size_t k = 0; k < SH9_COUNT; k++)
+        result += sh.coeffs[k] * basis[k];
+
+    return vec3(result.x, result.y, result.z);
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <bit>
 #include "array_types.hpp"
 
 constexpr float PI32 = 3.141592741f;
@@ -56,4 +57,51 @@ constexpr T accumulate(view<T> source, T initalValue = T(0))
         initalValue += source[i];
 
     return initalValue;
+}
+
+constexpr uint64_t FNV1A_OFFSET = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV1A_PRIME = 0x100000001b3ULL;
+
+// 64-bit FNV-1a, chain calls by passing the previous hash back in
+inline uint64_t Fnv1a(const void *data, size_t size, uint64_t hash = FNV1A_OFFSET)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * FNV1A_PRIME;
+
+    return hash;
+}
+
+// IEEE half to float, denormals are rescaled by the exponent bias difference (2^112)
+inline float HalfToFloat(uint16_t value)
+{
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t bits = uint32_t(value & 0x7FFF) << 13;
+
+    const float magnitude = (value & 0x7C00) == 0x7C00 ?
+                            std::bit_cast<float>(bits | 0x7F800000) :
+                            std::bit_cast<float>(bits) * 0x1p112f;
+
+    return std::bit_cast<float>(std::bit_cast<uint32_t>(magnitude) | sign);
+}
+
+// Float to IEEE half, rounded to nearest even. Out of range values become infinity
+inline uint16_t FloatToHalf(float value)
+{
+    const uint32_t bits = std::bit_cast<uint32_t>(value);
+    const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if(magnitude > 0x7F800000)
+        return sign | 0x7E00; // NaN
+    if(magnitude >= 0x477FF000)
+        return sign | 0x7C00; // Rounds past 65504
+
+    // Denormal results, adding 0.5 lines the half mantissa up with the float's low bits
+    if(magnitude < 0x38800000)
+        return sign | uint16_t(std::bit_cast<uint32_t>(std::bit_cast<float>(magnitude) + 0.5f) - 0x3F000000);
+
+    // Rebias the exponent from 127 to 15 and round on the 13 dropped mantissa bits
+    const uint32_t rounded = magnitude + 0xC8000FFF + ((magnitude >> 13) & 1);
+    return sign | uint16_t(rounded >> 13);
 }
\ No newline at end of file
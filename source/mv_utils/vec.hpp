@@ -27,7 +27,7 @@ struct vec2
 
     constexpr bool operator!=(vec2<T> other) const
     {
-        return (this->x != other.x && this->y != other.y);
+        return (this->x != other.x || this->y != other.y);
     }
 
     T x, y;
@@ -122,7 +122,7 @@ struct vec3
 
     constexpr bool operator!=(vec3<T> other) const
     {
-        return (this->x != other.x && this->y != other.y && this->z != other.z);
+        return (this->x != other.x || this->y != other.y || this->z != other.z);
     }
 
     T x, y, z;
@@ -223,8 +223,8 @@ struct vec4
 
     constexpr bool operator!=(vec4<T> other) const
     {
-        return (this->x != other.x && this->y != other.y &&
-                this->z != other.z && this->w != other.w);
+        return (this->x != other.x || this->y != other.y ||
+                this->z != other.z || this->w != other.w);
     }
 
     T x, y, z, w;
@@ -331,7 +331,7 @@ inline float VECTOR_API length(vec3<float> a)
 
 inline double VECTOR_API length(vec3<double> a)
 {
-    return std::sqrt(a.x * a.x + a.y * a.y) + a.z * a.z;
+    return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
 }
 
 inline float VECTOR_API length(vec4<float> a)
@@ -341,7 +341,7 @@ inline float VECTOR_API length(vec4<float> a)
 
 inline double VECTOR_API length(vec4<double> a)
 {
-    return std::sqrt(a.x * a.x + a.y * a.y) + a.z * a.z + a.w * a.w;
+    return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
 }
 
 inline vec2<float> VECTOR_API normalise(vec2<float> a)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 const auto SCREEN_SIZE_X = 2560;
 const auto SCREEN_SIZE_Y = 1440;
@@ -196,6 +197,7 @@ namespace pltf
 	// Timestep
 
 	timestep_type GetTimestep(logical_device device);
+	double GetTime(); // Seconds from a monotonic high resolution clock, for profiling
 
 	//  Debug
 
@@ -212,6 +214,8 @@ namespace pltf
 {
 	// Vulkan surface
 
+	// Instance extensions SurfaceCreate relies on, a count of 0 means the platform is headless
+	const char *const *SurfaceExtensions(uint32_t *pCount);
 	void SurfaceCreate(logical_device device, VkInstance instance, VkSurfaceKHR *pSurface);
 
 	// Events
@@ -237,16 +241,45 @@ namespace pltf
 	bool UnmapMemory(void *mapped);
 }
 
+namespace pltf
+{
+	// Threads
+
+	struct thread_T;
+	struct semaphore_T;
+	using thread = thread_T*;
+	using semaphore = semaphore_T*;
+	using thread_proc = void(*)(void*);
+
+	uint32_t ProcessorCount(); // Logical processors the process may run on
+
+	thread ThreadCreate(thread_proc proc, void *param);
+	void ThreadJoin(thread t); // Waits for proc to return and frees the thread
+
+	semaphore SemaphoreCreate(uint32_t initialCount);
+	void SemaphoreDestroy(semaphore s);
+	void SemaphoreWait(semaphore s);
+	void SemaphoreSignal(semaphore s, uint32_t count = 1);
+}
+
 namespace io
 {
     struct file;
 
+	// Read only view of a whole file, stays valid after the file is closed
 	struct file_map
 	{
-		void *data;
+		const void *data;
 		size_t size;
 	};
 
+	// How the mapping will be read, lets the kernel size its read ahead
+	enum class access
+	{
+		sequential,
+		random
+	};
+
 	enum class cmd
 	{
 		read,
@@ -264,6 +297,17 @@ namespace io
 	size_t GetSize(file *f);
 	bool IsValid(file *f);
 
-	file_map Map(file *f);
+	// Blocks until the written data is on disk, call before renaming a file into place
+	bool Sync(file *f);
+
+	// Replaces dst if it exists, readers see either the old or the new file
+	bool Rename(const char *src, const char *dst);
+
+	// Pages are read on first touch unless prefetched. The access hint is advisory, Win32
+	// has no equivalent for views and ignores it
+	file_map Map(file *f, access pattern = access::sequential, bool prefetch = false);
 	bool Unmap(file_map &map);
+
+	// Starts reading a range of the mapping in the background
+	void Prefetch(const file_map &map, size_t offset, size_t size);
 }
\ No newline at end of file
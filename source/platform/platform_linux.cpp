@@ -0,0 +1,417 @@
+#include "platform.hpp"
+
+#include <vulkan/vulkan.h>
+#include <time.h>
+#include <signal.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// NOTE(arle): There is no window system backend on Linux, the renderer runs headless
+// into offscreen targets. The "window" only tracks the running state and the timestep.
+
+namespace pltf
+{
+	struct logical_device_T
+	{
+		timespec				counter;
+		timestep_type			dt;
+		window_size_callback	windowSizeCallback;
+		key_event_callback		keyEventCallback;
+		mouse_move_callback		mouseMoveCallback;
+		mouse_button_callback	mouseButtonCallback;
+		scroll_wheel_callback	scrollWheelCallback;
+		void*					callbackHandle;
+	};
+
+	static volatile sig_atomic_t s_Running = false;
+	static bool s_WindowResized = false;
+	static bool s_WindowFullscreen = false;
+
+	constexpr size_t MAPPING_HEADER_SIZE = 4096;
+
+	void WindowSizeStub(logical_device, int32_t, int32_t){}
+	void KeyEventStub(logical_device, key_code, modifier){}
+	void MouseMoveStub(logical_device, int32_t, int32_t){}
+	void MouseButtonStub(logical_device, mouse_button, bool){}
+	void ScrollWheelStub(logical_device, double, double){}
+
+	logical_device DeviceCreate()
+	{
+		auto device = new logical_device_T;
+		device->counter = {};
+		device->dt = 0.0f;
+		device->windowSizeCallback = WindowSizeStub;
+		device->keyEventCallback = KeyEventStub;
+		device->mouseMoveCallback = MouseMoveStub;
+		device->mouseButtonCallback = MouseButtonStub;
+		device->scrollWheelCallback = ScrollWheelStub;
+		device->callbackHandle = nullptr;
+		return device;
+	}
+
+	void DeviceDestroy(logical_device device)
+	{
+		delete device;
+	}
+
+	void DeviceSetHandle(logical_device device, void *handle)
+	{
+		device->callbackHandle = handle;
+	}
+
+	void *DeviceGetHandle(logical_device device)
+	{
+		return device->callbackHandle;
+	}
+
+	static void TerminateSignal(int)
+	{
+		s_Running = false;
+	}
+
+	bool WindowCreate(logical_device device, const char* title)
+	{
+		// Batch runs are stopped from the outside, let SIGINT/SIGTERM end the frame loop cleanly
+		struct sigaction action{};
+		action.sa_handler = TerminateSignal;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGINT, &action, nullptr);
+		sigaction(SIGTERM, &action, nullptr);
+
+		clock_gettime(CLOCK_MONOTONIC, &device->counter);
+		s_Running = true;
+
+		return true;
+	}
+
+	void WindowSetFullscreen(logical_device device)
+	{
+	}
+
+	void WindowSetMinimised(logical_device device)
+	{
+	}
+
+	void WindowClose()
+	{
+		s_Running = false;
+	}
+
+	bool IsRunning()
+	{
+		return s_Running;
+	}
+
+	bool IsFullscreen()
+	{
+		return s_WindowFullscreen;
+	}
+
+	bool HasResized()
+	{
+		return s_WindowResized;
+	}
+
+	timestep_type GetTimestep(logical_device device)
+	{
+		return device->dt;
+	}
+
+	double GetTime()
+	{
+		timespec counter;
+		clock_gettime(CLOCK_MONOTONIC, &counter);
+		return double(counter.tv_sec) + double(counter.tv_nsec) * 1e-9;
+	}
+
+	void DebugBreak()
+	{
+		raise(SIGTRAP);
+	}
+
+	void DebugString(const char* string)
+	{
+		fputs(string, stderr);
+		fputc('\n', stderr);
+	}
+
+	const char *const *SurfaceExtensions(uint32_t *pCount)
+	{
+		*pCount = 0;
+		return nullptr;
+	}
+
+	void SurfaceCreate(logical_device device, VkInstance instance, VkSurfaceKHR *pSurface)
+	{
+		*pSurface = VK_NULL_HANDLE;
+	}
+
+	void EventsPoll(logical_device device)
+	{
+		s_WindowResized = false;
+
+		timespec counter;
+		clock_gettime(CLOCK_MONOTONIC, &counter);
+
+		device->dt = timestep_type(counter.tv_sec - device->counter.tv_sec);
+		device->dt += timestep_type(counter.tv_nsec - device->counter.tv_nsec) * timestep_type(1e-9);
+		device->counter = counter;
+	}
+
+	void EventsBindCallbacks(logical_device device, const EventCallbacks &callbacks)
+	{
+		device->windowSizeCallback = callbacks.windowSize ? callbacks.windowSize : device->windowSizeCallback;
+		device->keyEventCallback = callbacks.keyEvent ? callbacks.keyEvent : device->keyEventCallback;
+		device->mouseMoveCallback = callbacks.mouseMove ? callbacks.mouseMove : device->mouseMoveCallback;
+		device->mouseButtonCallback = callbacks.mouseButton ? callbacks.mouseButton : device->mouseButtonCallback;
+		device->scrollWheelCallback = callbacks.scrollWheel ? callbacks.scrollWheel : device->scrollWheelCallback;
+	}
+
+	bool IsKeyDown(key_code key)
+	{
+		return false;
+	}
+
+	void *MapMemory(size_t size)
+	{
+		// NOTE(arle): munmap needs the length, stash it in front of the returned pages
+		const size_t mappingSize = size + MAPPING_HEADER_SIZE;
+		auto mapped = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapped == MAP_FAILED)
+			return nullptr;
+
+		*static_cast<size_t*>(mapped) = mappingSize;
+		return static_cast<uint8_t*>(mapped) + MAPPING_HEADER_SIZE;
+	}
+
+	bool UnmapMemory(void *mapped)
+	{
+		if(mapped == nullptr)
+			return false;
+
+		auto base = static_cast<uint8_t*>(mapped) - MAPPING_HEADER_SIZE;
+		return munmap(base, *reinterpret_cast<size_t*>(base)) == 0;
+	}
+
+	struct thread_T
+	{
+		pthread_t	handle;
+		thread_proc	proc;
+		void*		param;
+	};
+
+	struct semaphore_T
+	{
+		sem_t		handle;
+	};
+
+	static void *ThreadEntry(void *param)
+	{
+		auto t = static_cast<thread_T*>(param);
+		t->proc(t->param);
+		return nullptr;
+	}
+
+	uint32_t ProcessorCount()
+	{
+		// Respects taskset and container cpu limits, unlike the online processor count
+		cpu_set_t cpuSet;
+		if(sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+			return uint32_t(CPU_COUNT(&cpuSet));
+
+		const auto count = sysconf(_SC_NPROCESSORS_ONLN);
+		return count > 0 ? uint32_t(count) : 1;
+	}
+
+	thread ThreadCreate(thread_proc proc, void *param)
+	{
+		auto t = new thread_T;
+		t->proc = proc;
+		t->param = param;
+		if(pthread_create(&t->handle, nullptr, ThreadEntry, t) != 0)
+		{
+			delete t;
+			return nullptr;
+		}
+		return t;
+	}
+
+	void ThreadJoin(thread t)
+	{
+		pthread_join(t->handle, nullptr);
+		delete t;
+	}
+
+	semaphore SemaphoreCreate(uint32_t initialCount)
+	{
+		auto s = new semaphore_T;
+		sem_init(&s->handle, 0, initialCount);
+		return s;
+	}
+
+	void SemaphoreDestroy(semaphore s)
+	{
+		sem_destroy(&s->handle);
+		delete s;
+	}
+
+	void SemaphoreWait(semaphore s)
+	{
+		// NOTE(arle): The termination handlers are installed without SA_RESTART
+		while(sem_wait(&s->handle) != 0 && errno == EINTR){}
+	}
+
+	void SemaphoreSignal(semaphore s, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			sem_post(&s->handle);
+	}
+}
+
+namespace io
+{
+	struct file
+	{
+		int data;
+	};
+
+	template<>
+	file *Open<cmd::read>(const char *filename)
+	{
+		auto f = new file;
+		f->data = open(filename, O_RDONLY);
+		return f;
+	}
+
+	template<>
+	file *Open<cmd::write>(const char *filename)
+	{
+		auto f = new file;
+		f->data = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		return f;
+	}
+
+	template<>
+	file *Open<cmd::rw_open>(const char *filename)
+	{
+		auto f = new file;
+		f->data = open(filename, O_RDWR);
+		return f;
+	}
+
+	template<>
+	file *Open<cmd::rw_create>(const char *filename)
+	{
+		auto f = new file;
+		f->data = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		return f;
+	}
+
+	bool Close(file *f)
+	{
+		const bool result = close(f->data) == 0;
+		delete f;
+		return result;
+	}
+
+	bool Read(file *f, size_t size, void *buffer)
+	{
+		auto dst = static_cast<uint8_t*>(buffer);
+		while(size > 0)
+		{
+			const auto bytesRead = read(f->data, dst, size);
+			if(bytesRead <= 0)
+				return false;
+
+			dst += bytesRead;
+			size -= size_t(bytesRead);
+		}
+		return true;
+	}
+
+	bool Write(file *f, size_t size, const void *source)
+	{
+		auto src = static_cast<const uint8_t*>(source);
+		while(size > 0)
+		{
+			const auto bytesWritten = write(f->data, src, size);
+			if(bytesWritten <= 0)
+				return false;
+
+			src += bytesWritten;
+			size -= size_t(bytesWritten);
+		}
+		return true;
+	}
+
+	size_t GetSize(file *f)
+	{
+		struct stat fileStat{};
+		fstat(f->data, &fileStat);
+		return size_t(fileStat.st_size);
+	}
+
+	bool IsValid(file *f)
+	{
+		return (f->data >= 0);
+	}
+
+	bool Sync(file *f)
+	{
+		return fsync(f->data) == 0;
+	}
+
+	bool Rename(const char *src, const char *dst)
+	{
+		return rename(src, dst) == 0;
+	}
+
+	file_map Map(file *f, access pattern, bool prefetch)
+	{
+		file_map map = {};
+		const auto size = GetSize(f);
+		if(size == 0)
+			return map;
+
+		// NOTE(arle): Reads past the end of a file truncated while mapped fault. The caches
+		// replace their files through Rename, which leaves existing mappings on the old inode
+		void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, f->data, 0);
+		if(data == MAP_FAILED)
+			return map;
+
+		madvise(data, size, pattern == access::random ? MADV_RANDOM : MADV_SEQUENTIAL);
+		if(prefetch)
+			madvise(data, size, MADV_WILLNEED);
+
+		map.data = data;
+		map.size = size;
+		return map;
+	}
+
+	void Prefetch(const file_map &map, size_t offset, size_t size)
+	{
+		if(map.data == nullptr || offset >= map.size)
+			return;
+
+		// madvise wants a page aligned start
+		const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+		const size_t begin = offset & ~(pageSize - 1);
+		const size_t end = size < map.size - offset ? offset + size : map.size;
+		madvise(const_cast<uint8_t*>(static_cast<const uint8_t*>(map.data)) + begin, end - begin, MADV_WILLNEED);
+	}
+
+	bool Unmap(file_map &map)
+	{
+		const auto result = map.data != nullptr && munmap(const_cast<void*>(map.data), map.size) == 0;
+		map.data = nullptr;
+		map.size = 0;
+		return result;
+	}
+}
@@ -6,6 +6,7 @@
 #include <Windows.h>
 #include <Windowsx.h>
 #include <vulkan/vulkan_win32.h>
+#include <intrin.h>
 
 namespace pltf
 {
@@ -165,6 +166,14 @@ namespace pltf
         return device->dt;
 	}
 
+	double GetTime()
+	{
+		LARGE_INTEGER counter, frequency;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&counter);
+		return double(counter.QuadPart) / double(frequency.QuadPart);
+	}
+
 	void DebugBreak()
 	{
 		::DebugBreak();
@@ -175,6 +184,16 @@ namespace pltf
 		OutputDebugStringA(string);
 	}
 
+	const char *const *SurfaceExtensions(uint32_t *pCount)
+	{
+		static const char *const extensions[] = {
+			VK_KHR_SURFACE_EXTENSION_NAME,
+			VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+		};
+		*pCount = uint32_t(sizeof(extensions) / sizeof(extensions[0]));
+		return extensions;
+	}
+
 	void SurfaceCreate(logical_device device, VkInstance instance, VkSurfaceKHR *pSurface)
 	{
 		VkWin32SurfaceCreateInfoKHR createInfo{};
@@ -392,6 +411,80 @@ namespace pltf
 	{
 		return bool(VirtualFree(mapped, 0, MEM_RELEASE));
 	}
+
+	struct thread_T
+	{
+		HANDLE		handle;
+		thread_proc	proc;
+		void*		param;
+	};
+
+	struct semaphore_T
+	{
+		HANDLE		handle;
+	};
+
+	static DWORD WINAPI ThreadEntry(LPVOID param)
+	{
+		auto t = static_cast<thread_T*>(param);
+		t->proc(t->param);
+		return 0;
+	}
+
+	uint32_t ProcessorCount()
+	{
+		DWORD_PTR processMask = 0, systemMask = 0;
+		if(GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask != 0)
+			return uint32_t(__popcnt64(processMask));
+
+		SYSTEM_INFO info{};
+		GetSystemInfo(&info);
+		return uint32_t(info.dwNumberOfProcessors);
+	}
+
+	thread ThreadCreate(thread_proc proc, void *param)
+	{
+		auto t = new thread_T;
+		t->proc = proc;
+		t->param = param;
+		t->handle = CreateThread(nullptr, 0, ThreadEntry, t, 0, nullptr);
+		if(t->handle == nullptr)
+		{
+			delete t;
+			return nullptr;
+		}
+		return t;
+	}
+
+	void ThreadJoin(thread t)
+	{
+		WaitForSingleObject(t->handle, INFINITE);
+		CloseHandle(t->handle);
+		delete t;
+	}
+
+	semaphore SemaphoreCreate(uint32_t initialCount)
+	{
+		auto s = new semaphore_T;
+		s->handle = CreateSemaphoreA(nullptr, LONG(initialCount), LONG_MAX, nullptr);
+		return s;
+	}
+
+	void SemaphoreDestroy(semaphore s)
+	{
+		CloseHandle(s->handle);
+		delete s;
+	}
+
+	void SemaphoreWait(semaphore s)
+	{
+		WaitForSingleObject(s->handle, INFINITE);
+	}
+
+	void SemaphoreSignal(semaphore s, uint32_t count)
+	{
+		ReleaseSemaphore(s->handle, LONG(count), nullptr);
+	}
 }
 
 namespace io
@@ -464,23 +557,55 @@ namespace io
 		return (f->data != INVALID_HANDLE_VALUE);
 	}
 
-	file_map Map(file *f)
+	bool Sync(file *f)
+	{
+		return FlushFileBuffers(f->data);
+	}
+
+	bool Rename(const char *src, const char *dst)
+	{
+		return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	}
+
+	file_map Map(file *f, access pattern, bool prefetch)
 	{
 		file_map map = {};
-		map.size = GetSize(f);
-		map.data = VirtualAlloc(nullptr, map.size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		const auto size = GetSize(f);
+		if(size == 0)
+			return map;
+
+		// The view keeps the mapping object alive, the handle can go right away
+		HANDLE mapping = CreateFileMappingA(f->data, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(mapping == nullptr)
+			return map;
 
-		if(map.data != nullptr)
-			Read(f, map.size, map.data);
-		else
-			map.size = 0;
+		map.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+
+		if(map.data == nullptr)
+			return map;
+
+		map.size = size;
+		if(prefetch)
+			Prefetch(map, 0, size);
 
 		return map;
 	}
 
+	void Prefetch(const file_map &map, size_t offset, size_t size)
+	{
+		if(map.data == nullptr || offset >= map.size)
+			return;
+
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = const_cast<uint8_t*>(static_cast<const uint8_t*>(map.data)) + offset;
+		range.NumberOfBytes = size < map.size - offset ? size : map.size - offset;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+
 	bool Unmap(file_map &map)
 	{
-		const auto result = VirtualFree(map.data, 0, MEM_RELEASE);
+		const auto result = map.data != nullptr && UnmapViewOfFile(map.data);
 		map.data = nullptr;
 		map.size = 0;
 		return result;
@@ -0,0 +1,427 @@
+#include "bc_encode.hpp"
+#include "../../source/mv_utils/utilities.hpp"
+#include <cmath>
+#include <string.h>
+
+constexpr uint32_t BLOCK_TEXELS = 16;
+constexpr uint32_t FIT_ITERATIONS = 3;
+
+// Interpolation weights of 4-bit BC7 indices, out of 64
+constexpr uint32_t BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+static void LoadTexels(const uint8_t *texels, float (*out)[4])
+{
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+            out[i][c] = float(texels[i * 4 + c]);
+    }
+}
+
+// Extremes of the texels along their principal axis, found by power iteration on the
+// covariance. Flat blocks get both endpoints on the mean
+template<uint32_t N>
+static void FitEndpoints(const float (*texels)[4], float *e0, float *e1)
+{
+    float mean[N] = {};
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+    {
+        for (uint32_t c = 0; c < N; c++)
+            mean[c] += texels[i][c] / float(BLOCK_TEXELS);
+    }
+
+    float covariance[N][N] = {};
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+    {
+        for (uint32_t a = 0; a < N; a++)
+        {
+            for (uint32_t b = 0; b < N; b++)
+                covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+        }
+    }
+
+    // Starting from the row of the widest channel keeps the iteration off a null vector
+    uint32_t widest = 0;
+    for (uint32_t c = 1; c < N; c++)
+    {
+        if(covariance[c][c] > covariance[widest][widest])
+            widest = c;
+    }
+
+    float axis[N];
+    for (uint32_t c = 0; c < N; c++)
+        axis[c] = covariance[widest][c];
+
+    for (uint32_t iteration = 0; iteration < 8; iteration++)
+    {
+        float next[N] = {};
+        float largest = 0.0f;
+        for (uint32_t a = 0; a < N; a++)
+        {
+            for (uint32_t b = 0; b < N; b++)
+                next[a] += covariance[a][b] * axis[b];
+            largest = max(largest, std::fabs(next[a]));
+        }
+        if(largest == 0.0f)
+            break;
+
+        for (uint32_t c = 0; c < N; c++)
+            axis[c] = next[c] / largest;
+    }
+
+    float length = 0.0f;
+    for (uint32_t c = 0; c < N; c++)
+        length += axis[c] * axis[c];
+    length = std::sqrt(length);
+
+    float low = 0.0f, high = 0.0f;
+    if(length > 0.0f)
+    {
+        for (uint32_t c = 0; c < N; c++)
+            axis[c] /= length;
+
+        low = 1e30f;
+        high = -1e30f;
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+        {
+            float t = 0.0f;
+            for (uint32_t c = 0; c < N; c++)
+                t += (texels[i][c] - mean[c]) * axis[c];
+            low = min(low, t);
+            high = max(high, t);
+        }
+    }
+
+    for (uint32_t c = 0; c < N; c++)
+    {
+        e0[c] = clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+        e1[c] = clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+    }
+}
+
+// Endpoints that minimise the squared error for fixed interpolation weights towards e1.
+// Fails when every texel has the same weight
+template<uint32_t N>
+static bool RefineEndpoints(const float (*texels)[4], const float *weights, float *e0, float *e1)
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[N] = {}, bx[N] = {};
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+    {
+        const float b = weights[i];
+        const float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (uint32_t c = 0; c < N; c++)
+        {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if(std::fabs(determinant) < 1e-6f)
+        return false;
+
+    for (uint32_t c = 0; c < N; c++)
+    {
+        e0[c] = clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+        e1[c] = clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+template<uint32_t N>
+static float NearestEntry(const float *texel, const float (*palette)[4], uint32_t count, uint32_t &index)
+{
+    float best = 1e30f;
+    for (uint32_t k = 0; k < count; k++)
+    {
+        float error = 0.0f;
+        for (uint32_t c = 0; c < N; c++)
+        {
+            const float d = texel[c] - palette[k][c];
+            error += d * d;
+        }
+        if(error < best)
+        {
+            best = error;
+            index = k;
+        }
+    }
+    return best;
+}
+
+static void WriteBits(uint8_t *block, uint32_t &position, uint32_t value, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++, position++)
+    {
+        if(value & (1u << i))
+            block[position >> 3] |= uint8_t(1u << (position & 7));
+    }
+}
+
+// BC1
+
+static uint16_t PackRGB565(const float *colour)
+{
+    const auto r = uint32_t(clamp(colour[0] * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f));
+    const auto g = uint32_t(clamp(colour[1] * (63.0f / 255.0f) + 0.5f, 0.0f, 63.0f));
+    const auto b = uint32_t(clamp(colour[2] * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f));
+    return uint16_t(r << 11 | g << 5 | b);
+}
+
+static void UnpackRGB565(uint16_t value, float *colour)
+{
+    const uint32_t r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+    colour[0] = float(r << 3 | r >> 2);
+    colour[1] = float(g << 2 | g >> 4);
+    colour[2] = float(b << 3 | b >> 2);
+}
+
+// Four colour mode, which BC1 only decodes when colour0 is the larger value
+static float BC1Indices(const float (*texels)[4], uint16_t colour0, uint16_t colour1, uint32_t *indices)
+{
+    float palette[4][4] = {};
+    UnpackRGB565(colour0, palette[0]);
+    UnpackRGB565(colour1, palette[1]);
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    float error = 0.0f;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+        error += NearestEntry<3>(texels[i], palette, 4, indices[i]);
+    return error;
+}
+
+static void EncodeBC1Colour(const float (*texels)[4], uint8_t *block)
+{
+    constexpr float weightOf[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+    float e0[3], e1[3];
+    FitEndpoints<3>(texels, e0, e1);
+
+    uint16_t best0 = 0, best1 = 0;
+    uint32_t bestIndices[BLOCK_TEXELS] = {};
+    float bestError = 1e30f;
+    for (uint32_t iteration = 0; iteration < FIT_ITERATIONS; iteration++)
+    {
+        uint16_t colour0 = PackRGB565(e1);
+        uint16_t colour1 = PackRGB565(e0);
+        if(colour0 < colour1)
+        {
+            const auto swap = colour0;
+            colour0 = colour1;
+            colour1 = swap;
+        }
+        // Equal colours would switch to the three colour mode
+        if(colour0 == colour1)
+        {
+            if(colour1 > 0)
+                colour1--;
+            else
+                colour0++;
+        }
+
+        uint32_t indices[BLOCK_TEXELS];
+        const float error = BC1Indices(texels, colour0, colour1, indices);
+        if(error < bestError)
+        {
+            bestError = error;
+            best0 = colour0;
+            best1 = colour1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        float weights[BLOCK_TEXELS];
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+            weights[i] = weightOf[indices[i]];
+        if(bestError == 0.0f || !RefineEndpoints<3>(texels, weights, e1, e0))
+            break;
+    }
+
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+        bits |= bestIndices[i] << (2 * i);
+
+    block[0] = uint8_t(best0);
+    block[1] = uint8_t(best0 >> 8);
+    block[2] = uint8_t(best1);
+    block[3] = uint8_t(best1 >> 8);
+    for (uint32_t i = 0; i < 4; i++)
+        block[4 + i] = uint8_t(bits >> (8 * i));
+}
+
+void EncodeBC1(const uint8_t *texels, uint8_t *block)
+{
+    float values[BLOCK_TEXELS][4];
+    LoadTexels(texels, values);
+    EncodeBC1Colour(values, block);
+}
+
+void EncodeBC3(const uint8_t *texels, uint8_t *block)
+{
+    float values[BLOCK_TEXELS][4];
+    LoadTexels(texels, values);
+    EncodeBC4(texels, 3, block);
+    EncodeBC1Colour(values, block + 8);
+}
+
+// BC4 and BC5
+
+void EncodeBC4(const uint8_t *texels, uint32_t channel, uint8_t *block)
+{
+    uint32_t low = 255, high = 0;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+    {
+        low = min(low, uint32_t(texels[i * 4 + channel]));
+        high = max(high, uint32_t(texels[i * 4 + channel]));
+    }
+
+    // Eight value mode, red0 above red1. Flat blocks only ever use index 0
+    uint32_t palette[8] = {high, low};
+    for (uint32_t k = 2; k < 8; k++)
+        palette[k] = ((8 - k) * high + (k - 1) * low) / 7;
+
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < BLOCK_TEXELS && high > low; i++)
+    {
+        const uint32_t value = texels[i * 4 + channel];
+        uint32_t index = 0, best = 256;
+        for (uint32_t k = 0; k < 8; k++)
+        {
+            const uint32_t error = value > palette[k] ? value - palette[k] : palette[k] - value;
+            if(error < best)
+            {
+                best = error;
+                index = k;
+            }
+        }
+        bits |= uint64_t(index) << (3 * i);
+    }
+
+    block[0] = uint8_t(high);
+    block[1] = uint8_t(low);
+    for (uint32_t i = 0; i < 6; i++)
+        block[2 + i] = uint8_t(bits >> (8 * i));
+}
+
+void EncodeBC5(const uint8_t *texels, uint8_t *block)
+{
+    EncodeBC4(texels, 0, block);
+    EncodeBC4(texels, 1, block + 8);
+}
+
+// BC7 mode 6
+
+struct bc7_endpoint
+{
+    uint32_t    values[4];  // 7 bits
+    uint32_t    pbit;
+};
+
+// 7 bits per channel and the shared low bit that together land closest to the endpoint
+static bc7_endpoint QuantizeBC7(const float *endpoint)
+{
+    bc7_endpoint best = {};
+    float bestError = 1e30f;
+    for (uint32_t pbit = 0; pbit < 2; pbit++)
+    {
+        bc7_endpoint candidate = {};
+        candidate.pbit = pbit;
+        float error = 0.0f;
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            candidate.values[c] = uint32_t(clamp(std::round((endpoint[c] - float(pbit)) * 0.5f), 0.0f, 127.0f));
+            const float d = float(candidate.values[c] << 1 | pbit) - endpoint[c];
+            error += d * d;
+        }
+        if(error < bestError)
+        {
+            bestError = error;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+static float BC7Indices(const float (*texels)[4], const bc7_endpoint &e0, const bc7_endpoint &e1, uint32_t *indices)
+{
+    float palette[16][4];
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        const uint32_t low = e0.values[c] << 1 | e0.pbit;
+        const uint32_t high = e1.values[c] << 1 | e1.pbit;
+        for (uint32_t k = 0; k < 16; k++)
+            palette[k][c] = float(((64 - BC7_WEIGHTS[k]) * low + BC7_WEIGHTS[k] * high + 32) >> 6);
+    }
+
+    float error = 0.0f;
+    for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+        error += NearestEntry<4>(texels[i], palette, 16, indices[i]);
+    return error;
+}
+
+void EncodeBC7(const uint8_t *texels, uint8_t *block)
+{
+    float values[BLOCK_TEXELS][4];
+    LoadTexels(texels, values);
+
+    float e0[4], e1[4];
+    FitEndpoints<4>(values, e0, e1);
+
+    bc7_endpoint best0 = {}, best1 = {};
+    uint32_t bestIndices[BLOCK_TEXELS] = {};
+    float bestError = 1e30f;
+    for (uint32_t iteration = 0; iteration < FIT_ITERATIONS; iteration++)
+    {
+        const auto q0 = QuantizeBC7(e0);
+        const auto q1 = QuantizeBC7(e1);
+
+        uint32_t indices[BLOCK_TEXELS];
+        const float error = BC7Indices(values, q0, q1, indices);
+        if(error < bestError)
+        {
+            bestError = error;
+            best0 = q0;
+            best1 = q1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        float weights[BLOCK_TEXELS];
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+            weights[i] = float(BC7_WEIGHTS[indices[i]]) / 64.0f;
+        if(bestError == 0.0f || !RefineEndpoints<4>(values, weights, e0, e1))
+            break;
+    }
+
+    // NOTE(arle): The first index is stored without its top bit, which has to be 0. The
+    // weights are symmetric, swapping the endpoints and mirroring the indices is lossless
+    if(bestIndices[0] >= 8)
+    {
+        const auto swap = best0;
+        best0 = best1;
+        best1 = swap;
+        for (uint32_t i = 0; i < BLOCK_TEXELS; i++)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    memset(block, 0, 16);
+    uint32_t position = 0;
+    WriteBits(block, position, 1u << 6, 7);
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        WriteBits(block, position, best0.values[c], 7);
+        WriteBits(block, position, best1.values[c], 7);
+    }
+    WriteBits(block, position, best0.pbit, 1);
+    WriteBits(block, position, best1.pbit, 1);
+
+    WriteBits(block, position, bestIndices[0], 3);
+    for (uint32_t i = 1; i < BLOCK_TEXELS; i++)
+        WriteBits(block, position, bestIndices[i], 4);
+}
\ No newline at end of file
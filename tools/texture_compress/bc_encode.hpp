@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+// Encoders for single 4x4 blocks of the BC formats. Texels are 16 RGBA8 values in rows
+// from the top left, blocks are written in the layout Vulkan expects for the format.
+//
+// Quality over speed within reason: endpoints come from the principal axis of the block
+// and are refined by least squares against the chosen indices. BC7 only uses mode 6, one
+// subset with RGBA endpoints, which suits smooth albedo and keeps the encoder small.
+
+// BC1 blocks are always opaque, the colour of BC3 comes from the same encoder
+void EncodeBC1(const uint8_t *texels, uint8_t *block);
+void EncodeBC3(const uint8_t *texels, uint8_t *block);
+
+// One channel of the texels, 0 to 3 for red to alpha
+void EncodeBC4(const uint8_t *texels, uint32_t channel, uint8_t *block);
+
+// Red and green, for tangent space normals
+void EncodeBC5(const uint8_t *texels, uint8_t *block);
+
+void EncodeBC7(const uint8_t *texels, uint8_t *block);
\ No newline at end of file
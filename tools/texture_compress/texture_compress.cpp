@@ -0,0 +1,518 @@
+// Offline compressor for material textures. Every input image is written next to itself as
+// a KTX2 file with a full mip chain in a BC format, which the viewer uploads as is instead
+// of decoding the PNG and blitting mips on every launch.
+//
+//     texture_compress [-bc1|-bc3|-bc4|-bc5|-bc7] image.png ...
+//     texture_compress -orm ao.png roughness.png metallic.png
+//
+// A format flag applies to the files after it. Without one the format follows the file
+// name: normal maps become BC5, roughness, metallic and ao maps BC4 and anything else BC7.
+// -orm packs the three greyscale maps into the red, green and blue channels of one BC7
+// orm.ktx2 next to the ao map, which the viewer samples once for all three.
+
+#include "bc_encode.hpp"
+#include "../../source/base.hpp"
+#include "../../source/backend/VulkanTools.hpp"
+#include "../../source/backend/thread_pool.hpp"
+#include "../../source/backend/ktx2.hpp"
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../vendor/stb/stb_image.h"
+
+constexpr uint32_t MAX_LEVELS = 16;  // MAX_MIP_LEVELS of the texture loader
+
+// How texels are filtered between levels
+enum class texture_kind
+{
+    colour,     // sRGB colour, averaged in linear space
+    normal,     // Tangent space vectors, renormalised
+    data        // Linear values
+};
+
+struct encode_format
+{
+    const char*     name;
+    VkFormat        format;
+    texture_kind    kind;
+    void          (*encode)(const uint8_t *texels, uint8_t *block);
+};
+
+static void EncodeBC4Red(const uint8_t *texels, uint8_t *block)
+{
+    EncodeBC4(texels, 0, block);
+}
+
+static const encode_format Formats[] = {
+    {"bc1", VK_FORMAT_BC1_RGB_SRGB_BLOCK, texture_kind::colour, EncodeBC1},
+    {"bc3", VK_FORMAT_BC3_SRGB_BLOCK, texture_kind::colour, EncodeBC3},
+    {"bc4", VK_FORMAT_BC4_UNORM_BLOCK, texture_kind::data, EncodeBC4Red},
+    {"bc5", VK_FORMAT_BC5_UNORM_BLOCK, texture_kind::normal, EncodeBC5},
+    {"bc7", VK_FORMAT_BC7_SRGB_BLOCK, texture_kind::colour, EncodeBC7},
+};
+
+static const encode_format OrmFormat = {"bc7", VK_FORMAT_BC7_UNORM_BLOCK, texture_kind::data, EncodeBC7};
+
+struct compress_stats
+{
+    uint32_t    textures;
+    uint64_t    uncompressedBytes;  // RGBA8 with blitted mips, what the viewer used before
+    uint64_t    compressedBytes;
+    double      decodeSeconds;
+    double      encodeSeconds;
+};
+
+static const char *FileName(const char *path)
+{
+    const char *name = path;
+    for (const char *c = path; *c; c++)
+    {
+        if(*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+    return name;
+}
+
+static const encode_format &FormatFromName(const char *path)
+{
+    // Material maps are named after what they hold, see assets/materials
+    constexpr const char *dataMaps[] = {"roughness", "metallic", "ao", "occlusion"};
+
+    const char *name = FileName(path);
+    if(strncmp(name, "normal", 6) == 0)
+        return Formats[3];
+    for (auto prefix : dataMaps)
+    {
+        if(strncmp(name, prefix, strlen(prefix)) == 0)
+            return Formats[2];
+    }
+    return Formats[4];
+}
+
+static float SrgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Texels to the space they are filtered in
+static void Expand(const uint8_t *texels, size_t count, texture_kind kind, float *out)
+{
+    for (size_t i = 0; i < count * 4; i++)
+        out[i] = float(texels[i]) / 255.0f;
+
+    for (size_t i = 0; i < count && kind != texture_kind::data; i++)
+    {
+        auto texel = out + i * 4;
+        if(kind == texture_kind::colour)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+                texel[c] = SrgbToLinear(texel[c]);
+        }
+        else
+        {
+            for (uint32_t c = 0; c < 3; c++)
+                texel[c] = texel[c] * 2.0f - 1.0f;
+        }
+    }
+}
+
+static void Compact(const float *texels, size_t count, texture_kind kind, uint8_t *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float texel[4] = {texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2], texels[i * 4 + 3]};
+        if(kind == texture_kind::colour)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+                texel[c] = LinearToSrgb(texel[c]);
+        }
+        else if(kind == texture_kind::normal)
+        {
+            const float length = std::sqrt(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+            for (uint32_t c = 0; c < 3; c++)
+                texel[c] = (length > 0.0f ? texel[c] / length : 0.0f) * 0.5f + 0.5f;
+        }
+
+        for (uint32_t c = 0; c < 4; c++)
+            out[i * 4 + c] = uint8_t(clamp(texel[c] * 255.0f + 0.5f, 0.0f, 255.0f));
+    }
+}
+
+// 2x2 box filter, odd edges repeat their last row or column
+static void Downsample(const float *source, uint32_t width, uint32_t height, float *target)
+{
+    const uint32_t targetWidth = max(width >> 1, 1u);
+    const uint32_t targetHeight = max(height >> 1, 1u);
+    for (uint32_t y = 0; y < targetHeight; y++)
+    {
+        const uint32_t y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < targetWidth; x++)
+        {
+            const uint32_t x0 = min(x * 2, width - 1), x1 = min(x * 2 + 1, width - 1);
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                target[(y * targetWidth + x) * 4 + c] = 0.25f * (source[(y0 * width + x0) * 4 + c] +
+                                                                 source[(y0 * width + x1) * 4 + c] +
+                                                                 source[(y1 * width + x0) * 4 + c] +
+                                                                 source[(y1 * width + x1) * 4 + c]);
+            }
+        }
+    }
+}
+
+struct encode_job
+{
+    const encode_format*    format;
+    const uint8_t*          texels;
+    uint32_t                width;
+    uint32_t                height;
+    uint32_t                blocksX;
+    uint32_t                blockSize;
+    uint8_t*                blocks;
+};
+
+// One row of blocks, texels past the edge repeat the last row or column
+static void EncodeRow(void *data, uint32_t row)
+{
+    auto job = static_cast<const encode_job*>(data);
+    uint8_t texels[64];
+    for (uint32_t bx = 0; bx < job->blocksX; bx++)
+    {
+        for (uint32_t y = 0; y < 4; y++)
+        {
+            const uint32_t sy = min(row * 4 + y, job->height - 1);
+            for (uint32_t x = 0; x < 4; x++)
+            {
+                const uint32_t sx = min(bx * 4 + x, job->width - 1);
+                memcpy(texels + (y * 4 + x) * 4, job->texels + (size_t(sy) * job->width + sx) * 4, 4);
+            }
+        }
+        job->format->encode(texels, job->blocks + (size_t(row) * job->blocksX + bx) * job->blockSize);
+    }
+}
+
+// Basic data format descriptor of the block format,
+// https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html
+static uint32_t BuildDFD(VkFormat format, uint32_t *dfd)
+{
+    constexpr uint32_t BT709_PRIMARIES = 1;
+    constexpr uint32_t LINEAR_TRANSFER = 1, SRGB_TRANSFER = 2;
+    constexpr uint32_t SAMPLE_LINEAR = 0x10;
+
+    uint32_t model = 0, channels[2] = {}, sampleCount = 1;
+    bool srgb = false;
+    switch (format)
+    {
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK: srgb = true; [[fallthrough]];
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK: model = 128; break;
+        case VK_FORMAT_BC3_SRGB_BLOCK: srgb = true; [[fallthrough]];
+        case VK_FORMAT_BC3_UNORM_BLOCK: model = 130; sampleCount = 2; channels[0] = 15; break;
+        case VK_FORMAT_BC4_UNORM_BLOCK: model = 131; break;
+        case VK_FORMAT_BC5_UNORM_BLOCK: model = 132; sampleCount = 2; channels[1] = 1; break;
+        case VK_FORMAT_BC7_SRGB_BLOCK: srgb = true; [[fallthrough]];
+        case VK_FORMAT_BC7_UNORM_BLOCK: model = 134; break;
+        default: break;
+    }
+
+    // Samples split the block evenly, BC3 holds alpha then colour and BC5 red then green
+    const uint32_t blockSize = vkTools::FormatBlockSize(format);
+    const uint32_t sampleBits = blockSize * 8 / sampleCount;
+    const uint32_t blockWords = 6 + 4 * sampleCount;
+
+    dfd[0] = (1 + blockWords) * 4;
+    dfd[1] = 0;
+    dfd[2] = 2 | (blockWords * 4) << 16;
+    dfd[3] = model | BT709_PRIMARIES << 8 | (srgb ? SRGB_TRANSFER : LINEAR_TRANSFER) << 16;
+    dfd[4] = 3 | 3 << 8;
+    dfd[5] = blockSize;
+    dfd[6] = 0;
+    for (uint32_t i = 0; i < sampleCount; i++)
+    {
+        const uint32_t qualifiers = srgb && channels[i] == 15 ? SAMPLE_LINEAR : 0;
+        auto sample = dfd + 7 + i * 4;
+        sample[0] = (i * sampleBits) | (sampleBits - 1) << 16 | (channels[i] | qualifiers) << 24;
+        sample[1] = 0;
+        sample[2] = 0;
+        sample[3] = UINT32_MAX;
+    }
+    return dfd[0];
+}
+
+static bool WriteKTX2(const char *filename, VkFormat format, VkExtent2D extent, uint32_t levelCount,
+                      uint8_t *const *levels)
+{
+    ktx2_header header = {};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat = uint32_t(format);
+    header.typeSize = 1;
+    header.pixelWidth = extent.width;
+    header.pixelHeight = extent.height;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+
+    uint32_t dfd[16];
+    header.dfdByteOffset = uint32_t(sizeof(header) + levelCount * sizeof(ktx2_level));
+    header.dfdByteLength = BuildDFD(format, dfd);
+
+    // NOTE(arle): Levels are stored from the smallest up. Their sizes are whole blocks,
+    // only the first one needs padding to the block alignment
+    const uint64_t blockSize = vkTools::FormatBlockSize(format);
+    const uint64_t dataStart = (header.dfdByteOffset + header.dfdByteLength + blockSize - 1) / blockSize * blockSize;
+
+    ktx2_level index[MAX_LEVELS] = {};
+    uint64_t offset = dataStart;
+    for (uint32_t level = levelCount; level-- > 0;)
+    {
+        index[level].byteOffset = offset;
+        index[level].byteLength = vkTools::ImageLevelSize(format, extent, level);
+        index[level].uncompressedByteLength = index[level].byteLength;
+        offset += index[level].byteLength;
+    }
+
+    char tempFilename[512];
+    snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", filename);
+
+    const uint8_t padding[16] = {};
+    auto file = io::Open<io::cmd::write>(tempFilename);
+    bool written = io::IsValid(file) &&
+                   io::Write(file, sizeof(header), &header) &&
+                   io::Write(file, levelCount * sizeof(ktx2_level), index) &&
+                   io::Write(file, header.dfdByteLength, dfd) &&
+                   io::Write(file, size_t(dataStart - header.dfdByteOffset - header.dfdByteLength), padding);
+    for (uint32_t level = levelCount; written && level-- > 0;)
+        written = io::Write(file, size_t(index[level].byteLength), levels[level]);
+    io::Close(file);
+
+    return written && io::Rename(tempFilename, filename);
+}
+
+// Encodes RGBA8 pixels with a full mip chain into the KTX2 file output
+static bool Compress(const uint8_t *pixels, VkExtent2D extent, const char *output, const encode_format &format,
+                     double decodeSeconds, ThreadPool &pool, compress_stats &stats)
+{
+    const uint32_t levelCount = uint32_t(std::bit_width(max(extent.width, extent.height)));
+    if(levelCount > MAX_LEVELS)
+    {
+        fprintf(stderr, "%s: %ux%u is too large\n", output, extent.width, extent.height);
+        return false;
+    }
+
+    const double encodeBegin = pltf::GetTime();
+
+    // Level 0 is encoded from the file itself, the others from filtered copies
+    const size_t texelCount = size_t(extent.width) * extent.height;
+    auto filtered = new float[texelCount * 4];
+    auto next = new float[texelCount * 4];
+    auto texels = new uint8_t[texelCount * 4];
+    Expand(pixels, texelCount, format.kind, filtered);
+
+    uint8_t *levels[MAX_LEVELS] = {};
+    uint64_t compressedBytes = 0, uncompressedBytes = 0;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        const uint32_t width = max(extent.width >> level, 1u);
+        const uint32_t height = max(extent.height >> level, 1u);
+        if(level > 0)
+        {
+            Downsample(filtered, max(extent.width >> (level - 1), 1u), max(extent.height >> (level - 1), 1u), next);
+            auto swap = filtered;
+            filtered = next;
+            next = swap;
+            Compact(filtered, size_t(width) * height, format.kind, texels);
+        }
+
+        const auto size = vkTools::ImageLevelSize(format.format, extent, level);
+        levels[level] = new uint8_t[size];
+
+        encode_job job = {};
+        job.format = &format;
+        job.texels = level == 0 ? pixels : texels;
+        job.width = width;
+        job.height = height;
+        job.blocksX = (width + 3) / 4;
+        job.blockSize = vkTools::FormatBlockSize(format.format);
+        job.blocks = levels[level];
+        pool.parallelFor((height + 3) / 4, EncodeRow, &job);
+
+        compressedBytes += size;
+        uncompressedBytes += vkTools::ImageLevelSize(VK_FORMAT_R8G8B8A8_UNORM, extent, level);
+    }
+    const double encodeSeconds = pltf::GetTime() - encodeBegin;
+
+    const bool written = WriteKTX2(output, format.format, extent, levelCount, levels);
+    if(written)
+    {
+        printf("%s: %ux%u, %u levels of %s, %.2f MB as RGBA8 -> %.2f MB (%.1fx), decode %.1f ms, encode %.1f ms\n",
+               output, extent.width, extent.height, levelCount, format.name,
+               double(uncompressedBytes) / (1024.0 * 1024.0), double(compressedBytes) / (1024.0 * 1024.0),
+               double(uncompressedBytes) / double(compressedBytes), decodeSeconds * 1000.0, encodeSeconds * 1000.0);
+
+        stats.textures++;
+        stats.uncompressedBytes += uncompressedBytes;
+        stats.compressedBytes += compressedBytes;
+        stats.decodeSeconds += decodeSeconds;
+        stats.encodeSeconds += encodeSeconds;
+    }
+    else
+    {
+        fprintf(stderr, "%s: could not be written\n", output);
+    }
+
+    for (auto level : levels)
+        delete[] level;
+    delete[] texels;
+    delete[] next;
+    delete[] filtered;
+    return written;
+}
+
+static bool CompressFile(const char *path, const encode_format &format, ThreadPool &pool, compress_stats &stats)
+{
+    const double decodeBegin = pltf::GetTime();
+    int x = 0, y = 0, channels = 0;
+    auto pixels = stbi_load(path, &x, &y, &channels, 4);
+    const double decodeSeconds = pltf::GetTime() - decodeBegin;
+    if(pixels == nullptr)
+    {
+        fprintf(stderr, "%s: %s\n", path, stbi_failure_reason());
+        return false;
+    }
+
+    char output[512];
+    snprintf(output, sizeof(output), "%s", path);
+    auto extension = strrchr(output, '.');
+    if(extension == nullptr || extension < FileName(output))
+        extension = output + strlen(output);
+    snprintf(extension, sizeof(output) - size_t(extension - output), ".ktx2");
+
+    const bool written = Compress(pixels, {uint32_t(x), uint32_t(y)}, output, format, decodeSeconds, pool, stats);
+    stbi_image_free(pixels);
+    return written;
+}
+
+// Occlusion, roughness and metallic into red, green and blue, alpha is opaque
+static bool CompressORM(const char *const *paths, ThreadPool &pool, compress_stats &stats)
+{
+    const double decodeBegin = pltf::GetTime();
+    stbi_uc *channels[3] = {};
+    int width = 0, height = 0;
+    bool loaded = true;
+    for (uint32_t c = 0; c < 3 && loaded; c++)
+    {
+        int x = 0, y = 0, components = 0;
+        channels[c] = stbi_load(paths[c], &x, &y, &components, 1);
+        if(channels[c] == nullptr)
+        {
+            fprintf(stderr, "%s: %s\n", paths[c], stbi_failure_reason());
+            loaded = false;
+        }
+        else if(c > 0 && (x != width || y != height))
+        {
+            fprintf(stderr, "%s: %dx%d does not match %s, %dx%d\n", paths[c], x, y, paths[0], width, height);
+            loaded = false;
+        }
+        width = x;
+        height = y;
+    }
+
+    bool written = false;
+    if(loaded)
+    {
+        const size_t texelCount = size_t(width) * height;
+        auto pixels = new uint8_t[texelCount * 4];
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            pixels[i * 4] = channels[0][i];
+            pixels[i * 4 + 1] = channels[1][i];
+            pixels[i * 4 + 2] = channels[2][i];
+            pixels[i * 4 + 3] = 255;
+        }
+        const double decodeSeconds = pltf::GetTime() - decodeBegin;
+
+        char output[512];
+        const auto directory = int(FileName(paths[0]) - paths[0]);
+        snprintf(output, sizeof(output), "%.*sorm.ktx2", directory, paths[0]);
+
+        written = Compress(pixels, {uint32_t(width), uint32_t(height)}, output, OrmFormat, decodeSeconds, pool, stats);
+        delete[] pixels;
+    }
+
+    for (auto channel : channels)
+    {
+        if(channel)
+            stbi_image_free(channel);
+    }
+    return written;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: texture_compress [-bc1|-bc3|-bc4|-bc5|-bc7] image.png ...\n"
+                        "       texture_compress -orm ao.png roughness.png metallic.png\n");
+        return 1;
+    }
+
+    ThreadPool pool;
+    pool.init();
+
+    const encode_format *forced = nullptr;
+    compress_stats stats = {};
+    uint32_t failures = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-orm") == 0)
+        {
+            if(i + 3 >= argc)
+            {
+                fprintf(stderr, "-orm needs the ao, roughness and metallic maps\n");
+                failures++;
+                break;
+            }
+            if(!CompressORM(argv + i + 1, pool, stats))
+                failures++;
+            i += 3;
+            continue;
+        }
+
+        if(argv[i][0] == '-')
+        {
+            forced = nullptr;
+            for (const auto &format : Formats)
+            {
+                if(strcmp(argv[i] + 1, format.name) == 0)
+                    forced = &format;
+            }
+            if(forced == nullptr)
+            {
+                fprintf(stderr, "unknown format %s\n", argv[i]);
+                failures++;
+                break;
+            }
+            continue;
+        }
+
+        if(!CompressFile(argv[i], forced ? *forced : FormatFromName(argv[i]), pool, stats))
+            failures++;
+    }
+
+    pool.destroy();
+
+    // The decode time is what every launch of the viewer spent before on these images
+    if(stats.textures > 1)
+    {
+        printf("%u textures: %.2f MB -> %.2f MB of video memory, %.1f ms of decoding saved per load, "
+               "encoded in %.1f ms\n", stats.textures, double(stats.uncompressedBytes) / (1024.0 * 1024.0),
+               double(stats.compressedBytes) / (1024.0 * 1024.0), stats.decodeSeconds * 1000.0,
+               stats.encodeSeconds * 1000.0);
+    }
+    return failures > 0 ? 1 : 0;
+}
\ No newline at end of file